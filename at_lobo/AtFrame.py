@@ -0,0 +1,470 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Host side codec for the ESP8266 AT binary framed mode (AT+TCPFRAME=1)
+# and the throughput benchmark of the framed and text protocol over simulated UART
+# and of the handshake and credit mode (AT+TCPCREDIT) delivery of the received data
+# and of the receive coalescing (AT+TCPCOAL) on a traffic trace of small segments
+
+import sys
+import os
+import time
+import random
+import argparse
+
+FRAME_END     = 0xC0
+FRAME_ESC     = 0xDB
+FRAME_ESC_END = 0xDC
+FRAME_ESC_ESC = 0xDD
+
+FRAME_TYPE_AT    = 0x00
+FRAME_TYPE_DATA  = 0x01
+FRAME_TYPE_ACK   = 0x02
+FRAME_TYPE_NAK   = 0x03
+FRAME_TYPE_ABORT = 0x04
+FRAME_TYPE_EVENT = 0x05
+FRAME_TYPE_CTRL  = 0x06
+FRAME_TYPE_DGRAM = 0x07
+
+FRAME_CTRL_EXIT = 0x00
+
+FRAME_LINK_SERVER = 0x10
+FRAME_LINK_SYSTEM = 0xFF
+
+FRAME_MAX_PAYLOAD = 1478
+FRAME_DGRAM_ADDR_SIZE = 6
+
+#-----------------------------
+def crc16(data, crc=0xFFFF):
+    # CRC-16/CCITT-FALSE
+    for b in data:
+        crc ^= b << 8
+        for i in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+#----------------------------------
+def encode(link, ftype, payload=b''):
+    if len(payload) > FRAME_MAX_PAYLOAD:
+        raise ValueError("payload too long")
+    frame = bytes([link, ftype, len(payload) & 0xFF, len(payload) >> 8]) + bytes(payload)
+    crc = crc16(frame)
+    frame += bytes([crc & 0xFF, crc >> 8])
+    out = bytearray([FRAME_END])
+    for b in frame:
+        if b == FRAME_END:
+            out += bytes([FRAME_ESC, FRAME_ESC_END])
+        elif b == FRAME_ESC:
+            out += bytes([FRAME_ESC, FRAME_ESC_ESC])
+        else:
+            out.append(b)
+    out.append(FRAME_END)
+    return bytes(out)
+
+#--------------------------------------------
+def encode_dgram(link, ip, port, data=b''):
+    # UDP datagram frame: remote IP and port (LE) followed by the data
+    addr = bytes(int(n) for n in ip.split('.')) + bytes([port & 0xFF, port >> 8])
+    return encode(link, FRAME_TYPE_DGRAM, addr + bytes(data))
+
+#-------------------------
+def decode_dgram(payload):
+    # returns (ip, port, data) of the datagram frame payload
+    ip = '.'.join(str(b) for b in payload[:4])
+    port = payload[4] | (payload[5] << 8)
+    return (ip, port, bytes(payload[FRAME_DGRAM_ADDR_SIZE:]))
+
+#============
+class Decoder:
+
+    #-------------------
+    def __init__(self):
+        self.buf = bytearray()
+        self.esc = False
+        self.overrun = False
+        self.frames = 0
+        self.errors = 0
+
+    #---------------------
+    def _process(self):
+        buf = self.buf
+        if len(buf) < 6:
+            self.errors += 1
+            return None
+        length = buf[2] | (buf[3] << 8)
+        if length + 6 != len(buf):
+            self.errors += 1
+            return None
+        crc = crc16(buf[:-2])
+        if buf[-2] != (crc & 0xFF) or buf[-1] != (crc >> 8):
+            self.errors += 1
+            return None
+        self.frames += 1
+        return (buf[0], buf[1], bytes(buf[4:-2]))
+
+    #----------------------
+    def feed(self, data):
+        # returns the list of decoded frames: (link, type, payload)
+        frames = []
+        for b in data:
+            if b == FRAME_END:
+                if self.overrun:
+                    self.errors += 1
+                elif len(self.buf) > 0:
+                    frame = self._process()
+                    if frame is not None:
+                        frames.append(frame)
+                self.buf = bytearray()
+                self.esc = False
+                self.overrun = False
+                continue
+            if self.esc:
+                self.esc = False
+                if b == FRAME_ESC_END:
+                    b = FRAME_END
+                elif b == FRAME_ESC_ESC:
+                    b = FRAME_ESC
+                else:
+                    self.overrun = True
+            elif b == FRAME_ESC:
+                self.esc = True
+                continue
+            if len(self.buf) < FRAME_MAX_PAYLOAD + 6:
+                self.buf.append(b)
+            else:
+                self.overrun = True
+        return frames
+
+#============
+class SimUart:
+    # Simulated UART line, 8N1: 10 bit times per byte
+
+    #------------------------------------------------
+    def __init__(self, baudrate, turnaround=0.001):
+        self.baudrate = baudrate
+        self.turnaround = turnaround
+        self.time = 0.0
+        self.bytes = 0
+
+    #---------------------------
+    def transfer(self, data):
+        self.time += len(data) * 10.0 / self.baudrate
+        self.bytes += len(data)
+        return data
+
+    #---------------------
+    def wait_host(self):
+        # the host must see the data before it can respond
+        self.time += self.turnaround
+
+#-----------------------------------------
+def bench_text(uart, payload, link=0):
+    # '+TCP,link,srv,len:' alert, host 'r', data, host 'y'
+    uart.transfer("\r\n+TCP,{},9,{}:".format(link, len(payload)).encode())
+    uart.wait_host()
+    uart.transfer(b'r')
+    uart.transfer(payload)
+    uart.wait_host()
+    uart.transfer(b'y')
+
+#------------------------------------------------------
+def bench_framed(uart, decoder, payload, link=0):
+    # data frame, host acknowledge frame
+    frames = decoder.feed(uart.transfer(encode(link, FRAME_TYPE_DATA, payload)))
+    if len(frames) != 1 or frames[0][2] != payload:
+        raise Exception("frame decode error")
+    uart.wait_host()
+    uart.transfer(encode(link, FRAME_TYPE_ACK))
+
+#=============
+class CreditSim:
+    # Credit mode delivery over simulated full duplex UART
+    # ESP8266 streams the segments while they fit into the window,
+    # the host acknowledges every 'ack_every' bytes after it has received them
+
+    #-------------------------------------------------------------------------
+    def __init__(self, baudrate, turnaround, window, ack_every, framed=False):
+        self.baudrate = baudrate
+        self.turnaround = turnaround
+        self.window = window
+        self.ack_every = ack_every
+        self.framed = framed
+        self.esp_time = 0.0     # ESP8266 -> host line busy until
+        self.host_time = 0.0    # host -> ESP8266 line busy until
+        self.unacked = 0
+        self.received = 0       # received by the host, not yet acknowledged
+        self.acks = []          # (arrival time, count)
+        self.bytes = 0
+
+    #------------------------
+    def _tx(self, nbytes):
+        self.esp_time += nbytes * 10.0 / self.baudrate
+        self.bytes += nbytes
+
+    #-----------------------
+    def _ack_arrived(self):
+        t, count = self.acks.pop(0)
+        self.esp_time = max(self.esp_time, t)
+        self.unacked -= count
+        if not self.framed:
+            # AT+TCPACK response
+            self._tx(len(b"\r\nOK\r\n"))
+
+    #---------------------
+    def _host_ack(self):
+        if self.framed:
+            cmd = encode(0, FRAME_TYPE_ACK, self.received.to_bytes(4, 'little'))
+        else:
+            cmd = "AT+TCPACK=0,{}\r\n".format(self.received).encode()
+        start = max(self.esp_time + self.turnaround, self.host_time)
+        self.host_time = start + len(cmd) * 10.0 / self.baudrate
+        self.acks.append((self.host_time, self.received))
+        self.received = 0
+
+    #---------------------------
+    def deliver(self, payload):
+        while self.acks and self.acks[0][0] <= self.esp_time:
+            self._ack_arrived()
+        while self.unacked > 0 and self.unacked + len(payload) > self.window:
+            # no credit, wait for the host
+            self._ack_arrived()
+        if self.framed:
+            self._tx(len(encode(0, FRAME_TYPE_DATA, payload)))
+        else:
+            self._tx(len("\r\n+TCP,0,9,{}:".format(len(payload)).encode()) + len(payload))
+        self.unacked += len(payload)
+        self.received += len(payload)
+        if self.received >= self.ack_every:
+            self._host_ack()
+
+    #-----------------
+    def finish(self):
+        # all data acknowledged
+        if self.received:
+            self._host_ack()
+        while self.acks:
+            self._ack_arrived()
+        return self.esp_time
+
+#==============
+class CoalSim:
+    # Handshake (r/y) delivery of a traffic trace over simulated UART
+    # with the firmware's receive coalescing: a segment arriving within 'window'
+    # after the previous one waits up to 'window' for more data, the following
+    # segments are merged into it while it is not delivered and has room for them
+
+    #-----------------------------------------------------------------
+    def __init__(self, baudrate, turnaround, coal_bytes, window):
+        self.uart = SimUart(baudrate, turnaround)
+        self.coal_bytes = coal_bytes
+        self.window = window
+        self.queue = []         # [len, size, wait until, [arrival times]]
+        self.last = None
+        self.segments = 0
+        self.merged = 0
+        self.alerts = 0
+        self.latency = []
+
+    #-----------------------------------------------
+    def _receive(self, t, length, delivering):
+        tail = self.queue[-1] if self.queue else None
+        if self.coal_bytes and tail and tail is not delivering and tail[0] + length <= tail[1]:
+            tail[0] += length
+            tail[3].append(t)
+            self.merged += 1
+        else:
+            burst = self.last is not None and (t - self.last) < self.window
+            size = self.coal_bytes if length < self.coal_bytes else length
+            self.queue.append([length, size, t + self.window if burst else t, [t]])
+        self.last = t
+        self.segments += 1
+
+    #----------------------
+    def run(self, trace):
+        n = 0
+        while n < len(trace) or self.queue:
+            if not self.queue:
+                self.uart.time = max(self.uart.time, trace[n][0])
+            while n < len(trace) and trace[n][0] <= self.uart.time:
+                self._receive(trace[n][0], trace[n][1], None)
+                n += 1
+            if not self.queue:
+                continue
+            seg = self.queue[0]
+            if self.coal_bytes and len(self.queue) == 1 and seg[0] < self.coal_bytes and self.uart.time < seg[2]:
+                # waiting for more data of the burst
+                self.uart.time = min(seg[2], trace[n][0]) if n < len(trace) else seg[2]
+                continue
+            self.alerts += 1
+            bench_text(self.uart, bytes(seg[0]), 0)
+            for t in seg[3]:
+                self.latency.append(self.uart.time - t)
+            # segments received during the delivery are merged into the next one
+            while n < len(trace) and trace[n][0] <= self.uart.time:
+                self._receive(trace[n][0], trace[n][1], seg)
+                n += 1
+            self.queue.pop(0)
+        return self
+
+#----------------------------------------
+def make_trace(count, seed=1):
+    # chatty peer: bursts of 10~60 byte segments 0.1~1 ms apart, 20~200 ms pauses
+    rnd = random.Random(seed)
+    trace = []
+    t = 0.0
+    while len(trace) < count:
+        for i in range(rnd.randint(3, 20)):
+            trace.append((t, rnd.randint(10, 60)))
+            t += rnd.uniform(0.0001, 0.001)
+        t += rnd.uniform(0.02, 0.2)
+    return trace[:count]
+
+#-------------------------
+def load_trace(fname):
+    # one segment per line: '<arrival time in us>,<length>'
+    trace = []
+    with open(fname) as f:
+        for line in f:
+            line = line.strip()
+            if line and not line.startswith('#'):
+                t, length = line.split(',')[:2]
+                trace.append((int(t) / 1e6, int(length)))
+    return sorted(trace)
+
+#----------------------------------------------------------------------------
+def run_coal_bench(baudrates, trace, turnaround, coal_bytes, windows):
+    total = sum(s[1] for s in trace)
+    print("trace: {} segments, {} bytes, {:.1f} s".format(len(trace), total, trace[-1][0] - trace[0][0]))
+    print("{:>8} {:>8} {:>8} {:>8} {:>10} {:>10} {:>10}".format(
+          "baud", "window", "alerts", "merged", "ovh bytes", "avg lat ms", "max lat ms"))
+    for baudrate in baudrates:
+        for window in [0] + windows:
+            sim = CoalSim(baudrate, turnaround, coal_bytes if window else 0, window / 1e6).run(trace)
+            print("{:>8} {:>8} {:>8} {:>8} {:>10} {:>10.2f} {:>10.2f}".format(
+                  baudrate, window if window else "off", sim.alerts, sim.merged, sim.uart.bytes - total,
+                  1000 * sum(sim.latency) / len(sim.latency), 1000 * max(sim.latency)))
+
+#---------------------------------------------------------------------
+def run_credit_bench(baudrates, sizes, count, turnaround, window):
+    print("{:>8} {:>6} {:>10} {:>10} {:>8} {:>12}".format(
+          "baud", "size", "r/y B/s", "credit B/s", "gain", "fr.cred B/s"))
+    for baudrate in baudrates:
+        for size in sizes:
+            payloads = [os.urandom(size) for i in range(count)]
+
+            text = SimUart(baudrate, turnaround)
+            for p in payloads:
+                bench_text(text, p, 0)
+
+            credit = CreditSim(baudrate, turnaround, window, window // 2)
+            framed = CreditSim(baudrate, turnaround, window, window // 2, True)
+            for p in payloads:
+                credit.deliver(p)
+                framed.deliver(p)
+
+            text_bps = size * count / text.time
+            credit_bps = size * count / credit.finish()
+            framed_bps = size * count / framed.finish()
+            print("{:>8} {:>6} {:>10.0f} {:>10.0f} {:>7.2f}x {:>12.0f}".format(
+                  baudrate, size, text_bps, credit_bps, credit_bps / text_bps, framed_bps))
+
+#--------------------------------------------------------------
+def run_bench(baudrates, sizes, count, turnaround):
+    print("{:>8} {:>6} {:>10} {:>10} {:>8} {:>10} {:>10}".format(
+          "baud", "size", "text B/s", "framed B/s", "gain", "ovh bytes", "codec us"))
+    for baudrate in baudrates:
+        for size in sizes:
+            payloads = [os.urandom(size) for i in range(count)]
+
+            text = SimUart(baudrate, turnaround)
+            for p in payloads:
+                bench_text(text, p, 0)
+
+            framed = SimUart(baudrate, turnaround)
+            decoder = Decoder()
+            t0 = time.perf_counter()
+            for n, p in enumerate(payloads):
+                bench_framed(framed, decoder, p, n % 5)
+            codec_us = (time.perf_counter() - t0) * 1e6 / count
+
+            text_bps = size * count / text.time
+            framed_bps = size * count / framed.time
+            overhead = (framed.bytes / count) - size
+            print("{:>8} {:>6} {:>10.0f} {:>10.0f} {:>7.2f}x {:>10.1f} {:>10.1f}".format(
+                  baudrate, size, text_bps, framed_bps, framed_bps / text_bps, overhead, codec_us))
+
+#------------------------
+def self_test(count):
+    # random frames, decoded from randomly split stream with some corrupted frames
+    decoder = Decoder()
+    sent = []
+    stream = bytearray()
+    for n in range(count):
+        payload = os.urandom(n % (FRAME_MAX_PAYLOAD + 1))
+        frame = bytearray(encode(n % 5, FRAME_TYPE_DATA, payload))
+        if n % 10 == 9:
+            frame[len(frame) // 2] ^= 0x01
+        else:
+            sent.append(payload)
+        stream += frame
+    received = []
+    pos = 0
+    while pos < len(stream):
+        step = 1 + (stream[pos] % 97)
+        received += [f[2] for f in decoder.feed(stream[pos:pos+step])]
+        pos += step
+    ok = (received == sent)
+    # UDP datagram frame
+    link, ftype, payload = Decoder().feed(encode_dgram(3, '192.168.4.2', 5683, b'reading'))[0]
+    ok = ok and (ftype == FRAME_TYPE_DGRAM) and (decode_dgram(payload) == ('192.168.4.2', 5683, b'reading'))
+    print("self test: {} frames, {} decoded, {} errors: {}".format(
+          count, decoder.frames, decoder.errors, "OK" if ok else "FAILED"))
+    return ok
+
+#=========================
+if __name__ == '__main__':
+    cli = argparse.ArgumentParser(
+    description="ESP8266 AT framed mode codec and benchmark.",
+    formatter_class=argparse.RawTextHelpFormatter
+    )
+
+    cli.add_argument("--baudrates", default="115200,921600,2000000", type=str, action="store",
+        help="Comma separated list of baudrates (default: 115200,921600,2000000).")
+    cli.add_argument("--sizes", default="16,64,256,1460", type=str, action="store",
+        help="Comma separated list of payload sizes (default: 16,64,256,1460).")
+    cli.add_argument("--count", default=200, type=int, action="store",
+        help="Number of segments per test (default: 200).")
+    cli.add_argument("--turnaround", default=1.0, type=float, action="store",
+        help="Host response time in ms (default: 1.0).")
+    cli.add_argument("--test", action="store_true",
+        help="Run the codec self test only")
+    cli.add_argument("--credit", action="store_true",
+        help="Benchmark the handshake (r/y) and credit mode delivery of the received data")
+    cli.add_argument("--window", default=4096, type=int, action="store",
+        help="Credit mode receive window in bytes, acknowledged every half window (default: 4096).")
+    cli.add_argument("--coalesce", action="store_true",
+        help="Benchmark the receive coalescing (AT+TCPCOAL) on a trace of small segments")
+    cli.add_argument("--coalbytes", default=512, type=int, action="store",
+        help="Coalesced segment size in bytes (default: 512).")
+    cli.add_argument("--coalwindows", default="500,2000,5000", type=str, action="store",
+        help="Comma separated list of coalescing windows in us (default: 500,2000,5000).")
+    cli.add_argument("--trace", default="", type=str, action="store",
+        help="Traffic trace file, '<arrival time in us>,<length>' per line (default: generated chatty trace).")
+
+    args = cli.parse_args()
+
+    if not self_test(args.count):
+        sys.exit(1)
+    if args.coalesce:
+        trace = load_trace(args.trace) if args.trace else make_trace(args.count * 10)
+        run_coal_bench([int(b) for b in args.baudrates.split(',')], trace, args.turnaround / 1000.0,
+                       args.coalbytes, [int(w) for w in args.coalwindows.split(',')])
+    elif args.credit:
+        run_credit_bench([int(b) for b in args.baudrates.split(',')], [int(s) for s in args.sizes.split(',')],
+                         args.count, args.turnaround / 1000.0, args.window)
+    elif not args.test:
+        run_bench([int(b) for b in args.baudrates.split(',')], [int(s) for s in args.sizes.split(',')],
+                  args.count, args.turnaround / 1000.0)
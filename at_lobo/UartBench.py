@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Find the highest reliable UART baudrate of the ESP8266 AT firmware
+# Each baudrate is set with AT+UARTFAST and tested with AT+UARTBENCH
+
+import sys
+import time
+import argparse
+try:
+    import serial
+except ImportError:
+    print("\033[1;31mPySerial must be installed, run \033[1;34m`pip3 install pyserial`\033[0m\r\n")
+    sys.exit(1)
+
+#--------------------------
+def bench_pattern(length):
+    # byte n of the benchmark data is (n + (n >> 8)) & 0xFF
+    return bytes([(n + (n >> 8)) & 0xFF for n in range(length)])
+
+#=============
+class UartBench:
+
+    #-----------------------------------------------------------
+    def __init__(self, device, baudrate, timeout, length):
+        self.timeout = timeout
+        self.length = length
+        self.uart = serial.Serial(port=device, baudrate=baudrate, timeout=0.1, rtscts=0)
+
+    #-------------------------------------------
+    def read_until(self, ends, timeout=2.0):
+        # read the response until one of the 'ends' strings is received
+        data = b''
+        tmo = time.time() + timeout
+        while time.time() < tmo:
+            data += self.uart.read(self.uart.in_waiting or 1)
+            for end in ends:
+                if end in data:
+                    return data
+        return data
+
+    #-----------------------------------------
+    def command(self, cmd, timeout=2.0):
+        self.uart.reset_input_buffer()
+        self.uart.write((cmd + "\r\n").encode())
+        return self.read_until([b"\r\nOK\r\n", b"ERROR\r\n"], timeout)
+
+    #-----------------------------
+    def set_baudrate(self, baud):
+        # AT+UARTFAST is answered at the new baudrate
+        old_baud = self.uart.baudrate
+        self.uart.reset_input_buffer()
+        self.uart.write("AT+UARTFAST={},{}\r\n".format(baud, int(self.timeout * 1000)).encode())
+        self.uart.flush()
+        # wait for the command echo at the old baudrate
+        time.sleep(0.05)
+        self.uart.baudrate = baud
+        self.uart.reset_input_buffer()
+        confirm = "+UARTFAST:{}".format(baud).encode()
+        resp = self.read_until([confirm], self.timeout / 2)
+        if confirm in resp:
+            self.uart.write(confirm + b"\r\n")
+            resp = self.read_until([b"\r\nOK\r\n", b"ERROR\r\n"], self.timeout)
+            if b"\r\nOK\r\n" in resp:
+                return True
+        # the firmware returns to the old baudrate after the timeout
+        self.uart.baudrate = old_baud
+        self.read_until([b"ERROR\r\n"], self.timeout + 0.5)
+        return False
+
+    #---------------------
+    def bench(self):
+        # returns (rx_bytes, errors, rx_Bps, tx_Bps, echo_errors) or None
+        data = bench_pattern(self.length)
+        self.uart.reset_input_buffer()
+        self.uart.write("AT+UARTBENCH={}\r\n".format(self.length).encode())
+        if b">" not in self.read_until([b">", b"ERROR\r\n"]):
+            return None
+        self.uart.write(data)
+        echo = b''
+        tmo = time.time() + 2.0 + self.length * 20.0 / self.uart.baudrate
+        while (len(echo) < self.length) and (time.time() < tmo):
+            echo += self.uart.read(self.uart.in_waiting or 1)
+        resp = echo[self.length:] + self.read_until([b"\r\nOK\r\n", b"ERROR\r\n"])
+        echo = echo[:self.length]
+        echo_errors = sum(1 for a, b in zip(echo, data) if a != b) + self.length - len(echo)
+        for line in resp.split(b"\r\n"):
+            if line.startswith(b"+UARTBENCH:"):
+                res = [int(v) for v in line[11:].split(b',')]
+                return (res[1], res[2], res[3], res[4], echo_errors)
+        return None
+
+#=========================
+if __name__ == '__main__':
+    cli = argparse.ArgumentParser(
+    description="ESP8266 AT UART baudrate benchmark.",
+    formatter_class=argparse.RawTextHelpFormatter
+    )
+
+    cli.add_argument("--device", default="/dev/ttyUSB0", type=str, action="store",
+        help="Serial device (default: /dev/ttyUSB0).")
+    cli.add_argument("--baudrate", default=115200, type=int, action="store",
+        help="Current baudrate of the device (default: 115200).")
+    cli.add_argument("--baudrates", default="921600,1500000,2000000,3000000,4000000,4608000", type=str, action="store",
+        help="Comma separated list of baudrates to test\n(default: 921600,1500000,2000000,3000000,4000000,4608000).")
+    cli.add_argument("--length", default=65536, type=int, action="store",
+        help="Number of bytes sent in each benchmark (default: 65536).")
+    cli.add_argument("--timeout", default=1000, type=int, action="store",
+        help="AT+UARTFAST confirmation timeout in ms (default: 1000).")
+
+    args = cli.parse_args()
+
+    ub = UartBench(args.device, args.baudrate, args.timeout / 1000.0, args.length)
+    if b"OK" not in ub.command("AT"):
+        print("No response at {} baud".format(args.baudrate))
+        sys.exit(1)
+
+    best = args.baudrate
+    print("{:>8} {:>10} {:>8} {:>10} {:>10} {:>8}".format("baud", "rx bytes", "errors", "rx B/s", "tx B/s", "echo err"))
+    for baud in [int(b) for b in args.baudrates.split(',')]:
+        if not ub.set_baudrate(baud):
+            print("{:>8} not confirmed".format(baud))
+            continue
+        res = ub.bench()
+        if res is None:
+            print("{:>8} benchmark failed".format(baud))
+            continue
+        print("{:>8} {:>10} {:>8} {:>10} {:>10} {:>8}".format(baud, *res))
+        if (res[0] == args.length) and (res[1] == 0) and (res[4] == 0):
+            best = baud
+
+    # leave the device at the highest reliable baudrate
+    if best != ub.uart.baudrate:
+        ub.set_baudrate(best)
+    print("Highest reliable baudrate: {}".format(best))
@@ -237,6 +237,21 @@ build_8266_firmware() {
 printf "${AT_VERSION}\r\n" > ../bin/upgrade/version.txt
 
 
+#------------------------------------
+# lib/liblwip.a is built from third_party/lwip (lwipopts.h, memp_profile.h)
+echo ""
+echo "Building liblwip.a"
+cd ../third_party
+./make_lib.sh lwip > /dev/null 2>&1
+if [ $? -ne 0 ]; then
+    echo "========== Error =========="
+    ./make_lib.sh lwip
+    echo "========== Error =========="
+    exit 1
+fi
+cd ../at_lobo
+echo "  liblwip.a OK"
+
 #------------------------------------
 if [ "${BUILD_8285}" == "yes" ]; then
     build_8285_firmware
@@ -0,0 +1,419 @@
+/*
+ * HSPI slave transport for ESP8266 AT firmware
+ * Copyright LoBo 2019
+*/
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "mem.h"
+#include "driver/spi_register.h"
+#include "driver/hspi_slv.h"
+
+#ifndef SPI
+#define SPI                     0
+#endif
+#ifndef HSPI
+#define HSPI                    1
+#endif
+
+// SPI, HSPI and I2S share one interrupt, the source is reported in this register
+#define SPI_INTR_STATUS_REG     0x3ff00020
+#define SPI_INTR_STATUS_SPI     BIT4
+#define SPI_INTR_STATUS_HSPI    BIT7
+
+#define HSPI_SLAVE_INT_EN       (SPI_SLV_WR_BUF_DONE_EN | SPI_SLV_RD_BUF_DONE_EN | SPI_SLV_RD_STA_DONE_EN)
+#define HSPI_SLAVE_INT_ALL      (SPI_TRANS_DONE | SPI_SLV_WR_STA_DONE | SPI_SLV_RD_STA_DONE | SPI_SLV_WR_BUF_DONE | SPI_SLV_RD_BUF_DONE)
+
+typedef struct {
+    uint8   *buf;
+    uint16  size;
+    uint16  head;
+    uint16  count;
+} hspi_ring_t;
+
+// Data which did not fit into the 'to host' ring
+typedef struct _hspi_to_host_seg_t {
+    struct _hspi_to_host_seg_t *next;
+    uint32  len;
+    uint32  offset;     // bytes already put into the ring
+    uint8   data[0];
+} hspi_to_host_seg_t;
+
+hspi_stats_t hspi_stats = { 0 };
+
+static hspi_ring_t to_host = { 0 };
+static hspi_ring_t from_host = { 0 };
+static hspi_recv_data_callback_t hspi_recv_data_callback_ptr = NULL;
+static hspi_link_status_cb_t hspi_link_status_cb = NULL;
+static uint16 link_status = 0;      // last reported per-link status
+static uint8 rd_len = 0;            // payload length of the loaded read packet
+static bool rd_empty = TRUE;        // an empty packet is loaded
+static uint8 rd_seq = 0;            // sequence number of the loaded read packet
+static uint8 wr_seq = 0;            // sequence number of the last packet written by the host
+static hspi_to_host_seg_t *to_host_head = NULL;    // queued data, sent after the data in the ring
+static hspi_to_host_seg_t *to_host_tail = NULL;
+static uint32 to_host_queued = 0;
+static os_timer_t to_host_timer;
+
+// Functions without ICACHE_FLASH_ATTR are called from the SPI interrupt
+
+// Copy up to 'len' bytes into the ring, returns the number of bytes copied
+//---------------------------------------------------------------------
+static uint32 hspi_ring_put(hspi_ring_t *r, const uint8 *data, uint32 len)
+{
+    uint32 n, done = 0;
+    uint16 idx;
+
+    if (len > (uint32)(r->size - r->count)) len = r->size - r->count;
+    while (len > 0) {
+        idx = (r->head + r->count) & (r->size - 1);
+        n = r->size - idx;
+        if (n > len) n = len;
+        os_memcpy(r->buf + idx, data, n);
+        r->count += n;
+        data += n;
+        len -= n;
+        done += n;
+    }
+    return done;
+}
+
+// Contiguous data at the head of the ring
+//--------------------------------------------------------
+static uint8 *hspi_ring_peek(hspi_ring_t *r, uint32 *len)
+{
+    uint32 n = r->size - r->head;
+
+    *len = (r->count < n) ? r->count : n;
+    return r->buf + r->head;
+}
+
+//----------------------------------------------------
+static void hspi_ring_consume(hspi_ring_t *r, uint32 len)
+{
+    r->head = (r->head + len) & (r->size - 1);
+    r->count -= len;
+}
+
+// Update the status word read by the host
+//-----------------------------
+static void hspi_set_status(void)
+{
+    uint32 status, free;
+
+    free = (from_host.size - from_host.count) / HSPI_PAYLOAD_SIZE;
+    if (free > 255) free = 255;
+
+    status = ((uint32)(wr_seq & 7) << HSPI_STA_WR_SEQ_S) | ((uint32)(rd_seq & 7) << HSPI_STA_RD_SEQ_S) | (free << HSPI_STA_TX_FREE_S);
+    status |= ((uint32)(link_status & 0xFF) << HSPI_STA_LINK_RX_S) | ((uint32)(link_status >> 8) << HSPI_STA_LINK_TX_S);
+    if (rd_len) status |= HSPI_STA_RX_READY;
+    if (free) status |= HSPI_STA_TX_READY;
+    WRITE_PERI_REG(SPI_RD_STATUS(HSPI), status);
+}
+
+// Load the next read packet into W8~W15
+// An empty packet is loaded if no data are waiting, so the host never reads the same data twice
+// Called with the SPI interrupt disabled or from the interrupt
+//----------------------------------
+static void hspi_to_host_load(void)
+{
+    uint32 words[HSPI_PACKET_SIZE / 4];
+    uint8 *pkt = (uint8 *)words;
+    uint8 *data;
+    uint32 len, n, i;
+
+    rd_len = 0;
+    while ((rd_len < HSPI_PAYLOAD_SIZE) && (to_host.count)) {
+        data = hspi_ring_peek(&to_host, &len);
+        n = HSPI_PAYLOAD_SIZE - rd_len;
+        if (n > len) n = len;
+        os_memcpy(pkt + 1 + rd_len, data, n);
+        hspi_ring_consume(&to_host, n);
+        rd_len += n;
+    }
+    // the empty packet is already loaded
+    if ((rd_len == 0) && (rd_empty)) return;
+
+    rd_empty = (rd_len == 0);
+    rd_seq = (rd_seq + 1) & 7;
+    pkt[0] = rd_len | (rd_seq << HSPI_HDR_SEQ_S);
+    for (i=0; i<(HSPI_PACKET_SIZE / 4); i++) {
+        WRITE_PERI_REG(SPI_W8(HSPI) + (i << 2), words[i]);
+    }
+}
+
+// Pass the data written by the host to the receive callback
+// The data which do not fit into the AT receive buffer stay in the ring,
+// processing continues from hspi_rx_buffer_fetch_cb
+// Called with the SPI interrupt disabled or from the interrupt
+//---------------------------------------
+static void hspi_from_host_process(void)
+{
+    uint32 len, n;
+    uint8 *data;
+
+    while (from_host.count) {
+        data = hspi_ring_peek(&from_host, &len);
+        n = len;
+        if (hspi_recv_data_callback_ptr) {
+            n = hspi_recv_data_callback_ptr(data, len);
+            if (n > len) n = len;
+        }
+        hspi_ring_consume(&from_host, n);
+        if (n < len) break;
+    }
+}
+
+// Copy the packet written by the host from W0~W7 into the 'from host' ring
+//-----------------------------------
+static void hspi_from_host_packet(void)
+{
+    uint32 words[HSPI_PACKET_SIZE / 4];
+    uint8 *pkt = (uint8 *)words;
+    uint32 i, len, n;
+    uint8 seq;
+
+    for (i=0; i<(HSPI_PACKET_SIZE / 4); i++) {
+        words[i] = READ_PERI_REG(SPI_W0(HSPI) + (i << 2));
+    }
+    len = pkt[0] & HSPI_HDR_LEN_MASK;
+    seq = pkt[0] >> HSPI_HDR_SEQ_S;
+    if (len == 0) return;
+
+    hspi_stats.from_host_writes++;
+    hspi_stats.from_host_lost += (seq - wr_seq - 1) & 7;
+    wr_seq = seq;
+
+    n = hspi_ring_put(&from_host, pkt + 1, len);
+    hspi_stats.from_host_bytes += n;
+    hspi_stats.from_host_full += len - n;
+    hspi_from_host_process();
+}
+
+//--------------------------------------
+static void hspi_slave_isr(void *para)
+{
+    uint32 regvalue;
+
+    if (READ_PERI_REG(SPI_INTR_STATUS_REG) & SPI_INTR_STATUS_SPI) {
+        // flash SPI, not used
+        CLEAR_PERI_REG_MASK(SPI_SLAVE(SPI), 0x3ff);
+    }
+    if ((READ_PERI_REG(SPI_INTR_STATUS_REG) & SPI_INTR_STATUS_HSPI) == 0) return;
+
+    regvalue = READ_PERI_REG(SPI_SLAVE(HSPI));
+    //clear all intrs
+    CLEAR_PERI_REG_MASK(SPI_SLAVE(HSPI), HSPI_SLAVE_INT_EN);
+    SET_PERI_REG_MASK(SPI_SLAVE(HSPI), SPI_SYNC_RESET);
+    CLEAR_PERI_REG_MASK(SPI_SLAVE(HSPI), HSPI_SLAVE_INT_ALL);
+    SET_PERI_REG_MASK(SPI_SLAVE(HSPI), HSPI_SLAVE_INT_EN);
+
+    //FROM HOST, the host has written a packet
+    if (regvalue & SPI_SLV_WR_BUF_DONE) {
+        hspi_from_host_packet();
+    }
+
+    //TO HOST, the host has read the loaded packet
+    if (regvalue & SPI_SLV_RD_BUF_DONE) {
+        if (rd_len) hspi_stats.to_host_reads++;
+        hspi_to_host_load();
+    }
+
+    if (regvalue & SPI_SLV_RD_STA_DONE) {
+        hspi_stats.status_reads++;
+    }
+
+    hspi_set_status();
+    // slave is ready for the next transaction
+    SET_PERI_REG_MASK(SPI_CMD(HSPI), SPI_USR);
+}
+
+//-------------------------------------
+void ICACHE_FLASH_ATTR hspi_slave_init(void)
+{
+    uint8 i;
+
+    ETS_SPI_INTR_DISABLE();
+
+    // buffers are accessed from the interrupt, must be in dRAM
+    to_host.buf = (uint8 *)os_malloc_dram(HSPI_TO_HOST_BUF_SIZE + HSPI_FROM_HOST_BUF_SIZE);
+    if (to_host.buf == NULL) {
+        os_printf("HSPI: no memory\r\n");
+        return;
+    }
+    to_host.size = HSPI_TO_HOST_BUF_SIZE;
+    from_host.buf = to_host.buf + HSPI_TO_HOST_BUF_SIZE;
+    from_host.size = HSPI_FROM_HOST_BUF_SIZE;
+    os_memset(&hspi_stats, 0, sizeof(hspi_stats_t));
+
+    PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTDI_U, 2);  // GPIO12, MISO
+    PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTCK_U, 2);  // GPIO13, MOSI
+    PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTMS_U, 2);  // GPIO14, SCLK
+    PIN_FUNC_SELECT(PERIPHS_IO_MUX_MTDO_U, 2);  // GPIO15, CS
+
+    // slave mode, mode 0, MSB first, host writes to W0~W7 and reads from W8~W15
+    WRITE_PERI_REG(SPI_SLAVE(HSPI), SPI_SLAVE_MODE | SPI_SLV_WR_RD_BUF_EN | HSPI_SLAVE_INT_EN);
+    CLEAR_PERI_REG_MASK(SPI_PIN(HSPI), SPI_IDLE_EDGE);
+    CLEAR_PERI_REG_MASK(SPI_USER(HSPI), SPI_CK_OUT_EDGE | SPI_FLASH_MODE);
+    CLEAR_PERI_REG_MASK(SPI_CTRL(HSPI), SPI_WR_BIT_ORDER | SPI_RD_BIT_ORDER | SPI_QIO_MODE | SPI_DIO_MODE | SPI_DOUT_MODE | SPI_QOUT_MODE);
+    SET_PERI_REG_MASK(SPI_USER(HSPI), SPI_USR_MISO_HIGHPART | SPI_USR_MOSI);
+    SET_PERI_REG_MASK(SPI_CTRL2(HSPI), (0x2 & SPI_MOSI_DELAY_NUM) << SPI_MOSI_DELAY_NUM_S);
+    WRITE_PERI_REG(SPI_CLOCK(HSPI), 0);
+
+    // 8-bit command, 8-bit address, 32-byte buffers, 32-bit status
+    WRITE_PERI_REG(SPI_USER2(HSPI), (0x7 & SPI_USR_COMMAND_BITLEN) << SPI_USR_COMMAND_BITLEN_S);
+    WRITE_PERI_REG(SPI_SLAVE1(HSPI), (((HSPI_PACKET_SIZE * 8 - 1) & SPI_SLV_BUF_BITLEN) << SPI_SLV_BUF_BITLEN_S) |
+                                     ((31 & SPI_SLV_STATUS_BITLEN) << SPI_SLV_STATUS_BITLEN_S) |
+                                     ((0x7 & SPI_SLV_WR_ADDR_BITLEN) << SPI_SLV_WR_ADDR_BITLEN_S) |
+                                     ((0x7 & SPI_SLV_RD_ADDR_BITLEN) << SPI_SLV_RD_ADDR_BITLEN_S));
+    SET_PERI_REG_MASK(SPI_PIN(HSPI), BIT19);
+
+    for (i=0; i<16; i++) {
+        WRITE_PERI_REG(SPI_W0(HSPI) + (i << 2), 0);
+    }
+    rd_len = 0;
+    rd_empty = TRUE;
+    rd_seq = 0;
+    wr_seq = 0;
+    hspi_set_status();
+
+    SET_PERI_REG_MASK(SPI_CMD(HSPI), SPI_USR);
+    ETS_SPI_INTR_ATTACH(hspi_slave_isr, NULL);
+    ETS_SPI_INTR_ENABLE();
+}
+
+// Copy the data into the 'to host' ring
+// Returns the number of bytes copied
+//---------------------------------------------------------------------
+static uint32 ICACHE_FLASH_ATTR hspi_to_host_put(const uint8 *data, uint32 len)
+{
+    uint32 n;
+
+    ETS_SPI_INTR_DISABLE();
+    n = hspi_ring_put(&to_host, data, len);
+    hspi_stats.to_host_bytes += n;
+    // if the loaded packet is empty, load the data now, otherwise when the host reads it
+    if (rd_len == 0) hspi_to_host_load();
+    hspi_set_status();
+    ETS_SPI_INTR_ENABLE();
+    return n;
+}
+
+// Move the queued data into the ring space freed by the host's reads
+// The heap is not used from the interrupt, the queue is checked by the timer
+//---------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR hspi_to_host_drain(void *arg)
+{
+    hspi_to_host_seg_t *seg;
+    uint32 n;
+
+    while ((seg = to_host_head) != NULL) {
+        n = hspi_to_host_put(seg->data + seg->offset, seg->len - seg->offset);
+        seg->offset += n;
+        to_host_queued -= n;
+        if (seg->offset < seg->len) break;
+        to_host_head = seg->next;
+        if (to_host_head == NULL) to_host_tail = NULL;
+        os_free(seg);
+    }
+    if (to_host_head) os_timer_arm(&to_host_timer, HSPI_TO_HOST_POLL_MS, 0);
+}
+
+// Send the data to the host
+// The data are copied into the 'to host' ring, the data which do not fit are queued
+// and sent when the host reads; only the data exceeding the queue size are dropped
+// Returns the number of bytes sent or queued
+//---------------------------------------------------------------------
+int32 ICACHE_FLASH_ATTR hspi_load_data(const uint8 *data, uint32 len)
+{
+    hspi_to_host_seg_t *seg;
+    uint32 n = 0;
+
+    if (to_host.buf == NULL) return 0;
+    if (hspi_link_status_cb) link_status = hspi_link_status_cb();
+
+    // the queued data go first
+    if (to_host_head == NULL) n = hspi_to_host_put(data, len);
+    if (n == len) return n;
+
+    len -= n;
+    seg = NULL;
+    if ((to_host_queued + len) <= HSPI_TO_HOST_QUEUE_MAX) seg = (hspi_to_host_seg_t *)os_malloc(sizeof(hspi_to_host_seg_t) + len);
+    if (seg == NULL) {
+        hspi_stats.to_host_dropped += len;
+        return n;
+    }
+    os_memcpy(seg->data, data + n, len);
+    seg->len = len;
+    seg->offset = 0;
+    seg->next = NULL;
+    if (to_host_tail) to_host_tail->next = seg;
+    else {
+        to_host_head = seg;
+        os_timer_disarm(&to_host_timer);
+        os_timer_setfn(&to_host_timer, (os_timer_func_t *)hspi_to_host_drain, NULL);
+        os_timer_arm(&to_host_timer, HSPI_TO_HOST_POLL_MS, 0);
+    }
+    to_host_tail = seg;
+    to_host_queued += len;
+    return n + len;
+}
+
+// Number of bytes which can be sent to the host without queueing
+//----------------------------------------------
+uint32 ICACHE_FLASH_ATTR hspi_to_host_space(void)
+{
+    uint32 space;
+
+    if ((to_host.buf == NULL) || (to_host_head)) return 0;
+
+    ETS_SPI_INTR_DISABLE();
+    space = to_host.size - to_host.count;
+    ETS_SPI_INTR_ENABLE();
+    return space;
+}
+
+// All data sent to the host were read
+//----------------------------------------------
+bool ICACHE_FLASH_ATTR hspi_to_host_drained(void)
+{
+    return ((to_host.count == 0) && (rd_len == 0) && (to_host_head == NULL));
+}
+
+//--------------------------------------------------------------------
+bool ICACHE_FLASH_ATTR hspi_register_recv_cb(hspi_recv_data_callback_t cb)
+{
+    hspi_recv_data_callback_ptr = cb;
+    return TRUE;
+}
+
+//---------------------------------------------------------------------------
+void ICACHE_FLASH_ATTR hspi_register_link_status_cb(hspi_link_status_cb_t cb)
+{
+    hspi_link_status_cb = cb;
+}
+
+// Refresh the per-link bits of the status word
+//----------------------------------------------
+void ICACHE_FLASH_ATTR hspi_update_status(void)
+{
+    if ((to_host.buf == NULL) || (hspi_link_status_cb == NULL)) return;
+
+    link_status = hspi_link_status_cb();
+    ETS_SPI_INTR_DISABLE();
+    hspi_set_status();
+    ETS_SPI_INTR_ENABLE();
+}
+
+// Called by the AT library when there is free space in the AT receive buffer
+//--------------------------------------------------
+void ICACHE_FLASH_ATTR hspi_rx_buffer_fetch_cb(void)
+{
+    if (from_host.buf == NULL) return;
+
+    ETS_SPI_INTR_DISABLE();
+    hspi_from_host_process();
+    hspi_set_status();
+    ETS_SPI_INTR_ENABLE();
+}
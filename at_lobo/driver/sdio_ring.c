@@ -0,0 +1,169 @@
+/*
+ * SDIO slave (SLC) DMA descriptor rings
+ * Copyright LoBo 2019
+*/
+
+#ifdef SDIO_SIM
+#include "driver/sdio_ring.h"
+#else
+#include "ets_sys.h"
+#include "osapi.h"
+#include "driver/sdio_ring.h"
+#endif
+
+// Functions without ICACHE_FLASH_ATTR are called from the SDIO interrupt
+
+//-------------------------------------------------------------------------------------------------------------------------
+void ICACHE_FLASH_ATTR sdio_ring_init(sdio_ring_t *r, struct sdio_queue *desc, uint8 *buf, uint8 num, uint16 size, bool from_host)
+{
+    struct sdio_queue *d;
+    uint8 i;
+
+    os_memset(r, 0, sizeof(sdio_ring_t));
+    r->desc = desc;
+    r->buf = buf;
+    r->num = num;
+    r->size = size;
+
+    for (i=0; i<num; i++) {
+        d = &desc[i];
+        os_memset(d, 0, sizeof(struct sdio_queue));
+        d->blocksize = size;
+        d->buf_ptr = SDIO_BUF_ADDR(r, i);
+        if (from_host) {
+            // circular list, all buffers are owned by the DMA
+            d->owner = 1;
+            d->next_link_ptr = SDIO_DESC_ADDR(r, (i + 1) % num);
+        }
+    }
+}
+
+// Copy the data into the free buffers of the 'to host' ring
+// Returns the number of bytes copied
+//---------------------------------------------------------------------------------
+uint32 ICACHE_FLASH_ATTR sdio_ring_put(sdio_ring_t *r, const uint8 *data, uint32 len)
+{
+    struct sdio_queue *d;
+    uint32 n, done = 0;
+    uint8 i = 0;
+
+    while (len > 0) {
+        d = NULL;
+        if (r->count > r->busy) {
+            // continue filling the last buffer, it is not loaded yet
+            i = (r->head + r->count - 1) % r->num;
+            if (r->desc[i].datalen < r->size) d = &r->desc[i];
+        }
+        if (d == NULL) {
+            if (r->count >= r->num) break;
+            i = (r->head + r->count) % r->num;
+            d = &r->desc[i];
+            d->datalen = 0;
+            r->count++;
+        }
+        n = r->size - d->datalen;
+        if (n > len) n = len;
+        os_memcpy(r->buf + (i * r->size) + d->datalen, data, n);
+        d->datalen += n;
+        data += n;
+        len -= n;
+        done += n;
+    }
+    return done;
+}
+
+// Link up to 'max' filled buffers into one chain and pass it to the DMA
+// The chain starts at descriptor 'head'
+// Returns the number of bytes to be read by the host, 0 if nothing to load or the DMA is busy
+//-----------------------------------------------
+uint32 sdio_ring_load(sdio_ring_t *r, uint8 max)
+{
+    struct sdio_queue *d;
+    uint32 len = 0;
+    uint8 i, k, n;
+
+    if ((r->busy) || (r->count == 0)) return 0;
+
+    n = (r->count < max) ? r->count : max;
+    for (k=0; k<n; k++) {
+        i = (r->head + k) % r->num;
+        d = &r->desc[i];
+        d->blocksize = r->size;
+        d->sub_sof = 0;
+        d->eof = (k == (n - 1));
+        d->next_link_ptr = (k == (n - 1)) ? 0 : SDIO_DESC_ADDR(r, (i + 1) % r->num);
+        d->owner = 1;
+        len += d->datalen;
+    }
+    r->busy = n;
+    return len;
+}
+
+// The loaded chain was read by the host, the buffers are free
+//-----------------------------------------
+void sdio_ring_load_done(sdio_ring_t *r)
+{
+    struct sdio_queue *d;
+
+    while (r->busy) {
+        d = &r->desc[r->head];
+        d->owner = 0;
+        d->eof = 0;
+        d->datalen = 0;
+        r->head = (r->head + 1) % r->num;
+        r->count--;
+        r->busy--;
+    }
+}
+
+// Number of bytes which can be put into the 'to host' ring
+//--------------------------------------------------
+uint32 ICACHE_FLASH_ATTR sdio_ring_space(sdio_ring_t *r)
+{
+    uint32 space = (r->num - r->count) * r->size;
+
+    if (r->count > r->busy) space += r->size - r->desc[(r->head + r->count - 1) % r->num].datalen;
+    return space;
+}
+
+// Get the not yet processed data of the oldest buffer written by the host
+// Returns NULL if the DMA still owns the buffer
+//-----------------------------------------------------
+uint8 *sdio_ring_peek(sdio_ring_t *r, uint32 *len)
+{
+    struct sdio_queue *d = &r->desc[r->head];
+
+    if (d->owner) return NULL;
+    *len = (d->datalen > r->offset) ? (d->datalen - r->offset) : 0;
+    return r->buf + (r->head * r->size) + r->offset;
+}
+
+// Mark 'len' bytes of the oldest buffer as processed
+// Returns true if the whole buffer is processed and returned to the DMA
+//-----------------------------------------------------
+bool sdio_ring_consume(sdio_ring_t *r, uint32 len)
+{
+    struct sdio_queue *d = &r->desc[r->head];
+
+    r->offset += len;
+    if (r->offset < d->datalen) return false;
+
+    r->offset = 0;
+    d->datalen = 0;
+    d->eof = 0;
+    d->owner = 1;
+    r->head = (r->head + 1) % r->num;
+    return true;
+}
+
+// Number of 'from host' buffers the host can write
+//-----------------------------------------
+uint8 sdio_ring_dma_free(sdio_ring_t *r)
+{
+    uint8 i, n = 0;
+
+    for (i=0; i<r->num; i++) {
+        if (r->desc[i].owner) n++;
+    }
+    return n;
+}
@@ -24,6 +24,7 @@
 
 #include "driver/slc_register.h"
 #include "driver/sdio_slv.h"
+#include "driver/sdio_ring.h"
 #include "ets_sys.h"
 #include "osapi.h"
 #include "os_type.h"
@@ -31,28 +32,10 @@
 #include "user_interface.h"
 #include "mem.h"
 
-#define SDIO_TOKEN_SIZE		0//4
-#define RX_BUFFER_SIZE      2048
-#define RX_BUFFER_NUM       5
-
-#define TX_BUFFER_SIZE		2048
-#define SLC_INTEREST_EVENT (SLC_TX_EOF_INT_ENA | SLC_RX_EOF_INT_ENA | SLC_RX_UDF_INT_ENA | SLC_TX_DSCR_ERR_INT_ENA)
+#define SLC_INTEREST_EVENT (SLC_TX_EOF_INT_ENA | SLC_RX_EOF_INT_ENA | SLC_RX_UDF_INT_ENA | SLC_TX_DSCR_ERR_INT_ENA | SLC_TX_DSCR_EMPTY_INT_ENA)
 #define TRIG_TOHOST_INT()	SET_PERI_REG_MASK(SLC_INTVEC_TOHOST , BIT0);\
 							CLEAR_PERI_REG_MASK(SLC_INTVEC_TOHOST , BIT0)
-                            
 
-struct sdio_queue
-{
-	uint32	blocksize:12;
-	uint32	datalen:12;
-	uint32	unused:5;
-	uint32	sub_sof:1;
-	uint32 	eof:1;
-	uint32	owner:1;
-
-	uint32	buf_ptr;
-	uint32	next_link_ptr;
-};
 
 struct sdio_slave_status_element
 {
@@ -70,44 +53,38 @@ union sdio_slave_status
 	uint32 word_value;
 };
 
-//uint8 rx_buffer[RX_BUFFER_NUM][RX_BUFFER_SIZE],tx_buffer[1024];
-uint8 tx_buffer[TX_BUFFER_SIZE];
+// Data which did not fit into the 'to host' buffers
+typedef struct _sdio_to_host_seg_t {
+    struct _sdio_to_host_seg_t *next;
+    uint32  len;
+    uint32  offset;     // bytes already put into the buffers
+    uint8   data[0];
+} sdio_to_host_seg_t;
 
-uint32 data_len = 0;
-
-struct sdio_list {
-	uint8 buffer[RX_BUFFER_SIZE + SDIO_TOKEN_SIZE];
-	uint8* tail;
-	struct sdio_list* next;
-};
+sdio_stats_t sdio_stats = { 0 };
 
 static sdio_recv_data_callback_t sdio_recv_data_callback_ptr = NULL;
-struct sdio_list* pHead_ToSend;
-struct sdio_list* pTail_ToSend;
-struct sdio_list* pHead_Sended;
-struct sdio_list* pTail_Sended;
-
 
-
-os_event_t * sdioQueue;
-struct sdio_queue rx_que,tx_que;
-
-static bool has_read = 0;
+// 'to host' (SLC RX) and 'from host' (SLC TX) descriptor rings
+static sdio_ring_t to_host;
+static sdio_ring_t from_host;
+static bool from_host_stalled = FALSE;  // the host wrote with no free buffer, the DMA must be restarted
+static sdio_to_host_seg_t *to_host_head = NULL;    // queued data, sent after the data in the buffers
+static sdio_to_host_seg_t *to_host_tail = NULL;
+static uint32 to_host_queued = 0;
+static os_timer_t to_host_timer;
 
 static void sdio_slave_isr(void *para);
-static void tx_buff_handle_done(void);
-static void rx_buff_read_done(void);
-static void tx_buff_write_done(void);
-
-static void sdio_try_to_load(void);
-static void sdio_read_done_process(void);
-#ifdef SDIO_DEBUG
-extern uint32 sum_len;
-#endif
+static void sdio_to_host_load(void);
+static void sdio_from_host_process(void);
+
+//--------------------------------
 void sdio_slave_init(void)
 {
-    uint32 regval = 0;
     union sdio_slave_status sdio_sta;
+    struct sdio_queue *desc;
+    uint8 *buf;
+
     ETS_SDIO_INTR_DISABLE();
 	///
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_SD_CLK_U,FUNC_SDCLK);
@@ -116,76 +93,39 @@ void sdio_slave_init(void)
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_SD_DATA2_U,FUNC_SDDATA2);
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_SD_DATA3_U,FUNC_SDDATA3);
 	PIN_FUNC_SELECT(PERIPHS_IO_MUX_SD_CMD_U,FUNC_SDCMD);
-	
-	
+
+
     ////reset orginal link
     SET_PERI_REG_MASK(SLC_CONF0, SLC_RXLINK_RST|SLC_TXLINK_RST);
     CLEAR_PERI_REG_MASK(SLC_CONF0, SLC_RXLINK_RST|SLC_TXLINK_RST);
 
-    os_printf("RX&TX link reset!\n");
-
     //set sdio mode
     SET_PERI_REG_MASK(SLC_RX_DSCR_CONF, SLC_RX_EOF_MODE | SLC_RX_FILL_MODE);
     //clear to host interrupt io signal for preventing from random initial signal.
     WRITE_PERI_REG(SLC_HOST_INTR_CLR, 0xffffffff);
     //enable 2 events to trigger the to host intr io
     SET_PERI_REG_MASK(SLC_HOST_INTR_ENA , SLC_HOST_TOHOST_BIT0_INT_ENA);
-    ////initialize rx queue information
-
-    has_read = TRUE;
-	pHead_ToSend = NULL;
-
-	int loop = RX_BUFFER_NUM;
-	struct sdio_list* p = NULL;
-	while(loop--) {
-		if(pHead_Sended == NULL) {
-			pHead_Sended = (struct sdio_list*)os_malloc_dram(sizeof(struct sdio_list));
-			p = pHead_Sended;
-		} else {
-			p->next = (struct sdio_list*)os_malloc_dram(sizeof(struct sdio_list));
-			p = p->next;
-		}
-		//os_printf("p:0x%08x\r\n",p);
-		p->tail = p->buffer + SDIO_TOKEN_SIZE;
-		p->next = NULL;
-	}
-	pTail_Sended = p;
-	
-    rx_que.blocksize = RX_BUFFER_SIZE;
-    rx_que.datalen=0;
-    rx_que.eof=1;
-    rx_que.owner=1;
-    rx_que.sub_sof=0;
-    rx_que.unused=0;
-    rx_que.buf_ptr=(uint32)pHead_Sended->buffer;
-    rx_que.next_link_ptr=0;
-
-
-    ////initialize tx queue information
-    tx_que.blocksize=TX_BUFFER_SIZE;
-    tx_que.datalen=0;
-    tx_que.eof=0;
-    tx_que.owner=1;
-    tx_que.sub_sof=0;
-    tx_que.unused=0;
-    tx_que.buf_ptr=(uint32)tx_buffer;
-    tx_que.next_link_ptr=0;
-
-    ///////link tx&rx queue information address to sdio hardware
-    CLEAR_PERI_REG_MASK(SLC_RX_LINK,SLC_RXLINK_DESCADDR_MASK);
-    regval= ((uint32)&rx_que);
-    SET_PERI_REG_MASK(SLC_RX_LINK, regval&SLC_RXLINK_DESCADDR_MASK);
+
+    ////initialize the descriptor rings, descriptors and buffers must be in dRAM
+    desc = (struct sdio_queue *)os_malloc_dram(sizeof(struct sdio_queue) * (SDIO_RX_BUF_NUM + SDIO_TX_BUF_NUM));
+    buf = (uint8 *)os_malloc_dram((SDIO_RX_BUF_NUM * SDIO_RX_BUF_SIZE) + (SDIO_TX_BUF_NUM * SDIO_TX_BUF_SIZE));
+    if ((desc == NULL) || (buf == NULL)) {
+        os_printf("SDIO: no memory\r\n");
+        return;
+    }
+    sdio_ring_init(&to_host, desc, buf, SDIO_RX_BUF_NUM, SDIO_RX_BUF_SIZE, FALSE);
+    sdio_ring_init(&from_host, desc + SDIO_RX_BUF_NUM, buf + (SDIO_RX_BUF_NUM * SDIO_RX_BUF_SIZE), SDIO_TX_BUF_NUM, SDIO_TX_BUF_SIZE, TRUE);
+    os_memset(&sdio_stats, 0, sizeof(sdio_stats_t));
+
+    ///////link the 'from host' ring to sdio hardware, the 'to host' chain is linked when loaded
     CLEAR_PERI_REG_MASK(SLC_TX_LINK,SLC_TXLINK_DESCADDR_MASK);
-    regval= ((uint32)&tx_que);
-    SET_PERI_REG_MASK(SLC_TX_LINK, regval&SLC_TXLINK_DESCADDR_MASK);
+    SET_PERI_REG_MASK(SLC_TX_LINK, SDIO_DESC_ADDR(&from_host, 0) & SLC_TXLINK_DESCADDR_MASK);
 
-#if (SDIO_TOKEN_SIZE == 0)
     SET_PERI_REG_MASK(SLC_RX_DSCR_CONF, SLC_TOKEN_NO_REPLACE);
-#endif
 
     /////config sdio_status reg
     sdio_sta.elm_value.comm_cnt=7;
-    sdio_sta.elm_value.intr_no=INIT_STAGE;
+    sdio_sta.elm_value.intr_no=INIT_STAGE | TX_AVAILIBLE;
     sdio_sta.elm_value.wr_busy=0;
     sdio_sta.elm_value.rd_empty=1;
     sdio_sta.elm_value.rx_length=0;
@@ -204,12 +144,10 @@ void sdio_slave_init(void)
     ETS_SDIO_INTR_ENABLE();
 }
 
+//--------------------------------------
 static void sdio_slave_isr(void *para)
 {
-    uint32 slc_intr_status,postval;
-    static uint8 state =0;
-    uint16 rx_len,i;
-    uint32* pword;
+    uint32 slc_intr_status;
     union sdio_slave_status sdio_sta;
 
     slc_intr_status = READ_PERI_REG(SLC_INT_STATUS);
@@ -221,275 +159,220 @@ static void sdio_slave_isr(void *para)
     }
     //clear all intrs
     WRITE_PERI_REG(SLC_INT_CLR, slc_intr_status);
-    //os_printf("slc_intr_status:0x%08x\r\n",slc_intr_status);
-    //process every intr
 
-    //TO HOST DONE
+    //TO HOST DONE, the loaded chain was read by the host
     if (slc_intr_status & SLC_RX_EOF_INT_ENA)
     {
-        //following code must be called after a data pack has been read
-        rx_buff_read_done();
-		sdio_read_done_process();
+        sdio_ring_load_done(&to_host);
+        sdio_stats.to_host_reads++;
+
+        sdio_sta.word_value=READ_PERI_REG(SLC_HOST_CONF_W2);
+        sdio_sta.elm_value.comm_cnt++;
+        sdio_sta.elm_value.rd_empty=1;
+        sdio_sta.elm_value.rx_length=0;
+        sdio_sta.elm_value.intr_no &= (~RX_AVAILIBLE);
+        WRITE_PERI_REG(SLC_HOST_CONF_W2, sdio_sta.word_value);
+
+        // load the data put into the ring in the meantime
+        sdio_to_host_load();
     }
 
-    //FROM HOST DONE
-    if (slc_intr_status & SLC_TX_EOF_INT_ENA)
-    {
-        //call the following function after host cpu data transmission finished
-        tx_buff_write_done();
-		if(sdio_recv_data_callback_ptr) {
-			if (sdio_recv_data_callback_ptr((uint8*)tx_que.buf_ptr,tx_que.datalen) == tx_que.datalen) {
-				tx_buff_handle_done();
-				TRIG_TOHOST_INT();
-			}
-		} else {
-			tx_buff_handle_done();
-			TRIG_TOHOST_INT();
-		}
-    }
-#if 0
-    //TO HOST underflow
-    if(slc_intr_status & SLC_RX_UDF_INT_ENA)
+    //FROM HOST: no free buffer when the host was writing
+    if (slc_intr_status & SLC_TX_DSCR_EMPTY_INT_ENA)
     {
+        sdio_stats.from_host_full++;
+        from_host_stalled = TRUE;
     }
 
-    //FROM HOST overflow
-    if(slc_intr_status & SLC_TX_DSCR_ERR_INT_ENA)
+    //FROM HOST DONE, the host has written the data
+    if (slc_intr_status & SLC_TX_EOF_INT_ENA)
     {
+        sdio_sta.word_value=READ_PERI_REG(SLC_HOST_CONF_W2);
+        sdio_sta.elm_value.comm_cnt++;
+        WRITE_PERI_REG(SLC_HOST_CONF_W2, sdio_sta.word_value);
+
+        sdio_from_host_process();
     }
 
-    slc_intr_status = READ_PERI_REG(SLC_INT_STATUS);
-    if(slc_intr_status)
+    if (slc_intr_status & (SLC_RX_UDF_INT_ENA | SLC_TX_DSCR_ERR_INT_ENA))
     {
-        WRITE_PERI_REG(SLC_INT_CLR, slc_intr_status);
+        sdio_stats.errors++;
     }
-#endif
 }
 
-static void rx_buff_read_done(void)
+// Pass the filled 'to host' buffers to the DMA and notify the host
+// Called with the SDIO interrupt disabled or from the interrupt
+//----------------------------------
+static void sdio_to_host_load(void)
 {
     union sdio_slave_status sdio_sta;
-    /////modify sdio status reg
-    sdio_sta.word_value=READ_PERI_REG(SLC_HOST_CONF_W2);
-    sdio_sta.elm_value.comm_cnt++;
-    sdio_sta.elm_value.rd_empty=1;
-    sdio_sta.elm_value.rx_length=0;
-    sdio_sta.elm_value.intr_no &= (~RX_AVAILIBLE);
-    WRITE_PERI_REG(SLC_HOST_CONF_W2, sdio_sta.word_value);  //update sdio status register
-    //os_printf("rx_buff_read_done\r\n");
-}
+    uint32 len;
+
+    len = sdio_ring_load(&to_host, SDIO_RX_BUF_NUM);
+    if (len == 0) return;
+
+    CLEAR_PERI_REG_MASK(SLC_RX_LINK,SLC_RXLINK_DESCADDR_MASK);
+    SET_PERI_REG_MASK(SLC_RX_LINK, SDIO_DESC_ADDR(&to_host, to_host.head) & SLC_RXLINK_DESCADDR_MASK);
 
-static void tx_buff_write_done(void)
-{
-    union sdio_slave_status sdio_sta;
     /////modify sdio status reg
     sdio_sta.word_value=READ_PERI_REG(SLC_HOST_CONF_W2);
-    sdio_sta.elm_value.comm_cnt++;
-    sdio_sta.elm_value.wr_busy=1;
-	sdio_sta.elm_value.intr_no &= (~TX_AVAILIBLE);
+    sdio_sta.elm_value.rd_empty=0;
+    sdio_sta.elm_value.intr_no |= RX_AVAILIBLE;
+    sdio_sta.elm_value.rx_length=len;
+
+    SET_PERI_REG_MASK(SLC_RX_LINK, SLC_RXLINK_START);       //rx chain is ready for being read
     WRITE_PERI_REG(SLC_HOST_CONF_W2, sdio_sta.word_value);  //update sdio status register
+    TRIG_TOHOST_INT();
 }
 
-static void tx_buff_handle_done(void)
+// Pass the data written by the host to the receive callback
+// and return the processed buffers to the DMA
+// Called with the SDIO interrupt disabled or from the interrupt
+//---------------------------------------
+static void sdio_from_host_process(void)
 {
     union sdio_slave_status sdio_sta;
+    uint32 len, n;
+    uint8 *data;
+    bool released = FALSE;
+
+    while ((data = sdio_ring_peek(&from_host, &len)) != NULL) {
+        if (from_host.offset == 0) sdio_stats.from_host_writes++;
+        n = len;
+        if ((len) && (sdio_recv_data_callback_ptr)) {
+            n = sdio_recv_data_callback_ptr(data, len);
+            if (n > len) n = len;
+        }
+        sdio_stats.from_host_bytes += n;
+        if (sdio_ring_consume(&from_host, n)) released = TRUE;
+        // the AT receive buffer is full, continue from at_custom_uart_rx_buffer_fetch_cb
+        if (n < len) break;
+    }
+    if (!released) return;
 
-    /////config tx queue information
-    tx_que.blocksize=TX_BUFFER_SIZE;
-    tx_que.datalen=0;
-    tx_que.eof=0;
-    tx_que.owner=1;
-
+    if (from_host_stalled) {
+        from_host_stalled = FALSE;
+        SET_PERI_REG_MASK(SLC_TX_LINK, SLC_TXLINK_RESTART);
+    }
     /////modify sdio status reg
     sdio_sta.word_value=READ_PERI_REG(SLC_HOST_CONF_W2);
     sdio_sta.elm_value.wr_busy=0;
     sdio_sta.elm_value.intr_no |= TX_AVAILIBLE;
-
-    SET_PERI_REG_MASK(SLC_TX_LINK, SLC_TXLINK_START);       //tx buffer is ready for being written
     WRITE_PERI_REG(SLC_HOST_CONF_W2, sdio_sta.word_value);  //update sdio status register
-    //*******************************************************************//
-
+    TRIG_TOHOST_INT();
 }
-static int32 rx_buff_load_done(uint16 rx_len)
-{
-    union sdio_slave_status sdio_sta;
 
-	if(rx_len == 0) {
-		return 0;
-	}
-    if(rx_len > rx_que.blocksize)
-    {
-        rx_len = rx_que.blocksize;
-    }
-
-    //os_memcpy(rx_que.buf_ptr,data,rx_len);
-    /////config rx queue information
-    rx_que.blocksize=RX_BUFFER_SIZE;
-    rx_que.datalen=rx_len + SDIO_TOKEN_SIZE;
-    rx_que.eof=1;
-    rx_que.owner=1;
-#ifdef SDIO_DEBUG
-	sum_len += rx_que.datalen;
-#endif
-    //ETS_SDIO_INTR_DISABLE();
-    //available_buffer_amount--;
+// Copy the data into the free 'to host' buffers
+// Returns the number of bytes copied
+//--------------------------------------------------------------
+static uint32 ICACHE_FLASH_ATTR sdio_to_host_put(const uint8* data,uint32 len)
+{
+    uint32 n;
 
-    /////modify sdio status reg
-    sdio_sta.word_value=READ_PERI_REG(SLC_HOST_CONF_W2);
-    sdio_sta.elm_value.rd_empty=0;
-    sdio_sta.elm_value.intr_no |= RX_AVAILIBLE;
-    sdio_sta.elm_value.rx_length=rx_len;
+    ETS_SDIO_INTR_DISABLE();
+    n = sdio_ring_put(&to_host, data, len);
+    sdio_stats.to_host_bytes += n;
+    // if the host is not reading, load the data now, otherwise when the host finishes
+    sdio_to_host_load();
+    ETS_SDIO_INTR_ENABLE();
+    return n;
+}
 
-    SET_PERI_REG_MASK(SLC_RX_LINK, SLC_RXLINK_START);       //rx buffer is ready for being read
-    WRITE_PERI_REG(SLC_HOST_CONF_W2, sdio_sta.word_value);  //update sdio status register
-    //ETS_SDIO_INTR_ENABLE();
-    return rx_len;
+// Move the queued data into the buffers freed by the host's reads
+// The heap is not used from the interrupt, the queue is checked by the timer
+//--------------------------------------------------------------
+static void ICACHE_FLASH_ATTR sdio_to_host_drain(void *arg)
+{
+    sdio_to_host_seg_t *seg;
+    uint32 n;
+
+    while ((seg = to_host_head) != NULL) {
+        n = sdio_to_host_put(seg->data + seg->offset, seg->len - seg->offset);
+        seg->offset += n;
+        to_host_queued -= n;
+        if (seg->offset < seg->len) break;
+        to_host_head = seg->next;
+        if (to_host_head == NULL) to_host_tail = NULL;
+        os_free(seg);
+    }
+    if (to_host_head) os_timer_arm(&to_host_timer, SDIO_TO_HOST_POLL_MS, 0);
 }
 
+// Send the data to the host
+// The data are copied into the free 'to host' buffers, the data which do not fit are queued
+// and sent when the host reads; only the data exceeding the queue size are dropped
+// Returns the number of bytes sent or queued
+//--------------------------------------------------------------
 int32 ICACHE_FLASH_ATTR sdio_load_data(const uint8* data,uint32 len)
 {
-    int32 data_len = 0;
-	struct sdio_list* temp_list;
-	if (pHead_Sended == NULL) {
-		//os_printf("no buf\r\n");
-		return 0;
-	}
-    int32 left_len = 0;
-    while(len)
-    {
-		ETS_SDIO_INTR_DISABLE();
-		if(pHead_Sended == NULL)
-        {
-            //os_printf("buf full\r\n");
-			ETS_SDIO_INTR_ENABLE();
-            break;
-        }
-		temp_list = pHead_Sended;
-		pHead_Sended = pHead_Sended->next;
-		ETS_SDIO_INTR_ENABLE();
-		left_len = RX_BUFFER_SIZE + SDIO_TOKEN_SIZE - (uint32)(temp_list->tail - temp_list->buffer);
-        if(len < left_len)
-        {
-            os_memcpy(temp_list->tail,data,len);
-			temp_list->tail += len;
-			
-			data_len += len;
-			len = 0;
-			ETS_SDIO_INTR_DISABLE();
-			temp_list->next = pHead_Sended;
-			pHead_Sended = temp_list;
-			//ETS_SDIO_INTR_ENABLE();
-        }
-        else
-        {
-            os_memcpy(temp_list->tail,data,left_len);
-			temp_list->tail += left_len;
-			len -= left_len;
-			data += left_len;
-			data_len += left_len;
-			ETS_SDIO_INTR_DISABLE();
-			if(pHead_ToSend == NULL) {
-				pTail_ToSend = temp_list;
-				pHead_ToSend = pTail_ToSend;
-				sdio_try_to_load();
-			} else {
-				pTail_ToSend->next = temp_list;
-				pTail_ToSend = pTail_ToSend->next;
-			}
-			pTail_ToSend->next = NULL;
-			//ETS_SDIO_INTR_ENABLE();
-        }
+    sdio_to_host_seg_t *seg;
+    uint32 n = 0;
+
+    if (to_host.desc == NULL) return 0;
+
+    // the queued data go first
+    if (to_host_head == NULL) n = sdio_to_host_put(data, len);
+    if (n == len) return n;
+
+    len -= n;
+    seg = NULL;
+    if ((to_host_queued + len) <= SDIO_TO_HOST_QUEUE_MAX) seg = (sdio_to_host_seg_t *)os_malloc(sizeof(sdio_to_host_seg_t) + len);
+    if (seg == NULL) {
+        sdio_stats.to_host_dropped += len;
+        return n;
     }
-	//ETS_SDIO_INTR_DISABLE();
-	if(pHead_ToSend == NULL) {
-		pTail_ToSend = pHead_Sended;
-		pHead_ToSend = pTail_ToSend;
-
-		pHead_Sended = pHead_Sended->next;
-		pTail_ToSend->next = NULL;
-		sdio_try_to_load();
-	}
-	ETS_SDIO_INTR_ENABLE();
-    return data_len;
+    os_memcpy(seg->data, data + n, len);
+    seg->len = len;
+    seg->offset = 0;
+    seg->next = NULL;
+    if (to_host_tail) to_host_tail->next = seg;
+    else {
+        to_host_head = seg;
+        os_timer_disarm(&to_host_timer);
+        os_timer_setfn(&to_host_timer, (os_timer_func_t *)sdio_to_host_drain, NULL);
+        os_timer_arm(&to_host_timer, SDIO_TO_HOST_POLL_MS, 0);
+    }
+    to_host_tail = seg;
+    to_host_queued += len;
+    return n + len;
 }
 
-static void sdio_try_to_load(void)
+// Number of bytes which can be sent to the host without queueing
+//--------------------------------------------
+uint32 ICACHE_FLASH_ATTR sdio_to_host_space(void)
 {
-	if((has_read == TRUE) && (pHead_ToSend != NULL))
-    {
-        rx_que.buf_ptr = (uint32)pHead_ToSend->buffer;
-        rx_buff_load_done(pHead_ToSend->tail- pHead_ToSend->buffer - SDIO_TOKEN_SIZE);
-		//pHead_ToSend = pHead_ToSend->next;
-        has_read = FALSE;
-        //os_printf("SLC_INT_STATUS:0x%08x\r\n",READ_PERI_REG(SLC_INT_STATUS));
-        TRIG_TOHOST_INT();
-    }
+    uint32 space;
+
+    if ((to_host.desc == NULL) || (to_host_head)) return 0;
+
+    ETS_SDIO_INTR_DISABLE();
+    space = sdio_ring_space(&to_host);
+    ETS_SDIO_INTR_ENABLE();
+    return space;
 }
 
-static void sdio_read_done_process(void)
+// All data sent to the host were read
+//--------------------------------------------
+bool ICACHE_FLASH_ATTR sdio_to_host_drained(void)
 {
-	has_read = TRUE;
-		
-	pHead_ToSend->tail = pHead_ToSend->buffer + SDIO_TOKEN_SIZE;
-	if(pHead_Sended) {
-       	pTail_Sended->next = pHead_ToSend;
-		pTail_Sended = pTail_Sended->next;
-	}else {
-		pTail_Sended = pHead_ToSend;
-		pHead_Sended = pTail_Sended;
-	}
-	pHead_ToSend = pHead_ToSend->next;
-	pTail_Sended->next = NULL;
-	//os_printf(">>pHead_ToSend:0x%08x,pHead_Sended:0x%08x,0x%08x,0x%08x\r\n",pHead_ToSend,pHead_Sended,pHead_Sended->buffer,pHead_Sended->tail);
-	if(pHead_ToSend) {
-		rx_que.buf_ptr = (uint32)pHead_ToSend->buffer;
-           rx_buff_load_done(pHead_ToSend->tail - pHead_ToSend->buffer - SDIO_TOKEN_SIZE);
-		has_read = FALSE;
-		//os_printf("intr trig\r\n");
-		//TRIG_TOHOST_INT();
-	} else if ((pHead_Sended != NULL) && (pHead_Sended->buffer != (pHead_Sended->tail- SDIO_TOKEN_SIZE))) {
-		pHead_ToSend = pHead_Sended;
-		pTail_ToSend = pHead_ToSend;
-		pHead_Sended = pHead_Sended->next;
-		pTail_ToSend->next = NULL;
-			
-		rx_que.buf_ptr = (uint32)pHead_ToSend->buffer;			
-        rx_buff_load_done(pHead_ToSend->tail- pHead_ToSend->buffer - SDIO_TOKEN_SIZE);
-		has_read = FALSE;
-		//os_printf("intr trig\r\n");
-		//TRIG_TOHOST_INT();
-	}
-
-    if (has_read == FALSE) {
-	    TRIG_TOHOST_INT();
-    }
+    return ((to_host.count == 0) && (to_host_head == NULL));
 }
 
+//--------------------------------------------------------
 bool sdio_register_recv_cb(sdio_recv_data_callback_t cb)
 {
 	sdio_recv_data_callback_ptr = cb;
-	
+
 	return TRUE;
 }
 
+// Called by the AT library when there is free space in the AT receive buffer
+//--------------------------------------------------------
 void ICACHE_FLASH_ATTR at_custom_uart_rx_buffer_fetch_cb(void)
 {
-	if(sdio_recv_data_callback_ptr && tx_que.datalen) {
-		if (sdio_recv_data_callback_ptr((uint8*)tx_que.buf_ptr,tx_que.datalen) == tx_que.datalen) {
-			tx_buff_handle_done();
-			TRIG_TOHOST_INT();
-		}
-	}
-}
-
-
-#ifdef SDIO_DEBUG
-void ICACHE_FLASH_ATTR at_spi_check_cb(void *arg)
-{
-	//TRIG_TOHOST_INT();
-	os_printf("sum_len:%d\r\n",sum_len);
-	//sdio_load_data("esp8266\r\n",os_strlen("esp8266\r\n"));
+    if (from_host.desc == NULL) return;
 
-	sum_len = 0;
+    ETS_SDIO_INTR_DISABLE();
+    sdio_from_host_process();
+    ETS_SDIO_INTR_ENABLE();
 }
-#endif
@@ -0,0 +1,136 @@
+/*
+ * Buffered, interrupt driven UART0 output for ESP8266 AT firmware
+ * Copyright LoBo 2019
+*/
+
+#include "ets_sys.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "driver/uart.h"
+#include "driver/uart_tx.h"
+#include "at_sdk_ext.h"
+#if AT_SDIO_ENABLE
+#include "driver/sdio_slv.h"
+#endif
+#if AT_HSPI_ENABLE
+#include "driver/hspi_slv.h"
+#endif
+
+uart_tx_stats_t uart_tx_stats = { 0 };
+
+static uart_tx_done_cb_t tx_done_cb[UART_TX_DONE_MAX];
+static void *tx_done_arg[UART_TX_DONE_MAX];
+static uint8_t tx_done_count = 0;
+static os_timer_t tx_done_timer;
+
+
+// Report the completion when all buffered output is on the wire
+//------------------------------------------------------------
+static void ICACHE_FLASH_ATTR uart_tx_done_check(void *arg)
+{
+    uart_tx_done_cb_t cb[UART_TX_DONE_MAX];
+    void *cb_arg[UART_TX_DONE_MAX];
+    uint8_t i, n;
+
+    if (tx_done_count == 0) return;
+    if (!uart_tx_drained()) {
+        os_timer_arm(&tx_done_timer, UART_TX_POLL_MS, 0);
+        return;
+    }
+
+    // the callbacks may write more data
+    n = tx_done_count;
+    os_memcpy(cb, tx_done_cb, sizeof(cb));
+    os_memcpy(cb_arg, tx_done_arg, sizeof(cb_arg));
+    tx_done_count = 0;
+    for (i=0; i<n; i++) {
+        uart_tx_stats.done++;
+        cb[i](cb_arg[i]);
+    }
+}
+
+// Called from the AT task when the TX FIFO is empty while the fake UART is enabled
+// (framed, SDIO or HSPI mode, or the UART0 AT input after the data delivery);
+// the TX interrupt only reports it, the buffer is emptied here
+//--------------------------------------------
+static void ICACHE_FLASH_ATTR uart_tx_fifo_empty(void)
+{
+    tx_start_uart_buffer(UART0);
+}
+
+//----------------------------------
+void ICACHE_FLASH_ATTR uart_tx_init(void)
+{
+    os_memset(&uart_tx_stats, 0, sizeof(uart_tx_stats_t));
+    tx_done_count = 0;
+    os_timer_disarm(&tx_done_timer);
+    os_timer_setfn(&tx_done_timer, (os_timer_func_t *)uart_tx_done_check, NULL);
+    at_register_uart_tx_complete_func(uart_tx_fifo_empty);
+}
+
+// Set the TX buffer size, the buffer is reallocated when it is empty
+// Returns the size set, limited by the AT library
+//-----------------------------------------------------
+uint16_t ICACHE_FLASH_ATTR uart_tx_set_size(uint16_t size)
+{
+    uart_tx_buffer_set_size(size);
+    return uart_tx_buffer_get_size();
+}
+
+//-------------------------------------
+uint16_t ICACHE_FLASH_ATTR uart_tx_get_size(void)
+{
+    return uart_tx_buffer_get_size();
+}
+
+// Check if the TX buffer and the TX FIFO are empty
+// With SDIO or HSPI transport, check if the host has read all data
+//---------------------------------
+bool ICACHE_FLASH_ATTR uart_tx_drained(void)
+{
+    #if AT_SDIO_ENABLE
+    return sdio_to_host_drained();
+    #elif AT_HSPI_ENABLE
+    return hspi_to_host_drained();
+    #else
+    return UART_CheckOutputFinished(UART0, 0);
+    #endif
+}
+
+// Copy the data into the TX buffer, never blocks
+// Data which do not fit are queued by the AT library, so the output order is preserved
+// With SDIO or HSPI transport, the data are copied directly into the transport buffers,
+// in order with the AT responses which reach them through the fake UART
+//-------------------------------------------------------------------
+void ICACHE_FLASH_ATTR uart_tx_write(const uint8_t *data, uint16_t len)
+{
+    if (len == 0) return;
+    #if AT_SDIO_ENABLE
+    sdio_load_data(data, len);
+    #elif AT_HSPI_ENABLE
+    hspi_load_data(data, len);
+    #else
+    uart_tx_buff_enq(-1, data, len, true);
+    #endif
+    uart_tx_stats.writes++;
+    uart_tx_stats.bytes += len;
+}
+
+// Write the data and call 'cb' when they are on the wire
+// The data are copied directly from the caller's buffer into the TX buffer,
+// so the buffer can be reused on return.
+// Returns false if the completion can not be reported (too many pending callbacks),
+// the data are written anyway.
+//-----------------------------------------------------------------------------------------------------------
+bool ICACHE_FLASH_ATTR uart_tx_write_cb(const uint8_t *data, uint16_t len, uart_tx_done_cb_t cb, void *arg)
+{
+    uart_tx_write(data, len);
+    if ((cb == NULL) || (tx_done_count >= UART_TX_DONE_MAX)) return false;
+
+    tx_done_cb[tx_done_count] = cb;
+    tx_done_arg[tx_done_count] = arg;
+    tx_done_count++;
+    os_timer_disarm(&tx_done_timer);
+    os_timer_arm(&tx_done_timer, UART_TX_POLL_MS, 0);
+    return true;
+}
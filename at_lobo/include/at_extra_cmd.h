@@ -40,15 +40,66 @@ void at_setupCmdCPUfreq(uint8_t id, char *pPara);
 void at_queryCmdSNTPTime(uint8_t id);
 void at_testCmdSNTPTime(uint8_t id);
 
+void uart0_tx_buffer(uint8_t *buf, uint16_t len);
+void at_setupCmdUartFlow(uint8_t id, char *pPara);
+void at_queryCmdUartFlow(uint8_t id);
+void at_setupCmdUartTxBuf(uint8_t id, char *pPara);
+void at_queryCmdUartTxBuf(uint8_t id);
+void at_setupCmdUartFast(uint8_t id, char *pPara);
+void at_queryCmdUartFast(uint8_t id);
+void at_setupCmdUartBench(uint8_t id, char *pPara);
+#if AT_SDIO_ENABLE
+void at_queryCmdSdioStat(uint8_t id);
+#endif
+#if AT_HSPI_ENABLE
+uint16 at_hspi_link_status(void);
+void at_queryCmdHspiStat(uint8_t id);
+#endif
+
 void at_setupCmdTCPServer(uint8_t id, char *pPara);
 void at_queryCmdTCPServer(uint8_t id);
 
 void at_setupCmdTCPConnConnect(uint8_t id, char *pPara);
 void at_setupCmdTCPSend(uint8_t id, char *pPara);
+void at_setupCmdTCPSendQueue(uint8_t id, char *pPara);
+void at_queryCmdTCPSendQueue(uint8_t id);
 void at_setupCmdTCPClose(uint8_t id, char *pPara);
 void at_queryCmdTCP(uint8_t id);
 void at_queryCmdTCPStatus(uint8_t id);
 void ICACHE_FLASH_ATTR at_setupCmdTCPStatus(uint8_t id, char *pPara);
+void at_queryCmdTCPStats(uint8_t id);
+void at_setupCmdTCPStats(uint8_t id, char *pPara);
+void at_exeCmdTCPStats(uint8_t id);
+void at_setupCmdTCPRecvMode(uint8_t id, char *pPara);
+void at_queryCmdTCPRecvMode(uint8_t id);
+void at_setupCmdTCPRecv(uint8_t id, char *pPara);
+void at_queryCmdTCPRecv(uint8_t id);
+void at_setupCmdTCPCredit(uint8_t id, char *pPara);
+void at_queryCmdTCPCredit(uint8_t id);
+void at_setupCmdTCPAck(uint8_t id, char *pPara);
+void at_setupCmdTCPCoal(uint8_t id, char *pPara);
+void at_queryCmdTCPCoal(uint8_t id);
+void at_setupCmdTCPCork(uint8_t id, char *pPara);
+void at_queryCmdTCPCork(uint8_t id);
+void at_setupCmdTCPSpool(uint8_t id, char *pPara);
+void at_queryCmdTCPSpool(uint8_t id);
+void at_setupCmdTCPAsync(uint8_t id, char *pPara);
+void at_queryCmdTCPAsync(uint8_t id);
+void at_setupCmdTCPLimits(uint8_t id, char *pPara);
+void at_queryCmdTCPLimits(uint8_t id);
+void at_setupCmdTCPPool(uint8_t id, char *pPara);
+void at_queryCmdTCPPool(uint8_t id);
+void at_setupCmdDNSCache(uint8_t id, char *pPara);
+void at_queryCmdDNSCache(uint8_t id);
+void at_queryCmdLwipMem(uint8_t id);
+void at_exeCmdLwipMem(uint8_t id);
+void at_queryCmdNetStats(uint8_t id);
+void at_exeCmdNetStats(uint8_t id);
+void at_setupCmdUDPStart(uint8_t id, char *pPara);
+void at_queryCmdUDPStart(uint8_t id);
+void at_setupCmdUDPSend(uint8_t id, char *pPara);
+void at_setupCmdTCPFrame(uint8_t id, char *pPara);
+void at_queryCmdTCPFrame(uint8_t id);
 
 void at_setupCmdTCPSSLconfig(uint8_t id, char *pPara);
 void at_queryCmdTCPSSLconfig(uint8_t id);
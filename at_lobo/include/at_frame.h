@@ -0,0 +1,67 @@
+/*
+ * Binary framing of the host communication for ESP8266 AT firmware
+ * Copyright LoBo 2019
+*/
+
+/*
+ * Frame format (before SLIP encoding):
+ *
+ *   | link | type | length (LE) | payload ... | CRC16 (LE) |
+ *      1      1         2          length          2
+ *
+ * CRC16 is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) of all bytes before it.
+ * The frame is SLIP encoded (RFC 1055) and starts and ends with FRAME_END.
+*/
+
+#ifndef __AT_FRAME_H__
+#define __AT_FRAME_H__
+
+#include "c_types.h"
+
+// SLIP special characters
+#define FRAME_END               0xC0
+#define FRAME_ESC               0xDB
+#define FRAME_ESC_END           0xDC
+#define FRAME_ESC_ESC           0xDD
+
+#define FRAME_HEAD_SIZE         4
+#define FRAME_CRC_SIZE          2
+#define FRAME_MAX_PAYLOAD       1478    // UDP datagram: 6 byte address and 1472 data bytes
+#define FRAME_DGRAM_ADDR_SIZE   6       // remote IP and port (LE) at the start of the datagram frame
+
+// Frame types
+#define FRAME_TYPE_AT           0x00    // AT command (host), AT response (ESP8266); link FRAME_LINK_SYSTEM
+#define FRAME_TYPE_DATA         0x01    // link data
+#define FRAME_TYPE_ACK          0x02    // host: data processed; ESP8266: data sent, payload is the sequence number (LE)
+#define FRAME_TYPE_NAK          0x03    // host: send the data again; ESP8266: data not sent, payload is the sequence number (LE)
+#define FRAME_TYPE_ABORT        0x04    // host: discard the data and close the link
+#define FRAME_TYPE_EVENT        0x05    // ESP8266: link event (CONNECT, CLOSED, ...) as text
+#define FRAME_TYPE_CTRL         0x06    // host: framed mode control, payload is one of FRAME_CTRL_xxx
+#define FRAME_TYPE_DGRAM        0x07    // UDP link datagram, payload is the remote IP (4) and port (LE) followed by the data
+
+// Control frame commands
+#define FRAME_CTRL_EXIT         0x00    // leave the framed mode
+
+// Link ids
+// 0 ~ 14 are TCP and UDP links
+#define FRAME_LINK_SERVER       0x10    // + server id, TCP server events
+#define FRAME_LINK_SYSTEM       0xFF
+
+typedef void (*frame_handler_t)(uint8_t link, uint8_t type, uint8_t *data, uint16_t len);
+
+typedef struct {
+    uint32_t    rx_frames;
+    uint32_t    tx_frames;
+    uint32_t    rx_errors;
+} frame_stats_t;
+
+extern frame_stats_t frame_stats;
+
+uint16_t frame_crc16(uint16_t crc, const uint8_t *data, uint32_t len);
+bool frame_init(frame_handler_t handler);
+void frame_deinit(void);
+void frame_send(uint8_t link, uint8_t type, const uint8_t *data, uint16_t len);
+void frame_send_hdr(uint8_t link, uint8_t type, const uint8_t *hdr, uint16_t hlen, const uint8_t *data, uint16_t len);
+void frame_rx(const uint8_t *data, int32 len);
+
+#endif
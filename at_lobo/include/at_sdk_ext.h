@@ -0,0 +1,64 @@
+/*
+ * SDK library functions used by the AT firmware
+ * Copyright LoBo 2019
+*/
+
+/*
+ * The functions are exported by libat and by liblwip (built from third_party/lwip),
+ * but are not declared in the SDK headers.
+*/
+
+#ifndef __AT_SDK_EXT_H__
+#define __AT_SDK_EXT_H__
+
+#include "c_types.h"
+#include "ip_addr.h"
+#include "espconn.h"
+
+struct pbuf;
+
+// libat: UART TX buffer
+// with 'queue' set, data which do not fit into the buffer are queued and sent later
+void uart_tx_buff_enq(int8 link, const uint8 *data, uint16 len, bool queue);
+void uart_tx_buffer_set_size(uint16 size);
+uint16 uart_tx_buffer_get_size(void);
+void tx_start_uart_buffer(uint8 uart_no);
+void at_register_uart_tx_complete_func(void (*func)(void));
+
+// lwip/app/espconn_buf.c: ring buffer
+typedef struct ringbuf_t *ringbuf_t;
+ringbuf_t ringbuf_new(size_t capacity);
+void ringbuf_free(ringbuf_t *rb);
+size_t ringbuf_capacity(const struct ringbuf_t *rb);
+size_t ringbuf_bytes_free(const struct ringbuf_t *rb);
+size_t ringbuf_bytes_used(const struct ringbuf_t *rb);
+void *ringbuf_memcpy_into(ringbuf_t dst, const void *src, size_t count);
+void *ringbuf_memcpy_from(void *dst, ringbuf_t src, size_t count);
+
+// lwip/app/espconn.c, lwip/app/espconn_tcp.c
+uint16 espconn_tcp_get_mss(void);
+sint8 espconn_tcp_get_stats(struct espconn *pespconn, uint16 *srtt, uint16 *rto, uint16 *rexmits, uint16 *snd_wnd, uint16 *cwnd);
+// receive callback taking the pbuf chain, ESPCONN_MEM refuses the chain,
+// lwIP delivers the TCP data again, the UDP datagram is dropped
+typedef sint8 (* espconn_recv_pbuf_callback)(void *arg, struct pbuf *p, unsigned short len);
+sint8 espconn_regist_recv_pbufcb(struct espconn *pespconn, espconn_recv_pbuf_callback recv_cb);
+sint8 espconn_recv_pbuf_free(struct espconn *pespconn, struct pbuf *p);
+uint16 espconn_pbuf_payload(struct pbuf *p, void **payload, struct pbuf **next);
+
+// lwip/core/pbuf.c
+uint16 pbuf_copy_partial(struct pbuf *p, void *dataptr, uint16 len, uint16 offset);
+
+// lwip/core/dns.c: DNS cache
+uint8 dns_cache_setup(uint8 size, uint16 neg_ttl);
+uint8 dns_cache_get_setup(uint16 *neg_ttl);
+void dns_cache_get_stats(uint32 *hits, uint32 *neg_hits, uint32 *misses, uint32 *prefetches);
+const char *dns_cache_get_entry(uint8 i, ip_addr_t *addr, uint32 *ttl, uint16 *hits);
+
+// lwip/core/memp.c, lwip/core/stats.c: pool and protocol counters
+uint8 memp_get_stats(uint8 type, const char **desc, uint16 *size, uint16 *num, uint16 *used, uint16 *high, uint16 *fail);
+void memp_clear_stats(void);
+uint32 memp_get_fails(void);
+uint8 stats_get_counters(uint8 group, const char **name, uint32 *cnt, uint8 max);
+void stats_reset(void);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Flash spool of the link data for ESP8266 AT firmware
+ * Copyright LoBo 2019
+*/
+
+/*
+ * The spool is a log-structured ring in the spare flash (SPOOL_FLASH_ADDR, SPOOL_FLASH_SIZE).
+ * Each record holds the data of one link:
+ *
+ *   | magic | link | length (LE) | state (LE) | data ... |
+ *      1       1        2            4          length, padded to 4 bytes
+ *
+ * The records never cross the sector end, the rest of the sector is left erased.
+ * The state is 0xFFFFFFFF when the record is written and cleared to 0 when it is delivered,
+ * the sectors are erased again when the ring wraps.
+ * The positions are kept in RAM only, the spool is empty after a restart.
+*/
+
+#ifndef __AT_SPOOL_H__
+#define __AT_SPOOL_H__
+
+#include "c_types.h"
+
+#define SPOOL_MAGIC             0xA5
+#define SPOOL_HDR_SIZE          8
+#define SPOOL_RECORD_MAX        1536    // maximal data length of one record
+#define SPOOL_LINKS             16
+
+typedef struct {
+    uint32_t    records;        // records written
+    uint32_t    bytes;          // data bytes written
+    uint32_t    delivered;      // records delivered
+    uint32_t    discarded;      // records discarded
+    uint32_t    full;           // records refused, the spool was full
+    uint32_t    erases;         // sectors erased
+} spool_stats_t;
+
+extern spool_stats_t spool_stats;
+
+bool spool_init(void);
+uint32_t spool_size(void);
+uint32_t spool_used(void);
+uint32_t spool_free(void);
+bool spool_write(uint8_t link, const uint8_t *data, uint16_t len);
+uint16_t spool_next(uint8_t link);
+uint16_t spool_read(uint8_t link, uint8_t *buf, uint16_t size);
+uint16_t spool_commit(uint8_t link);
+void spool_rewind(uint8_t link);
+void spool_discard(uint8_t link);
+void spool_drop(uint8_t link, uint16_t count);
+uint16_t spool_records(uint8_t link);
+uint32_t spool_pending(uint8_t link);
+
+#endif
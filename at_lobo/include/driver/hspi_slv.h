@@ -0,0 +1,77 @@
+/*
+ * HSPI slave transport for ESP8266 AT firmware
+ * Copyright LoBo 2019
+*/
+
+/*
+ * The host is SPI master (mode 0, up to 20 MHz), ESP8266 HSPI pins:
+ *   GPIO12 MISO, GPIO13 MOSI, GPIO14 SCLK, GPIO15 CS
+ *
+ * Every transaction starts with 8-bit command and 8-bit address (ignored):
+ *   0x02 write packet: 32 data bytes, received in W0~W7
+ *   0x03 read packet:  32 data bytes, sent from W8~W15
+ *   0x04 read status:  32-bit status word, LSB first
+ *
+ * Packet: the first byte holds the payload length (bits 0~4, 0~31) and the packet
+ * sequence number (bits 5~7), followed by the payload.
+ * Read packets are preloaded, an empty packet (length 0) is read when no data are waiting.
+ * The host must ignore a read packet with the same sequence number as the previous one,
+ * it was read again before the next packet was loaded.
+ * The host increments the sequence number of each written packet, a write packet is dropped
+ * if the host writes when TX_READY is not set.
+*/
+
+#ifndef __HSPI_SLAVE_H__
+#define __HSPI_SLAVE_H__
+
+#include "c_types.h"
+
+#define HSPI_PACKET_SIZE        32
+#define HSPI_PAYLOAD_SIZE       (HSPI_PACKET_SIZE - 1)
+#define HSPI_HDR_LEN_MASK       0x1F
+#define HSPI_HDR_SEQ_S          5
+
+// 'to host' and 'from host' ring buffers, size must be power of 2
+#define HSPI_TO_HOST_BUF_SIZE   4096
+#define HSPI_FROM_HOST_BUF_SIZE 1024
+// data which do not fit into the 'to host' ring are queued in the heap up to this size
+// and moved into the ring as the host reads
+#define HSPI_TO_HOST_QUEUE_MAX  20480
+#define HSPI_TO_HOST_POLL_MS    2       // ms, queue check interval
+
+// Status word
+#define HSPI_STA_RX_READY       0x00000001  // data packet loaded, the host can read it
+#define HSPI_STA_TX_READY       0x00000002  // the host can write a packet
+#define HSPI_STA_WR_SEQ_S       2           // bits  2~4: sequence number of the last packet written by the host
+#define HSPI_STA_RD_SEQ_S       5           // bits  5~7: sequence number of the loaded read packet
+#define HSPI_STA_TX_FREE_S      8           // bits  8~15: number of packets the host can write
+#define HSPI_STA_LINK_RX_S      16          // bits 16~23: links with received data waiting for the host
+#define HSPI_STA_LINK_TX_S      24          // bits 24~31: links which can accept the host's data
+
+typedef struct {
+    uint32  to_host_bytes;
+    uint32  to_host_reads;      // number of data packets read by the host
+    uint32  to_host_dropped;    // bytes dropped, no free buffer space
+    uint32  from_host_bytes;
+    uint32  from_host_writes;   // number of packets written by the host
+    uint32  from_host_full;     // bytes dropped, written while TX_READY was not set
+    uint32  from_host_lost;     // write packets missing in the sequence
+    uint32  status_reads;
+} hspi_stats_t;
+
+// Returns the per-link status bits, RX links in bits 0~7, TX links in bits 8~15
+typedef uint16 (*hspi_link_status_cb_t)(void);
+typedef uint32 (*hspi_recv_data_callback_t)(uint8 *data, uint32 len);
+
+extern hspi_stats_t hspi_stats;
+
+void hspi_slave_init(void);
+int32 hspi_load_data(const uint8 *data, uint32 len);
+uint32 hspi_to_host_space(void);
+bool hspi_to_host_drained(void);
+bool hspi_register_recv_cb(hspi_recv_data_callback_t cb);
+void hspi_register_link_status_cb(hspi_link_status_cb_t cb);
+void hspi_update_status(void);
+void hspi_rx_buffer_fetch_cb(void);
+
+#endif
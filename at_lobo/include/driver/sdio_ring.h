@@ -0,0 +1,84 @@
+/*
+ * SDIO slave (SLC) DMA descriptor rings
+ * Copyright LoBo 2019
+*/
+
+/*
+ * The SLC DMA uses linked lists of descriptors, each pointing to one buffer.
+ * 'to host' ring (SLC RX):
+ *   the data are copied into the free buffers, all filled buffers are
+ *   linked into one chain and read by the host in one transfer
+ * 'from host' ring (SLC TX):
+ *   circular list of buffers owned by the DMA, the host can write the next
+ *   packet while the previous one is still processed
+ *
+ * The ring management does not access the hardware and can be built on the host
+ * with SDIO_SIM defined (see sim/sdio_sim.c)
+*/
+
+#ifndef __SDIO_RING_H__
+#define __SDIO_RING_H__
+
+#ifdef SDIO_SIM
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+typedef uint8_t uint8;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+typedef int32_t int32;
+#define ICACHE_FLASH_ATTR
+#define os_memcpy memcpy
+#define os_memset memset
+#else
+#include "c_types.h"
+#endif
+
+// SLC DMA descriptor
+struct sdio_queue
+{
+    uint32  blocksize:12;
+    uint32  datalen:12;
+    uint32  unused:5;
+    uint32  sub_sof:1;
+    uint32  eof:1;
+    uint32  owner:1;        // 1: DMA, 0: CPU
+
+    uint32  buf_ptr;
+    uint32  next_link_ptr;
+};
+
+#ifdef SDIO_SIM
+// 32-bit DMA addresses can not hold the host pointers, the indexes are stored instead
+#define SDIO_DESC_ADDR(r, n)    ((uint32)(n) + 1)
+#define SDIO_BUF_ADDR(r, n)     ((uint32)(n))
+#else
+#define SDIO_DESC_ADDR(r, n)    ((uint32)&(r)->desc[n])
+#define SDIO_BUF_ADDR(r, n)     ((uint32)((r)->buf + ((n) * (r)->size)))
+#endif
+
+typedef struct {
+    struct sdio_queue   *desc;
+    uint8               *buf;       // num * size bytes
+    uint16              size;       // buffer size of one descriptor, max 4095
+    uint16              offset;     // 'from host': processed bytes of the head buffer
+    uint8               num;        // number of descriptors
+    uint8               head;       // first used descriptor
+    uint8               count;      // 'to host': used descriptors
+    uint8               busy;       // 'to host': used descriptors owned by the DMA
+} sdio_ring_t;
+
+void sdio_ring_init(sdio_ring_t *r, struct sdio_queue *desc, uint8 *buf, uint8 num, uint16 size, bool from_host);
+
+// 'to host' ring
+uint32 sdio_ring_put(sdio_ring_t *r, const uint8 *data, uint32 len);
+uint32 sdio_ring_load(sdio_ring_t *r, uint8 max);
+void sdio_ring_load_done(sdio_ring_t *r);
+uint32 sdio_ring_space(sdio_ring_t *r);
+
+// 'from host' ring
+uint8 *sdio_ring_peek(sdio_ring_t *r, uint32 *len);
+bool sdio_ring_consume(sdio_ring_t *r, uint32 len);
+uint8 sdio_ring_dma_free(sdio_ring_t *r);
+
+#endif
@@ -25,18 +25,41 @@
 #ifndef __SDIO_SLAVE_H__
 #define __SDIO_SLAVE_H__
 #include "slc_register.h"
-#include "c_types.h"
+#include "c_types.h"
 #include "user_interface.h"
 
-//#define SDIO_DEBUG
-
 #define RX_AVAILIBLE 2
 #define TX_AVAILIBLE 1
 #define INIT_STAGE	 0
 
+// 'to host' buffers (SLC RX), all filled buffers are read by the host in one transfer
+#define SDIO_RX_BUF_NUM     4
+#define SDIO_RX_BUF_SIZE    2048
+// 'from host' buffers (SLC TX)
+#define SDIO_TX_BUF_NUM     3
+#define SDIO_TX_BUF_SIZE    2048
+// data which do not fit into the 'to host' buffers are queued in the heap up to this size
+// and moved into the buffers as the host reads them
+#define SDIO_TO_HOST_QUEUE_MAX  20480
+#define SDIO_TO_HOST_POLL_MS    2       // ms, queue check interval
+
+typedef struct {
+    uint32  to_host_bytes;
+    uint32  to_host_reads;      // number of host read transfers
+    uint32  to_host_dropped;    // bytes dropped, no free buffer
+    uint32  from_host_bytes;
+    uint32  from_host_writes;   // number of buffers written by the host
+    uint32  from_host_full;     // host write with no free buffer
+    uint32  errors;             // DMA descriptor errors
+} sdio_stats_t;
+
+extern sdio_stats_t sdio_stats;
+
 void sdio_slave_init(void);
 
 int32 sdio_load_data(const uint8* data,uint32 len);
+uint32 sdio_to_host_space(void);
+bool sdio_to_host_drained(void);
 typedef uint32 (*sdio_recv_data_callback_t)(uint8* data,uint32 len);
 
 bool sdio_register_recv_cb(sdio_recv_data_callback_t cb);
@@ -0,0 +1,37 @@
+/*
+ * Buffered, interrupt driven UART0 output for ESP8266 AT firmware
+ * Copyright LoBo 2019
+*/
+
+/*
+ * All output goes through the AT library's UART TX buffer,
+ * which is emptied into the TX FIFO from the TX-FIFO-empty interrupt.
+ * The data written with uart_tx_write() are sent in order with the AT responses.
+*/
+
+#ifndef __UART_TX_H__
+#define __UART_TX_H__
+
+#include "c_types.h"
+
+#define UART_TX_DONE_MAX        4       // max number of pending completion callbacks
+#define UART_TX_POLL_MS         2       // ms, UART output check interval while a callback is pending
+
+typedef void (*uart_tx_done_cb_t)(void *arg);
+
+typedef struct {
+    uint32_t    writes;
+    uint32_t    bytes;
+    uint32_t    done;       // reported completions
+} uart_tx_stats_t;
+
+extern uart_tx_stats_t uart_tx_stats;
+
+void uart_tx_init(void);
+uint16_t uart_tx_set_size(uint16_t size);
+uint16_t uart_tx_get_size(void);
+bool uart_tx_drained(void);
+void uart_tx_write(const uint8_t *data, uint16_t len);
+bool uart_tx_write_cb(const uint8_t *data, uint16_t len, uart_tx_done_cb_t cb, void *arg);
+
+#endif
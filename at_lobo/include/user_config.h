@@ -46,11 +46,17 @@
 #define CONFIG_ENABLE_IRAM_MEMORY                           1
 
 
-// ====================================
-// === Experimental, do not enable! ===
+// ===============================================================
+// Use the SDIO slave interface instead of UART0 for the host communication
+// AT commands, responses and data are exchanged through the SDIO DMA buffers,
+// see driver/sdio_slv.c and sim/sdio_sim.c
 #define AT_SDIO_ENABLE          0
-//#define SDIO_DEBUG
-// ====================================
+
+// Use the HSPI slave interface instead of UART0 for the host communication
+// 32-byte packets and a status word with per-link RX/TX bits, see include/driver/hspi_slv.h
+// UART0 stays available for the debug output, only one transport can be enabled
+#define AT_HSPI_ENABLE          0
+// ===============================================================
 
 
 /*
@@ -146,6 +152,33 @@
 
 #endif
 
+// Spare flash above the highest firmware slot, used to spool the data of the dropped links (AT+TCPSPOOL)
+// The firmware slots are at 0x1000 + n * 0x80000 (512+512) or 0x1000 + n * 0x100000 (1024+1024),
+// up to the end of the flash (AT+UPDATE, AT+BOOT). The content is not kept over a restart
+#define SYSTEM_PARTITION_SPOOL                              (SYSTEM_PARTITION_CUSTOMER_BEGIN + 2)
+
+#if (SPI_FLASH_SIZE_MAP_EX == 0) && (SPI_FLASH_SIZE_MAP == 3)
+// 2MB flash, 512+512 flash map, after the 4th firmware slot (0x181000)
+#define SPOOL_FLASH_ADDR                                    0x1FA000
+#define SPOOL_FLASH_SIZE                                    0x6000  // 6 sectors
+#elif (SPI_FLASH_SIZE_MAP_EX == 0) && (SPI_FLASH_SIZE_MAP == 4)
+// 4MB flash, 512+512 flash map, after the 8th firmware slot (0x381000)
+#define SPOOL_FLASH_ADDR                                    0x3FA000
+#define SPOOL_FLASH_SIZE                                    0x6000  // 6 sectors
+#elif (SPI_FLASH_SIZE_MAP_EX == 0) && (SPI_FLASH_SIZE_MAP == 5)
+// 2MB flash, 1024+1024 flash map, after the 2nd firmware slot (0x101000)
+#define SPOOL_FLASH_ADDR                                    (SYSTEM_PARTITION_OTA_2_ADDR + SYSTEM_PARTITION_OTA_SIZE)
+#define SPOOL_FLASH_SIZE                                    0xF000  // 15 sectors
+#elif (SPI_FLASH_SIZE_MAP_EX == 0) && (SPI_FLASH_SIZE_MAP == 6)
+// 4MB flash, 1024+1024 flash map, after the 4th firmware slot (0x301000)
+#define SPOOL_FLASH_ADDR                                    0x3F1000
+#define SPOOL_FLASH_SIZE                                    0xF000  // 15 sectors
+#else
+// no spare flash
+#define SPOOL_FLASH_ADDR                                    0
+#define SPOOL_FLASH_SIZE                                    0
+#endif
+
 // ==============================================================================================
 
 #endif
@@ -0,0 +1,335 @@
+/*
+ * Host test and benchmark of the lwIP checksum routines
+ * Copyright LoBo 2019
+ *
+ * Builds third_party/lwip/core/ipv4/inet_chksum.c four times, once for each
+ * LWIP_CHKSUM_ALGORITHM, and checks them against version #1 (byte-wise, RFC 1071):
+ *   v1:  16 bits at a time, byte loads
+ *   v2:  16 bits at a time, the lwIP default
+ *   v3:  32 bits at a time with carry checks
+ *   v4:  32 bits at a time, added as 16-bit halves, unrolled (the firmware)
+ * and the checksum-on-copy routines used by tcp_write() (LWIP_CHECKSUM_ON_COPY):
+ *   copy1: MEMCPY, then checksum (LWIP_CHKSUM_COPY_ALGORITHM 1, with v2)
+ *   copy2: copy and checksum in one pass (LWIP_CHKSUM_COPY_ALGORITHM 2, with v4)
+ *
+ * The random test covers all alignments of the source and destination, lengths
+ * of 0 to 0xffff bytes, all 0xff data (the largest sums) and pbuf chains with odd lengths
+ * (inet_chksum_pseudo()). The benchmark times the routines on the host, the LX106
+ * ratios differ: no carry flag, 1 cycle load-use stall and faults on unaligned loads.
+ *
+ * Build and run on Linux:
+ *   gcc -O2 -Wall -I../../third_party/include -o chksum_sim chksum_sim.c
+ *   ./chksum_sim [tests] [seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <endian.h>
+#include <arpa/inet.h>
+
+#define BUF_SIZE            0x10000 + 64
+#define GUARD               0xA5
+#define CHAIN_MAX           8
+#define REPEAT_NS           100e6   // each routine is timed for at least this time
+
+// lwIP environment of inet_chksum.c, the include guards skip lwip/opt.h, lwip/def.h and lwip/inet_chksum.h
+#define __LWIP_OPT_H__
+#define __LWIP_DEF_H__
+#define __LWIP_INET_CHKSUM_H__
+
+typedef uint8_t   u8_t;
+typedef uint16_t  u16_t;
+typedef uint32_t  u32_t;
+typedef uintptr_t mem_ptr_t;
+
+struct pbuf {
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+};
+
+typedef struct {
+    u32_t addr;
+} ip_addr_t;
+
+#define ICACHE_FLASH_ATTR
+#define X32_F                       "x"
+#define MEMCPY(dst,src,len)         memcpy(dst,src,len)
+#define LWIP_DEBUGF(debug, message)
+#define LWIP_ASSERT(message, assertion)
+#define ip4_addr_get_u32(src_ipaddr) ((src_ipaddr)->addr)
+#define SWAP_BYTES_IN_WORD(w)       (((w) & 0xff) << 8) | (((w) & 0xff00) >> 8)
+#define FOLD_U32T(u)                (((u) >> 16) + ((u) & 0x0000ffffUL))
+
+// every build of inet_chksum.c gets its own names, suffix SIM_V
+#define SIM_CAT2(a, b)              a##b
+#define SIM_CAT(a, b)               SIM_CAT2(a, b)
+#define lwip_standard_chksum        SIM_CAT(chksum, SIM_V)
+#define lwip_chksum_copy            SIM_CAT(chksum_copy, SIM_V)
+#define inet_chksum                 SIM_CAT(inet_chksum, SIM_V)
+#define inet_chksum_pbuf            SIM_CAT(inet_chksum_pbuf, SIM_V)
+#define inet_chksum_pseudo          SIM_CAT(inet_chksum_pseudo, SIM_V)
+#define inet_chksum_pseudo_partial  SIM_CAT(inet_chksum_pseudo_partial, SIM_V)
+
+#define INET_CHKSUM_C               "../../third_party/lwip/core/ipv4/inet_chksum.c"
+
+#define SIM_V                       _v1
+#define LWIP_CHKSUM_ALGORITHM       1
+#define LWIP_CHKSUM_COPY_ALGORITHM  0
+#include INET_CHKSUM_C
+#undef SIM_V
+#undef LWIP_CHKSUM
+#undef LWIP_CHKSUM_ALGORITHM
+#undef LWIP_CHKSUM_COPY_ALGORITHM
+
+#define SIM_V                       _v2
+#define LWIP_CHKSUM_ALGORITHM       2
+#define LWIP_CHKSUM_COPY_ALGORITHM  1
+#include INET_CHKSUM_C
+#undef SIM_V
+#undef LWIP_CHKSUM
+#undef LWIP_CHKSUM_ALGORITHM
+#undef LWIP_CHKSUM_COPY_ALGORITHM
+
+#define SIM_V                       _v3
+#define LWIP_CHKSUM_ALGORITHM       3
+#define LWIP_CHKSUM_COPY_ALGORITHM  0
+#include INET_CHKSUM_C
+#undef SIM_V
+#undef LWIP_CHKSUM
+#undef LWIP_CHKSUM_ALGORITHM
+#undef LWIP_CHKSUM_COPY_ALGORITHM
+
+#define SIM_V                       _v4
+#define LWIP_CHKSUM_ALGORITHM       4
+#define LWIP_CHKSUM_COPY_ALGORITHM  2
+#include INET_CHKSUM_C
+#undef SIM_V
+
+typedef u16_t (*chksum_fn_t)(void *dataptr, int len);
+typedef u16_t (*copy_fn_t)(void *dst, const void *src, u16_t len);
+
+// version #1 takes an u16_t length
+static u16_t chksum_v1_int(void *dataptr, int len)
+{
+    return chksum_v1(dataptr, (u16_t)len);
+}
+
+static const struct {
+    const char *name;
+    chksum_fn_t fn;
+} chksum_fns[] = {
+    { "v1", chksum_v1_int },
+    { "v2", chksum_v2 },
+    { "v3", chksum_v3 },
+    { "v4", chksum_v4 },
+};
+#define CHKSUM_FNS  (int)(sizeof(chksum_fns) / sizeof(chksum_fns[0]))
+
+static const struct {
+    const char *name;
+    copy_fn_t fn;
+} copy_fns[] = {
+    { "copy1", chksum_copy_v2 },
+    { "copy2", chksum_copy_v4 },
+};
+#define COPY_FNS    (int)(sizeof(copy_fns) / sizeof(copy_fns[0]))
+
+static u8_t *src_buf, *dst_buf;
+static volatile u16_t sink;     // keeps the timed calls
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static uint32_t rnd(void)
+{
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+// random length, mostly the TCP/IP sizes, some up to 0xffff
+static int rnd_len(void)
+{
+    uint32_t r = rnd() % 16;
+
+    if (r < 4) return rnd() % 64;
+    if (r < 14) return rnd() % 1461;
+    return rnd() % 0x10000;
+}
+
+static void fill(u8_t *buf, int len)
+{
+    int i, ones = ((rnd() % 8) == 0);
+
+    for (i=0; i<len; i++) buf[i] = (ones) ? 0xff : (u8_t)rnd();
+}
+
+//--------------------------------------------------------
+static int test_chksum(int src_off, int len, u32_t *errors)
+{
+    u16_t ref = chksum_v1(src_buf + src_off, len);
+    int f, fail = 0;
+
+    for (f=1; f<CHKSUM_FNS; f++) {
+        if (chksum_fns[f].fn(src_buf + src_off, len) != ref) {
+            if (errors[f]++ == 0) printf("%s: len %d, offset %d: %04x, expected %04x\n", chksum_fns[f].name,
+                   len, src_off, chksum_fns[f].fn(src_buf + src_off, len), ref);
+            fail = 1;
+        }
+    }
+    return fail;
+}
+
+//------------------------------------------------------------------------------
+static int test_copy(int src_off, int dst_off, int len, u32_t *errors)
+{
+    u16_t ref = chksum_v1(src_buf + src_off, len), sum;
+    int f, i, fail = 0, bad;
+
+    for (f=0; f<COPY_FNS; f++) {
+        memset(dst_buf, GUARD, len + 16);
+        sum = copy_fns[f].fn(dst_buf + dst_off, src_buf + src_off, len);
+        bad = (sum != ref) || (memcmp(dst_buf + dst_off, src_buf + src_off, len) != 0);
+        for (i=0; i<dst_off; i++) bad |= (dst_buf[i] != GUARD);
+        for (i=dst_off+len; i<dst_off+len+8; i++) bad |= (dst_buf[i] != GUARD);
+        if (bad) {
+            if (errors[f]++ == 0) printf("%s: len %d, src offset %d, dst offset %d: %04x, expected %04x\n",
+                   copy_fns[f].name, len, src_off, dst_off, sum, ref);
+            fail = 1;
+        }
+    }
+    return fail;
+}
+
+// pbuf chain with random lengths over the source buffer
+//---------------------------------------------------------------------------
+static int test_pseudo(int src_off, int len, u32_t *errors)
+{
+    struct pbuf chain[CHAIN_MAX];
+    ip_addr_t src = { rnd() }, dest = { rnd() };
+    int n = 0, pos = 0, left = len, seg, fail = 0;
+    u16_t ref, sum;
+
+    if (len == 0) return 0;
+    while ((left > 0) && (n < CHAIN_MAX)) {
+        seg = (n == CHAIN_MAX - 1) ? left : 1 + (int)(rnd() % left);
+        chain[n].payload = src_buf + src_off + pos;
+        chain[n].len = seg;
+        chain[n].next = NULL;
+        if (n > 0) chain[n-1].next = &chain[n];
+        pos += seg;
+        left -= seg;
+        n++;
+    }
+    ref = inet_chksum_pseudo_v1(&chain[0], &src, &dest, 6, len);
+    sum = inet_chksum_pseudo_v4(&chain[0], &src, &dest, 6, len);
+    if (sum != ref) {
+        if (errors[0]++ == 0) printf("pseudo v4: len %d, %d pbufs: %04x, expected %04x\n", len, n, sum, ref);
+        fail = 1;
+    }
+    return fail;
+}
+
+//------------------------------------------------------------
+static double bench_chksum(chksum_fn_t fn, int off, int len)
+{
+    double start = now_ns(), elapsed = 0;
+    uint32_t calls = 0, i;
+
+    while (elapsed < REPEAT_NS) {
+        for (i=0; i<1000; i++) sink = fn(src_buf + off, len);
+        calls += 1000;
+        elapsed = now_ns() - start;
+    }
+    return elapsed / calls;
+}
+
+//---------------------------------------------------------------------------
+static double bench_copy(copy_fn_t fn, int src_off, int dst_off, int len)
+{
+    double start = now_ns(), elapsed = 0;
+    uint32_t calls = 0, i;
+
+    while (elapsed < REPEAT_NS) {
+        for (i=0; i<1000; i++) sink = fn(dst_buf + dst_off, src_buf + src_off, len);
+        calls += 1000;
+        elapsed = now_ns() - start;
+    }
+    return elapsed / calls;
+}
+
+//================================
+int main(int argc, char **argv)
+{
+    static const int lens[] = { 20, 64, 536, 1460 };
+    u32_t errors_sum[CHKSUM_FNS] = { 0 }, errors_copy[COPY_FNS] = { 0 }, errors_pseudo[1] = { 0 };
+    uint32_t tests = 200000, t, fails = 0;
+    unsigned int seed = 1;
+    int f, l, len, src_off, dst_off;
+    double ns;
+
+    if (argc > 1) tests = strtoul(argv[1], NULL, 0);
+    if (argc > 2) seed = strtoul(argv[2], NULL, 0);
+    srand(seed);
+
+    // 8 byte aligned buffers, the offsets set the alignment
+    src_buf = aligned_alloc(8, BUF_SIZE);
+    dst_buf = aligned_alloc(8, BUF_SIZE);
+    if ((src_buf == NULL) || (dst_buf == NULL)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    printf("random test, %u tests, seed %u\n", tests, seed);
+    for (t=0; t<tests; t++) {
+        len = rnd_len();
+        src_off = rnd() % 8;
+        dst_off = rnd() % 8;
+        fill(src_buf + src_off, len);
+        fails += test_chksum(src_off, len, errors_sum);
+        fails += test_copy(src_off, dst_off, len, errors_copy);
+        fails += test_pseudo(src_off, len, errors_pseudo);
+    }
+    for (f=1; f<CHKSUM_FNS; f++) printf("  %-6s %u errors\n", chksum_fns[f].name, errors_sum[f]);
+    for (f=0; f<COPY_FNS; f++) printf("  %-6s %u errors\n", copy_fns[f].name, errors_copy[f]);
+    printf("  %-6s %u errors\n", "pseudo", errors_pseudo[0]);
+
+    fill(src_buf, BUF_SIZE);
+    printf("\nchecksum, ns/call (aligned / odd address)\n%-8s", "len");
+    for (f=0; f<CHKSUM_FNS; f++) printf(" %15s", chksum_fns[f].name);
+    printf("\n");
+    for (l=0; l<(int)(sizeof(lens) / sizeof(lens[0])); l++) {
+        printf("%-8d", lens[l]);
+        for (f=0; f<CHKSUM_FNS; f++) {
+            ns = bench_chksum(chksum_fns[f].fn, 0, lens[l]);
+            printf(" %7.1f /", ns);
+            printf("%6.1f", bench_chksum(chksum_fns[f].fn, 1, lens[l]));
+        }
+        printf("\n");
+    }
+
+    printf("\ncopy and checksum, ns/call (src aligned / src unaligned, dst aligned)\n%-8s", "len");
+    for (f=0; f<COPY_FNS; f++) printf(" %15s", copy_fns[f].name);
+    printf("\n");
+    for (l=0; l<(int)(sizeof(lens) / sizeof(lens[0])); l++) {
+        printf("%-8d", lens[l]);
+        for (f=0; f<COPY_FNS; f++) {
+            ns = bench_copy(copy_fns[f].fn, 0, 0, lens[l]);
+            printf(" %7.1f /", ns);
+            printf("%6.1f", bench_copy(copy_fns[f].fn, 3, 0, lens[l]));
+        }
+        printf("\n");
+    }
+
+    free(src_buf);
+    free(dst_buf);
+    return (fails) ? 1 : 0;
+}
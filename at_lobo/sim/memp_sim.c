@@ -0,0 +1,635 @@
+/*
+ * Host benchmark of the lwIP memp allocators
+ * Copyright LoBo 2019
+ *
+ * Replays a memp allocation trace against the two allocators of the lwIP build:
+ *   heap:  MEMP_MEM_MALLOC, every pool element is allocated from the heap
+ *   pools: LWIP_MEMP_FIXED_POOLS, fixed-size free lists in .bss, the rest of the RAM is the heap
+ * The heap is modeled as a first-fit free list with coalescing (as the SDK heap),
+ * both allocators get the same amount of RAM.
+ * Reports the time per operation, the free list walk, the failed allocations,
+ * the fragmentation of the heap and prints the memp_profile.h for the trace.
+ *
+ * The trace is the log of a firmware built with MEMP_TRACE=1 (lwipopts.h), one operation per line:
+ *   memp:a <pool> <address>     memp_malloc(), address 0 if it failed
+ *   memp:f <pool> <address>     memp_free()
+ * Other heap allocations can be added to the trace:
+ *   memp:m <size> <id>          mem_malloc()
+ *   memp:x <id>                 mem_free()
+ * The lines of AT+LWIPMEM? in the log set the element sizes and the numbers of the pools:
+ *   +LWIPMEM:"<pool>",<size>,<num>,...
+ * All other lines are ignored. Without a trace an AT firmware workload is generated.
+ *
+ * Build and run on Linux:
+ *   gcc -O2 -Wall -o memp_sim memp_sim.c
+ *   ./memp_sim [ops] [seed]          synthetic workload
+ *   ./memp_sim trace.log             replay the trace
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define RAM_SIZE            40960   // free heap of the AT firmware with the Wi-Fi connected
+#define HEAP_HDR            8       // block header of the heap
+#define HEAP_ALIGN          8
+#define HEAP_SPLIT_MIN      16      // smaller rest of a free block is not split off
+#define HEAP_BLOCKS_MAX     4096
+
+#define POOL_MAX            16
+#define POOL_HEAP           0xFF    // 'pool' of the mem_malloc() operations
+#define PROFILE_ELEM_MAX    512     // larger pool elements are left on the heap in the printed profile
+
+#define OP_ALLOC            0
+#define OP_FREE             1
+
+#define SYN_LINKS           8       // synthetic workload: TCP links
+#define SYN_SEND_QUEUE      8       // segments sent and not acknowledged per link (TCP_SND_QUEUELEN)
+#define SYN_SEND_BUF        2920    // bytes sent and not acknowledged per link (TCP_SND_BUF)
+#define SYN_MSS             1460
+#define REPEAT_NS           200e6   // each allocator is timed for at least this time
+
+typedef struct {
+    char name[24];
+    const char *macro;              // memp_profile.h define
+    uint32_t size;
+    uint32_t num;                   // fixed pool elements, 0: heap
+} pool_def_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t pool;
+    uint32_t slot;                  // index of the allocated object
+    uint32_t size;                  // mem_malloc() size
+} trace_op_t;
+
+typedef struct {
+    uint32_t off;
+    uint32_t size;
+    int next;
+} heap_blk_t;
+
+typedef struct {
+    heap_blk_t blk[HEAP_BLOCKS_MAX];
+    int free_head;                  // free blocks, sorted by offset
+    int spare;                      // unused block descriptors
+    uint32_t size;
+    uint32_t free_bytes;
+    uint32_t min_free;
+    uint64_t walk;                  // free blocks visited
+    uint32_t max_walk;
+} heap_t;
+
+typedef struct {
+    uint32_t *next;                 // free list of the elements
+    int head;
+    uint32_t used;
+} pool_t;
+
+typedef struct {
+    uint8_t where;                  // 0: not allocated, 1: pool, 2: heap
+    uint32_t addr;
+    uint32_t size;
+} slot_t;
+
+typedef struct {
+    uint64_t ops;
+    uint64_t fails;
+    uint32_t pool_bytes;
+    uint32_t heap_size;
+    uint32_t min_free;
+    uint32_t min_largest;
+    double max_frag;
+    double end_frag;
+    double mean_walk;
+    uint32_t max_walk;
+    double ns_op;
+    uint32_t high[POOL_MAX];
+    uint32_t fail[POOL_MAX];
+} sim_result_t;
+
+// Pools of memp_std.h in the AT firmware, the sizes are approximate,
+// AT+LWIPMEM? reports the sizes of the actual build
+static pool_def_t pools[POOL_MAX] = {
+    {"RAW_PCB",         "MEMP_NUM_RAW_PCB",         32,   4},
+    {"UDP_PCB",         "MEMP_NUM_UDP_PCB",         32,   8},
+    {"TCP_PCB",         "MEMP_NUM_TCP_PCB_POOL",    172,  16},
+    {"TCP_PCB_LISTEN",  "MEMP_NUM_TCP_PCB_LISTEN",  28,   8},
+    {"TCP_SEG",         "MEMP_NUM_TCP_SEG",         20,   64},
+    {"ARP_QUEUE",       "MEMP_NUM_ARP_QUEUE",       8,    10},
+    {"IGMP_GROUP",      "MEMP_NUM_IGMP_GROUP",      16,   8},
+    {"SYS_TIMEOUT",     "MEMP_NUM_SYS_TIMEOUT",     16,   8},
+    {"PBUF_REF/ROM",    "MEMP_NUM_PBUF",            20,   32},
+    {"PBUF_POOL",       "MEMP_NUM_PBUF_POOL",       1536, 0},
+};
+static int pool_count = 10;
+
+static trace_op_t *trace;
+static uint32_t trace_len, trace_size;
+static uint32_t slot_count;
+static slot_t *slots;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//==== Heap model ========================================================
+
+static void heap_init(heap_t *h, uint32_t size)
+{
+    int i;
+
+    for (i=1; i<HEAP_BLOCKS_MAX-1; i++) h->blk[i].next = i + 1;
+    h->blk[HEAP_BLOCKS_MAX-1].next = -1;
+    h->spare = 1;
+    h->blk[0].off = 0;
+    h->blk[0].size = size;
+    h->blk[0].next = -1;
+    h->free_head = 0;
+    h->size = size;
+    h->free_bytes = size;
+    h->min_free = size;
+    h->walk = 0;
+    h->max_walk = 0;
+}
+
+// First fit, returns the block size in '*bsize' or 0 if there is no free block large enough
+static uint32_t heap_alloc(heap_t *h, uint32_t size, uint32_t *bsize)
+{
+    uint32_t need = (size + HEAP_HDR + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+    uint32_t walk = 0, off;
+    int prev = -1, b = h->free_head;
+
+    while (b >= 0) {
+        walk++;
+        if (h->blk[b].size >= need) break;
+        prev = b;
+        b = h->blk[b].next;
+    }
+    h->walk += walk;
+    if (walk > h->max_walk) h->max_walk = walk;
+    if (b < 0) return 0;
+
+    off = h->blk[b].off;
+    if ((h->blk[b].size - need) >= HEAP_SPLIT_MIN) {
+        h->blk[b].off += need;
+        h->blk[b].size -= need;
+    }
+    else {
+        need = h->blk[b].size;
+        if (prev < 0) h->free_head = h->blk[b].next;
+        else h->blk[prev].next = h->blk[b].next;
+        h->blk[b].next = h->spare;
+        h->spare = b;
+    }
+    h->free_bytes -= need;
+    if (h->free_bytes < h->min_free) h->min_free = h->free_bytes;
+    *bsize = need;
+    return off + 1;
+}
+
+// Insert the block in the address ordered free list and merge it with its neighbours
+static void heap_free(heap_t *h, uint32_t addr, uint32_t bsize)
+{
+    uint32_t off = addr - 1, walk = 0;
+    int prev = -1, b = h->free_head, n;
+
+    while ((b >= 0) && (h->blk[b].off < off)) {
+        walk++;
+        prev = b;
+        b = h->blk[b].next;
+    }
+    h->walk += walk;
+    if (walk > h->max_walk) h->max_walk = walk;
+    h->free_bytes += bsize;
+
+    if ((prev >= 0) && ((h->blk[prev].off + h->blk[prev].size) == off)) {
+        h->blk[prev].size += bsize;
+        n = prev;
+    }
+    else {
+        n = h->spare;
+        if (n < 0) {
+            fprintf(stderr, "heap model: out of block descriptors\n");
+            exit(1);
+        }
+        h->spare = h->blk[n].next;
+        h->blk[n].off = off;
+        h->blk[n].size = bsize;
+        h->blk[n].next = b;
+        if (prev < 0) h->free_head = n;
+        else h->blk[prev].next = n;
+    }
+    if ((b >= 0) && ((h->blk[n].off + h->blk[n].size) == h->blk[b].off)) {
+        h->blk[n].size += h->blk[b].size;
+        h->blk[n].next = h->blk[b].next;
+        h->blk[b].next = h->spare;
+        h->spare = b;
+    }
+}
+
+static uint32_t heap_largest(heap_t *h)
+{
+    uint32_t largest = 0;
+    int b;
+
+    for (b=h->free_head; b>=0; b=h->blk[b].next) {
+        if (h->blk[b].size > largest) largest = h->blk[b].size;
+    }
+    return largest;
+}
+
+//==== Trace ==============================================================
+
+static void trace_add(uint8_t op, uint8_t pool, uint32_t slot, uint32_t size)
+{
+    if (trace_len == trace_size) {
+        trace_size = (trace_size) ? trace_size * 2 : 65536;
+        trace = realloc(trace, trace_size * sizeof(trace_op_t));
+        if (trace == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    trace[trace_len].op = op;
+    trace[trace_len].pool = pool;
+    trace[trace_len].slot = slot;
+    trace[trace_len].size = size;
+    trace_len++;
+}
+
+static uint8_t pool_find(const char *name)
+{
+    int i;
+
+    for (i=0; i<pool_count; i++) {
+        if (strcmp(pools[i].name, name) == 0) return i;
+    }
+    if (pool_count == POOL_MAX) {
+        fprintf(stderr, "too many pools\n");
+        exit(1);
+    }
+    // pool not known, on the heap until its size is set by the +LWIPMEM line
+    snprintf(pools[pool_count].name, sizeof(pools[pool_count].name), "%s", name);
+    pools[pool_count].macro = NULL;
+    pools[pool_count].size = 32;
+    pools[pool_count].num = 0;
+    return pool_count++;
+}
+
+// Object ids of the trace (addresses) to slots, open addressing
+#define ID_HASH_SIZE        65536
+
+static uint64_t id_key[ID_HASH_SIZE];
+static uint32_t id_slot[ID_HASH_SIZE];
+
+static uint32_t *id_lookup(uint32_t kind, uint32_t id)
+{
+    uint64_t key = ((uint64_t)kind << 32) | id;
+    uint32_t h = (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 48);
+
+    while ((id_key[h] != 0) && (id_key[h] != key + 1)) h = (h + 1) & (ID_HASH_SIZE - 1);
+    if (id_key[h] == 0) {
+        id_key[h] = key + 1;
+        id_slot[h] = 0;
+    }
+    return &id_slot[h];     // 0: not allocated, else slot + 1
+}
+
+static int trace_read(const char *fname)
+{
+    FILE *f = fopen(fname, "r");
+    char line[256], name[64], op;
+    const char *p;
+    uint32_t size, num, id, *s;
+    uint8_t pool;
+
+    if (f == NULL) {
+        perror(fname);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if ((p = strstr(line, "+LWIPMEM:\"")) != NULL) {
+            if (sscanf(p + 10, "%63[^\"]\",%u,%u", name, &size, &num) == 3) {
+                pool = pool_find(name);
+                pools[pool].size = size;
+                if (num) pools[pool].num = num;
+            }
+            continue;
+        }
+        if ((p = strstr(line, "memp:")) == NULL) continue;
+        p += 5;
+        op = *p++;
+        if ((op == 'a') || (op == 'f')) {
+            if (sscanf(p, " %63s %x", name, &id) != 2) continue;
+            pool = pool_find(name);
+            s = id_lookup(pool, id);
+            if (op == 'a') {
+                if (id == 0) continue;  // failed on the device
+                *s = ++slot_count;
+                trace_add(OP_ALLOC, pool, *s - 1, 0);
+            }
+            else if (*s) {
+                trace_add(OP_FREE, pool, *s - 1, 0);
+                *s = 0;
+            }
+        }
+        else if (op == 'm') {
+            if (sscanf(p, " %u %x", &size, &id) != 2) continue;
+            s = id_lookup(POOL_HEAP, id);
+            *s = ++slot_count;
+            trace_add(OP_ALLOC, POOL_HEAP, *s - 1, size);
+        }
+        else if (op == 'x') {
+            if (sscanf(p, " %x", &id) != 1) continue;
+            s = id_lookup(POOL_HEAP, id);
+            if (*s) {
+                trace_add(OP_FREE, POOL_HEAP, *s - 1, 0);
+                *s = 0;
+            }
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+//==== Synthetic AT firmware workload ======================================
+
+#define SYN_OBJ_MAX         64
+
+typedef struct {
+    uint32_t obj[SYN_OBJ_MAX];
+    uint32_t size[SYN_OBJ_MAX];
+    uint8_t pool[SYN_OBJ_MAX];
+    uint32_t bytes;
+    int n;
+} syn_list_t;
+
+static uint8_t P_UDP_PCB, P_TCP_PCB, P_TCP_SEG, P_SYS_TIMEOUT, P_PBUF;
+
+static uint32_t syn_alloc(uint8_t pool, uint32_t size)
+{
+    uint32_t slot = slot_count++;
+    trace_add(OP_ALLOC, pool, slot, size);
+    return slot;
+}
+
+static void syn_push(syn_list_t *l, uint8_t pool, uint32_t size)
+{
+    l->pool[l->n] = pool;
+    l->size[l->n] = size;
+    l->bytes += size;
+    l->obj[l->n++] = syn_alloc(pool, size);
+}
+
+// Free the oldest object of the list
+static void syn_pop(syn_list_t *l)
+{
+    trace_add(OP_FREE, l->pool[0], l->obj[0], 0);
+    l->bytes -= l->size[0];
+    memmove(&l->obj[0], &l->obj[1], (l->n - 1) * sizeof(uint32_t));
+    memmove(&l->size[0], &l->size[1], (l->n - 1) * sizeof(uint32_t));
+    memmove(&l->pool[0], &l->pool[1], l->n - 1);
+    l->n--;
+}
+
+// TCP links connect, send and receive data of random sizes and close,
+// with the AT buffers, DNS lookups and timers in between.
+// The data pbufs (PBUF_RAM) are allocated from the heap with both allocators.
+static void trace_generate(uint32_t ops, unsigned int seed)
+{
+    syn_list_t links[SYN_LINKS], sent[SYN_LINKS], at_bufs, timers;
+    uint32_t pcb[SYN_LINKS];
+    uint32_t len;
+    int i, n;
+
+    P_UDP_PCB = pool_find("UDP_PCB");
+    P_TCP_PCB = pool_find("TCP_PCB");
+    P_TCP_SEG = pool_find("TCP_SEG");
+    P_SYS_TIMEOUT = pool_find("SYS_TIMEOUT");
+    P_PBUF = pool_find("PBUF_REF/ROM");
+
+    srand(seed);
+    memset(links, 0, sizeof(links));
+    memset(sent, 0, sizeof(sent));
+    memset(&at_bufs, 0, sizeof(at_bufs));
+    memset(&timers, 0, sizeof(timers));
+    for (i=0; i<SYN_LINKS; i++) pcb[i] = UINT32_MAX;
+
+    while (trace_len < ops) {
+        i = rand() % SYN_LINKS;
+        n = rand() % 100;
+        if (pcb[i] == UINT32_MAX) {
+            // connect, DNS lookup and the link's AT buffers
+            syn_push(&timers, P_UDP_PCB, 0);
+            pcb[i] = syn_alloc(P_TCP_PCB, 0);
+            syn_push(&links[i], POOL_HEAP, 128 + (rand() % 256));
+            syn_pop(&timers);
+        }
+        else if (n < 40) {
+            // AT+TCPSEND, the data is copied into a PBUF_RAM and queued in a segment,
+            // the host waits while the send buffer is full
+            len = 1 + (rand() % SYN_MSS);
+            if ((sent[i].n >= 2 * SYN_SEND_QUEUE) || ((sent[i].bytes + len) > SYN_SEND_BUF)) continue;
+            syn_push(&sent[i], POOL_HEAP, len);
+            syn_push(&sent[i], P_TCP_SEG, 0);
+        }
+        else if (n < 60) {
+            // acknowledgement
+            if (sent[i].n) {
+                syn_pop(&sent[i]);
+                syn_pop(&sent[i]);
+            }
+        }
+        else if (n < 85) {
+            // received segment: WLAN pbuf, copied into the link's receive buffer
+            len = 1 + (rand() % SYN_MSS);
+            syn_push(&at_bufs, P_PBUF, 0);
+            syn_push(&at_bufs, POOL_HEAP, len);
+            syn_pop(&at_bufs);
+            if (at_bufs.n > 16) syn_pop(&at_bufs);
+        }
+        else if (n < 97) {
+            // timers
+            syn_push(&timers, P_SYS_TIMEOUT, 0);
+            if (timers.n > 6) syn_pop(&timers);
+        }
+        else {
+            // close
+            while (sent[i].n) syn_pop(&sent[i]);
+            while (links[i].n) syn_pop(&links[i]);
+            trace_add(OP_FREE, P_TCP_PCB, pcb[i], 0);
+            pcb[i] = UINT32_MAX;
+        }
+    }
+}
+
+//==== Replay =============================================================
+
+static void replay(int fixed, sim_result_t *res, int timed)
+{
+    static heap_t heap;
+    static pool_t pool[POOL_MAX];
+    uint32_t pool_bytes = 0, used[POOL_MAX] = {0}, largest, i, p, bsize, addr, sample = 0;
+    double frag;
+    trace_op_t *op;
+    slot_t *s;
+
+    for (p=0; p<(uint32_t)pool_count; p++) {
+        pool[p].head = -1;
+        pool[p].used = 0;
+        if ((!fixed) || (pools[p].num == 0)) continue;
+        pool_bytes += pools[p].num * pools[p].size;
+        pool[p].next = realloc(pool[p].next, pools[p].num * sizeof(uint32_t));
+        for (i=0; i<pools[p].num; i++) {
+            pool[p].next[i] = pool[p].head;
+            pool[p].head = i;
+        }
+    }
+    memset(res, 0, sizeof(sim_result_t));
+    if (pool_bytes >= RAM_SIZE) {
+        fprintf(stderr, "pools (%u bytes) larger than the RAM\n", pool_bytes);
+        exit(1);
+    }
+    heap_init(&heap, RAM_SIZE - pool_bytes);
+    memset(slots, 0, slot_count * sizeof(slot_t));
+    res->pool_bytes = pool_bytes;
+    res->heap_size = RAM_SIZE - pool_bytes;
+    res->min_largest = heap.size;
+
+    for (op=trace; op<trace+trace_len; op++) {
+        s = &slots[op->slot];
+        p = op->pool;
+        if (op->op == OP_ALLOC) {
+            if ((p != POOL_HEAP) && fixed && pools[p].num) {
+                if (pool[p].head < 0) {
+                    if (!timed) res->fail[p]++;
+                    res->fails++;
+                    continue;
+                }
+                s->addr = pool[p].head;
+                pool[p].head = pool[p].next[s->addr];
+                s->where = 1;
+            }
+            else {
+                addr = heap_alloc(&heap, (p == POOL_HEAP) ? op->size : pools[p].size, &bsize);
+                if (addr == 0) {
+                    if ((!timed) && (p != POOL_HEAP)) res->fail[p]++;
+                    res->fails++;
+                    continue;
+                }
+                s->addr = addr;
+                s->size = bsize;
+                s->where = 2;
+            }
+            if ((!timed) && (p != POOL_HEAP) && (++used[p] > res->high[p])) res->high[p] = used[p];
+        }
+        else {
+            if (s->where == 1) {
+                pool[p].next[s->addr] = pool[p].head;
+                pool[p].head = s->addr;
+            }
+            else if (s->where == 2) heap_free(&heap, s->addr, s->size);
+            else continue;  // the allocation failed
+            s->where = 0;
+            if ((!timed) && (p != POOL_HEAP)) used[p]--;
+        }
+        res->ops++;
+        if ((!timed) && (++sample >= 64)) {
+            // fragmentation: part of the free heap not usable for the largest allocation
+            sample = 0;
+            largest = heap_largest(&heap);
+            if (largest < res->min_largest) res->min_largest = largest;
+            frag = (heap.free_bytes) ? 1.0 - (double)largest / heap.free_bytes : 0;
+            if (frag > res->max_frag) res->max_frag = frag;
+        }
+    }
+    largest = heap_largest(&heap);
+    res->end_frag = (heap.free_bytes) ? 1.0 - (double)largest / heap.free_bytes : 0;
+    res->min_free = heap.min_free;
+    res->mean_walk = (res->ops) ? (double)heap.walk / res->ops : 0;
+    res->max_walk = heap.max_walk;
+}
+
+static void sim_run(int fixed, sim_result_t *res)
+{
+    sim_result_t t;
+    double t0, elapsed = 0;
+    uint64_t ops = 0;
+
+    replay(fixed, res, 0);
+    while (elapsed < REPEAT_NS) {
+        t0 = now_ns();
+        replay(fixed, &t, 1);
+        elapsed += now_ns() - t0;
+        ops += t.ops;
+    }
+    res->ns_op = elapsed / ops;
+}
+
+int main(int argc, char **argv)
+{
+    sim_result_t res[2];
+    uint32_t ops = 200000, high;
+    unsigned int seed = 1;
+    char *end = NULL;
+    int p;
+
+    if (argc > 1) ops = strtoul(argv[1], &end, 0);
+    if ((argc > 1) && (*end != '\0')) {
+        if (trace_read(argv[1]) < 0) return 1;
+        printf("trace '%s', %u operations\n", argv[1], trace_len);
+    }
+    else {
+        if (argc > 2) seed = strtoul(argv[2], NULL, 0);
+        trace_generate(ops, seed);
+        printf("synthetic workload, %d links, %u operations, seed %u\n", SYN_LINKS, trace_len, seed);
+    }
+    if (trace_len == 0) {
+        fprintf(stderr, "no operations\n");
+        return 1;
+    }
+    slots = calloc(slot_count, sizeof(slot_t));
+    if (slots == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    sim_run(0, &res[0]);
+    sim_run(1, &res[1]);
+
+    printf("RAM %d bytes, heap block header %d bytes, %d bytes aligned\n\n", RAM_SIZE, HEAP_HDR, HEAP_ALIGN);
+    printf("%-26s %12s %12s\n", "", "heap", "pools");
+    printf("%-26s %12u %12u\n", "pool bytes (.bss)", res[0].pool_bytes, res[1].pool_bytes);
+    printf("%-26s %12u %12u\n", "heap bytes", res[0].heap_size, res[1].heap_size);
+    printf("%-26s %12.1f %12.1f\n", "ns/operation", res[0].ns_op, res[1].ns_op);
+    printf("%-26s %12.2f %12.2f\n", "free list walk, mean", res[0].mean_walk, res[1].mean_walk);
+    printf("%-26s %12u %12u\n", "free list walk, max", res[0].max_walk, res[1].max_walk);
+    printf("%-26s %12llu %12llu\n", "failed allocations", (unsigned long long)res[0].fails, (unsigned long long)res[1].fails);
+    printf("%-26s %12u %12u\n", "minimal free heap", res[0].min_free, res[1].min_free);
+    printf("%-26s %12u %12u\n", "minimal largest block", res[0].min_largest, res[1].min_largest);
+    printf("%-26s %12.2f %12.2f\n", "fragmentation, max", res[0].max_frag, res[1].max_frag);
+    printf("%-26s %12.2f %12.2f\n", "fragmentation, end", res[0].end_frag, res[1].end_frag);
+
+    printf("\n%-16s %6s %6s %6s %10s %10s\n", "pool", "size", "num", "high", "fail heap", "fail pools");
+    for (p=0; p<pool_count; p++) {
+        printf("%-16s %6u %6u %6u %10u %10u\n", pools[p].name, pools[p].size, pools[p].num,
+               res[0].high[p], res[0].fail[p], res[1].fail[p]);
+    }
+
+    // high-water mark with the heap allocator and a 25% margin
+    printf("\n// memp_profile.h for this trace\n");
+    for (p=0; p<pool_count; p++) {
+        if (pools[p].macro == NULL) continue;
+        high = res[0].high[p];
+        if (high) high += 1 + high / 4;
+        if (pools[p].size > PROFILE_ELEM_MAX) high = 0;
+        printf("#define %-31s %u\n", pools[p].macro, high);
+    }
+    return 0;
+}
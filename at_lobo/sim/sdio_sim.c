@@ -0,0 +1,228 @@
+/*
+ * Host simulation of the SDIO slave (SLC) descriptor rings
+ * Copyright LoBo 2019
+ *
+ * Uses the firmware's ring management (driver/sdio_ring.c) with a model of the
+ * SLC DMA and of the host driver to test the buffer management and to compare
+ * the throughput of the single buffer and the descriptor chain transfers.
+ *
+ * Build and run on Linux:
+ *   gcc -O2 -Wall -DSDIO_SIM -I../include -o sdio_sim sdio_sim.c ../driver/sdio_ring.c
+ *   ./sdio_sim [total_bytes] [seed]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "driver/sdio_ring.h"
+
+#define RX_BUF_SIZE         2048    // 'to host', as SDIO_RX_BUF_SIZE
+#define RX_BUF_MAX          16
+#define TX_BUF_NUM          3       // 'from host', as SDIO_TX_BUF_NUM
+#define TX_BUF_SIZE         2048
+#define FLOW_SPACE_MIN      1536    // as SDIO_FLOW_SPACE_MIN
+#define SEGMENT_MAX         1460
+#define AT_RXBUF_SIZE       1024    // AT library receive buffer model
+
+// Host transfer timing model
+#define BUS_BYTES_PER_US    12.5    // 4-bit SDIO bus at 25 MHz
+#define XFER_OVERHEAD_US    50.0    // interrupt, status read (CMD52) and transfer setup (CMD53)
+#define ISR_LATENCY_US      10.0    // firmware interrupt latency
+
+typedef struct {
+    uint32 reads;
+    uint32 descs;
+    uint64_t bytes;
+    uint64_t errors;
+    double time_us;
+    double ring_ns;
+} sim_result_t;
+
+static uint8 pattern(uint64_t n)
+{
+    return (uint8)(n + (n >> 8) + (n >> 16));
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// DMA reads the loaded chain, starting at descriptor 'first'
+//---------------------------------------------------------------------------------------
+static uint32 dma_read_chain(sdio_ring_t *r, uint32 first, uint8 *out, uint32 *ndesc, int *err)
+{
+    uint32 addr = SDIO_DESC_ADDR(r, first), len = 0;
+    struct sdio_queue *d;
+
+    *ndesc = 0;
+    while (addr) {
+        d = &r->desc[addr - 1];
+        if (!d->owner) {
+            // CPU owned descriptor in the chain
+            (*err)++;
+            break;
+        }
+        memcpy(out + len, r->buf + (d->buf_ptr * r->size), d->datalen);
+        len += d->datalen;
+        (*ndesc)++;
+        if (d->eof) break;
+        addr = d->next_link_ptr;
+    }
+    return len;
+}
+
+// DMA writes the host data into the next descriptor
+// Returns the number of bytes written, 0 if the descriptor is owned by the CPU
+//----------------------------------------------------------------------------------
+static uint32 dma_write(sdio_ring_t *r, uint32 *dma_addr, const uint8 *data, uint32 len)
+{
+    struct sdio_queue *d = &r->desc[*dma_addr - 1];
+
+    if (!d->owner) return 0;
+    if (len > d->blocksize) len = d->blocksize;
+    memcpy(r->buf + (d->buf_ptr * r->size), data, len);
+    d->datalen = len;
+    d->eof = 1;
+    d->owner = 0;
+    *dma_addr = d->next_link_ptr;
+    return len;
+}
+
+// 'to host' transfer of 'total' bytes, up to 'max' descriptors per host read
+//------------------------------------------------------------------------------------------
+static sim_result_t sim_to_host(uint8 num, uint8 max, uint64_t total, unsigned int seed)
+{
+    sim_result_t res = { 0 };
+    struct sdio_queue desc[RX_BUF_MAX];
+    static uint8 buf[RX_BUF_MAX * RX_BUF_SIZE];
+    static uint8 out[RX_BUF_MAX * RX_BUF_SIZE];
+    static uint8 seg[SEGMENT_MAX];
+    sdio_ring_t r;
+    uint64_t produced = 0, received = 0;
+    uint32 i, n, len, ndesc, first;
+    double t0;
+    int err = 0;
+
+    srand(seed);
+    sdio_ring_init(&r, desc, buf, num, RX_BUF_SIZE, false);
+
+    while (received < total) {
+        // firmware: deliver the received TCP segments while there is room
+        t0 = now_ns();
+        while ((produced < total) && (sdio_ring_space(&r) >= FLOW_SPACE_MIN)) {
+            n = 1 + (rand() % SEGMENT_MAX);
+            if (n > (total - produced)) n = total - produced;
+            for (i=0; i<n; i++) seg[i] = pattern(produced + i);
+            if (sdio_ring_put(&r, seg, n) != n) err++;
+            produced += n;
+        }
+        // firmware: load the chain (sdio_to_host_load)
+        first = r.head;
+        len = sdio_ring_load(&r, max);
+        res.ring_ns += now_ns() - t0;
+        if (len == 0) break;
+
+        // host: read the chain
+        n = dma_read_chain(&r, first, out, &ndesc, &err);
+        if (n != len) err++;
+        for (i=0; i<n; i++) {
+            if (out[i] != pattern(received + i)) res.errors++;
+        }
+        received += n;
+        res.reads++;
+        res.descs += ndesc;
+        res.time_us += ISR_LATENCY_US + XFER_OVERHEAD_US + (n / BUS_BYTES_PER_US);
+
+        // firmware: read done interrupt
+        t0 = now_ns();
+        sdio_ring_load_done(&r);
+        res.ring_ns += now_ns() - t0;
+    }
+    res.bytes = received;
+    res.errors += err + (total - received);
+    return res;
+}
+
+// 'from host' transfer of 'total' bytes in random size packets,
+// the AT receive buffer accepts only part of the data at a time
+//------------------------------------------------------------------
+static sim_result_t sim_from_host(uint64_t total, unsigned int seed)
+{
+    sim_result_t res = { 0 };
+    struct sdio_queue desc[TX_BUF_NUM];
+    static uint8 buf[TX_BUF_NUM * TX_BUF_SIZE];
+    static uint8 pkt[TX_BUF_SIZE];
+    sdio_ring_t r;
+    uint64_t sent = 0, consumed = 0;
+    uint32 dma_addr, i, n, len, at_free;
+    uint8 *data;
+    double t0;
+
+    srand(seed);
+    sdio_ring_init(&r, desc, buf, TX_BUF_NUM, TX_BUF_SIZE, true);
+    dma_addr = SDIO_DESC_ADDR(&r, 0);
+
+    while (consumed < total) {
+        // host: write packets while the firmware has free buffers
+        while ((sent < total) && (sdio_ring_dma_free(&r))) {
+            n = 1 + (rand() % TX_BUF_SIZE);
+            if (n > (total - sent)) n = total - sent;
+            for (i=0; i<n; i++) pkt[i] = pattern(sent + i);
+            if (dma_write(&r, &dma_addr, pkt, n) != n) res.errors++;
+            sent += n;
+            res.reads++;
+            res.time_us += XFER_OVERHEAD_US + (n / BUS_BYTES_PER_US);
+        }
+        // firmware: pass the data to the AT receive buffer (sdio_from_host_process)
+        t0 = now_ns();
+        at_free = AT_RXBUF_SIZE / 2 + (rand() % (AT_RXBUF_SIZE / 2));
+        while ((at_free) && ((data = sdio_ring_peek(&r, &len)) != NULL)) {
+            n = (len < at_free) ? len : at_free;
+            for (i=0; i<n; i++) {
+                if (data[i] != pattern(consumed + i)) res.errors++;
+            }
+            consumed += n;
+            at_free -= n;
+            if (sdio_ring_consume(&r, n)) res.descs++;
+        }
+        res.ring_ns += now_ns() - t0;
+        res.time_us += ISR_LATENCY_US;
+    }
+    res.bytes = consumed;
+    return res;
+}
+
+//----------------------------
+int main(int argc, char **argv)
+{
+    uint64_t total = 4 * 1024 * 1024;
+    unsigned int seed = 1;
+    static const uint8 config[][2] = { {5, 1}, {4, 2}, {4, 4}, {8, 8}, {16, 16} };
+    sim_result_t res;
+    int i, failed = 0;
+
+    if (argc > 1) total = strtoull(argv[1], NULL, 0);
+    if (argc > 2) seed = strtoul(argv[2], NULL, 0);
+
+    printf("'to host', %llu bytes, TCP segments 1 ~ %d bytes\n", (unsigned long long)total, SEGMENT_MAX);
+    printf("%6s %6s %8s %10s %8s %10s %10s %s\n", "bufs", "chain", "reads", "bytes/rd", "errors", "MB/s", "ns/KB", "");
+    for (i=0; i<(int)(sizeof(config)/sizeof(config[0])); i++) {
+        res = sim_to_host(config[i][0], config[i][1], total, seed);
+        printf("%6d %6d %8u %10.0f %8llu %10.2f %10.0f %s\n", config[i][0], config[i][1], res.reads,
+               (double)res.bytes / res.reads, (unsigned long long)res.errors, res.bytes / res.time_us,
+               res.ring_ns * 1024.0 / res.bytes, (config[i][1] == 1) ? "single buffer" : "");
+        if (res.errors) failed = 1;
+    }
+
+    res = sim_from_host(total, seed);
+    printf("\n'from host', %llu bytes, %d buffers: %u writes, %u buffers processed, %llu errors, %.0f ns/KB\n",
+           (unsigned long long)res.bytes, TX_BUF_NUM, res.reads, res.descs, (unsigned long long)res.errors,
+           res.ring_ns * 1024.0 / res.bytes);
+    if (res.errors) failed = 1;
+
+    printf("%s\n", failed ? "FAILED" : "OK");
+    return failed;
+}
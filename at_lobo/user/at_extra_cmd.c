@@ -38,31 +38,248 @@
 #include "at_upgrade.h"
 #endif
 #include "driver/uart.h"
+#include "driver/uart_tx.h"
 #include "at_extra_cmd.h"
+#include "at_frame.h"
+#include "at_spool.h"
+#include "at_sdk_ext.h"
+#if AT_SDIO_ENABLE
+#include "driver/sdio_slv.h"
+#endif
+#if AT_HSPI_ENABLE
+#include "driver/hspi_slv.h"
+#endif
 
-#define TCPCONN_MAX_CONN            5       // maximal number of TCP connections
-#define TCPCONN_MAX_SERV            3       // maximal number of TCP servers
+#define TCPCONN_MAX_CONN            15      // upper limit of the number of TCP connections (SDK 'linkMax')
+#define TCPCONN_MAX_SERV            7       // upper limit of the number of TCP servers
+#define TCPCONN_DEF_CONN            5       // default number of TCP connections, AT+TCPLIMITS
+#define TCPCONN_DEF_SERV            3       // default number of TCP servers, AT+TCPLIMITS
 #define TCPSERV_CONN_TIMEOUT        120
 #define TCPCONN_PARRENT_MASK        0xA0
+#define TCPCONN_PARRENT_CLIENT      0x07    // server id of the client links, never a valid server
+#define TCPADM_HEAP_RESERVE         6144    // free heap always kept for the system and the AT library
+#define TCPADM_LINK_COST            640     // lwIP PCB, espconn and SDK bookkeeping of a TCP link
+#define TCPADM_SSL_COST             12288   // mbedtls contexts and handshake of a SSL link, without the record buffers
+#define TCPPOOL_MAX                 4       // maximal number of parked client connections (AT+TCPPOOL)
+#define TCPPOOL_TTL_DEFAULT         30      // s, default idle time of the parked connection
+#define TCPPOOL_TTL_MAX             3600    // s
+#define TCPPOOL_POLL_MS             1000    // ms, idle time check interval
+#define TCPPOOL_TAG                 0xFF    // espconn 'reverse' tag of the parked connection, never a valid link
 #define TCP_MAX_CERTS               1
+#define DNSCACHE_MAX                32      // DNS_CACHE_MAX in lwipopts.h
+#define DNSCACHE_NEG_TTL_MAX        3600    // s
+#define DNSCACHE_FAILED             (-6)    // lwIP ERR_VAL, espconn_gethostbyname: the name failed to resolve recently
+
+#define NETSTATS_COUNTERS           16      // maximal number of counters of one lwIP stats group
 
 #define TCPINPUT_TERMINATE_CHAR     '^'
 #define TCP_CERT_HEAD_SIZE          32
 #define TCP_CERT_LEN_SIZE           2
 #define TCP_DATA_TIMEOUT_MS         50000   // ms
+#define TCP_CONFIRM_TIMEOUT_MS      1000    // ms
+#define TCP_UART_FWD_MS             100     // ms, UART0 AT input goes through the fake UART until the host is idle this long
+#define TCPCONN_RXQUEUE_MAX         4096    // receive window is held when more bytes are waiting for the host
+#define TCPCONN_RXRING_SIZE         4096    // default size of the passive mode receive buffer
+#define TCPCONN_RXRING_MAX          16384
+#define TCPCONN_RXCREDIT_MAX        16384   // maximal credit mode receive window in bytes
+#define TCPCONN_RXCREDIT_SEGS       16      // maximal credit mode receive window in segments
+#define TCPRECV_CHUNK_SIZE          256
+#define TCPCOAL_BYTES_MAX           1460    // maximal size of the coalesced segment (AT+TCPCOAL)
+#define TCPCOAL_WINDOW_DEFAULT      2000    // us, default coalescing window
+#define TCPCOAL_WINDOW_MAX          100000  // us
+#ifndef TCP_MSS
+#define TCP_MSS                     1460
+#endif
 
+#define TCPSEND_MAX_LEN             65536   // maximal length of the data sent with one AT+TCPSEND
+#define TCPSEND_CHUNK_SIZE          TCP_MSS // data are passed to espconn in chunks of this size
+#define TCPSEND_INPUT_TIMEOUT_MS    1000    // ms, maximal pause in the host's data
+#define TCPSEND_QUEUE_MAX           8192    // maximal number of bytes waiting to be sent, all links
+#define TCPSEND_DEPTH_DEFAULT       4       // default number of AT+TCPSEND operations in progress per link
+#define TCPSEND_DEPTH_MAX           8
+#define TCPTX_MODE_NODELAY          0       // each chunk is sent at once, Nagle algorithm disabled (default)
+#define TCPTX_MODE_NAGLE            1       // Nagle algorithm enabled, waiting chunks are merged
+#define TCPTX_MODE_CORK             2       // waiting chunks are merged, the last one is held until full or timeout
+#define TCPCORK_DELAY_DEFAULT       200     // ms, default time the corked data wait
+#define TCPCORK_DELAY_MAX           5000    // ms
+#define TCPSPOOL_FEED_CHUNKS        2       // replayed chunks waiting to be sent, the next records are read when they are written
+
+#define UART_FLOW_RX_THRESH         110     // default RX FIFO level at which RTS is deasserted
+#define UART_FLOW_POLL_MS           10      // ms, UART output check interval while the windows are held
+#define SDIO_FLOW_SPACE_MIN         1536    // free SDIO bytes needed to deliver the received data
+#define HSPI_FLOW_SPACE_MIN         1536    // free HSPI bytes needed to deliver the received data
+#define UART_TXBUF_MIN              256     // UART TX buffer size limits
+#define UART_TXBUF_MAX              8192
+#define UART_FAST_BAUD_MIN          115200  // AT+UARTFAST baudrate limits
+#define UART_FAST_BAUD_MAX          4608000
+#define UART_FAST_TIMEOUT_MIN       100     // ms, host confirmation timeout limits
+#define UART_FAST_TIMEOUT_MAX       10000
+#define UART_BENCH_MAX_LEN          1048576 // max AT+UARTBENCH length
+#define UART_BENCH_TIMEOUT_MS       1000    // ms, default maximal pause in the host's AT+UARTBENCH data
+#define UART_BENCH_PATTERN(n)       ((uint8_t)((n) + ((n) >> 8)))   // byte 'n' of the AT+UARTBENCH data
+
+// UART test states
+#define UARTTEST_IDLE               0
+#define UARTTEST_CONFIRM            1       // new baudrate set, waiting for the host's confirmation
+#define UARTTEST_BENCH              2       // receiving and echoing the benchmark data
+#define UARTTEST_DRAIN              3       // all data received, waiting until the echo is sent
+
+// Receive modes
+#define TCPRECV_MODE_ACTIVE         0       // received data are pushed to the host ('+TCP' alert)
+#define TCPRECV_MODE_PASSIVE        1       // host is notified ('+TCPDATA') and reads the data with AT+TCPRECV
+
+// State of the pooled client connection
+#define TCPPOOL_USED                0       // used by a link
+#define TCPPOOL_PARKED              1       // link closed, connection kept open for reuse
+#define TCPPOOL_CLOSING             2       // parked connection is closed, waiting for the disconnect callback
+
+// Delivery state of the received data to the host
+#define TCPRX_IDLE                  0
+#define TCPRX_WAIT_REQUEST          1       // '+TCP' alert sent, waiting for 'r'
+#define TCPRX_WAIT_CONFIRM          2       // data sent, waiting for 'y'
+
+// Unit of the credit mode receive window (AT+TCPCREDIT)
+#define TCPRX_CREDIT_BYTES          0
+#define TCPRX_CREDIT_SEGMENTS       1
+
+// State of the data input from the host (AT+TCPSEND)
+#define TCPTX_IDLE                  0
+#define TCPTX_INPUT                 1       // receiving data from the host
+#define TCPTX_DISCARD               2       // send failed, discarding the rest of the host's data
+#define UDP_MAX_LEN                 1472    // maximal datagram length, not fragmented
+#define UDP_RX_PBUF_LEN             256     // maximal length of the datagram queued in its pbuf, not copied
+#define UDP_RX_PBUF_MAX             4       // maximal number of datagrams queued in their pbufs, all links
+
+// Received data segment, waiting to be delivered to the host
+typedef struct _tcp_rxseg_t {
+    struct _tcp_rxseg_t *next;
+    uint16_t            len;
+    uint16_t            size;           // allocated data size, more segments can be merged while len < size
+    uint16_t            port;           // UDP: remote port of the datagram
+    uint8_t             ip[4];          // UDP: remote IP of the datagram
+    struct pbuf         *pbuf;          // UDP: the small datagram is kept in its pbuf, NULL: data are in 'data'
+    uint8_t             *payload;       // UDP: the datagram's data in 'pbuf'
+    uint8_t             data[0];
+} tcp_rxseg_t;
+
+#define RXSEG_DATA(seg)             (((seg)->pbuf) ? (seg)->payload : (seg)->data)
+
+// AT+TCPSEND operation, completed when all its chunks are acknowledged
+typedef struct _tcp_txop_t {
+    struct _tcp_txop_t  *next;
+    uint16_t            seq;
+    uint8_t             input_done;     // all data are received from the host
+    uint8_t             chunks;         // number of chunks queued
+    uint8_t             unwritten;      // number of chunks not yet passed to espconn
+    uint8_t             unacked;        // number of chunks passed to espconn, not yet acknowledged
+} tcp_txop_t;
+
+// Data chunk waiting to be sent
+typedef struct _tcp_txseg_t {
+    struct _tcp_txseg_t *next;
+    tcp_txop_t          *op;
+    uint16_t            len;
+    uint16_t            size;           // allocated data size
+    uint8_t             data[0];
+} tcp_txseg_t;
+
+// Link transport statistics (AT+TCPSTATS), cleared on link allocation or reset
 typedef struct {
+    uint32_t        rx_bytes;       // received from the remote
+    uint32_t        rx_segs;
+    uint32_t        tx_bytes;       // passed to espconn
+    uint32_t        tx_segs;
+    uint32_t        resends;        // data sent to the host again on its request
+    uint32_t        aborts;         // delivery aborted by the host or timed out
+    uint32_t        wait_ms;        // time the delivered data waited for the host's confirmation
+    uint32_t        hold_ms;        // time the receive window was held
+    uint32_t        wait_since;     // start of the delivery in progress
+    uint32_t        hold_since;     // start of the receive window hold
+    uint16_t        rexmits_base;   // lwIP retransmission count at the last reset
+} tcpstats_t;
+
+typedef struct {
+    uint32_t        tag;            // link id and slot generation, stored in the espconn 'reverse' field
     uint8_t         parrent;
     uint8_t         ssl;
+    uint8_t         udp;            // UDP link, one segment per datagram
     uint8_t         connected;
+    uint8_t         closing;        // disconnected, CLOSED is reported after all received data are delivered
+    uint8_t         async;          // asynchronous AT+TCPSTART in progress, the result is reported as an event
+    uint8_t         rx_hold;        // receive window is held
+    uint8_t         rx_mode;        // TCPRECV_MODE_ACTIVE or TCPRECV_MODE_PASSIVE
+    uint8_t         rx_notify;      // passive mode, '+TCPDATA' has to be sent to the host
+    uint8_t         rx_unit;        // TCPRX_CREDIT_BYTES or TCPRX_CREDIT_SEGMENTS
+    uint8_t         rx_dlv_segs;    // credit mode: number of segments delivered, not yet acknowledged
+    uint16_t        rx_credit;      // credit mode receive window, 0: 'r'/'y' handshake for each segment
+    uint16_t        rx_coal_bytes;  // active mode: coalesce the segments up to this size, 0: disabled
+    uint32_t        rx_coal_window; // us, segments arriving within the window are merged
+    uint32_t        rx_coal_until;  // time until which the last segment waits for more data
+    uint32_t        rx_last_time;   // arrival time of the last segment
+    uint32_t        rx_segs;        // number of received segments
+    uint32_t        rx_merged;      // number of segments merged into the previous one
+    uint32_t        rx_dropped;     // UDP: datagrams dropped, the queue was full
+    uint8_t         tx_busy;        // chunk passed to espconn, not yet written
+    uint8_t         tx_ops;         // number of AT+TCPSEND operations in progress
+    uint16_t        tx_seq;         // sequence number of the last AT+TCPSEND operation
+    uint8_t         tx_mode;        // TCPTX_MODE_NODELAY, TCPTX_MODE_NAGLE or TCPTX_MODE_CORK (AT+TCPCORK)
+    uint16_t        tx_cork_bytes;  // cork mode: the last chunk is sent when it has this size
+    uint16_t        tx_cork_delay;  // ms, cork mode: maximal time the data wait
+    uint32_t        tx_cork_until;  // time until which the corked data wait
+    uint32_t        tx_merged;      // number of chunks merged into the waiting one
+    uint32_t        tx_replayed;    // bytes replayed from the spool and acknowledged
     uint16_t        keepalive;
     uint16_t        port;
     uint16_t        local_port;
+    uint32_t        rx_queued;      // number of bytes waiting for delivery
+    uint32_t        rx_delivered;   // credit mode: number of bytes delivered, not yet acknowledged
+    uint32_t        rx_ackpend;     // credit mode: acknowledged bytes of the partially acknowledged segment
     uint8           remote_ip[4];
     struct espconn  *conn;
+    struct _tcppool_t *pool;        // pooled client link: pool entry holding the espconn
     ip_addr_t       ip;
+    ip_addr_t       mcast;          // UDP: joined multicast group
+    tcp_rxseg_t     *rx_head;       // passive mode: data which did not fit into the ring buffer
+    tcp_rxseg_t     *rx_tail;
+    tcp_rxseg_t     *rx_next;       // credit mode: next segment to deliver, the ones before are unacknowledged
+    ringbuf_t       rx_ring;        // passive mode receive buffer
+    tcp_rxseg_t     *rx_spare;      // SSL: segment reserved for the record received when the heap is exhausted
+    uint16_t        rx_spare_size;  // SSL: size of the reserved segment, the SSL record buffer size
+    tcp_txseg_t     *tx_head;       // chunks waiting to be sent
+    tcp_txseg_t     *tx_tail;
+    tcp_txseg_t     *tx_inflight;   // chunk being written by espconn
+    tcp_txop_t      *txop_head;     // AT+TCPSEND operations in progress, in order of sending
+    tcp_txop_t      *txop_tail;
+    tcp_txop_t      *spool_op;      // replay of the spooled data in progress (AT+TCPSPOOL)
+    tcpstats_t      stats;
 } tcpconn_t;
 
+// Link slot: the link's tcpconn_t with the espconn and esp_tcp/esp_udp of the client connection
+// The slots are allocated with the first link, for the number of links set by AT+TCPLIMITS,
+// the link id is the slot index
+typedef struct {
+    tcpconn_t       tcpconn;
+    struct espconn  conn;
+    union {
+        esp_tcp     tcp;
+        esp_udp     udp;
+    } proto;
+} tcpconn_slot_t;
+
+// Pooled client connection (AT+TCPPOOL)
+// The espconn is not in the link's slot, it stays valid while the connection is parked
+// and is given to the next link connecting to the same host, port and type
+typedef struct _tcppool_t {
+    struct _tcppool_t *next;
+    uint8_t         state;
+    uint8_t         ssl;
+    uint16_t        port;
+    uint16_t        idle;           // s, time the connection is parked
+    char            host[32];       // remote host as given to AT+TCPSTART
+    struct espconn  conn;
+    esp_tcp         tcp;
+} tcppool_t;
+
 typedef struct {
     uint8_t         ssl;
     uint8_t         connected;
@@ -73,8 +290,90 @@ typedef struct {
 } tcpserver_t;
 
 static uint8_t tcp_sslconfig = 0;
+static uint8_t tcp_async = 0;           // AT+TCPSTART returns at once, the result is reported later (AT+TCPASYNC)
+static uint8_t tcp_recvmode = TCPRECV_MODE_ACTIVE;
+static uint16_t tcp_recvbuf_size = TCPCONN_RXRING_SIZE;
 static tcpconn_t *tcpconns[TCPCONN_MAX_CONN] = { NULL };
+static tcpconn_slot_t *tcpconn_slab = NULL;
+static uint16_t tcpconn_gen = 0;        // incremented on each slot allocation
 static tcpserver_t *tcpservers[TCPCONN_MAX_SERV] = { NULL };
+static uint8_t tcpconn_max = TCPCONN_DEF_CONN;
+static uint8_t tcpserv_max = TCPCONN_DEF_SERV;
+static uint8_t tcpadm_ssl_reserve = 1;  // plain links leave room for one SSL link while none is open
+static uint32_t tcpadm_admitted = 0;
+static uint32_t tcpadm_refused = 0;
+static tcppool_t *tcppool_head = NULL;  // pooled connections, used by the links or parked
+static uint8_t tcppool_size = 0;        // maximal number of parked connections, 0: pooling disabled
+static uint16_t tcppool_ttl = TCPPOOL_TTL_DEFAULT;
+static uint32_t tcppool_hits = 0;
+static uint32_t tcppool_misses = 0;
+static uint32_t tcppool_evicted = 0;    // parked connections closed before reuse
+static os_timer_t tcppool_timer;
+
+static uint8_t tcprx_state = TCPRX_IDLE;
+static uint8_t tcprx_link = 0;
+static uint32_t tcprx_sent_id = 0;      // id of the last data sent on 'r' request
+static os_timer_t tcprx_timer;
+static os_timer_t tcprx_coal_timer;
+static uint8_t tcp_uart_fwd = 0;        // UART0: AT input received during the delivery is passed through the fake UART
+static uint32_t tcp_uart_fwd_last = 0;  // time of the last forwarded AT input
+static os_timer_t tcp_uart_fwd_timer;
+static uint8_t tcprx_coal_armed = 0;
+static uint32_t tcprx_coal_due = 0;     // time at which the coalescing timer expires
+static os_timer_t tcpcork_timer;
+static uint8_t tcpcork_armed = 0;
+static uint32_t tcpcork_due = 0;        // time at which the cork timer expires
+static uint8_t tcpspool_ready = 0;      // flash spool initialized
+static uint16_t tcpspool_links = 0;     // links with the spool enabled, bit per link id (AT+TCPSPOOL)
+
+// Data input from the host (AT+TCPSEND)
+// The data are queued to the link in chunks while they are received
+typedef struct {
+    uint8_t         state;
+    uint8_t         link;
+    uint8_t         term;           // data are terminated by TCPINPUT_TERMINATE_CHAR
+    uint8_t         spool;          // the link is not connected or is replaying, the data go to the spool
+    uint16_t        spooled;        // number of records written to the spool, removed if the input fails
+    uint32_t        remain;         // number of bytes still expected from the host
+    uint32_t        total;          // number of bytes received from the host
+    tcp_txop_t      *op;
+    tcp_txseg_t     *seg;           // chunk being filled
+    uint8_t         udp_ip[4];      // AT+UDPSEND: remote address of the datagram
+    uint16_t        udp_port;       // AT+UDPSEND: remote port, 0: the link's remote
+} tcpsend_t;
+
+static tcpsend_t tcpsend = { 0 };
+static uint8_t tcpsend_depth = TCPSEND_DEPTH_DEFAULT;
+static uint16_t tcpsend_queued = 0;     // bytes allocated for the chunks not yet written
+static os_timer_t tcpsend_timer;
+
+static uint8_t tcp_framed = 0;          // binary framed mode is active
+static uint8_t udp_rx_pbufs = 0;        // received datagrams queued in their pbufs
+
+static uint8_t uart_flowctrl = USART_HardwareFlowControl_None;
+static uint8_t uart_flow_rx_thresh = UART_FLOW_RX_THRESH;
+static uint8_t uart_tx_held = 0;        // host is not reading, receive windows of all active links are held
+static uint32_t uart_tx_holds = 0;      // number of times the receive windows were held
+static os_timer_t uart_flow_timer;
+
+// UART baudrate change (AT+UARTFAST) and line benchmark (AT+UARTBENCH)
+// The UART input is used by the test, the data delivery waits until it is finished
+typedef struct {
+    uint8_t         state;
+    uint8_t         match;          // number of confirmation characters received
+    char            confirm[24];    // expected confirmation
+    uint32_t        baud;
+    uint32_t        old_clkdiv;     // restored if the host does not confirm
+    uint32_t        timeout;        // ms
+    uint32_t        length;         // number of benchmark bytes expected from the host
+    uint32_t        rx_bytes;
+    uint32_t        errors;
+    uint32_t        t_first;        // us, first byte received
+    uint32_t        t_last;         // us, last byte received
+} uarttest_t;
+
+static uarttest_t uarttest = { 0 };
+static os_timer_t uarttest_timer;
 
 
 //-------------------------------------------------------------
@@ -205,598 +504,3931 @@ void ICACHE_FLASH_ATTR at_testCmdSNTPTime(uint8_t id)
 // ===========================================================================================
 
 
-//--------------------------------------------------------------------
-static uint8_t ICACHE_FLASH_ATTR _get_tcpn(uint8_t *ip, uint16_t port)
+// Get the link id from the tag in the espconn 'reverse' field
+// The tag also holds the slot generation, so the callbacks of a closed connection
+// never match the new connection using the same slot
+// The SDK copies 'reverse' into the server's espconn passed to the server links' callbacks
+//-------------------------------------------------------------
+static uint8_t ICACHE_FLASH_ATTR _get_tcpn(struct espconn *conn)
+{
+    uint32_t tag = (uint32_t)conn->reverse;
+    uint8_t tcp_n = tag & 0xFF;
+
+    if ((tcp_n >= tcpconn_max) || (tcpconns[tcp_n] == NULL) || (tcpconns[tcp_n]->tag != tag)) return tcpconn_max;
+    return tcp_n;
+}
+
+// Clear the link's statistics
+// lwIP counts the retransmissions for the pcb's lifetime, the current count is the new base
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpstats_reset(tcpconn_t *tcpconn)
+{
+    uint16 srtt, rto, rexmits, snd_wnd, cwnd;
+    uint32_t now = system_get_time();
+
+    os_memset(&tcpconn->stats, 0, sizeof(tcpstats_t));
+    if ((!tcpconn->udp) && (espconn_tcp_get_stats(tcpconn->conn, &srtt, &rto, &rexmits, &snd_wnd, &cwnd) == ESPCONN_OK)) {
+        tcpconn->stats.rexmits_base = rexmits;
+    }
+    tcpconn->stats.wait_since = now;
+    tcpconn->stats.hold_since = now;
+}
+
+// Prepare the link's slot, the link is registered by setting tcpconns[tcp_n]
+// With 'conn' NULL (client connection) the slot's espconn is used,
+// the espconn of the server's client connection belongs to the SDK
+// Returns NULL if the slots can not be allocated
+//-------------------------------------------------------------------------------
+static tcpconn_t * ICACHE_FLASH_ATTR tcpconn_alloc(uint8_t tcp_n, struct espconn *conn)
+{
+    tcpconn_slot_t *slot;
+
+    if (tcpconn_slab == NULL) {
+        tcpconn_slab = (tcpconn_slot_t *)os_zalloc(tcpconn_max * sizeof(tcpconn_slot_t));
+        if (tcpconn_slab == NULL) return NULL;
+    }
+    slot = &tcpconn_slab[tcp_n];
+    os_memset(slot, 0, sizeof(tcpconn_slot_t));
+    tcpconn_gen++;
+    if (tcpconn_gen == 0) tcpconn_gen = 1;
+    slot->tcpconn.tag = ((uint32_t)tcpconn_gen << 8) | tcp_n;
+    if (conn == NULL) {
+        conn = &slot->conn;
+        conn->proto.tcp = &slot->proto.tcp;
+    }
+    conn->reverse = (void *)slot->tcpconn.tag;
+    slot->tcpconn.conn = conn;
+    tcpstats_reset(&slot->tcpconn);
+    return &slot->tcpconn;
+}
+
+// Memory needed by a new link: lwIP and SDK bookkeeping, one received segment or
+// the passive mode receive buffer and, for SSL, the mbedtls contexts, record buffers and the reserved segment
+//-------------------------------------------------------------------------
+static uint32_t ICACHE_FLASH_ATTR tcpconn_cost(uint8_t ssl, uint8_t server)
 {
+    uint32_t cost = TCPADM_LINK_COST + espconn_tcp_get_mss();
+    sint16 size;
+
+    if (tcp_recvmode == TCPRECV_MODE_PASSIVE) cost += tcp_recvbuf_size;
+    if (ssl) {
+        size = espconn_secure_get_size((server) ? ESPCONN_SERVER : ESPCONN_CLIENT);
+        if (size > 0) cost += 3 * size;
+        cost += TCPADM_SSL_COST;
+    }
+    return cost;
+}
+
+// Admission control, accept the new link if the free heap covers its cost and the reserve
+// The open links' memory is already taken from the free heap
+//-------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR tcpconn_admit(uint8_t ssl, uint8_t server)
+{
+    uint32_t need = tcpconn_cost(ssl, server) + TCPADM_HEAP_RESERVE;
     uint8_t tcp_n;
-    for (tcp_n=0; tcp_n<TCPCONN_MAX_CONN; tcp_n++) {
-        if (tcpconns[tcp_n] != NULL) {
-            if ((os_memcmp(tcpconns[tcp_n]->remote_ip, ip, 4) == 0) && (tcpconns[tcp_n]->port == port)) break;
+
+    if (tcpconn_slab == NULL) need += tcpconn_max * sizeof(tcpconn_slot_t);
+    if ((!ssl) && (tcpadm_ssl_reserve)) {
+        for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+            if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->ssl)) break;
         }
+        if (tcp_n >= tcpconn_max) need += tcpconn_cost(1, 0);
     }
-    return tcp_n;
+    if (system_get_free_heap_size() < need) {
+        tcpadm_refused++;
+        return false;
+    }
+    tcpadm_admitted++;
+    return true;
 }
 
+// Send the data through the UART TX buffer, in order with the AT responses
 //-----------------------------------------------------------------------
 void ICACHE_FLASH_ATTR uart0_tx_buffer(uint8_t *buf, uint16_t len)
 {
-    uint16_t i;
+    uart_tx_write(buf, len);
+}
 
-    for (i = 0; i < len; i++) {
-        uart_tx_one_char(UART0, buf[i]);
+//-----------------------------------------------------------
+static uint8_t ICACHE_FLASH_ATTR _is_server_link(uint8_t tcp_n)
+{
+    if ((tcpconns[tcp_n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
+        return ((tcpconns[tcp_n]->parrent & 0x07) < tcpserv_max) ? 1 : 0;
     }
+    return 0;
 }
 
-// Data sent callback
-//-----------------------------------------------------
-static void ICACHE_FLASH_ATTR tcpconn_sendcb(void *arg)
+// SSL link: reserve the segment taking the received record when the heap is exhausted
+// The decrypted data can not be refused to lwIP, the record would be lost
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_rx_reserve(tcpconn_t *tcpconn)
 {
-    at_response_ok();
-    at_leave_special_state();
+    if ((tcpconn->ssl == 0) || (tcpconn->rx_spare) || (tcpconn->rx_spare_size == 0)) return;
+    tcpconn->rx_spare = (tcp_rxseg_t *)os_malloc(sizeof(tcp_rxseg_t) + tcpconn->rx_spare_size);
+    if (tcpconn->rx_spare) tcpconn->rx_spare->size = tcpconn->rx_spare_size;
 }
 
-// Data sent callback
-//------------------------------------------------------
-static void ICACHE_FLASH_ATTR tcpconn_writecb(void *arg)
+// Free the segment removed from the receive queue
+// The SSL link which used its reserved segment keeps the segment as the new reserve
+// The UDP datagram queued in its pbuf releases the pbuf
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_rx_seg_free(tcpconn_t *tcpconn, tcp_rxseg_t *seg)
 {
+    if (seg->pbuf) {
+        // the datagram's WLAN receive buffer is returned to the driver
+        espconn_recv_pbuf_free(tcpconn->conn, seg->pbuf);
+        udp_rx_pbufs--;
+    }
+    else if ((tcpconn->ssl) && (tcpconn->rx_spare == NULL) && (tcpconn->rx_spare_size) && (seg->size >= tcpconn->rx_spare_size)) {
+        tcpconn->rx_spare = seg;
+        return;
+    }
+    os_free(seg);
 }
 
-// called when connection receives data
-// send alert message to master and wait for request
-//--------------------------------------------------------------------------------------------
-static void ICACHE_FLASH_ATTR tcpconn_recvcb(void *arg, char *pusrdata, unsigned short length)
+// Free all received data not yet delivered to the host
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_rx_flush(uint8_t tcp_n)
 {
-    struct espconn *conn = (struct espconn *)arg;
-    char info[32] = {'\0'};
-    uint8_t ch = 0;
-    int tmo;
-    uint8_t srv_n = 9;
-    uint8_t tcp_n = _get_tcpn(conn->proto.tcp->remote_ip, conn->proto.tcp->remote_port);
-
-    if (tcp_n >= TCPCONN_MAX_CONN) {
-        os_sprintf(info, "\r\nTCPClientERROR:recv,%d:", length);
-        at_port_print(info);
-        return;
+    tcp_rxseg_t *seg;
+
+    while (tcpconns[tcp_n]->rx_head) {
+        seg = tcpconns[tcp_n]->rx_head;
+        tcpconns[tcp_n]->rx_head = seg->next;
+        if (seg->pbuf) {
+            espconn_recv_pbuf_free(tcpconns[tcp_n]->conn, seg->pbuf);
+            udp_rx_pbufs--;
+        }
+        os_free(seg);
     }
-    if ((tcpconns[tcp_n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
-        srv_n = ((tcpconns[tcp_n]->parrent & 0x07) < TCPCONN_MAX_SERV) ? (tcpconns[tcp_n]->parrent & 0x07) : 9;
+    tcpconns[tcp_n]->rx_tail = NULL;
+    tcpconns[tcp_n]->rx_next = NULL;
+    tcpconns[tcp_n]->rx_queued = 0;
+    tcpconns[tcp_n]->rx_delivered = 0;
+    tcpconns[tcp_n]->rx_dlv_segs = 0;
+    tcpconns[tcp_n]->rx_ackpend = 0;
+    if (tcpconns[tcp_n]->rx_ring) ringbuf_free(&tcpconns[tcp_n]->rx_ring);
+    if (tcpconns[tcp_n]->rx_spare) {
+        os_free(tcpconns[tcp_n]->rx_spare);
+        tcpconns[tcp_n]->rx_spare = NULL;
     }
+}
 
-    at_enter_special_state();
-resend:
-    // send the alert message:  '+TCP,<link_id>,<server_id>,<length>
-    os_sprintf(info, "\r\n+TCP,%d,%d,%d:", tcp_n, srv_n, length);
-    at_port_print(info);
+// Set the receive mode of the new link to the current mode
+//----------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR tcpconn_set_rxmode(tcpconn_t *tcpconn)
+{
+    tcpconn->rx_mode = tcp_recvmode;
+    if (tcpconn->rx_mode == TCPRECV_MODE_PASSIVE) {
+        tcpconn->rx_ring = ringbuf_new(tcp_recvbuf_size);
+        if (tcpconn->rx_ring == NULL) return false;
+    }
+    return true;
+}
 
-    // wait for request (max 5 seconds)
-    tmo = TCP_DATA_TIMEOUT_MS;
-    system_soft_wdt_stop();
-    while (tmo > 0) {
-        os_delay_us(100);
-        if (uart_rx_one_char(&ch) == 0) {
-            if ((ch == 'r') || (ch == 'a')) break;
-        }
-        tmo--;
+// Passive mode: move the data which did not fit into the ring buffer
+//------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_rx_refill(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_rxseg_t *seg;
+
+    while ((tcpconn->rx_head) && (ringbuf_bytes_free(tcpconn->rx_ring) >= tcpconn->rx_head->len)) {
+        seg = tcpconn->rx_head;
+        ringbuf_memcpy_into(tcpconn->rx_ring, seg->data, seg->len);
+        tcpconn->rx_head = seg->next;
+        if (tcpconn->rx_head == NULL) tcpconn->rx_tail = NULL;
+        tcpconn_rx_seg_free(tcpconn, seg);
     }
-    system_soft_wdt_restart();
-    if ((tmo == 0) || (ch == 'a')) goto abort;
+}
 
-    // send data to host
-    uart0_tx_buffer(pusrdata, length);
+//-----------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpsend_seg_free(tcp_txseg_t *seg)
+{
+    tcpsend_queued -= seg->size;
+    os_free(seg);
+}
 
-    // wait for confirmation (1 second)
-    tmo = 10000;
-    system_soft_wdt_stop();
-    while (tmo > 0) {
-        os_delay_us(100);
-        if (uart_rx_one_char(&ch) == 0) {
-            if ((ch == 'y') || (ch == 'a') || (ch == 'c')) break;
+// Report the link event to the host
+// In framed mode the event is sent in the event frame of the link
+//-------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_event(uint8_t link, char *info)
+{
+    if (tcp_framed) frame_send(link, FRAME_TYPE_EVENT, (uint8_t *)info, os_strlen(info));
+    else at_port_print(info);
+}
+
+// Report the result of the send operation in framed mode
+//--------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpframe_send_result(uint8_t tcp_n, uint8_t type, uint16_t seq)
+{
+    uint8_t buf[2];
+
+    buf[0] = seq & 0xFF;
+    buf[1] = seq >> 8;
+    frame_send(tcp_n, type, buf, 2);
+}
+
+// Free all data waiting to be sent
+// The AT+TCPSEND operations already completed by the host are reported as failed
+// If the spool is enabled for the link (AT+TCPSPOOL), the operations not yet passed to espconn
+// are moved to the spool in order and reported with '+TCPSENT,<link_id>,<seq>,SPOOL'
+//-------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_tx_flush(uint8_t tcp_n, bool report)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_txseg_t *seg;
+    tcp_txop_t *op, *gap = NULL;
+    char info[32] = {'\0'};
+    uint32_t need = 0;
+    bool spool = ((report) && (tcpspool_ready) && (tcpspool_links & (1 << tcp_n)));
+
+    if (spool) {
+        // all waiting data must fit, the host would resend the rest before the spooled part
+        for (seg = tcpconn->tx_head; seg != NULL; seg = seg->next) need += SPOOL_HDR_SIZE + seg->len + 3;
+        if ((need) && (spool_free() < need)) spool = false;
+        // the merged chunks hold data of several operations, with data in flight
+        // the part already sent is not known
+        for (op = tcpconn->txop_head; op != NULL; op = op->next) {
+            if ((op->unacked) && (tcpconn->tx_mode != TCPTX_MODE_NODELAY) && (op != tcpconn->spool_op)) spool = false;
         }
-        tmo--;
     }
-    system_soft_wdt_restart();
 
-    if ((tmo == 0) || (ch == 'a')) goto abort;
-    if (ch == 'c') {
-        at_port_print_irom_str("\r\n+TCPresend\r\n");
-        os_delay_us(1000);
-        goto resend;
+    while (tcpconn->tx_head) {
+        seg = tcpconn->tx_head;
+        tcpconn->tx_head = seg->next;
+        // the replayed records are still in the spool, the data after the first partially sent
+        // operation are not spooled, the spooled data must stay in order
+        if ((spool) && (gap == NULL) && (seg->op != tcpconn->spool_op)) {
+            if ((seg->op->unacked) || (!spool_write(tcp_n, seg->data, seg->len))) gap = seg->op;
+            else if (seg->op == tcpsend.op) tcpsend.spooled++;
+        }
+        tcpsend_seg_free(seg);
+    }
+    tcpconn->tx_tail = NULL;
+    if (tcpconn->tx_inflight) tcpsend_seg_free(tcpconn->tx_inflight);
+    tcpconn->tx_inflight = NULL;
+    tcpconn->tx_busy = 0;
+
+    // data input in progress for this link
+    if ((tcpsend.state == TCPTX_INPUT) && (tcpsend.link == tcp_n)) {
+        // the rest of the host's data goes to the spool
+        if ((spool) && (gap == NULL) && ((tcpsend.op == NULL) || (tcpsend.op->unacked == 0))) tcpsend.spool = 1;
+        else if (!tcpsend.spool) tcpsend.state = TCPTX_DISCARD;
     }
-    at_leave_special_state();
-    return;
 
-abort:
-    // timeout receiving confirmation or abort requested
-    if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->connected)) {
-        at_port_print_irom_str("\r\n+TCPabort\r\n");
-        if (tcpconns[tcp_n]->ssl > 0) espconn_secure_disconnect(conn);
-        else espconn_disconnect(conn);
+    while (tcpconn->txop_head) {
+        op = tcpconn->txop_head;
+        tcpconn->txop_head = op->next;
+        if (op == gap) spool = false;
+        if (op == tcpsend.op) tcpsend.op = NULL;
+        else if (op == tcpconn->spool_op) {
+            // the records not acknowledged are replayed again on the next connection
+            tcpconn->spool_op = NULL;
+            spool_rewind(tcp_n);
+        }
+        else if ((report) && (op->input_done)) {
+            if ((spool) && (op->unacked == 0)) {
+                os_sprintf(info, "+TCPSENT,%d,%d,SPOOL\r\n", tcp_n, op->seq);
+                tcpconn_event(tcp_n, info);
+            }
+            else if (tcp_framed) tcpframe_send_result(tcp_n, FRAME_TYPE_NAK, op->seq);
+            else {
+                os_sprintf(info, "\r\n+TCPSENT,%d,%d,FAIL\r\n", tcp_n, op->seq);
+                at_port_print(info);
+            }
+        }
+        os_free(op);
     }
-    at_leave_special_state();
+    tcpconn->txop_tail = NULL;
+    tcpconn->tx_ops = 0;
 }
 
-// Free memory used by tcpconn structure
-//----------------------------------------------------------
-static void ICACHE_FLASH_ATTR tcpconn_cleanup(uint8_t tcp_n)
+// Find the pool entry holding the espconn
+//-------------------------------------------------------------------
+static tcppool_t * ICACHE_FLASH_ATTR tcppool_find(struct espconn *conn)
 {
-    if ((tcp_n < TCPCONN_MAX_CONN) && (tcpconns[tcp_n])) {
-        if (tcpconns[tcp_n]->conn->proto.tcp) os_free(tcpconns[tcp_n]->conn->proto.tcp);
-        if (tcpconns[tcp_n]->conn) os_free(tcpconns[tcp_n]->conn);
-        os_free(tcpconns[tcp_n]);
-        tcpconns[tcp_n] = NULL;
+    tcppool_t *entry;
+
+    for (entry=tcppool_head; entry; entry=entry->next) {
+        if (&entry->conn == conn) break;
     }
+    return entry;
 }
 
-// Disconnect callback
-//-------------------------------------------------------
-static void ICACHE_FLASH_ATTR tcpconn_disconcb(void *arg)
+// New pool entry for the client link connecting to the host
+//-----------------------------------------------------------------------------------------
+static tcppool_t * ICACHE_FLASH_ATTR tcppool_new(const char *host, uint16_t port, uint8_t ssl)
 {
-    char info[16] = {'\0'};
-    struct espconn *conn = (struct espconn *)arg;
-    uint8_t tcp_n = _get_tcpn(conn->proto.tcp->remote_ip, conn->proto.tcp->remote_port);
+    tcppool_t *entry = (tcppool_t *)os_zalloc(sizeof(tcppool_t));
+
+    if (entry == NULL) return NULL;
+    entry->state = TCPPOOL_USED;
+    entry->ssl = ssl;
+    entry->port = port;
+    os_strncpy(entry->host, host, sizeof(entry->host) - 1);
+    entry->conn.proto.tcp = &entry->tcp;
+    entry->next = tcppool_head;
+    tcppool_head = entry;
+    return entry;
+}
 
-    uint8_t srv_n = TCPCONN_MAX_SERV;
-    if ((conn->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
-        srv_n = conn->parrent & 0x07;
-    }
-    if ((srv_n < TCPCONN_MAX_SERV) && (tcpservers[srv_n]->connected > 0)) tcpservers[srv_n]->connected--;
+// Remove the entry from the pool, the SDK is done with its espconn
+//-----------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcppool_free(tcppool_t *entry)
+{
+    tcppool_t **pentry = &tcppool_head;
 
-    if (tcp_n < TCPCONN_MAX_CONN) {
-        tcpconn_cleanup(tcp_n);
-        os_sprintf(info, "%d,CLOSED\r\n", tcp_n);
-        at_port_print(info);
-    }
-    else {
-        at_port_print_irom_str("\r\nTCPClientERROR:disconn\r\n");
-        if (conn->state == ESPCONN_CLOSE) {
-            at_port_print_irom_str("9,CLOSED\r\n");
+    while (*pentry) {
+        if (*pentry == entry) {
+            *pentry = entry->next;
+            os_free(entry);
+            break;
         }
+        pentry = &(*pentry)->next;
     }
 }
 
-// callback for lost connection
-//----------------------------------------------------------------------
-static void ICACHE_FLASH_ATTR tcpconn_recon_cb(void *arg, sint8 errType)
+// Close the parked connection, the entry is freed from the disconnect callback
+//------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcppool_close(tcppool_t *entry)
 {
-    char info[16] = {'\0'};
-    struct espconn *conn = (struct espconn *)arg;
-    uint8_t tcp_n = _get_tcpn(conn->proto.tcp->remote_ip, conn->proto.tcp->remote_port);
+    sint8 res;
+
+    entry->state = TCPPOOL_CLOSING;
+    tcppool_evicted++;
+    if (entry->ssl) res = espconn_secure_disconnect(&entry->conn);
+    else res = espconn_disconnect(&entry->conn);
+    // the connection is already gone, there will be no callback
+    if (res == ESPCONN_ARG) tcppool_free(entry);
+}
 
-    at_leave_special_state();
-    if (tcp_n < TCPCONN_MAX_CONN) {
-        if (tcpconns[tcp_n]->connected == 0) {
-            at_response_error();
-        }
-        else {
-            os_sprintf(info, "%d,CLOSED\r\n", tcp_n);
-            at_port_print(info);
-        }
-        tcpconn_cleanup(tcp_n);
+// Close the parked connections idle for longer than the TTL
+//--------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcppool_timer_cb(void *arg)
+{
+    tcppool_t *entry, *next;
+    uint8_t parked = 0;
+
+    for (entry=tcppool_head; entry; entry=next) {
+        next = entry->next;
+        if (entry->state != TCPPOOL_PARKED) continue;
+        entry->idle++;
+        if (entry->idle >= tcppool_ttl) tcppool_close(entry);
+        else parked++;
     }
-    else {
-        at_port_print_irom_str("\r\nTCPClientERROR:reconn\r\n");
-        if (conn->state == ESPCONN_CLOSE) {
-            at_port_print_irom_str("9,CLOSED\r\n");
+    if (parked) os_timer_arm(&tcppool_timer, TCPPOOL_POLL_MS, 0);
+}
+
+// Free the link's data and release its slot
+// The pool entry of the client link is freed too, its connection is already closed
+//----------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_cleanup(uint8_t tcp_n)
+{
+    if ((tcp_n < tcpconn_max) && (tcpconns[tcp_n])) {
+        if ((tcprx_state != TCPRX_IDLE) && (tcprx_link == tcp_n)) {
+            os_timer_disarm(&tcprx_timer);
+            tcprx_state = TCPRX_IDLE;
         }
+        tcpconn_rx_flush(tcp_n);
+        tcpconn_tx_flush(tcp_n, false);
+        if (tcpconns[tcp_n]->pool) tcppool_free(tcpconns[tcp_n]->pool);
+        tcpconns[tcp_n] = NULL;
     }
 }
 
+// Report the closed connection to the host and free it
+//----------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_closed(uint8_t tcp_n)
+{
+    char info[16] = {'\0'};
+
+    tcpconn_cleanup(tcp_n);
+    os_sprintf(info, "%d,CLOSED\r\n", tcp_n);
+    tcpconn_event(tcp_n, info);
+}
+
+// Report the result of the asynchronous AT+TCPSTART
 //-------------------------------------------------------------------------
-static void ICACHE_FLASH_ATTR _tcpconn_register_cb_cb(struct espconn *conn)
+static void ICACHE_FLASH_ATTR tcpstart_done(uint8_t tcp_n, const char *result)
 {
-    // set connection options
-    /*
-    ESPCONN_REUSEADDR = 0x01,   free memory after TCP disconnection. Need not wait for 2 minutes
-    ESPCONN_NODELAY = 0x02,     disable nagle algorithm during TCP data transmission, thus quickening the data transmission
-    ESPCONN_COPY = 0x04,        enable espconn_regist_write_finish. Enter write finish callback once the data has been sent using espconn_send
-    ESPCONN_KEEPALIVE = 0x08,   enable TCP keep alive
-    */
-    espconn_set_opt(conn, 0x0F); // ESPCONN_REUSEADDR | ESPCONN_NODELAY | ESPCONN_KEEPALIVE | ESPCONN_COPY
+    char info[32] = {'\0'};
 
-    // register connection callbacks
-    espconn_regist_disconcb(conn, tcpconn_disconcb);
-    espconn_regist_recvcb(conn, tcpconn_recvcb);
-    espconn_regist_write_finish(conn, tcpconn_writecb);
-    espconn_regist_sentcb(conn, tcpconn_sendcb);
+    os_sprintf(info, "+TCPSTART,%d,%s\r\n", tcp_n, result);
+    tcpconn_event(tcp_n, info);
 }
 
-// TCP Client successfully connected to the remote server
-// Used by AT+TCPSTART
-//---------------------------------------------------------
-static void ICACHE_FLASH_ATTR tcpconn_connect_cb(void *arg)
+// Close the UDP link, there is no disconnect callback
+// CLOSED is reported after all received datagrams are delivered
+//----------------------------------------------------------
+static void ICACHE_FLASH_ATTR udpconn_close(uint8_t tcp_n)
 {
-    struct espconn *conn = (struct espconn *)arg;
-    char info[16] = {'\0'};
-    uint8_t tcp_n = _get_tcpn(conn->proto.tcp->remote_ip, conn->proto.tcp->remote_port);
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    ip_addr_t any;
 
-    if (tcp_n < TCPCONN_MAX_CONN) {
-        _tcpconn_register_cb_cb(conn);
+    if (tcpconn->mcast.addr) {
+        any.addr = IPADDR_ANY;
+        espconn_igmp_leave(&any, &tcpconn->mcast);
+    }
+    espconn_delete(tcpconn->conn);
+    tcpconn->connected = 0;
+    if (tcpconn->rx_queued) tcpconn->closing = 1;
+    else tcpconn_closed(tcp_n);
+}
 
-        if (tcpconns[tcp_n]->keepalive) {
-            espconn_set_keepalive(tcpconns[tcp_n]->conn, ESPCONN_KEEPIDLE, &tcpconns[tcp_n]->keepalive);
-        }
+// Close the link's connection
+// TCP links report CLOSED from the disconnect callback, UDP links are closed at once
+//-------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_disconnect(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
 
-        tcpconns[tcp_n]->connected = 1;
-        os_sprintf(info, "%d,CONNECT\r\n", tcp_n);
-        at_port_print(info);
+    if (tcpconn->udp) udpconn_close(tcp_n);
+    else if (tcpconn->ssl > 0) espconn_secure_disconnect(tcpconn->conn);
+    else espconn_disconnect(tcpconn->conn);
+}
 
-        at_leave_special_state();
-        at_response_ok();
+// Park the link's connection in the pool instead of closing it
+// Only an idle connection can be reused, with no data moving in either direction
+// The oldest parked connection is closed if the pool is full
+// Returns false if the connection can not be parked
+//------------------------------------------------------
+static bool ICACHE_FLASH_ATTR tcppool_park(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcppool_t *entry = tcpconn->pool;
+    tcppool_t *oldest = NULL, *e;
+    uint8_t parked = 0;
+
+    if ((tcppool_size == 0) || (entry == NULL) || (!tcpconn->connected) || (tcpconn->conn->state != ESPCONN_CONNECT)) return false;
+    if ((tcpconn->rx_queued) || (tcpconn->rx_hold) || (tcpconn->tx_ops) || (tcpconn->tx_head) || (tcpconn->tx_busy)) return false;
+    if ((tcpsend.state != TCPTX_IDLE) && (tcpsend.link == tcp_n)) return false;
+
+    for (e=tcppool_head; e; e=e->next) {
+        if (e->state != TCPPOOL_PARKED) continue;
+        parked++;
+        if ((oldest == NULL) || (e->idle >= oldest->idle)) oldest = e;
     }
-    else {
-        at_leave_special_state();
-        at_port_print_irom_str("\r\nTCPClientERROR:connect\r\n");
-        at_response_error();
+    if (parked >= tcppool_size) tcppool_close(oldest);
+
+    // the link is released without the entry, the connection stays open
+    tcpconn->pool = NULL;
+    entry->state = TCPPOOL_PARKED;
+    entry->idle = 0;
+    entry->conn.reverse = (void *)TCPPOOL_TAG;
+    // received data are detected while parked
+    if (uart_tx_held) espconn_recv_unhold(&entry->conn);
+    // the next link gets the connection with the default options
+    if (tcpconn->tx_mode == TCPTX_MODE_NAGLE) espconn_set_opt(&entry->conn, ESPCONN_NODELAY);
+    tcpconn_closed(tcp_n);
+
+    os_timer_disarm(&tcppool_timer);
+    os_timer_setfn(&tcppool_timer, (os_timer_func_t *)tcppool_timer_cb, NULL);
+    os_timer_arm(&tcppool_timer, TCPPOOL_POLL_MS, 0);
+    return true;
+}
+
+// Take the parked connection to the host, port and type out of the pool
+// With 'local_port' set, the connection must use that local port
+//------------------------------------------------------------------------------------------------------------------
+static tcppool_t * ICACHE_FLASH_ATTR tcppool_take(const char *host, uint16_t port, uint8_t ssl, uint16_t local_port)
+{
+    tcppool_t *entry;
+
+    for (entry=tcppool_head; entry; entry=entry->next) {
+        if ((entry->state != TCPPOOL_PARKED) || (entry->port != port) || (entry->ssl != ssl)) continue;
+        if ((local_port) && (entry->tcp.local_port != local_port)) continue;
+        if (os_strcmp(entry->host, host) != 0) continue;
+        if (entry->conn.state != ESPCONN_CONNECT) continue;
+        entry->state = TCPPOOL_USED;
+        return entry;
     }
+    return NULL;
 }
 
-// call back for DNS lookup
-//----------------------------------------------------------------------------------------
-static void ICACHE_FLASH_ATTR tcpconn_resolved(const char *name, ip_addr_t *ip, void *arg)
+// The host caught up, advertise the receive window again
+// The window stays held while the UART TX is held by the host's flow control
+// and while the SSL link's reserved segment is still queued and can not be replaced
+//---------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_rx_unhold(tcpconn_t *tcpconn)
+{
+    tcpconn_rx_reserve(tcpconn);
+    if ((tcpconn->ssl) && (tcpconn->rx_spare == NULL) && (tcpconn->rx_queued)) return;
+    tcpconn->rx_hold = 0;
+    tcpconn->stats.hold_ms += (system_get_time() - tcpconn->stats.hold_since) / 1000;
+    if ((tcpconn->connected) && (!tcpconn->udp) && (!uart_tx_held)) espconn_recv_unhold(tcpconn->conn);
+}
+
+// Hold the receive windows of all connected active mode TCP links
+//-------------------------------------------------
+static void ICACHE_FLASH_ATTR uart_flow_hold_links(void)
 {
-    struct espconn *conn = (struct espconn *)arg;
     uint8_t tcp_n;
-    for (tcp_n=0; tcp_n<TCPCONN_MAX_CONN; tcp_n++) {
-        if (tcpconns[tcp_n] != NULL) {
-            if (tcpconns[tcp_n]->parrent == conn->parrent) break;
+
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->connected) && (!tcpconns[tcp_n]->udp) &&
+                (tcpconns[tcp_n]->rx_mode == TCPRECV_MODE_ACTIVE)) {
+            espconn_recv_hold(tcpconns[tcp_n]->conn);
         }
     }
+}
 
-    if ((tcp_n >= TCPCONN_MAX_CONN) || (ip == 0)) {
-        // Domain name not resolved or tcpconn not resolved, exit with error
-        tcpconn_cleanup(tcp_n);
-        at_leave_special_state();
-        if (ip != 0) at_port_print_irom_str("\r\n+TCPSTART:linkError\r\n");
-        else at_port_print_irom_str("\r\n+TCPSTART:DNSError\r\n");
-        at_response_error();
+static void ICACHE_FLASH_ATTR tcprx_start(void);
+
+// Check the UART output while the receive windows are held
+// The windows are released when the host has read all buffered output
+//------------------------------------------------------------
+static void ICACHE_FLASH_ATTR uart_flow_timer_cb(void *arg)
+{
+    uint8_t tcp_n;
+
+    if (!uart_tx_held) return;
+    #if AT_SDIO_ENABLE
+    if (sdio_to_host_space() < SDIO_FLOW_SPACE_MIN) {
+    #elif AT_HSPI_ENABLE
+    if (hspi_to_host_space() < HSPI_FLOW_SPACE_MIN) {
+    #else
+    if (!uart_tx_drained()) {
+    #endif
+        // links connected in the meantime are held too
+        uart_flow_hold_links();
+        os_timer_arm(&uart_flow_timer, UART_FLOW_POLL_MS, 0);
         return;
     }
 
-    // set up the connection
-    conn->type = ESPCONN_TCP;
-    conn->state = ESPCONN_NONE;
-    if (tcpconns[tcp_n]->local_port == 0) conn->proto.tcp->local_port = espconn_port();
-    else conn->proto.tcp->local_port = tcpconns[tcp_n]->local_port;
-    conn->proto.tcp->remote_port = tcpconns[tcp_n]->port;
-    *(ip_addr_t*)conn->proto.tcp->remote_ip = *ip;
-    os_memcpy(tcpconns[tcp_n]->remote_ip, conn->proto.tcp->remote_ip, 4);
+    uart_tx_held = 0;
+    // the passive mode links released while the UART was held are unheld too
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->connected) && (!tcpconns[tcp_n]->udp) && (!tcpconns[tcp_n]->rx_hold)) {
+            espconn_recv_unhold(tcpconns[tcp_n]->conn);
+        }
+    }
+    tcprx_start();
+}
 
-    // register connect & reconnect connection callbacks
-    espconn_regist_connectcb(conn, tcpconn_connect_cb);
-    espconn_regist_reconcb(conn, tcpconn_recon_cb);
+// Check if the data can be sent to the host
+// With CTS flow control enabled, the host deasserts CTS when it can not accept more data.
+// If output is then still waiting in the TX buffer, its queue or the TX FIFO,
+// no more data are delivered and the receive windows of the links are held until it is all sent.
+//-------------------------------------------
+static bool ICACHE_FLASH_ATTR uart_flow_check(void)
+{
+    if (uart_tx_held) return false;
+    #if AT_SDIO_ENABLE
+    // SDIO transport, the host has not read the previous data yet
+    if (sdio_to_host_space() >= SDIO_FLOW_SPACE_MIN) return true;
+    #elif AT_HSPI_ENABLE
+    // HSPI transport, the host has not read the previous data yet
+    if (hspi_to_host_space() >= HSPI_FLOW_SPACE_MIN) return true;
+    #else
+    if ((uart_flowctrl & USART_HardwareFlowControl_CTS) == 0) return true;
+    if ((READ_PERI_REG(UART_STATUS(UART0)) & UART_CTSN) == 0) return true;
+    if (uart_tx_drained()) return true;
+    #endif
+
+    uart_tx_held = 1;
+    uart_tx_holds++;
+    uart_flow_hold_links();
+    os_timer_disarm(&uart_flow_timer);
+    os_timer_setfn(&uart_flow_timer, (os_timer_func_t *)uart_flow_timer_cb, NULL);
+    os_timer_arm(&uart_flow_timer, UART_FLOW_POLL_MS, 0);
+    return false;
+}
 
-    tcpconns[tcp_n]->connected = 0;
+static void ICACHE_FLASH_ATTR tcprx_timeout_cb(void *arg);
 
-    //espconn_tcp_set_max_syn(100); // ToDo: ??
+//-----------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_arm_timer(uint32_t ms)
+{
+    os_timer_disarm(&tcprx_timer);
+    os_timer_setfn(&tcprx_timer, (os_timer_func_t *)tcprx_timeout_cb, NULL);
+    os_timer_arm(&tcprx_timer, ms, 0);
+}
 
-    if (tcpconns[tcp_n]->ssl > 0) espconn_secure_connect(conn);
-    else espconn_connect(conn);
+// The data requested by the host are on the wire, wait for the confirmation
+//--------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_sent_cb(void *arg)
+{
+    if ((tcprx_state == TCPRX_WAIT_CONFIRM) && ((uint32_t)arg == tcprx_sent_id)) tcprx_arm_timer(TCP_CONFIRM_TIMEOUT_MS);
 }
 
-//AT+TCPSTART=<link ID>,<type>,<remote IP>,<remoteport>[,<TCP keep alive>],[<local_port]
-//=======================================================================
-void ICACHE_FLASH_ATTR at_setupCmdTCPConnConnect(uint8_t id, char *pPara)
+// Print the segment's alert message: '+TCP,<link_id>,<server_id>,<length>:'
+// or '+UDP,<link_id>,<length>,<remote_ip>,<remote_port>:' for the UDP datagram
+//----------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_print_alert(uint8_t tcp_n, tcp_rxseg_t *seg)
 {
-    int port = 0, localport = 0;
-    int err = 0, flag = 0;
-    int conn_no = 0, ssl = 0, keepalive = 0;
-    char type[4] = {0};
-    char domain[32] = {0};
-    err_t result;
+    char info[56] = {'\0'};
+    uint8_t srv_n = 9;
 
-    pPara++; // skip '='
+    if (tcpconns[tcp_n]->udp) {
+        os_sprintf(info, "\r\n+UDP,%d,%d,"IPSTR",%d:", tcp_n, seg->len, seg->ip[0], seg->ip[1], seg->ip[2], seg->ip[3], seg->port);
+    }
+    else {
+        if (_is_server_link(tcp_n)) srv_n = tcpconns[tcp_n]->parrent & 0x07;
+        os_sprintf(info, "\r\n+TCP,%d,%d,%d:", tcp_n, srv_n, seg->len);
+    }
+    at_port_print(info);
+}
 
-    //get the 1st parameter (conn number)
-    flag = at_get_next_int_dec(&pPara, &conn_no, &err);
-    if (err != 0) goto exit_err;
-    if ((conn_no < 0) || (conn_no >= TCPCONN_MAX_CONN)) goto exit_err;
-    if (tcpconns[conn_no] != NULL) {
-        at_port_print_irom_str("\r\n+TCPSTART:linkUsed\r\n");
-        goto exit_err;
+// Send the segment in the data frame
+// The UDP datagram is sent in the datagram frame, with its remote address before the data
+//--------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_frame_send(uint8_t tcp_n, tcp_rxseg_t *seg)
+{
+    uint8_t addr[FRAME_DGRAM_ADDR_SIZE];
+
+    if (tcpconns[tcp_n]->udp) {
+        os_memcpy(addr, seg->ip, 4);
+        addr[4] = seg->port & 0xFF;
+        addr[5] = seg->port >> 8;
+        frame_send_hdr(tcp_n, FRAME_TYPE_DGRAM, addr, FRAME_DGRAM_ADDR_SIZE, RXSEG_DATA(seg), seg->len);
     }
+    else frame_send(tcp_n, FRAME_TYPE_DATA, seg->data, seg->len);
+}
 
-    if (*pPara != ',') goto exit_err;
-    pPara++; // skip ','
-    //get the 2nd parameter (connection type), string
-    flag = at_data_str_copy(type, &pPara, 3);
-    if (flag != 3) goto exit_err;
-    if (os_memcmp(type, "TCP", 3) == 0) ssl = 0;
-    else if (os_memcmp(type, "SSL", 3) == 0) ssl = 1;
-    else  goto exit_err;
+// Send the alert message to the host and wait for the request
+//------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_send_alert(void)
+{
+    if (tcp_framed) {
+        // framed mode, send the data frame and wait for the host's acknowledge
+        tcprx_frame_send(tcprx_link, tcpconns[tcprx_link]->rx_head);
+        tcprx_state = TCPRX_WAIT_CONFIRM;
+        tcprx_arm_timer(TCP_DATA_TIMEOUT_MS);
+        return;
+    }
 
-    if (*pPara != ',') goto exit_err;
-    pPara++; // skip ','
-    //get the 3rd parameter (domain), string
-    flag = at_data_str_copy(domain, &pPara, 31);
-    if (flag < 3) goto exit_err;
+    tcprx_print_alert(tcprx_link, tcpconns[tcprx_link]->rx_head);
 
-    if (*pPara != ',') goto exit_err;
-    pPara++; // skip ','
-    //get the 4th parameter (port)
-    flag = at_get_next_int_dec(&pPara, &port, &err);
-    if (err != 0) goto exit_err;
-    if ((port < 1) || (port > 65365)) goto exit_err;
+    tcprx_state = TCPRX_WAIT_REQUEST;
+    tcprx_arm_timer(TCP_DATA_TIMEOUT_MS);
+}
 
-    // check if more parameters available
-    if (*pPara == ',') {
-        pPara++; // skip ','
-        //get the optional 5th parameter (keepalive)
-        flag = at_get_next_int_dec(&pPara, &keepalive, &err);
-        if (err != 0) keepalive = 0;
-        else if ((keepalive < 0) || (keepalive >= 7200)) goto exit_err;
+static void ICACHE_FLASH_ATTR tcp_uart_rx_cb(uint8 *data, int32 len);
+
+// Passive mode: send '+TCPDATA,<link_id>,<available>' to the host
+// Sent once after new data are received, again only after the host has read some data
+//----------------------------------------------
+static void ICACHE_FLASH_ATTR tcprecv_notify(void)
+{
+    char info[32] = {'\0'};
+    uint8_t tcp_n;
+
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->rx_notify == 1)) {
+            tcpconns[tcp_n]->rx_notify = 2;
+            os_sprintf(info, "\r\n+TCPDATA,%d,%d\r\n", tcp_n, tcpconns[tcp_n]->rx_queued);
+            tcpconn_event(tcp_n, info);
+        }
     }
-    // check if more parameters available
-    if (*pPara == ',') {
-        pPara++; // skip ','
-        //get the optional 6th parameter (local port)
-        flag = at_get_next_int_dec(&pPara, &localport, &err);
-        if (err != 0) goto exit_err;
-        if ((localport < 0) || (localport >= 65536) || (localport == port)) goto exit_err;
+}
+
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_coal_timer_cb(void *arg)
+{
+    tcprx_coal_armed = 0;
+    tcprx_start();
+}
+
+// Coalescing: check if the segment has to wait for more data of the burst
+// The segment waits while it is the last one, not full, and the window since its first data is not over.
+// The delivery is restarted from the timer when the earliest waiting segment is due.
+//---------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR tcprx_coal_wait(tcpconn_t *tcpconn, tcp_rxseg_t *seg)
+{
+    int32_t remain;
+
+    if ((tcpconn->rx_coal_bytes == 0) || (seg != tcpconn->rx_tail) || (seg->len >= tcpconn->rx_coal_bytes)) return false;
+    remain = (int32_t)(tcpconn->rx_coal_until - system_get_time());
+    if (remain <= 0) return false;
+
+    if ((!tcprx_coal_armed) || ((int32_t)(tcprx_coal_due - tcpconn->rx_coal_until) > 0)) {
+        os_timer_disarm(&tcprx_coal_timer);
+        os_timer_setfn(&tcprx_coal_timer, (os_timer_func_t *)tcprx_coal_timer_cb, NULL);
+        os_timer_arm(&tcprx_coal_timer, (remain + 999) / 1000, 0);
+        tcprx_coal_armed = 1;
+        tcprx_coal_due = tcpconn->rx_coal_until;
     }
-    // check if the last parameter
-    if (*pPara != '\r') goto exit_err;
+    return true;
+}
 
-    // create tcpconn structure
-    tcpconn_t *tcpconn = (tcpconn_t *)os_zalloc(sizeof(tcpconn_t));
-    if (!tcpconn) goto exit_err_alloc;
+// Coalescing: check if the received data can be appended to the link's last segment
+// The segment must not be delivered or announced to the host yet
+//--------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR tcprx_coal_open(uint8_t tcp_n, uint16_t length)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_rxseg_t *seg = tcpconn->rx_tail;
+
+    if ((tcpconn->rx_coal_bytes == 0) || (tcpconn->rx_mode != TCPRECV_MODE_ACTIVE) || (seg == NULL)) return false;
+    if ((seg->len + length) > seg->size) return false;
+    // credit mode: the segments from rx_next on are not delivered
+    if (tcpconn->rx_credit) return (tcpconn->rx_next != NULL);
+    return ((seg != tcpconn->rx_head) || (tcprx_state == TCPRX_IDLE) || (tcprx_link != tcp_n));
+}
 
-    // create connection
-    tcpconn->conn = (struct espconn *)os_zalloc(sizeof(struct espconn));
-    if (!tcpconn->conn) {
-        os_free(tcpconn);
-        goto exit_err_alloc;
+// Credit mode: check if the link's next segment fits into the receive window
+// The first segment is always delivered, even if it is larger than the window
+//-------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR tcprx_credit_avail(tcpconn_t *tcpconn)
+{
+    if ((tcpconn->rx_mode != TCPRECV_MODE_ACTIVE) || (tcpconn->rx_credit == 0) || (tcpconn->rx_next == NULL)) return false;
+    if (tcpconn->rx_dlv_segs == 0) return true;
+    if (tcpconn->rx_unit == TCPRX_CREDIT_SEGMENTS) return (tcpconn->rx_dlv_segs < tcpconn->rx_credit);
+    return ((tcpconn->rx_delivered + tcpconn->rx_next->len) <= tcpconn->rx_credit);
+}
+
+// Credit mode: send the segment to the host without waiting for the request
+// The segment is kept in the link's queue until the host acknowledges it
+//--------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_send_credit(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_rxseg_t *seg = tcpconn->rx_next;
+
+    if (tcp_framed) tcprx_frame_send(tcp_n, seg);
+    else {
+        tcprx_print_alert(tcp_n, seg);
+        uart0_tx_buffer(RXSEG_DATA(seg), seg->len);
     }
-    tcpconn->conn->proto.tcp = (esp_tcp *)os_zalloc(sizeof(esp_tcp));
-    if (!tcpconn->conn->proto.tcp) {
-        os_free(tcpconn->conn);
-        os_free(tcpconn);
-        goto exit_err_alloc;
+    tcpconn->rx_next = seg->next;
+    tcpconn->rx_delivered += seg->len;
+    tcpconn->rx_dlv_segs++;
+}
+
+// Credit mode: stream the segments of all credit mode links while they have the credit
+//---------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_stream(void)
+{
+    uint8_t tcp_n, sent;
+
+    do {
+        sent = 0;
+        for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+            if (!uart_flow_check()) return;
+            if ((tcpconns[tcp_n]) && (tcprx_credit_avail(tcpconns[tcp_n])) &&
+                    (!tcprx_coal_wait(tcpconns[tcp_n], tcpconns[tcp_n]->rx_next))) {
+                tcprx_send_credit(tcp_n);
+                sent = 1;
+            }
+        }
+    } while (sent);
+}
+
+// UART0: AT responses while the AT input is passed through the fake UART
+//-------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcp_uart_at_tx(const uint8 *data, uint32 length)
+{
+    uart_tx_write(data, length);
+}
+
+// UART0: AT input received while the fake UART is enabled, passed to the AT command processor
+//-------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcp_uart_fwd_rx_cb(uint8 *data, int32 len)
+{
+    tcp_uart_fwd_last = system_get_time();
+    at_fake_uart_rx(data, len);
+}
+
+// UART0: disable the fake UART, the AT task reads the UART FIFO again
+//-------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcp_uart_fwd_stop(void)
+{
+    if (!tcp_uart_fwd) return;
+    os_timer_disarm(&tcp_uart_fwd_timer);
+    at_fake_uart_enable(false, NULL);
+    tcp_uart_fwd = 0;
+}
+
+// UART0: return the UART to the AT command processor when the host is idle
+// and the UART is not used by the data delivery, AT+TCPSEND or the UART test
+//-------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcp_uart_fwd_timer_cb(void *arg)
+{
+    if (!tcp_uart_fwd) return;
+    if ((tcprx_state != TCPRX_IDLE) || (tcpsend.state != TCPTX_IDLE) || (uarttest.state != UARTTEST_IDLE) ||
+            ((system_get_time() - tcp_uart_fwd_last) < (TCP_UART_FWD_MS * 1000))) {
+        os_timer_arm(&tcp_uart_fwd_timer, TCP_UART_FWD_MS, 0);
+        return;
     }
+    tcp_uart_fwd_stop();
+    at_register_uart_rx_intr(NULL);
+}
 
-    tcpconn->port = port;
-    tcpconn->local_port = localport;
-    tcpconn->connected = 0;
-    tcpconn->keepalive = keepalive;
-    tcpconn->ssl = ssl;
-    tcpconn->parrent = TCPCONN_PARRENT_MASK | (TCPCONN_MAX_SERV + conn_no);
-    tcpconn->conn->parrent = tcpconn->parrent;
-    tcpconns[conn_no] = tcpconn;
+// Return the UART to the AT command processor
+// While the fake UART is enabled, the AT input is passed to it
+//-------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcp_uart_rx_release(void)
+{
+    at_register_uart_rx_intr((tcp_uart_fwd) ? tcp_uart_fwd_rx_cb : NULL);
+}
 
-    if (ssl) {
-        if (tcp_sslconfig & 2) espconn_secure_ca_enable(1, SYSTEM_PARTITION_SSL_CLIENT_CA_ADDR / SECTOR_SIZE);
-        else espconn_secure_ca_disable(1);
+// Start the delivery of the next received segment
+// Links with the data waiting are served in round-robin order
+//--------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_start(void)
+{
+    uint8_t n, tcp_n;
+
+    if (tcprx_state != TCPRX_IDLE) return;
+    // the host is sending data, the UART is used by AT+TCPSEND
+    if (tcpsend.state != TCPTX_IDLE) return;
+    // the UART is used by AT+UARTFAST or AT+UARTBENCH
+    if (uarttest.state != UARTTEST_IDLE) return;
+
+    // credit mode links do not wait for the host
+    if (uart_flow_check()) tcprx_stream();
+    if (uart_tx_held) {
+        // the host is not reading, continue when the UART TX drains
+        if (!tcp_framed) tcp_uart_rx_release();
+        return;
     }
 
-    at_enter_special_state();
-    // DNS lookup
-    result = espconn_gethostbyname(tcpconn->conn, domain, &tcpconn->ip, tcpconn_resolved);
-    if (result == ESPCONN_OK) {
-        // host name is already cached or is actually a dotted decimal IP address
-        // call tcpconn_resolved to start the connection
-        tcpconn_resolved(0, &tcpconn->ip, tcpconn->conn);
+    for (n=1; n<=tcpconn_max; n++) {
+        tcp_n = (tcprx_link + n) % tcpconn_max;
+        if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->rx_mode == TCPRECV_MODE_ACTIVE) &&
+                (tcpconns[tcp_n]->rx_credit == 0) && (tcpconns[tcp_n]->rx_head) &&
+                (!tcprx_coal_wait(tcpconns[tcp_n], tcpconns[tcp_n]->rx_head))) break;
     }
-    else if (result == ESPCONN_INPROGRESS) {
-        // lookup taking place, will call tcpconn_resolved on completion
+    if (n > tcpconn_max) {
+        // nothing to deliver, return the UART to the AT command processor
+        if (!tcp_framed) tcp_uart_rx_release();
+        tcprecv_notify();
+        return;
     }
-    else {
-        // error
-        tcpconn_cleanup(conn_no);
-        at_leave_special_state();
-        at_port_print_irom_str("\r\n+TCPSTART:resolveError\r\n");
-        goto exit_err;
+
+    tcprx_link = tcp_n;
+    tcpconns[tcp_n]->stats.wait_since = system_get_time();
+    // in framed mode the UART is always used by the frame decoder
+    if (!tcp_framed) at_register_uart_rx_intr(tcp_uart_rx_cb);
+    tcprx_send_alert();
+}
+
+// The host confirmed the data, remove the segment from the queue
+//-------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_done(void)
+{
+    tcpconn_t *tcpconn = tcpconns[tcprx_link];
+    tcp_rxseg_t *seg = tcpconn->rx_head;
+
+    os_timer_disarm(&tcprx_timer);
+    tcprx_state = TCPRX_IDLE;
+    tcpconn->stats.wait_ms += (system_get_time() - tcpconn->stats.wait_since) / 1000;
+
+    tcpconn->rx_head = seg->next;
+    if (tcpconn->rx_head == NULL) tcpconn->rx_tail = NULL;
+    tcpconn->rx_queued -= seg->len;
+    tcpconn_rx_seg_free(tcpconn, seg);
+
+    if ((tcpconn->rx_hold) && (tcpconn->rx_queued <= (TCPCONN_RXQUEUE_MAX / 2))) {
+        tcpconn_rx_unhold(tcpconn);
     }
+    if ((tcpconn->closing) && (tcpconn->rx_head == NULL)) tcpconn_closed(tcprx_link);
+}
 
-    return;
+// Credit mode: the host acknowledged <count> bytes or segments, free the delivered data
+// With <resend> set, the delivered segments which are still not acknowledged are sent again
+//---------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_rx_ack(uint8_t tcp_n, uint32_t count, bool resend)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_rxseg_t *seg;
+
+    if (tcpconn->rx_unit == TCPRX_CREDIT_BYTES) tcpconn->rx_ackpend += count;
+    while ((seg = tcpconn->rx_head) != tcpconn->rx_next) {
+        if (tcpconn->rx_unit == TCPRX_CREDIT_SEGMENTS) {
+            if (count == 0) break;
+            count--;
+        }
+        else {
+            if (seg->len > tcpconn->rx_ackpend) break;
+            tcpconn->rx_ackpend -= seg->len;
+        }
+        tcpconn->rx_head = seg->next;
+        if (tcpconn->rx_head == NULL) tcpconn->rx_tail = NULL;
+        tcpconn->rx_queued -= seg->len;
+        tcpconn->rx_delivered -= seg->len;
+        tcpconn->rx_dlv_segs--;
+        tcpconn_rx_seg_free(tcpconn, seg);
+    }
+    if ((resend) || (tcpconn->rx_head == tcpconn->rx_next)) tcpconn->rx_ackpend = 0;
+    if (resend) {
+        if (tcpconn->rx_next != tcpconn->rx_head) tcpconn->stats.resends++;
+        tcpconn->rx_next = tcpconn->rx_head;
+        tcpconn->rx_delivered = 0;
+        tcpconn->rx_dlv_segs = 0;
+    }
 
-exit_err_alloc:
-    at_port_print_irom_str("\r\n+TCPSTART:zallocError\r\n");
+    // the unacknowledged data are not counted as waiting
+    if ((tcpconn->rx_hold) && ((tcpconn->rx_queued - tcpconn->rx_delivered) <= (TCPCONN_RXQUEUE_MAX / 2))) {
+        tcpconn_rx_unhold(tcpconn);
+    }
+    if ((tcpconn->closing) && (tcpconn->rx_queued == 0)) tcpconn_closed(tcp_n);
+    #if AT_HSPI_ENABLE
+    hspi_update_status();
+    #endif
+}
 
-exit_err:
-    at_response_error();
-    return;
+// Timeout receiving the request/confirmation or abort requested
+// Discard the link's data and close the connection
+//--------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_abort(void)
+{
+    tcpconn_t *tcpconn = tcpconns[tcprx_link];
+
+    os_timer_disarm(&tcprx_timer);
+    tcprx_state = TCPRX_IDLE;
+    tcpconn->stats.wait_ms += (system_get_time() - tcpconn->stats.wait_since) / 1000;
+    tcpconn->stats.aborts++;
+
+    tcpconn_rx_flush(tcprx_link);
+    if (tcpconn->closing) {
+        tcpconn_closed(tcprx_link);
+    }
+    else if (tcpconn->connected) {
+        at_port_print_irom_str("\r\n+TCPabort\r\n");
+        tcpconn_disconnect(tcprx_link);
+    }
 }
 
-// new client connected to the TCP Server
-//------------------------------------------------------------------
-static void ICACHE_FLASH_ATTR tcpserver_client_connect_cb(void *arg)
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_timeout_cb(void *arg)
 {
-    struct espconn *conn = (struct espconn *)arg;
-    uint8_t tcp_n, res;
-    char info[48] = {'\0'};
-    char ip_addr[16] = {'\0'};
-    uint8_t srv_n = TCPCONN_MAX_SERV;
+    if (tcprx_state == TCPRX_IDLE) return;
+    tcprx_abort();
+    tcprx_start();
+}
 
-    if ((conn->parrent & TCPCONN_PARRENT_MASK) != TCPCONN_PARRENT_MASK) goto exit;
-    srv_n = conn->parrent & 0x07;
-    if (srv_n >= TCPCONN_MAX_SERV) goto exit;
+// The delivery finished within the received chunk, the rest of it are AT commands
+// With the SDIO and HSPI transports the AT input goes through the fake UART and the bytes
+// are passed back to the AT command processor. On UART0 the AT task reads the FIFO itself
+// and libat has no call taking the bytes back, so the fake UART is enabled with the output
+// going to UART0, as in framed mode. The bytes and the following AT input are passed
+// through it until the host is idle for TCP_UART_FWD_MS.
+//-------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcp_uart_rx_to_at(uint8 *data, int32 len)
+{
+    #if AT_SDIO_ENABLE || AT_HSPI_ENABLE
+    at_fake_uart_rx(data, len);
+    #else
+    if (!tcp_uart_fwd) {
+        // waits for the buffered UART output to be sent
+        if (!at_fake_uart_enable(true, tcp_uart_at_tx)) return;
+        tcp_uart_fwd = 1;
+        os_timer_disarm(&tcp_uart_fwd_timer);
+        os_timer_setfn(&tcp_uart_fwd_timer, (os_timer_func_t *)tcp_uart_fwd_timer_cb, NULL);
+        os_timer_arm(&tcp_uart_fwd_timer, TCP_UART_FWD_MS, 0);
+    }
+    // the following AT input is forwarded too
+    at_register_uart_rx_intr(tcp_uart_fwd_rx_cb);
+    tcp_uart_fwd_rx_cb(data, len);
+    #endif
+}
 
-    // Find free TCP connection to use for the connected client
-    for (tcp_n=0; tcp_n<TCPCONN_MAX_CONN; tcp_n++) {
-        if (tcpconns[tcp_n] == NULL) break;
+// Characters received from the host while the data delivery is in progress
+// Called from the AT UART receive task, never blocks
+// The whole chunk is processed, the delivery of the next segment can start within it
+//-------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcp_uart_rx_cb(uint8 *data, int32 len)
+{
+    int32 i;
+    tcp_rxseg_t *seg;
+
+    for (i=0; i<len; i++) {
+        if (tcprx_state == TCPRX_WAIT_REQUEST) {
+            if (data[i] == 'r') {
+                // send data to host
+                seg = tcpconns[tcprx_link]->rx_head;
+                tcprx_sent_id++;
+                tcprx_state = TCPRX_WAIT_CONFIRM;
+                // wait for confirmation, the confirm timeout starts when the data are on the wire
+                if (uart_tx_write_cb(RXSEG_DATA(seg), seg->len, tcprx_sent_cb, (void *)tcprx_sent_id)) tcprx_arm_timer(TCP_DATA_TIMEOUT_MS);
+                else tcprx_arm_timer(TCP_CONFIRM_TIMEOUT_MS);
+            }
+            else if (data[i] == 'a') {
+                tcprx_abort();
+                tcprx_start();
+            }
+        }
+        else if (tcprx_state == TCPRX_WAIT_CONFIRM) {
+            if (data[i] == 'y') {
+                tcprx_done();
+                tcprx_start();
+            }
+            else if (data[i] == 'c') {
+                at_port_print_irom_str("\r\n+TCPresend\r\n");
+                tcpconns[tcprx_link]->stats.resends++;
+                tcprx_send_alert();
+            }
+            else if (data[i] == 'a') {
+                tcprx_abort();
+                tcprx_start();
+            }
+        }
+        else {
+            // nothing more to deliver, the UART is returned to the AT command processor
+            tcp_uart_rx_to_at(data + i, len - i);
+            return;
+        }
     }
-    if (tcp_n >= TCPCONN_MAX_CONN) goto exit; // not found
+    tcprx_start();
+}
 
-    if (tcpservers[srv_n]->connected >= tcpservers[srv_n]->maxconn) goto exit; // max number of connections reached
+static void ICACHE_FLASH_ATTR tcpconn_tx_push(uint8_t tcp_n);
 
-    // register new TCP connection to server
-    // create tcpconn structure
-    tcpconn_t *tcpconn = (tcpconn_t *)os_zalloc(sizeof(tcpconn_t));
-    if (!tcpconn) goto exit;
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpcork_timer_cb(void *arg)
+{
+    uint8_t tcp_n;
 
-    tcpconn->connected = 1;
-    os_memcpy(tcpconn->remote_ip, conn->proto.tcp->remote_ip, 4);
-    os_sprintf(ip_addr, IPSTR, conn->proto.tcp->remote_ip[0], conn->proto.tcp->remote_ip[1], conn->proto.tcp->remote_ip[2], conn->proto.tcp->remote_ip[3]);
-    tcpconn->ip.addr = ipaddr_addr(ip_addr);
-    tcpconn->port = (uint16_t)conn->proto.tcp->remote_port;
-    tcpconn->ssl = tcpservers[srv_n]->ssl;
-    tcpconn->parrent = conn->parrent;
-    tcpconn->conn = conn;
+    tcpcork_armed = 0;
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if (tcpconns[tcp_n]) tcpconn_tx_push(tcp_n);
+    }
+}
 
-    res = espconn_regist_time(tcpconn->conn, (uint32_t)tcpservers[srv_n]->timeout, 1);
-    if (res != ESPCONN_OK) {
-        at_port_print_irom_str("\r\nTCPClientRegTimeERROR\r\n");
+// Cork mode: check if the chunk has to wait for more data
+// The chunk waits while it is the last one, smaller than the cork size and the cork delay is not over.
+// The links are pushed again from the timer when the earliest waiting chunk is due.
+//---------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR tcpconn_tx_corked(tcpconn_t *tcpconn, tcp_txseg_t *seg)
+{
+    int32_t remain;
+
+    if ((tcpconn->tx_mode != TCPTX_MODE_CORK) || (seg != tcpconn->tx_tail) || (seg->len >= tcpconn->tx_cork_bytes)) return false;
+    remain = (int32_t)(tcpconn->tx_cork_until - system_get_time());
+    if (remain <= 0) return false;
+
+    if ((!tcpcork_armed) || ((int32_t)(tcpcork_due - tcpconn->tx_cork_until) > 0)) {
+        os_timer_disarm(&tcpcork_timer);
+        os_timer_setfn(&tcpcork_timer, (os_timer_func_t *)tcpcork_timer_cb, NULL);
+        os_timer_arm(&tcpcork_timer, (remain + 999) / 1000, 0);
+        tcpcork_armed = 1;
+        tcpcork_due = tcpconn->tx_cork_until;
     }
+    return true;
+}
 
-    tcpconns[tcp_n] = tcpconn;
+// Pass the next queued chunk of the link to espconn
+// Only one chunk is written at a time, the next one is passed from the write finish callback
+//----------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_tx_push(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_txseg_t *seg = tcpconn->tx_head;
+    sint8 res;
+
+    if ((tcpconn->tx_busy) || (seg == NULL) || (!tcpconn->connected)) return;
+    // cork mode, the last chunk waits for more data
+    if (tcpconn_tx_corked(tcpconn, seg)) return;
+
+    if (tcpconn->ssl > 0) res = espconn_secure_send(tcpconn->conn, seg->data, seg->len);
+    else res = espconn_send(tcpconn->conn, seg->data, seg->len);
+    if (res == ESPCONN_MAXNUM) {
+        // TCP send queue is full, try again when some data are acknowledged
+        return;
+    }
+    if (res != 0) {
+        // the waiting operations are reported as failed when the connection is closed
+        at_port_print_irom_str("\r\n+TCPSEND:sendError\r\n");
+        if (tcpconn->ssl > 0) espconn_secure_disconnect(tcpconn->conn);
+        else espconn_disconnect(tcpconn->conn);
+        return;
+    }
 
-    // register connection callbacks
-    _tcpconn_register_cb_cb(conn);
+    tcpconn->tx_head = seg->next;
+    if (tcpconn->tx_head == NULL) tcpconn->tx_tail = NULL;
+    tcpconn->tx_inflight = seg;
+    tcpconn->tx_busy = 1;
+    tcpconn->stats.tx_bytes += seg->len;
+    tcpconn->stats.tx_segs++;
+    seg->op->unwritten--;
+    seg->op->unacked++;
+}
 
-    tcpservers[srv_n]->connected++;
+// Queue the chunk to the link and send it
+// In Nagle and cork modes the data are first merged into the last chunk waiting to be sent,
+// so the small writes are sent in full segments (one TLS record on SSL links).
+// The merged data are acknowledged with that chunk, the operations are still reported in order.
+// The replayed spool records are never merged, each one is committed when its chunk is acknowledged.
+//---------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_tx_queue(uint8_t tcp_n, tcp_txseg_t *seg)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_txseg_t *tail = tcpconn->tx_tail;
+    uint16_t n;
+
+    seg->op->chunks++;
+    if ((tcpconn->tx_mode != TCPTX_MODE_NODELAY) && (tail) && (tail->len < tail->size) && (seg->op != tcpconn->spool_op)) {
+        n = tail->size - tail->len;
+        if (n > seg->len) n = seg->len;
+        os_memcpy(tail->data + tail->len, seg->data, n);
+        tail->len += n;
+        seg->len -= n;
+        tcpconn->tx_merged++;
+        if (seg->len == 0) {
+            tcpsend_seg_free(seg);
+            tcpconn_tx_push(tcp_n);
+            return;
+        }
+        os_memmove(seg->data, seg->data + n, seg->len);
+    }
 
-    os_sprintf(info, "%d,%d,TCPconnect:%s,%d\r\n", srv_n, tcp_n, ip_addr, tcpconn->port);
-    at_port_print(info);
+    // the cork delay starts with the first waiting data
+    if (tcpconn->tx_head == NULL) tcpconn->tx_cork_until = system_get_time() + (tcpconn->tx_cork_delay * 1000);
+    if (tail) tail->next = seg;
+    else tcpconn->tx_head = seg;
+    tcpconn->tx_tail = seg;
+    seg->op->unwritten++;
 
-    return;
+    tcpconn_tx_push(tcp_n);
+}
 
-exit:
-    if (srv_n < TCPCONN_MAX_SERV) {
-        if (tcpservers[srv_n]->ssl > 0) espconn_secure_disconnect(conn);
-        else espconn_disconnect(conn);
+static void ICACHE_FLASH_ATTR tcpconn_txop_check(uint8_t tcp_n);
+
+// Queue the link's spooled records while there is room in the send queue
+// A record is read when the previous ones are written, it is committed when its chunk is acknowledged
+//---------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpspool_feed(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_txop_t *op;
+    tcp_txseg_t *seg;
+    uint16_t len;
+
+    if (tcpconn == NULL) return;
+    // the host's data are being written to the spool, they are replayed when complete
+    if ((tcpsend.state != TCPTX_IDLE) && (tcpsend.spool) && (tcpsend.link == tcp_n)) return;
+    op = tcpconn->spool_op;
+    while ((op) && (!op->input_done) && (op->unwritten < TCPSPOOL_FEED_CHUNKS)) {
+        len = spool_next(tcp_n);
+        if (len == 0) {
+            // all records are queued, the replay completes when they are acknowledged
+            op->input_done = 1;
+            break;
+        }
+        // no room, retried when some data are acknowledged
+        if ((tcpsend_queued + len) > TCPSEND_QUEUE_MAX) break;
+        seg = (tcp_txseg_t *)os_malloc(sizeof(tcp_txseg_t) + len);
+        if (seg == NULL) break;
+        seg->next = NULL;
+        seg->op = op;
+        seg->size = len;
+        tcpsend_queued += len;
+        seg->len = spool_read(tcp_n, seg->data, len);
+        if (seg->len == 0) {
+            // flash read error, the record is replayed on the next connection
+            tcpsend_seg_free(seg);
+            op->input_done = 1;
+            break;
+        }
+        tcpconn_tx_queue(tcp_n, seg);
     }
-    else espconn_disconnect(conn);
-    os_sprintf(info, "\r\nTCPServerERROR:conn,%d\r\n", conn->link_cnt);
-    at_port_print(info);
+    // all records were already acknowledged
+    if ((op) && (op->input_done) && (op->unwritten == 0) && (op->unacked == 0)) tcpconn_txop_check(tcp_n);
 }
 
-
-//AT+TCPSERVER=<serv_id>,<enable>,[<port>],[<ssl>],[<maxconn>],[conn_timeout]
-//==================================================================
-void ICACHE_FLASH_ATTR at_setupCmdTCPServer(uint8_t id, char *pPara)
+// Feed the replays of all links, called when the acknowledged data freed room in the send queue
+//---------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpspool_feed_all(void)
 {
-    int enable = -1;
-    int port = 333;
-    int ssl = 0;
-    int srv_n = 0;
-    int maxconn = TCPCONN_MAX_CONN;
-    int tmo = TCPSERV_CONN_TIMEOUT;
-    int err = 0, flag = 0;
     uint8_t tcp_n;
-    uint8_t cli_srv_n;
-    err_t result;
-    uint8_t res;
 
-    pPara++; // skip '='
+    for (tcp_n = 0; tcp_n < tcpconn_max; tcp_n++) {
+        if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->spool_op)) tcpspool_feed(tcp_n);
+    }
+}
 
-    //get the 1st parameter (serv_id)
-    flag = at_get_next_int_dec(&pPara, &srv_n, &err);
-    if (err != 0) goto exit_err;
-    if ((srv_n < 0) || (srv_n >= TCPCONN_MAX_SERV)) goto exit_err;
+static void ICACHE_FLASH_ATTR tcpspool_start(uint8_t tcp_n);
 
-    if (*pPara != ',') goto exit_err;
-    pPara++; // skip ','
+// Report the completed AT+TCPSEND operations: '+TCPSENT,<link_id>,<seq>'
+// The completed replay of the spooled data is reported with '+TCPSPOOL,<link_id>,DONE,<bytes>'
+//-----------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_txop_check(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_txop_t *op;
+    char info[40] = {'\0'};
+    bool restart = false;
 
-    //get the 2nd parameter (enable)
+    while ((op = tcpconn->txop_head) != NULL) {
+        if ((!op->input_done) || (op->unwritten) || (op->unacked)) break;
+
+        if (op == tcpconn->spool_op) {
+            tcpconn->spool_op = NULL;
+            // data spooled while the replay was in progress are replayed before the link is released
+            if ((op->chunks) && (spool_records(tcp_n))) restart = true;
+            else {
+                os_sprintf(info, "+TCPSPOOL,%d,DONE,%u\r\n", tcp_n, tcpconn->tx_replayed);
+                tcpconn_event(tcp_n, info);
+                tcpconn->tx_replayed = 0;
+            }
+        }
+        else if (tcp_framed) tcpframe_send_result(tcp_n, FRAME_TYPE_ACK, op->seq);
+        else {
+            os_sprintf(info, "\r\n+TCPSENT,%d,%d\r\n", tcp_n, op->seq);
+            at_port_print(info);
+        }
+
+        tcpconn->txop_head = op->next;
+        if (tcpconn->txop_head == NULL) tcpconn->txop_tail = NULL;
+        tcpconn->tx_ops--;
+        os_free(op);
+    }
+    if (restart) tcpspool_start(tcp_n);
+    #if AT_HSPI_ENABLE
+    hspi_update_status();
+    #endif
+}
+
+// Start the replay of the link's spooled data, called when the link is connected
+// The records are sent before any new data, AT+TCPSEND goes to the spool until the replay completes
+//---------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpspool_start(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcp_txop_t *op;
+
+    if ((!tcpspool_ready) || (tcpconn == NULL) || (tcpconn->udp) || (tcpconn->spool_op)) return;
+    if (spool_records(tcp_n) == 0) return;
+
+    op = (tcp_txop_t *)os_zalloc(sizeof(tcp_txop_t));
+    if (!op) return;
+    spool_rewind(tcp_n);
+    if (tcpconn->txop_tail) tcpconn->txop_tail->next = op;
+    else tcpconn->txop_head = op;
+    tcpconn->txop_tail = op;
+    tcpconn->tx_ops++;
+    tcpconn->spool_op = op;
+
+    tcpspool_feed(tcp_n);
+}
+
+// Check if the data sent to the link go to the spool: the spool is enabled for the link
+// and the link is not connected or its spooled data are not yet replayed
+//---------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR tcpspool_route(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+
+    if ((!tcpspool_ready) || ((tcpspool_links & (1 << tcp_n)) == 0)) return false;
+    if (tcpconn == NULL) return true;
+    if (tcpconn->udp) return false;
+    return ((!tcpconn->connected) || (tcpconn->closing) || (tcpconn->spool_op) || (spool_records(tcp_n)));
+}
+
+// Remove the operation which has no data queued
+//-----------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_txop_remove(tcpconn_t *tcpconn, tcp_txop_t *op)
+{
+    tcp_txop_t *prev = NULL, *cur = tcpconn->txop_head;
+
+    while ((cur) && (cur != op)) {
+        prev = cur;
+        cur = cur->next;
+    }
+    if (cur == NULL) return;
+
+    if (prev) prev->next = op->next;
+    else tcpconn->txop_head = op->next;
+    if (tcpconn->txop_tail == op) tcpconn->txop_tail = prev;
+    tcpconn->tx_ops--;
+    os_free(op);
+}
+
+// Finish the AT+TCPSEND command and release the UART
+// The data are sent in background, completion is reported with '+TCPSENT'
+//------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpsend_end(bool ok)
+{
+    uint8_t tcp_n = tcpsend.link;
+    tcp_txop_t *op = tcpsend.op;
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    uint8_t spool = tcpsend.spool;
+
+    os_timer_disarm(&tcpsend_timer);
+    if (tcpsend.seg) tcpsend_seg_free(tcpsend.seg);
+    // the incomplete data are not replayed
+    if ((!ok) && (spool)) spool_drop(tcp_n, tcpsend.spooled);
+    os_memset(&tcpsend, 0, sizeof(tcpsend_t));
+
+    if ((op) && (tcpconn)) {
+        if (ok) op->input_done = 1;
+        else if (op->chunks == 0) tcpconn_txop_remove(tcpconn, op);
+        else if (tcpconn->connected) {
+            // part of the data is already queued, the connection must be closed
+            if (tcpconn->ssl > 0) espconn_secure_disconnect(tcpconn->conn);
+            else espconn_disconnect(tcpconn->conn);
+        }
+    }
+
+    if (ok) at_response_ok();
+    else at_port_print_irom_str("\r\nFAIL\r\n");
+    at_leave_special_state();
+    // return the UART to the AT command processor or to the data delivery
+    tcprx_start();
+
+    if ((tcpconn) && (spool)) {
+        // replay the spooled data if the link is connected
+        if ((!tcpconn->connected) || (tcpconn->closing)) return;
+        if (tcpconn->spool_op) tcpspool_feed(tcp_n);
+        else if (ok) tcpspool_start(tcp_n);
+    }
+    else if ((ok) && (tcpconn)) {
+        tcpconn_tx_push(tcp_n);
+        tcpconn_txop_check(tcp_n);
+    }
+}
+
+// Queue the filled chunk to the link
+//-----------------------------------------------
+static void ICACHE_FLASH_ATTR tcpsend_seg_queue(void)
+{
+    tcp_txseg_t *seg = tcpsend.seg;
+
+    tcpsend.seg = NULL;
+    if (tcpsend.spool) {
+        // the link is not connected or is replaying, the chunk is appended to the spool
+        if (spool_write(tcpsend.link, seg->data, seg->len)) tcpsend.spooled++;
+        else {
+            at_port_print_irom_str("\r\n+TCPSEND:spoolFull\r\n");
+            tcpsend.state = TCPTX_DISCARD;
+        }
+        tcpsend_seg_free(seg);
+        return;
+    }
+    tcpconn_tx_queue(tcpsend.link, seg);
+}
+
+// All data are received from the host: '+TCPSEND:<length>,<seq>'
+// The data written to the spool are reported with '+TCPSEND:<length>,SPOOL'
+//-----------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpsend_input_done(void)
+{
+    char info[32] = {'\0'};
+
+    if ((tcpsend.spool) && (tcpsend.state == TCPTX_INPUT)) {
+        if ((tcpsend.seg) && (tcpsend.seg->len > 0)) tcpsend_seg_queue();
+    }
+    if ((tcpsend.state == TCPTX_DISCARD) || ((tcpsend.op == NULL) && (!tcpsend.spool))) {
+        os_sprintf(info, "\r\n+TCPSEND:%d\r\n", tcpsend.total);
+        at_port_print(info);
+        tcpsend_end(false);
+        return;
+    }
+
+    if (tcpsend.spool) {
+        os_sprintf(info, "\r\n+TCPSEND:%d,SPOOL\r\n", tcpsend.total);
+        at_port_print(info);
+        tcpsend_end(true);
+        return;
+    }
+    os_sprintf(info, "\r\n+TCPSEND:%d,%d\r\n", tcpsend.total, tcpsend.op->seq);
+    at_port_print(info);
+    if ((tcpsend.seg) && (tcpsend.seg->len > 0)) tcpsend_seg_queue();
+    tcpsend_end(true);
+}
+
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpsend_timeout_cb(void *arg)
+{
+    char info[32] = {'\0'};
+
+    if (tcpsend.state == TCPTX_IDLE) return;
+
+    os_sprintf(info, "\r\n+TCPSEND:%d\r\n", tcpsend.total);
+    at_port_print(info);
+    tcpsend_end(false);
+}
+
+// Data received from the host during AT+TCPSEND
+// Called from the AT UART receive task, the data are copied into the chunk buffers
+//--------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpsend_uart_rx_cb(uint8 *data, int32 len)
+{
+    int32 i;
+    tcp_txseg_t *seg;
+
+    os_timer_arm(&tcpsend_timer, TCPSEND_INPUT_TIMEOUT_MS, 0);
+
+    for (i=0; i<len; i++) {
+        if ((tcpsend.term) && (data[i] == TCPINPUT_TERMINATE_CHAR)) {
+            tcpsend_input_done();
+            return;
+        }
+        if (tcpsend.state == TCPTX_INPUT) {
+            if (tcpsend.seg == NULL) {
+                seg = NULL;
+                if ((tcpsend_queued + TCPSEND_CHUNK_SIZE) <= TCPSEND_QUEUE_MAX) {
+                    seg = (tcp_txseg_t *)os_malloc(sizeof(tcp_txseg_t) + TCPSEND_CHUNK_SIZE);
+                }
+                if (seg) {
+                    seg->next = NULL;
+                    seg->op = tcpsend.op;
+                    seg->len = 0;
+                    seg->size = TCPSEND_CHUNK_SIZE;
+                    tcpsend_queued += TCPSEND_CHUNK_SIZE;
+                    tcpsend.seg = seg;
+                }
+                else {
+                    // the host sends faster than the data can be sent
+                    at_port_print_irom_str("\r\n+TCPSEND:overflow\r\n");
+                    tcpsend.state = TCPTX_DISCARD;
+                }
+            }
+            if (tcpsend.seg) {
+                tcpsend.seg->data[tcpsend.seg->len++] = data[i];
+                if (tcpsend.seg->len == TCPSEND_CHUNK_SIZE) tcpsend_seg_queue();
+            }
+        }
+        tcpsend.total++;
+        if (!tcpsend.term) tcpsend.remain--;
+        if (((!tcpsend.term) && (tcpsend.remain == 0)) || (tcpsend.total >= TCPSEND_MAX_LEN)) {
+            tcpsend_input_done();
+            return;
+        }
+    }
+}
+
+// Data sent callback
+// Called when the data passed with espconn_send are acknowledged by the remote side
+//-----------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_sendcb(void *arg)
+{
+    struct espconn *conn = (struct espconn *)arg;
+    uint8_t tcp_n = _get_tcpn(conn);
+    tcpconn_t *tcpconn;
+    tcp_txop_t *op;
+
+    if (tcp_n >= tcpconn_max) return;
+    tcpconn = tcpconns[tcp_n];
+
+    // chunks are acknowledged in the order they were sent
+    for (op = tcpconn->txop_head; op != NULL; op = op->next) {
+        if (op->unacked) {
+            op->unacked--;
+            // the replayed record is delivered
+            if (op == tcpconn->spool_op) tcpconn->tx_replayed += spool_commit(tcp_n);
+            break;
+        }
+    }
+    if ((tcpconn->ssl > 0) && (tcpconn->tx_inflight)) {
+        // secure connection, the next chunk can be sent only after the previous is acknowledged
+        tcpsend_seg_free(tcpconn->tx_inflight);
+        tcpconn->tx_inflight = NULL;
+        tcpconn->tx_busy = 0;
+    }
+    tcpconn_tx_push(tcp_n);
+    tcpspool_feed_all();
+    tcpconn_txop_check(tcp_n);
+}
+
+// Write finish callback
+// Called when all data passed with espconn_send are written (copied) to the TCP stack
+//------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_writecb(void *arg)
+{
+    struct espconn *conn = (struct espconn *)arg;
+    uint8_t tcp_n = _get_tcpn(conn);
+    tcpconn_t *tcpconn;
+
+    if (tcp_n >= tcpconn_max) return;
+    tcpconn = tcpconns[tcp_n];
+    if (tcpconn->ssl > 0) return;
+
+    // the chunk can be freed
+    if (tcpconn->tx_inflight) {
+        tcpsend_seg_free(tcpconn->tx_inflight);
+        tcpconn->tx_inflight = NULL;
+    }
+    tcpconn->tx_busy = 0;
+    tcpconn_tx_push(tcp_n);
+    tcpspool_feed(tcp_n);
+}
+
+// Copy the received data into the link's queue, from the linear buffer or from the pbuf chain
+//--------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_copy(uint8_t *dst, const char *pusrdata, struct pbuf *p, uint16_t length)
+{
+    if (p) pbuf_copy_partial(p, dst, length, 0);
+    else os_memcpy(dst, pusrdata, length);
+}
+
+// Copy the received data into the passive mode ring buffer, segment by segment from the pbuf chain
+//--------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcprx_ring_copy(ringbuf_t rb, const char *pusrdata, struct pbuf *p, uint16_t length)
+{
+    void *payload;
+    uint16_t n;
+
+    if (p == NULL) {
+        ringbuf_memcpy_into(rb, pusrdata, length);
+        return;
+    }
+    while ((p) && (length > 0)) {
+        n = espconn_pbuf_payload(p, &payload, &p);
+        if (n > length) n = length;
+        ringbuf_memcpy_into(rb, payload, n);
+        length -= n;
+    }
+}
+
+// queue the received data and start the delivery to the host, never waits for the host
+// The data are given in the linear buffer 'pusrdata' or, on plain TCP links, in the pbuf chain 'p'
+// Returns false if there is no memory for the data, the plain TCP data are then refused to lwIP
+//--------------------------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR tcpconn_rx_input(struct espconn *conn, char *pusrdata, struct pbuf *p, unsigned short length)
+{
+    char info[32] = {'\0'};
+    tcp_rxseg_t *seg;
+    uint16_t size;
+    uint32_t now = system_get_time();
+    bool burst;
+    tcppool_t *entry;
+    uint8_t tcp_n = _get_tcpn(conn);
+
+    if (tcp_n >= tcpconn_max) {
+        entry = tcppool_find(conn);
+        if (entry) {
+            // data on the parked connection, it is not idle and can not be reused
+            if (entry->state == TCPPOOL_PARKED) tcppool_close(entry);
+            return true;
+        }
+        os_sprintf(info, "\r\nTCPClientERROR:recv,%d:", length);
+        at_port_print(info);
+        return true;
+    }
+    tcpconn_rx_reserve(tcpconns[tcp_n]);
+
+    if ((tcpconns[tcp_n]->rx_mode == TCPRECV_MODE_PASSIVE) && (tcpconns[tcp_n]->rx_head == NULL) &&
+            (ringbuf_bytes_free(tcpconns[tcp_n]->rx_ring) >= length)) {
+        tcprx_ring_copy(tcpconns[tcp_n]->rx_ring, pusrdata, p, length);
+    }
+    else if (tcprx_coal_open(tcp_n, length)) {
+        // coalescing, merge into the last segment which is not yet delivered
+        seg = tcpconns[tcp_n]->rx_tail;
+        tcprx_copy(seg->data + seg->len, pusrdata, p, length);
+        seg->len += length;
+        tcpconns[tcp_n]->rx_merged++;
+    }
+    else {
+        // active mode or the ring buffer is full, queue the segment
+        // a small segment of the coalescing link gets room for the following ones
+        size = length;
+        if ((tcpconns[tcp_n]->rx_mode == TCPRECV_MODE_ACTIVE) && (length < tcpconns[tcp_n]->rx_coal_bytes)) {
+            size = tcpconns[tcp_n]->rx_coal_bytes;
+        }
+        seg = (tcp_rxseg_t *)os_malloc(sizeof(tcp_rxseg_t) + size);
+        if ((!seg) && (tcpconns[tcp_n]->rx_spare) && (length <= tcpconns[tcp_n]->rx_spare->size)) {
+            // SSL link, take the reserved segment, the window is held until it is replaced
+            seg = tcpconns[tcp_n]->rx_spare;
+            tcpconns[tcp_n]->rx_spare = NULL;
+            size = seg->size;
+        }
+        if (!seg) {
+            if (tcpconns[tcp_n]->ssl) {
+                // the decrypted record can not be received again, close the link rather than
+                // deliver the stream with the data missing
+                os_sprintf(info, "\r\nTCPClientERROR:mem,%d:", length);
+                at_port_print(info);
+                tcpconn_disconnect(tcp_n);
+            }
+            return false;
+        }
+        seg->next = NULL;
+        seg->pbuf = NULL;
+        seg->len = length;
+        seg->size = size;
+        tcprx_copy(seg->data, pusrdata, p, length);
+        // the segment waits for more data only within a burst,
+        // the first segment after a pause is delivered without delay
+        burst = ((tcpconns[tcp_n]->rx_segs) && ((now - tcpconns[tcp_n]->rx_last_time) < tcpconns[tcp_n]->rx_coal_window));
+        tcpconns[tcp_n]->rx_coal_until = (burst) ? (now + tcpconns[tcp_n]->rx_coal_window) : now;
+
+        if (tcpconns[tcp_n]->rx_tail) tcpconns[tcp_n]->rx_tail->next = seg;
+        else tcpconns[tcp_n]->rx_head = seg;
+        tcpconns[tcp_n]->rx_tail = seg;
+        if ((tcpconns[tcp_n]->rx_credit) && (tcpconns[tcp_n]->rx_next == NULL)) tcpconns[tcp_n]->rx_next = seg;
+    }
+    tcpconns[tcp_n]->rx_queued += length;
+    tcpconns[tcp_n]->rx_segs++;
+    tcpconns[tcp_n]->rx_last_time = now;
+    tcpconns[tcp_n]->stats.rx_bytes += length;
+    tcpconns[tcp_n]->stats.rx_segs++;
+
+    // the host is too slow or the SSL link has no reserved segment, stop advertising the receive window
+    if (!tcpconns[tcp_n]->rx_hold) {
+        if (((tcpconns[tcp_n]->rx_mode == TCPRECV_MODE_ACTIVE) &&
+                ((tcpconns[tcp_n]->rx_queued - tcpconns[tcp_n]->rx_delivered) >= TCPCONN_RXQUEUE_MAX)) ||
+                ((tcpconns[tcp_n]->rx_mode == TCPRECV_MODE_PASSIVE) && (ringbuf_bytes_free(tcpconns[tcp_n]->rx_ring) < TCP_MSS)) ||
+                ((tcpconns[tcp_n]->ssl) && (tcpconns[tcp_n]->rx_spare == NULL))) {
+            espconn_recv_hold(conn);
+            tcpconns[tcp_n]->rx_hold = 1;
+            tcpconns[tcp_n]->stats.hold_since = now;
+        }
+    }
+
+    if ((tcpconns[tcp_n]->rx_mode == TCPRECV_MODE_PASSIVE) && (tcpconns[tcp_n]->rx_notify == 0)) tcpconns[tcp_n]->rx_notify = 1;
+    tcprx_start();
+    return true;
+}
+
+// called when connection receives data
+//--------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_recvcb(void *arg, char *pusrdata, unsigned short length)
+{
+    tcpconn_rx_input((struct espconn *)arg, pusrdata, NULL, length);
+}
+
+// called when the plain TCP connection receives data, with the lwIP pbuf chain
+// The chain is copied once into the link's queue instead of into the linear buffer espconn
+// allocates for tcpconn_recvcb and again into the queue. The chain holds the WLAN receive
+// buffers, so it is released at once, the receive window is still controlled by the hold.
+// Without memory for the data the chain is refused, lwIP keeps it and passes it again later.
+//--------------------------------------------------------------------------------------------
+static sint8 ICACHE_FLASH_ATTR tcpconn_recv_pbuf(void *arg, struct pbuf *p, unsigned short length)
+{
+    struct espconn *conn = (struct espconn *)arg;
+
+    if (!tcpconn_rx_input(conn, NULL, p, length)) return ESPCONN_MEM;
+    espconn_recv_pbuf_free(conn, p);
+    return ESPCONN_OK;
+}
+
+// Disconnect callback
+//-------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_disconcb(void *arg)
+{
+    struct espconn *conn = (struct espconn *)arg;
+    tcppool_t *entry;
+    uint8_t tcp_n = _get_tcpn(conn);
+
+    if ((tcp_n >= tcpconn_max) && ((entry = tcppool_find(conn)) != NULL)) {
+        // parked connection closed, by the remote or by the pool
+        if (entry->state == TCPPOOL_PARKED) tcppool_evicted++;
+        tcppool_free(entry);
+        return;
+    }
+
+    uint8_t srv_n = tcpserv_max;
+    if ((conn->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
+        srv_n = conn->parrent & 0x07;
+    }
+    if (tcp_n < tcpconn_max) {
+        // refused connections were never counted
+        if ((srv_n < tcpserv_max) && (tcpservers[srv_n]) && (tcpservers[srv_n]->connected > 0)) tcpservers[srv_n]->connected--;
+        tcpconns[tcp_n]->connected = 0;
+        tcpconn_tx_flush(tcp_n, true);
+        if (_is_server_link(tcp_n)) tcpconns[tcp_n]->conn = NULL;
+        if (tcpconns[tcp_n]->rx_queued) tcpconns[tcp_n]->closing = 1;
+        else tcpconn_closed(tcp_n);
+        tcprx_start();
+    }
+    else {
+        at_port_print_irom_str("\r\nTCPClientERROR:disconn\r\n");
+        if (conn->state == ESPCONN_CLOSE) {
+            at_port_print_irom_str("9,CLOSED\r\n");
+        }
+    }
+}
+
+// callback for lost connection
+//----------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_recon_cb(void *arg, sint8 errType)
+{
+    struct espconn *conn = (struct espconn *)arg;
+    tcppool_t *entry;
+    uint8_t tcp_n = _get_tcpn(conn);
+
+    if ((tcp_n >= tcpconn_max) && ((entry = tcppool_find(conn)) != NULL)) {
+        // parked connection lost
+        if (entry->state == TCPPOOL_PARKED) tcppool_evicted++;
+        tcppool_free(entry);
+        return;
+    }
+    if (tcp_n < tcpconn_max) {
+        if (tcpconns[tcp_n]->connected == 0) {
+            // connection failed
+            if (tcpconns[tcp_n]->async) tcpstart_done(tcp_n, "ERROR");
+            else {
+                at_leave_special_state();
+                at_response_error();
+            }
+            tcpconn_cleanup(tcp_n);
+        }
+        else {
+            tcpconns[tcp_n]->connected = 0;
+            tcpconn_tx_flush(tcp_n, true);
+            if (_is_server_link(tcp_n)) tcpconns[tcp_n]->conn = NULL;
+            if (tcpconns[tcp_n]->rx_queued) tcpconns[tcp_n]->closing = 1;
+            else tcpconn_closed(tcp_n);
+        }
+        tcprx_start();
+    }
+    else {
+        if (!tcp_async) at_leave_special_state();
+        at_port_print_irom_str("\r\nTCPClientERROR:reconn\r\n");
+        if (conn->state == ESPCONN_CLOSE) {
+            at_port_print_irom_str("9,CLOSED\r\n");
+        }
+    }
+}
+
+//-------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR _tcpconn_register_cb_cb(struct espconn *conn)
+{
+    uint8_t tcp_n;
+    sint16 size;
+
+    // set connection options
+    /*
+    ESPCONN_REUSEADDR = 0x01,   free memory after TCP disconnection. Need not wait for 2 minutes
+    ESPCONN_NODELAY = 0x02,     disable nagle algorithm during TCP data transmission, thus quickening the data transmission
+    ESPCONN_COPY = 0x04,        enable espconn_regist_write_finish. Enter write finish callback once the data has been sent using espconn_send
+    ESPCONN_KEEPALIVE = 0x08,   enable TCP keep alive
+    */
+    espconn_set_opt(conn, 0x0F); // ESPCONN_REUSEADDR | ESPCONN_NODELAY | ESPCONN_KEEPALIVE | ESPCONN_COPY
+
+    // register connection callbacks
+    espconn_regist_disconcb(conn, tcpconn_disconcb);
+    espconn_regist_recvcb(conn, tcpconn_recvcb);
+    espconn_regist_write_finish(conn, tcpconn_writecb);
+    espconn_regist_sentcb(conn, tcpconn_sendcb);
+    // the plain TCP data are taken from the pbuf chain, without the intermediate copy
+    tcp_n = _get_tcpn(conn);
+    if (tcp_n >= tcpconn_max) return;
+    if (tcpconns[tcp_n]->ssl == 0) espconn_regist_recv_pbufcb(conn, tcpconn_recv_pbuf);
+    else {
+        // the decrypted data are given in one buffer of up to the SSL record buffer size
+        size = espconn_secure_get_size((_is_server_link(tcp_n)) ? ESPCONN_SERVER : ESPCONN_CLIENT);
+        tcpconns[tcp_n]->rx_spare_size = (size > 0) ? size : TCP_MSS;
+        tcpconn_rx_reserve(tcpconns[tcp_n]);
+    }
+}
+
+// TCP Client successfully connected to the remote server
+// Used by AT+TCPSTART
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_connect_cb(void *arg)
+{
+    struct espconn *conn = (struct espconn *)arg;
+    char info[16] = {'\0'};
+    uint8_t tcp_n = _get_tcpn(conn);
+
+    if (tcp_n < tcpconn_max) {
+        _tcpconn_register_cb_cb(conn);
+
+        if (tcpconns[tcp_n]->keepalive) {
+            espconn_set_keepalive(tcpconns[tcp_n]->conn, ESPCONN_KEEPIDLE, &tcpconns[tcp_n]->keepalive);
+        }
+
+        tcpconns[tcp_n]->connected = 1;
+        if (tcpconns[tcp_n]->async) {
+            tcpconns[tcp_n]->async = 0;
+            tcpstart_done(tcp_n, "CONNECT");
+        }
+        else {
+            os_sprintf(info, "%d,CONNECT\r\n", tcp_n);
+            tcpconn_event(tcp_n, info);
+
+            at_leave_special_state();
+            at_response_ok();
+        }
+        tcpspool_start(tcp_n);
+    }
+    else if (tcp_async) {
+        at_port_print_irom_str("\r\nTCPClientERROR:connect\r\n");
+    }
+    else {
+        at_leave_special_state();
+        at_port_print_irom_str("\r\nTCPClientERROR:connect\r\n");
+        at_response_error();
+    }
+}
+
+// call back for DNS lookup
+//----------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpconn_resolved(const char *name, ip_addr_t *ip, void *arg)
+{
+    struct espconn *conn = (struct espconn *)arg;
+    sint8 res;
+    uint8_t tcp_n = _get_tcpn(conn);
+
+    if ((tcp_n < tcpconn_max) && (tcpconns[tcp_n]->async) && (ip == 0)) {
+        tcpconn_cleanup(tcp_n);
+        tcpstart_done(tcp_n, "DNSError");
+        return;
+    }
+    if ((tcp_n >= tcpconn_max) && (tcp_async)) return;
+    if ((tcp_n >= tcpconn_max) || (ip == 0)) {
+        // Domain name not resolved or tcpconn not resolved, exit with error
+        tcpconn_cleanup(tcp_n);
+        at_leave_special_state();
+        if (ip != 0) at_port_print_irom_str("\r\n+TCPSTART:linkError\r\n");
+        else at_port_print_irom_str("\r\n+TCPSTART:DNSError\r\n");
+        at_response_error();
+        return;
+    }
+
+    // set up the connection
+    conn->type = ESPCONN_TCP;
+    conn->state = ESPCONN_NONE;
+    if (tcpconns[tcp_n]->local_port == 0) conn->proto.tcp->local_port = espconn_port();
+    else conn->proto.tcp->local_port = tcpconns[tcp_n]->local_port;
+    conn->proto.tcp->remote_port = tcpconns[tcp_n]->port;
+    *(ip_addr_t*)conn->proto.tcp->remote_ip = *ip;
+    os_memcpy(tcpconns[tcp_n]->remote_ip, conn->proto.tcp->remote_ip, 4);
+
+    // register connect & reconnect connection callbacks
+    espconn_regist_connectcb(conn, tcpconn_connect_cb);
+    espconn_regist_reconcb(conn, tcpconn_recon_cb);
+
+    tcpconns[tcp_n]->connected = 0;
+
+    //espconn_tcp_set_max_syn(100); // ToDo: ??
+
+    if (tcpconns[tcp_n]->ssl > 0) res = espconn_secure_connect(conn);
+    else res = espconn_connect(conn);
+    if (res != ESPCONN_OK) {
+        // no callback will follow
+        if (tcpconns[tcp_n]->async) {
+            tcpconn_cleanup(tcp_n);
+            tcpstart_done(tcp_n, "ERROR");
+        }
+        else {
+            tcpconn_cleanup(tcp_n);
+            at_leave_special_state();
+            at_port_print_irom_str("\r\n+TCPSTART:connectError\r\n");
+            at_response_error();
+        }
+    }
+}
+
+//AT+TCPSTART=<link ID>,<type>,<remote IP>,<remoteport>[,<TCP keep alive>],[<local_port]
+//=======================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPConnConnect(uint8_t id, char *pPara)
+{
+    int port = 0, localport = 0;
+    int err = 0, flag = 0;
+    int conn_no = 0, ssl = 0, keepalive = 0;
+    char type[4] = {0};
+    char domain[32] = {0};
+    char info[32] = {'\0'};
+    tcppool_t *entry = NULL;
+    tcpconn_t *tcpconn;
+    err_t result;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &conn_no, &err);
+    if (err != 0) goto exit_err;
+    if ((conn_no < 0) || (conn_no >= tcpconn_max)) goto exit_err;
+    if (tcpconns[conn_no] != NULL) {
+        at_port_print_irom_str("\r\n+TCPSTART:linkUsed\r\n");
+        goto exit_err;
+    }
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (connection type), string
+    flag = at_data_str_copy(type, &pPara, 3);
+    if (flag != 3) goto exit_err;
+    if (os_memcmp(type, "TCP", 3) == 0) ssl = 0;
+    else if (os_memcmp(type, "SSL", 3) == 0) ssl = 1;
+    else  goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 3rd parameter (domain), string
+    flag = at_data_str_copy(domain, &pPara, 31);
+    if (flag < 3) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 4th parameter (port)
+    flag = at_get_next_int_dec(&pPara, &port, &err);
+    if (err != 0) goto exit_err;
+    if ((port < 1) || (port > 65365)) goto exit_err;
+
+    // check if more parameters available
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 5th parameter (keepalive)
+        flag = at_get_next_int_dec(&pPara, &keepalive, &err);
+        if (err != 0) keepalive = 0;
+        else if ((keepalive < 0) || (keepalive >= 7200)) goto exit_err;
+    }
+    // check if more parameters available
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 6th parameter (local port)
+        flag = at_get_next_int_dec(&pPara, &localport, &err);
+        if (err != 0) goto exit_err;
+        if ((localport < 0) || (localport >= 65536) || (localport == port)) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    if (tcppool_size) {
+        // reuse the parked connection, it is already connected and its memory is allocated
+        entry = tcppool_take(domain, port, ssl, localport);
+        if (entry) {
+            tcpconn = tcpconn_alloc(conn_no, &entry->conn);
+            if ((tcpconn == NULL) || (!tcpconn_set_rxmode(tcpconn))) {
+                entry->state = TCPPOOL_PARKED;
+                entry->conn.reverse = (void *)TCPPOOL_TAG;
+                goto exit_err_alloc;
+            }
+            tcppool_hits++;
+            tcpconn->pool = entry;
+            tcpconn->port = port;
+            tcpconn->local_port = localport;
+            tcpconn->keepalive = keepalive;
+            tcpconn->ssl = ssl;
+            tcpconn->parrent = TCPCONN_PARRENT_MASK | TCPCONN_PARRENT_CLIENT;
+            tcpconn->conn->parrent = tcpconn->parrent;
+            os_memcpy(tcpconn->remote_ip, entry->tcp.remote_ip, 4);
+            os_memcpy(&tcpconn->ip, entry->tcp.remote_ip, 4);
+            if (keepalive) espconn_set_keepalive(tcpconn->conn, ESPCONN_KEEPIDLE, &tcpconn->keepalive);
+            tcpconn->connected = 1;
+            tcpconns[conn_no] = tcpconn;
+
+            if (tcp_async) {
+                at_response_ok();
+                tcpstart_done(conn_no, "CONNECT");
+            }
+            else {
+                os_sprintf(info, "%d,CONNECT\r\n", conn_no);
+                tcpconn_event(conn_no, info);
+                at_response_ok();
+            }
+            tcpspool_start(conn_no);
+            return;
+        }
+        tcppool_misses++;
+    }
+
+    if (!tcpconn_admit(ssl, 0)) {
+        at_port_print_irom_str("\r\n+TCPSTART:noMemory\r\n");
+        goto exit_err;
+    }
+
+    // the pooled connection's espconn is in the pool entry, not in the link's slot
+    if (tcppool_size) {
+        entry = tcppool_new(domain, port, ssl);
+        if (entry == NULL) goto exit_err_alloc;
+    }
+
+    // prepare the link's slot with the connection
+    tcpconn = tcpconn_alloc(conn_no, (entry) ? &entry->conn : NULL);
+    if ((tcpconn == NULL) || (!tcpconn_set_rxmode(tcpconn))) {
+        if (entry) tcppool_free(entry);
+        goto exit_err_alloc;
+    }
+
+    tcpconn->pool = entry;
+    tcpconn->port = port;
+    tcpconn->local_port = localport;
+    tcpconn->connected = 0;
+    tcpconn->keepalive = keepalive;
+    tcpconn->ssl = ssl;
+    tcpconn->parrent = TCPCONN_PARRENT_MASK | TCPCONN_PARRENT_CLIENT;
+    tcpconn->conn->parrent = tcpconn->parrent;
+    tcpconns[conn_no] = tcpconn;
+
+    if (ssl) {
+        if (tcp_sslconfig & 2) espconn_secure_ca_enable(1, SYSTEM_PARTITION_SSL_CLIENT_CA_ADDR / SECTOR_SIZE);
+        else espconn_secure_ca_disable(1);
+    }
+
+    // in asynchronous mode the AT engine is not held, the link's lookups and connections run in parallel
+    tcpconn->async = tcp_async;
+    if (!tcp_async) at_enter_special_state();
+    // DNS lookup, the link is found from the espconn passed to tcpconn_resolved
+    result = espconn_gethostbyname(tcpconn->conn, domain, &tcpconn->ip, tcpconn_resolved);
+    if ((result != ESPCONN_OK) && (result != ESPCONN_INPROGRESS)) {
+        // error
+        tcpconn_cleanup(conn_no);
+        if (!tcp_async) at_leave_special_state();
+        if (result == DNSCACHE_FAILED) at_port_print_irom_str("\r\n+TCPSTART:DNSError\r\n");
+        else at_port_print_irom_str("\r\n+TCPSTART:resolveError\r\n");
+        goto exit_err;
+    }
+
+    if (tcp_async) {
+        // the result is reported with '+TCPSTART,<link>,...'
+        os_sprintf(info, "\r\n+TCPSTART:%d,pending\r\n", conn_no);
+        at_port_print(info);
+        at_response_ok();
+    }
+    if (result == ESPCONN_OK) {
+        // host name is already cached or is actually a dotted decimal IP address
+        // call tcpconn_resolved to start the connection
+        tcpconn_resolved(0, &tcpconn->ip, tcpconn->conn);
+    }
+    // otherwise the lookup is taking place, will call tcpconn_resolved on completion
+
+    return;
+
+exit_err_alloc:
+    at_port_print_irom_str("\r\n+TCPSTART:zallocError\r\n");
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+// new client connected to the TCP Server
+//------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpserver_client_connect_cb(void *arg)
+{
+    struct espconn *conn = (struct espconn *)arg;
+    uint8_t tcp_n, res;
+    char info[48] = {'\0'};
+    char ip_addr[16] = {'\0'};
+    const char *reason = "conn";
+    uint8_t srv_n = tcpserv_max;
+
+    if ((conn->parrent & TCPCONN_PARRENT_MASK) != TCPCONN_PARRENT_MASK) goto exit;
+    srv_n = conn->parrent & 0x07;
+    if (srv_n >= tcpserv_max) goto exit;
+
+    // Find free TCP connection to use for the connected client
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if (tcpconns[tcp_n] == NULL) break;
+    }
+    if (tcp_n >= tcpconn_max) goto exit; // not found
+
+    if (tcpservers[srv_n]->connected >= tcpservers[srv_n]->maxconn) goto exit; // max number of connections reached
+
+    if (!tcpconn_admit(tcpservers[srv_n]->ssl, 1)) {
+        reason = "mem";
+        goto exit;
+    }
+
+    // register new TCP connection to server
+    tcpconn_t *tcpconn = tcpconn_alloc(tcp_n, conn);
+    if ((tcpconn == NULL) || (!tcpconn_set_rxmode(tcpconn))) goto exit;
+
+    tcpconn->connected = 1;
+    os_memcpy(tcpconn->remote_ip, conn->proto.tcp->remote_ip, 4);
+    os_sprintf(ip_addr, IPSTR, conn->proto.tcp->remote_ip[0], conn->proto.tcp->remote_ip[1], conn->proto.tcp->remote_ip[2], conn->proto.tcp->remote_ip[3]);
+    tcpconn->ip.addr = ipaddr_addr(ip_addr);
+    tcpconn->port = (uint16_t)conn->proto.tcp->remote_port;
+    tcpconn->ssl = tcpservers[srv_n]->ssl;
+    tcpconn->parrent = conn->parrent;
+
+    res = espconn_regist_time(tcpconn->conn, (uint32_t)tcpservers[srv_n]->timeout, 1);
+    if (res != ESPCONN_OK) {
+        at_port_print_irom_str("\r\nTCPClientRegTimeERROR\r\n");
+    }
+
+    tcpconns[tcp_n] = tcpconn;
+
+    // register connection callbacks
+    _tcpconn_register_cb_cb(conn);
+
+    tcpservers[srv_n]->connected++;
+
+    os_sprintf(info, "%d,%d,TCPconnect:%s,%d\r\n", srv_n, tcp_n, ip_addr, tcpconn->port);
+    tcpconn_event(FRAME_LINK_SERVER + srv_n, info);
+
+    return;
+
+exit:
+    if (srv_n < tcpserv_max) {
+        if (tcpservers[srv_n]->ssl > 0) espconn_secure_disconnect(conn);
+        else espconn_disconnect(conn);
+    }
+    else espconn_disconnect(conn);
+    os_sprintf(info, "\r\nTCPServerERROR:%s,%d\r\n", reason, conn->link_cnt);
+    at_port_print(info);
+}
+
+
+//AT+TCPSERVER=<serv_id>,<enable>,[<port>],[<ssl>],[<maxconn>],[conn_timeout]
+//==================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPServer(uint8_t id, char *pPara)
+{
+    int enable = -1;
+    int port = 333;
+    int ssl = 0;
+    int srv_n = 0;
+    int maxconn = tcpconn_max;
+    int tmo = TCPSERV_CONN_TIMEOUT;
+    int err = 0, flag = 0;
+    uint8_t tcp_n;
+    uint8_t cli_srv_n;
+    err_t result;
+    uint8_t res;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (serv_id)
+    flag = at_get_next_int_dec(&pPara, &srv_n, &err);
+    if (err != 0) goto exit_err;
+    if ((srv_n < 0) || (srv_n >= tcpserv_max)) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+
+    //get the 2nd parameter (enable)
     flag = at_get_next_int_dec(&pPara, &enable, &err);
     if (err != 0) goto exit_err;
-    if ((enable < 0) || (enable > 1)) goto exit_err;
+    if ((enable < 0) || (enable > 1)) goto exit_err;
+
+    // check if the last parameter
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 3rd parameter (port)
+        flag = at_get_next_int_dec(&pPara, &port, &err);
+        if (err != 0) port = 333;
+        if ((port < 0) || (port > 65535)) port = 333;
+    }
+    // check if the last parameter
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 4th parameter (ssl)
+        flag = at_get_next_int_dec(&pPara, &ssl, &err);
+        if (err != 0) ssl = 0;
+        if ((ssl < 0) || (ssl > 1)) ssl = 0;
+    }
+    // check if the last parameter
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 5th parameter (keepalive)
+        flag = at_get_next_int_dec(&pPara, &maxconn, &err);
+        if (err != 0) maxconn = tcpconn_max;
+        if ((maxconn < 1) || (maxconn > tcpconn_max)) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 6th parameter (timeout)
+        flag = at_get_next_int_dec(&pPara, &tmo, &err);
+        if (err != 0) tmo = TCPSERV_CONN_TIMEOUT;
+        if ((tmo < 0) || (maxconn > 7200)) goto exit_err;
+    }
+    if (*pPara != '\r') goto exit_err;
+
+    if (enable == 1) {
+        // === Create the new TCP Server ===
+        if (tcpservers[srv_n] != NULL) goto exit_err;
+
+        // create tcpconn structure
+        tcpserver_t *tcpsrv = (tcpserver_t *)os_zalloc(sizeof(tcpserver_t));
+        if (!tcpsrv) goto exit_err;
+
+        // create connection
+        tcpsrv->conn = (struct espconn *)os_zalloc(sizeof(struct espconn));
+        if (!tcpsrv->conn) {
+            os_free(tcpsrv);
+            goto exit_err;
+        }
+        tcpsrv->conn->proto.tcp = (esp_tcp *)os_zalloc(sizeof(esp_tcp));
+        if (!tcpsrv->conn->proto.tcp) {
+            os_free(tcpsrv->conn);
+            os_free(tcpsrv);
+            goto exit_err;
+        }
+
+        // Configure tcpserver structure
+        tcpservers[srv_n] = tcpsrv;
+        tcpservers[srv_n]->port = port;
+        tcpservers[srv_n]->connected = 0;
+        tcpservers[srv_n]->ssl = ssl;
+        tcpservers[srv_n]->timeout = tmo;
+        tcpservers[srv_n]->maxconn = maxconn;
+        tcpservers[srv_n]->conn->parrent = TCPCONN_PARRENT_MASK | srv_n;
+        tcpservers[srv_n]->conn->type = ESPCONN_TCP;
+        tcpservers[srv_n]->conn->state = ESPCONN_NONE;
+        tcpservers[srv_n]->conn->proto.tcp->local_port = port;
+        // register client connection callback
+        espconn_regist_connectcb(tcpservers[srv_n]->conn, tcpserver_client_connect_cb);
+
+        espconn_tcp_set_max_con_allow(tcpservers[srv_n]->conn, maxconn);
+        // Accept connections
+        if (ssl) espconn_secure_accept(tcpservers[srv_n]->conn);
+        else {
+            res = espconn_accept(tcpservers[srv_n]->conn);
+            if (res != ESPCONN_OK) {
+                at_port_print_irom_str("\r\nTCPServerAcceptERROR\r\n");
+                goto exit_err;
+            }
+        }
+    }
+    else if (enable == 0) {
+        // === Delete the TCP Server ===
+        if (tcpservers[srv_n]) {
+            // Close all clients
+            for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+                if (tcpconns[tcp_n] != NULL) {
+                    if ((tcpconns[tcp_n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
+                        cli_srv_n = tcpconns[tcp_n]->parrent & 0x07;
+                        if (cli_srv_n == srv_n) {
+                            if (tcpconns[tcp_n]->connected) {
+                                if (tcpconns[tcp_n]->ssl > 0) espconn_secure_disconnect(tcpconns[tcp_n]->conn);
+                                else espconn_disconnect(tcpconns[tcp_n]->conn);
+                            }
+                        }
+                    }
+                }
+            }
+
+            espconn_delete(tcpservers[srv_n]->conn);
+            os_free(tcpservers[srv_n]->conn);
+            os_free(tcpservers[srv_n]);
+            tcpservers[srv_n] = NULL;
+        }
+        else goto exit_err;
+    }
+    else goto exit_err;
+
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//AT+TCPSERVER?
+//-----------------------------------------------------
+void ICACHE_FLASH_ATTR at_queryCmdTCPServer(uint8_t id)
+{
+    char info[128] = {'\0'};
+    char ip_addr[16] = {'\0'};
+    uint8_t srv_n, cli_srv_n;
+    uint8_t tcp_n, n = 0;
+
+    for (srv_n=0; srv_n<tcpserv_max; srv_n++) {
+        if (tcpservers[srv_n]) n++;
+    }
+    os_sprintf(info, "+TCPSERVER:%d\r\n", n);
+    at_port_print(info);
+    if (n > 0) {
+        for (srv_n=0; srv_n<tcpserv_max; srv_n++) {
+            if (tcpservers[srv_n]) {
+                n++;
+                os_sprintf(info, "+TCPSERVER:%d,%d,%d,%d,%d,%d\r\n", srv_n, tcpservers[srv_n]->connected,
+                        tcpservers[srv_n]->maxconn, tcpservers[srv_n]->port, tcpservers[srv_n]->ssl, tcpservers[srv_n]->timeout);
+                at_port_print(info);
+                for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+                    if (tcpconns[tcp_n] != NULL) {
+                        if ((tcpconns[tcp_n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
+                            cli_srv_n = tcpconns[tcp_n]->parrent & 0x07;
+                            if ((cli_srv_n == srv_n) && (tcpconns[tcp_n]->conn)) {
+                                os_sprintf(ip_addr, IPSTR, tcpconns[tcp_n]->conn->proto.tcp->remote_ip[0], tcpconns[tcp_n]->conn->proto.tcp->remote_ip[1],
+                                        tcpconns[tcp_n]->conn->proto.tcp->remote_ip[2], tcpconns[tcp_n]->conn->proto.tcp->remote_ip[3]);
+                                os_sprintf(info, "+TCPCLIENT:%d,\"%s\",%d\r\n", ip_addr, tcpconns[tcp_n]->conn->proto.tcp->remote_port);
+                                at_port_print(info);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    at_response_ok();
+}
+
+//AT+TCPASYNC=<mode>
+// mode 1: AT+TCPSTART returns at once, the result is reported with '+TCPSTART,<link>,CONNECT|DNSError|ERROR'
+//=========================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPAsync(uint8_t id, char *pPara)
+{
+    int mode = 0, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (mode)
+    flag = at_get_next_int_dec(&pPara, &mode, &err);
+    if (err != 0) goto exit_err;
+    if ((mode < 0) || (mode > 1)) goto exit_err;
+    if (*pPara != '\r') goto exit_err;
+
+    // links already starting report their result as they were started
+    tcp_async = mode;
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+}
+
+//AT+TCPASYNC?
+//----------------------------------------------------
+void ICACHE_FLASH_ATTR at_queryCmdTCPAsync(uint8_t id)
+{
+    char info[32] = {'\0'};
+
+    os_sprintf(info, "+TCPASYNC:%d\r\n", tcp_async);
+    at_port_print(info);
+    at_response_ok();
+}
+
+//AT+TCPLIMITS=<links>,<servers>[,<ssl_reserve>]
+// Can only be changed while no link is open and no server is running
+//=========================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPLimits(uint8_t id, char *pPara)
+{
+    int links = 0, servers = 0, reserve = tcpadm_ssl_reserve;
+    int err = 0, flag = 0;
+    uint8_t n;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (number of links)
+    flag = at_get_next_int_dec(&pPara, &links, &err);
+    if (err != 0) goto exit_err;
+    // the parked connections use the SDK's connections too
+    if ((links < 1) || (links > (TCPCONN_MAX_CONN - tcppool_size))) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (number of servers)
+    flag = at_get_next_int_dec(&pPara, &servers, &err);
+    if (err != 0) goto exit_err;
+    if ((servers < 1) || (servers > TCPCONN_MAX_SERV)) goto exit_err;
+
+    // check if more parameters available
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 3rd parameter (keep the memory for one SSL link)
+        flag = at_get_next_int_dec(&pPara, &reserve, &err);
+        if (err != 0) goto exit_err;
+        if ((reserve < 0) || (reserve > 1)) goto exit_err;
+    }
+    if (*pPara != '\r') goto exit_err;
+
+    for (n=0; n<tcpconn_max; n++) {
+        if (tcpconns[n] != NULL) goto exit_err;
+    }
+    for (n=0; n<tcpserv_max; n++) {
+        if (tcpservers[n] != NULL) goto exit_err;
+    }
+
+    // the slots are allocated again for the new number of links
+    if (tcpconn_slab) {
+        os_free(tcpconn_slab);
+        tcpconn_slab = NULL;
+    }
+    tcpconn_max = links;
+    tcpserv_max = servers;
+    tcpadm_ssl_reserve = reserve;
+    // lwIP limit of the active TCP connections, shared with the AT library's links
+    if (espconn_tcp_get_max_con() < (tcpconn_max + tcppool_size)) espconn_tcp_set_max_con(tcpconn_max + tcppool_size);
+
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+}
+
+//AT+TCPLIMITS?
+//-----------------------------------------------------
+void ICACHE_FLASH_ATTR at_queryCmdTCPLimits(uint8_t id)
+{
+    char info[128] = {'\0'};
+
+    os_sprintf(info, "+TCPLIMITS:%d,%d,%d,%d,%d,%d,%d,%d\r\n", tcpconn_max, tcpserv_max, tcpadm_ssl_reserve,
+            system_get_free_heap_size(), tcpconn_cost(0, 0), tcpconn_cost(1, 0), tcpadm_admitted, tcpadm_refused);
+    at_port_print(info);
+    at_response_ok();
+}
+
+//AT+TCPPOOL=<size>[,<ttl>]
+// Closed client links are parked for reuse by AT+TCPSTART to the same host, port and type
+// <size> 0 disables the pooling and closes the parked connections
+//=======================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPPool(uint8_t id, char *pPara)
+{
+    int size = 0, ttl = tcppool_ttl;
+    int err = 0, flag = 0;
+    tcppool_t *entry, *next;
+    uint8_t parked = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (maximal number of parked connections)
+    flag = at_get_next_int_dec(&pPara, &size, &err);
+    if (err != 0) goto exit_err;
+    if ((size < 0) || (size > TCPPOOL_MAX) || (size > (TCPCONN_MAX_CONN - tcpconn_max))) goto exit_err;
+
+    // check if more parameters available
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 2nd parameter (idle time of the parked connection)
+        flag = at_get_next_int_dec(&pPara, &ttl, &err);
+        if (err != 0) goto exit_err;
+        if ((ttl < 1) || (ttl > TCPPOOL_TTL_MAX)) goto exit_err;
+    }
+    if (*pPara != '\r') goto exit_err;
+
+    tcppool_size = size;
+    tcppool_ttl = ttl;
+    // close the parked connections over the new limit
+    for (entry=tcppool_head; entry; entry=next) {
+        next = entry->next;
+        if (entry->state != TCPPOOL_PARKED) continue;
+        if (parked < tcppool_size) parked++;
+        else tcppool_close(entry);
+    }
+    // lwIP limit of the active TCP connections, the parked connections are included
+    if (espconn_tcp_get_max_con() < (tcpconn_max + tcppool_size)) espconn_tcp_set_max_con(tcpconn_max + tcppool_size);
+
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+}
+
+//AT+TCPPOOL?
+//---------------------------------------------------
+void ICACHE_FLASH_ATTR at_queryCmdTCPPool(uint8_t id)
+{
+    char info[96] = {'\0'};
+    tcppool_t *entry;
+    uint8_t parked = 0;
+
+    for (entry=tcppool_head; entry; entry=entry->next) {
+        if (entry->state == TCPPOOL_PARKED) parked++;
+    }
+    os_sprintf(info, "+TCPPOOL:%d,%d,%d,%d,%d,%d\r\n", tcppool_size, tcppool_ttl, parked,
+            tcppool_hits, tcppool_misses, tcppool_evicted);
+    at_port_print(info);
+    for (entry=tcppool_head; entry; entry=entry->next) {
+        if (entry->state != TCPPOOL_PARKED) continue;
+        os_sprintf(info, "+TCPPOOL:\"%s\",%d,%s,%d\r\n", entry->host, entry->port, (entry->ssl) ? "SSL" : "TCP", entry->idle);
+        at_port_print(info);
+    }
+    at_response_ok();
+}
+
+//AT+DNSCACHE=<size>[,<neg_ttl>]
+// The cache is flushed
+//=========================================================
+void ICACHE_FLASH_ATTR at_setupCmdDNSCache(uint8_t id, char *pPara)
+{
+    int size = 0, neg_ttl = 0;
+    int err = 0, flag = 0;
+    uint16 ttl;
+
+    dns_cache_get_setup(&ttl);
+    neg_ttl = ttl;
+    pPara++; // skip '='
+
+    //get the 1st parameter (number of entries)
+    flag = at_get_next_int_dec(&pPara, &size, &err);
+    if (err != 0) goto exit_err;
+    if ((size < 0) || (size > DNSCACHE_MAX)) goto exit_err;
+
+    // check if more parameters available
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 2nd parameter (time a failed lookup is cached)
+        flag = at_get_next_int_dec(&pPara, &neg_ttl, &err);
+        if (err != 0) goto exit_err;
+        if ((neg_ttl < 0) || (neg_ttl > DNSCACHE_NEG_TTL_MAX)) goto exit_err;
+    }
+    if (*pPara != '\r') goto exit_err;
+
+    dns_cache_setup(size, neg_ttl);
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+}
+
+//AT+DNSCACHE?
+//----------------------------------------------------
+void ICACHE_FLASH_ATTR at_queryCmdDNSCache(uint8_t id)
+{
+    char info[128] = {'\0'};
+    uint32 hits, neg_hits, misses, prefetches, lookups, ttl;
+    uint16 neg_ttl, entry_hits;
+    uint8 size, n;
+    ip_addr_t addr;
+    const char *name;
+
+    size = dns_cache_get_setup(&neg_ttl);
+    dns_cache_get_stats(&hits, &neg_hits, &misses, &prefetches);
+    lookups = hits + neg_hits + misses;
+    os_sprintf(info, "+DNSCACHE:%d,%d,%d,%d,%d,%d,%d\r\n", size, neg_ttl, hits, neg_hits, misses, prefetches,
+            (lookups) ? ((hits + neg_hits) * 100) / lookups : 0);
+    at_port_print(info);
+    for (n=0; n<size; n++) {
+        name = dns_cache_get_entry(n, &addr, &ttl, &entry_hits);
+        if (name == NULL) continue;
+        os_sprintf(info, "+DNSCACHE:\"%s\",\"" IPSTR "\",%d,%d\r\n", name, IP2STR(&addr), ttl, entry_hits);
+        at_port_print(info);
+    }
+    at_response_ok();
+}
+
+//AT+LWIPMEM?
+// Report the lwIP memp pools, the pools with 'num'=0 are allocated from the heap
+//-------------------------------------------------------------------------------
+void ICACHE_FLASH_ATTR at_queryCmdLwipMem(uint8_t id)
+{
+    char info[96] = {'\0'};
+    const char *desc;
+    uint16 size, num, used, high, fail;
+    uint8 type, pools = 0;
+
+    for (type=0; memp_get_stats(type, &desc, &size, &num, &used, &high, &fail); type++) {
+        if (num) pools++;
+    }
+    os_sprintf(info, "+LWIPMEM:%s,%d\r\n", (pools) ? "POOLS" : "HEAP", system_get_free_heap_size());
+    at_port_print(info);
+    for (type=0; memp_get_stats(type, &desc, &size, &num, &used, &high, &fail); type++) {
+        os_sprintf(info, "+LWIPMEM:\"%s\",%d,%d,%d,%d,%d\r\n", desc, size, num, used, high, fail);
+        at_port_print(info);
+    }
+    at_response_ok();
+}
+
+//AT+LWIPMEM
+// Clear the high-water marks and the failure counters
+//=====================================================
+void ICACHE_FLASH_ATTR at_exeCmdLwipMem(uint8_t id)
+{
+    memp_clear_stats();
+    at_response_ok();
+}
+
+static uint32 netstats_memp_base = 0;   // memp failures counted at the last AT+NETSTATS
+
+//AT+NETSTATS?
+// Report the lwIP counters, one line per group
+//----------------------------------------------------
+void ICACHE_FLASH_ATTR at_queryCmdNetStats(uint8_t id)
+{
+    char info[192] = {'\0'};
+    uint32 cnt[NETSTATS_COUNTERS];
+    const char *name;
+    uint8 group, n, i;
+
+    for (group=0; (n = stats_get_counters(group, &name, cnt, NETSTATS_COUNTERS)); group++) {
+        os_sprintf(info, "+NETSTATS:%s", name);
+        for (i=0; i<n; i++) os_sprintf(info + os_strlen(info), ",%u", cnt[i]);
+        os_strcat(info, "\r\n");
+        at_port_print(info);
+    }
+    os_sprintf(info, "+NETSTATS:MEM,%d,%u\r\n", system_get_free_heap_size(), memp_get_fails() - netstats_memp_base);
+    at_port_print(info);
+    at_response_ok();
+}
+
+//AT+NETSTATS
+// Clear the lwIP counters
+//=====================================================
+void ICACHE_FLASH_ATTR at_exeCmdNetStats(uint8_t id)
+{
+    stats_reset();
+    netstats_memp_base = memp_get_fails();
+    at_response_ok();
+}
+
+// queue the received UDP datagram and start the delivery to the host
+// The datagram is given in the linear buffer 'pusrdata' or in the pbuf chain 'p'.
+// The small datagram in a single pbuf is queued in the pbuf, without a copy; the number of
+// such datagrams is limited, as they hold the WLAN receive buffers until they are delivered.
+// Other datagrams are copied from the pbuf into the link's queue, one segment per datagram.
+// There is no receive window to hold, the datagrams are dropped while the queue is full
+// Returns true if the pbuf is kept in the queue
+//--------------------------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR udpconn_rx_input(struct espconn *conn, char *pusrdata, struct pbuf *p, unsigned short length)
+{
+    uint8_t tcp_n = _get_tcpn(conn);
+    tcpconn_t *tcpconn;
+    tcp_rxseg_t *seg;
+    remot_info *premot = NULL;
+    void *payload = NULL;
+    struct pbuf *next = NULL;
+    bool keep = false;
+
+    if (tcp_n >= tcpconn_max) return false;
+    tcpconn = tcpconns[tcp_n];
+    if ((!tcpconn->connected) || (length == 0)) return false;
+
+    tcpconn->rx_segs++;
+    seg = NULL;
+    if ((tcpconn->rx_queued - tcpconn->rx_delivered + length) <= TCPCONN_RXQUEUE_MAX) {
+        if ((p) && (length <= UDP_RX_PBUF_LEN) && (udp_rx_pbufs < UDP_RX_PBUF_MAX)) {
+            keep = ((espconn_pbuf_payload(p, &payload, &next) == length) && (next == NULL));
+        }
+        seg = (tcp_rxseg_t *)os_malloc(sizeof(tcp_rxseg_t) + ((keep) ? 0 : length));
+    }
+    if (!seg) {
+        tcpconn->rx_dropped++;
+        return false;
+    }
+    seg->next = NULL;
+    seg->len = length;
+    seg->size = (keep) ? 0 : length;
+    // remote address of this datagram
+    if (espconn_get_connection_info(conn, &premot, 0) == ESPCONN_OK) {
+        os_memcpy(seg->ip, premot[0].remote_ip, 4);
+        seg->port = premot[0].remote_port;
+    }
+    else {
+        os_memset(seg->ip, 0, 4);
+        seg->port = 0;
+    }
+    if (keep) {
+        seg->pbuf = p;
+        seg->payload = (uint8_t *)payload;
+        udp_rx_pbufs++;
+    }
+    else {
+        seg->pbuf = NULL;
+        tcprx_copy(seg->data, pusrdata, p, length);
+    }
+
+    if (tcpconn->rx_tail) tcpconn->rx_tail->next = seg;
+    else tcpconn->rx_head = seg;
+    tcpconn->rx_tail = seg;
+    if ((tcpconn->rx_credit) && (tcpconn->rx_next == NULL)) tcpconn->rx_next = seg;
+    tcpconn->rx_queued += length;
+    tcpconn->rx_last_time = system_get_time();
+    tcpconn->stats.rx_bytes += length;
+    tcpconn->stats.rx_segs++;
+
+    tcprx_start();
+    return keep;
+}
+
+// UDP datagram received
+//--------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR udpconn_recvcb(void *arg, char *pusrdata, unsigned short length)
+{
+    udpconn_rx_input((struct espconn *)arg, pusrdata, NULL, length);
+}
+
+// UDP datagram received, with the lwIP pbuf
+// Unless it is kept in the link's queue, the pbuf is released at once
+//--------------------------------------------------------------------------------------------
+static sint8 ICACHE_FLASH_ATTR udpconn_recv_pbuf(void *arg, struct pbuf *p, unsigned short length)
+{
+    struct espconn *conn = (struct espconn *)arg;
+
+    if (!udpconn_rx_input(conn, NULL, p, length)) espconn_recv_pbuf_free(conn, p);
+    return ESPCONN_OK;
+}
+
+// Parse the dotted decimal IP address, the broadcast address is valid
+//------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR _parse_ip(const char *str, ip_addr_t *ip)
+{
+    ip->addr = ipaddr_addr(str);
+    if ((ip->addr == IPADDR_NONE) && (os_strcmp(str, "255.255.255.255") != 0)) return false;
+    return true;
+}
+
+// Send the datagram to 'ip':'port', or to the link's remote if 'ip' is NULL
+// The data are copied into the pbuf, no sent callback is waited for
+//-------------------------------------------------------------------------------------------------
+static sint16 ICACHE_FLASH_ATTR udpconn_sendto(uint8_t tcp_n, uint8_t *data, uint16_t len, const uint8_t *ip, uint16_t port)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    esp_udp *udp = tcpconn->conn->proto.udp;
+    sint16 res;
+
+    if (ip == NULL) {
+        ip = tcpconn->remote_ip;
+        port = tcpconn->port;
+    }
+    if ((port == 0) || (len == 0) || (len > UDP_MAX_LEN)) return ESPCONN_ARG;
+    os_memcpy(udp->remote_ip, ip, 4);
+    udp->remote_port = port;
+    res = espconn_sendto(tcpconn->conn, data, len);
+    if (res == ESPCONN_OK) {
+        tcpconn->stats.tx_bytes += len;
+        tcpconn->stats.tx_segs++;
+    }
+    return res;
+}
+
+//AT+UDPSTART=<link ID>,<remote IP>,<remote port>,<local port>[,<multicast IP>]
+// <remote port> = 0 -> no default remote, the remote is given with each datagram
+// <local port> = 0  -> any free local port
+//=======================================================================
+void ICACHE_FLASH_ATTR at_setupCmdUDPStart(uint8_t id, char *pPara)
+{
+    int conn_no = 0, port = 0, localport = 0;
+    int err = 0, flag = 0;
+    char ip_str[16] = {0};
+    char info[16] = {0};
+    ip_addr_t ip, mcast, any;
+    tcpconn_t *tcpconn;
+    struct espconn *conn;
+
+    mcast.addr = 0;
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &conn_no, &err);
+    if (err != 0) goto exit_err;
+    if ((conn_no < 0) || (conn_no >= tcpconn_max)) goto exit_err;
+    if (tcpconns[conn_no] != NULL) {
+        at_port_print_irom_str("\r\n+UDPSTART:linkUsed\r\n");
+        goto exit_err;
+    }
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (remote IP), string
+    flag = at_data_str_copy(ip_str, &pPara, 15);
+    if (flag < 7) goto exit_err;
+    if (!_parse_ip(ip_str, &ip)) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 3rd parameter (remote port)
+    flag = at_get_next_int_dec(&pPara, &port, &err);
+    if (err != 0) goto exit_err;
+    if ((port < 0) || (port > 65535)) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 4th parameter (local port)
+    flag = at_get_next_int_dec(&pPara, &localport, &err);
+    if (err != 0) goto exit_err;
+    if ((localport < 0) || (localport > 65535)) goto exit_err;
+
+    // check if more parameters available
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 5th parameter (multicast group), string
+        flag = at_data_str_copy(ip_str, &pPara, 15);
+        if (flag < 7) goto exit_err;
+        // 224.0.0.0 ~ 239.255.255.255
+        if ((!_parse_ip(ip_str, &mcast)) || ((ip4_addr1(&mcast) & 0xF0) != 0xE0)) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    if (!tcpconn_admit(0, 0)) {
+        at_port_print_irom_str("\r\n+UDPSTART:noMemory\r\n");
+        goto exit_err;
+    }
+
+    // prepare the link's slot with the connection
+    tcpconn = tcpconn_alloc(conn_no, NULL);
+    if (tcpconn == NULL) {
+        at_port_print_irom_str("\r\n+UDPSTART:zallocError\r\n");
+        goto exit_err;
+    }
+    tcpconn->udp = 1;
+    tcpconn->rx_mode = TCPRECV_MODE_ACTIVE;
+    tcpconn->parrent = TCPCONN_PARRENT_MASK | TCPCONN_PARRENT_CLIENT;
+    tcpconn->ip = ip;
+    os_memcpy(tcpconn->remote_ip, &ip, 4);
+    tcpconn->port = port;
+
+    conn = tcpconn->conn;
+    conn->type = ESPCONN_UDP;
+    conn->state = ESPCONN_NONE;
+    conn->parrent = tcpconn->parrent;
+    conn->proto.udp->local_port = (localport) ? localport : espconn_port();
+    conn->proto.udp->remote_port = port;
+    os_memcpy(conn->proto.udp->remote_ip, &ip, 4);
+    tcpconn->local_port = conn->proto.udp->local_port;
+    espconn_regist_recvcb(conn, udpconn_recvcb);
+
+    if (espconn_create(conn) != ESPCONN_OK) {
+        at_port_print_irom_str("\r\n+UDPSTART:createError\r\n");
+        goto exit_err;
+    }
+    // the datagrams are taken from the pbuf, the data callback is used if it can not be registered
+    espconn_regist_recv_pbufcb(conn, udpconn_recv_pbuf);
+    if (mcast.addr) {
+        any.addr = IPADDR_ANY;
+        if (espconn_igmp_join(&any, &mcast) != ESPCONN_OK) {
+            espconn_delete(conn);
+            at_port_print_irom_str("\r\n+UDPSTART:joinError\r\n");
+            goto exit_err;
+        }
+        tcpconn->mcast = mcast;
+    }
+
+    tcpconn->connected = 1;
+    tcpconns[conn_no] = tcpconn;
+    at_response_ok();
+    os_sprintf(info, "%d,CONNECT\r\n", conn_no);
+    tcpconn_event(conn_no, info);
+    return;
+
+exit_err:
+    at_response_error();
+}
+
+//AT+UDPSTART?
+//-----------------------------------------------------
+void ICACHE_FLASH_ATTR at_queryCmdUDPStart(uint8_t id)
+{
+    char info[112] = {'\0'};
+    char ip_addr[16] = {'\0'};
+    char mcast_addr[16] = {'\0'};
+    tcpconn_t *tcpconn;
+    uint8_t tcp_n;
+
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        tcpconn = tcpconns[tcp_n];
+        if ((tcpconn == NULL) || (!tcpconn->udp)) continue;
+        os_sprintf(ip_addr, IPSTR, tcpconn->remote_ip[0], tcpconn->remote_ip[1], tcpconn->remote_ip[2], tcpconn->remote_ip[3]);
+        os_sprintf(mcast_addr, IPSTR, IP2STR(&tcpconn->mcast));
+        os_sprintf(info, "+UDPSTART:%d,\"%s\",%d,%d,\"%s\",%d,%d\r\n", tcp_n, ip_addr, tcpconn->port, tcpconn->local_port,
+                mcast_addr, tcpconn->rx_segs, tcpconn->rx_dropped);
+        at_port_print(info);
+    }
+    at_response_ok();
+}
+
+// Finish the AT+UDPSEND command, send the datagram and release the UART
+//------------------------------------------------
+static void ICACHE_FLASH_ATTR udpsend_end(bool ok)
+{
+    uint8_t tcp_n = tcpsend.link;
+    tcp_txseg_t *seg = tcpsend.seg;
+    char info[32] = {'\0'};
+
+    os_timer_disarm(&tcpsend_timer);
+    if ((ok) && (tcpsend.state == TCPTX_INPUT) && (tcpconns[tcp_n]) && (tcpconns[tcp_n]->connected)) {
+        ok = (udpconn_sendto(tcp_n, seg->data, seg->len, (tcpsend.udp_port) ? tcpsend.udp_ip : NULL, tcpsend.udp_port) == ESPCONN_OK);
+    }
+    else ok = false;
+
+    os_sprintf(info, "\r\n+UDPSEND:%d\r\n", tcpsend.total);
+    at_port_print(info);
+    if (seg) tcpsend_seg_free(seg);
+    os_memset(&tcpsend, 0, sizeof(tcpsend_t));
+
+    if (ok) at_response_ok();
+    else at_port_print_irom_str("\r\nFAIL\r\n");
+    at_leave_special_state();
+    // return the UART to the AT command processor or to the data delivery
+    tcprx_start();
+}
+
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR udpsend_timeout_cb(void *arg)
+{
+    if (tcpsend.state == TCPTX_IDLE) return;
+    udpsend_end(false);
+}
+
+// Datagram data received from the host during AT+UDPSEND
+//--------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR udpsend_uart_rx_cb(uint8 *data, int32 len)
+{
+    uint32_t n;
+
+    os_timer_arm(&tcpsend_timer, TCPSEND_INPUT_TIMEOUT_MS, 0);
+
+    n = ((uint32_t)len < tcpsend.remain) ? (uint32_t)len : tcpsend.remain;
+    os_memcpy(tcpsend.seg->data + tcpsend.seg->len, data, n);
+    tcpsend.seg->len += n;
+    tcpsend.remain -= n;
+    tcpsend.total += n;
+    if (tcpsend.remain == 0) udpsend_end(true);
+}
+
+//AT+UDPSEND=<link ID>,<length>[,<remote IP>,<remote port>]
+// The datagram is sent as soon as all its data are received from the host,
+// OK is returned when it is passed to lwIP
+//================================================================
+void ICACHE_FLASH_ATTR at_setupCmdUDPSend(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, len = 0, port = 0, err = 0, flag = 0;
+    char ip_str[16] = {0};
+    ip_addr_t ip;
+    tcp_txseg_t *seg;
+
+    ip.addr = 0;
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    if ((tcpconns[tcp_n] == NULL) || (!tcpconns[tcp_n]->udp) || (!tcpconns[tcp_n]->connected)) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (length)
+    flag = at_get_next_int_dec(&pPara, &len, &err);
+    if (err != 0) goto exit_err;
+    if ((len < 1) || (len > UDP_MAX_LEN)) goto exit_err;
+
+    // check if more parameters available
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 3rd parameter (remote IP), string
+        flag = at_data_str_copy(ip_str, &pPara, 15);
+        if (flag < 7) goto exit_err;
+        if (!_parse_ip(ip_str, &ip)) goto exit_err;
+
+        if (*pPara != ',') goto exit_err;
+        pPara++; // skip ','
+        //get the 4th parameter (remote port)
+        flag = at_get_next_int_dec(&pPara, &port, &err);
+        if (err != 0) goto exit_err;
+        if ((port < 1) || (port > 65535)) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+    // in framed mode the datagrams are sent in data or datagram frames
+    if ((tcpsend.state != TCPTX_IDLE) || (tcp_framed)) goto exit_err;
+    // no default remote
+    if ((port == 0) && (tcpconns[tcp_n]->port == 0)) goto exit_err;
+
+    if ((tcpsend_queued + len) > TCPSEND_QUEUE_MAX) goto exit_err;
+    seg = (tcp_txseg_t *)os_malloc(sizeof(tcp_txseg_t) + len);
+    if (!seg) goto exit_err;
+    seg->next = NULL;
+    seg->op = NULL;
+    seg->len = 0;
+    seg->size = len;
+    tcpsend_queued += len;
+
+    tcpsend.link = tcp_n;
+    tcpsend.seg = seg;
+    tcpsend.remain = len;
+    os_memcpy(tcpsend.udp_ip, &ip, 4);
+    tcpsend.udp_port = port;
+    tcpsend.state = TCPTX_INPUT;
+
+    at_enter_special_state();
+    // Take the UART input and send the ready prompt to the client
+    at_register_uart_rx_intr(udpsend_uart_rx_cb);
+    os_timer_disarm(&tcpsend_timer);
+    os_timer_setfn(&tcpsend_timer, (os_timer_func_t *)udpsend_timeout_cb, NULL);
+    os_timer_arm(&tcpsend_timer, TCPSEND_INPUT_TIMEOUT_MS, 0);
+    at_port_print_irom_str("\r\n>");
+
+    return;
+
+exit_err:
+    at_response_error();
+}
+
+//AT+TCPSTATUS or AT+TCPSTATUS?
+//=====================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPStatus(uint8_t id)
+{
+    char info[80] = {'\0'};
+    char ip_addr[16] = {'\0'};
+    uint8_t is_server, n, status, found = 0;
+    uint8_t wifi_mode = wifi_get_opmode() & 1;
+
+    for (n=0; n<tcpconn_max; n++) {
+        if (tcpconns[n] != NULL) {
+            if (tcpconns[n]->connected) {
+                found++;
+                break;
+            }
+        }
+    }
+    if (wifi_mode == 0) status = 5;
+    else {
+        status = 2;
+        if (found) status = 3;
+    }
+
+    os_sprintf(info, "STATUS:%d\r\n", status);
+    at_port_print(info);
+    if (status == 3) {
+        for (n=0; n<tcpconn_max; n++) {
+            if ((tcpconns[n] != NULL) && (tcpconns[n]->conn)) {
+                is_server = 0;
+                if ((tcpconns[n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
+                    is_server = ((tcpconns[n]->parrent & 0x07) < tcpserv_max) ? 1 : 0;
+                }
+                os_sprintf(ip_addr, IPSTR, tcpconns[n]->conn->proto.tcp->remote_ip[0], tcpconns[n]->conn->proto.tcp->remote_ip[1],
+                        tcpconns[n]->conn->proto.tcp->remote_ip[2], tcpconns[n]->conn->proto.tcp->remote_ip[3]);
+                os_sprintf(info, "+TCPSTATUS:%d,\"%s\",\"%s\",%d,%d,%d\r\n",
+                        n, (tcpconns[n]->udp) ? "UDP" : "TCP", ip_addr, tcpconns[n]->port, tcpconns[n]->conn->proto.tcp->remote_port, is_server);
+                at_port_print(info);
+            }
+        }
+    }
+
+    at_response_ok();
+}
+
+//AT+TCPSTATUS=<link_id>
+//==================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPStatus(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, err = 0, flag = 0;
+    char info[40] = {'\0'};
+    char ip_addr[16] = {'\0'};
+    uint8_t is_server = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    if ((tcpconns[tcp_n] == NULL) || (tcpconns[tcp_n]->conn == NULL)) goto exit_err;
+
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    is_server = 0;
+    if ((tcpconns[tcp_n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
+        is_server = ((tcpconns[tcp_n]->parrent & 0x07) < tcpserv_max) ? 1 : 0;
+    }
+    os_sprintf(ip_addr, IPSTR, tcpconns[tcp_n]->conn->proto.tcp->remote_ip[0], tcpconns[tcp_n]->conn->proto.tcp->remote_ip[1],
+            tcpconns[tcp_n]->conn->proto.tcp->remote_ip[2], tcpconns[tcp_n]->conn->proto.tcp->remote_ip[3]);
+    os_sprintf(info, "+TCPSTATUS:\"%s\",%d,%d", ip_addr, tcpconns[tcp_n]->conn->proto.tcp->remote_port, is_server);
+    at_port_print(info);
+
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+// Print '+TCPSTATS:<link_id>,<rx_bytes>,<rx_segs>,<tx_bytes>,<tx_segs>,<resends>,<aborts>,<wait_ms>,<hold_ms>,
+//        <srtt_ms>,<rto_ms>,<rexmits>,<snd_wnd>,<cwnd>'
+// The lwIP values are reported as 0 for UDP and not connected links
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpstats_print(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+    tcpstats_t *stats = &tcpconn->stats;
+    uint16 srtt = 0, rto = 0, rexmits = 0, snd_wnd = 0, cwnd = 0;
+    uint32_t hold_ms = stats->hold_ms;
+    char info[160] = {'\0'};
+
+    if ((tcpconn->connected) && (!tcpconn->udp) &&
+            (espconn_tcp_get_stats(tcpconn->conn, &srtt, &rto, &rexmits, &snd_wnd, &cwnd) == ESPCONN_OK)) {
+        rexmits -= stats->rexmits_base;
+    }
+    else rexmits = 0;
+    // the hold in progress is counted too
+    if (tcpconn->rx_hold) hold_ms += (system_get_time() - stats->hold_since) / 1000;
+
+    os_sprintf(info, "+TCPSTATS:%d,%u,%u,%u,%u,%u,%u,%u,%u,%d,%d,%d,%d,%d\r\n", tcp_n,
+            stats->rx_bytes, stats->rx_segs, stats->tx_bytes, stats->tx_segs, stats->resends, stats->aborts,
+            stats->wait_ms, hold_ms, srtt, rto, rexmits, snd_wnd, cwnd);
+    at_port_print(info);
+}
+
+// Clear the link's statistics, the delivery or hold in progress is counted from now
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpstats_clear(uint8_t tcp_n)
+{
+    tcpconn_t *tcpconn = tcpconns[tcp_n];
+
+    if (tcpconn->connected) tcpstats_reset(tcpconn);
+    else {
+        os_memset(&tcpconn->stats, 0, sizeof(tcpstats_t));
+        tcpconn->stats.wait_since = system_get_time();
+        tcpconn->stats.hold_since = tcpconn->stats.wait_since;
+    }
+}
+
+//AT+TCPSTATS?
+//=====================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPStats(uint8_t id)
+{
+    uint8_t n;
+
+    for (n=0; n<tcpconn_max; n++) {
+        if (tcpconns[n] != NULL) tcpstats_print(n);
+    }
+    at_response_ok();
+}
+
+//AT+TCPSTATS=<link_id>
+// Print the link's statistics and clear them
+//==================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPStats(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    if (tcpconns[tcp_n] == NULL) goto exit_err;
+
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    tcpstats_print(tcp_n);
+    tcpstats_clear(tcp_n);
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+}
+
+//AT+TCPSTATS
+// Clear the statistics of all links
+//=====================================================
+void ICACHE_FLASH_ATTR at_exeCmdTCPStats(uint8_t id)
+{
+    uint8_t n;
+
+    for (n=0; n<tcpconn_max; n++) {
+        if (tcpconns[n] != NULL) tcpstats_clear(n);
+    }
+    at_response_ok();
+}
+
+//AT+TCPCLOSE=<link ID>
+//=================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPClose(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    if (tcpconns[tcp_n] == NULL) goto exit_err;
+    // asynchronous AT+TCPSTART in progress, wait for its result
+    if (tcpconns[tcp_n]->async) goto exit_err;
+
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    // the idle pooled connection is parked, CLOSED is reported at once
+    if ((tcpconns[tcp_n]->connected) && (!tcppool_park(tcp_n))) tcpconn_disconnect(tcp_n);
+
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//-----------------------------------------------------------------------------------------
+static uint16_t ICACHE_FLASH_ATTR _request_get_input(uint8_t *buf, uint16_t len, char *msg)
+{
+    uint16_t idx = 0;
+    uint32_t tmo = 500000; // one second timeout
+    uint8_t term = 0, ch;
+    char info[32] = {0};
+
+    // ==== Send the data request prompt to the client ====
+    at_port_print_irom_str("\r\n>");
+
+    // ==== Accept input data into buffer ====
+    system_soft_wdt_stop();
+    while (tmo) {
+        os_delay_us(2);
+        tmo--;
+        while (uart_rx_one_char(&ch) == 0) {
+            if ((len == 0) && (ch == TCPINPUT_TERMINATE_CHAR)) term = 1;
+            else {
+                // place the received character into the buffer
+                buf[idx++] = ch;
+                if (idx == len) term = 1;
+            }
+            if (term) break;
+        }
+        if (term) break;
+    }
+    system_soft_wdt_restart();
+
+    os_sprintf(info, "\r\n%s:%d\r\n", msg, idx);
+    at_port_print(info);
+
+    if ((tmo == 0) || (idx == 0) || ((len > 0) && (idx != len))) {
+        os_free(buf);
+        at_port_print_irom_str("\r\nFAIL\r\n");
+        idx = 0;
+    }
+    return idx;
+}
+
+//AT+TCPSEND=<link ID>[,<length>]
+// <length> > 0       -> load send data of specified length
+// <length> not given -> load send data with terminating character at the end
+// OK is returned after all data are received from the host,
+// '+TCPSENT,<link ID>,<seq>' is reported when the data are acknowledged by the remote side
+// With the spool enabled (AT+TCPSPOOL) the data sent while the link is not connected are
+// written to the spool, '+TCPSEND:<length>,SPOOL' is reported instead of the sequence number
+//================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPSend(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, len = -1, err = 0, flag = 0;
+    tcp_txop_t *op;
+    bool spool;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    spool = tcpspool_route(tcp_n);
+    if ((!spool) && ((tcpconns[tcp_n] == NULL) || (!tcpconns[tcp_n]->connected) || (tcpconns[tcp_n]->udp))) goto exit_err;
+
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the 2nd parameter (length)
+        flag = at_get_next_int_dec(&pPara, &len, &err);
+        if (err != 0) goto exit_err;
+        if ((len < 1) || (len > TCPSEND_MAX_LEN)) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+    // in framed mode the data are sent in data frames
+    if ((tcpsend.state != TCPTX_IDLE) || (tcp_framed)) goto exit_err;
+
+    if (spool) {
+        // the data are written to the spool while they are received, all must fit
+        if ((len > 0) && (spool_free() < (len + ((len / TCPSEND_CHUNK_SIZE) + 1) * (SPOOL_HDR_SIZE + 3)))) {
+            at_port_print_irom_str("\r\n+TCPSEND:spoolFull\r\n");
+            goto exit_err;
+        }
+        tcpsend.spool = 1;
+    }
+    else {
+        if (tcpconns[tcp_n]->tx_ops >= tcpsend_depth) {
+            at_port_print_irom_str("\r\n+TCPSEND:busy\r\n");
+            goto exit_err;
+        }
+
+        // Create the send operation
+        op = (tcp_txop_t *)os_zalloc(sizeof(tcp_txop_t));
+        if (!op) goto exit_err;
+        op->seq = ++tcpconns[tcp_n]->tx_seq;
+        if (tcpconns[tcp_n]->txop_tail) tcpconns[tcp_n]->txop_tail->next = op;
+        else tcpconns[tcp_n]->txop_head = op;
+        tcpconns[tcp_n]->txop_tail = op;
+        tcpconns[tcp_n]->tx_ops++;
+        tcpsend.op = op;
+    }
+
+    tcpsend.link = tcp_n;
+    if (len < 0) {
+        // load up to terminating character
+        tcpsend.term = 1;
+        tcpsend.remain = 0;
+    }
+    else tcpsend.remain = len;
+    tcpsend.state = TCPTX_INPUT;
+
+    at_enter_special_state();
+    // Take the UART input and send the ready prompt to the client
+    at_register_uart_rx_intr(tcpsend_uart_rx_cb);
+    os_timer_disarm(&tcpsend_timer);
+    os_timer_setfn(&tcpsend_timer, (os_timer_func_t *)tcpsend_timeout_cb, NULL);
+    os_timer_arm(&tcpsend_timer, TCPSEND_INPUT_TIMEOUT_MS, 0);
+    at_port_print_irom_str("\r\n>");
+
+    return;
+
+exit_err:
+    at_response_error();
+}
+
+//AT+TCPSENDQ=<depth>
+// <depth> -> maximal number of AT+TCPSEND operations in progress per link
+//================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPSendQueue(uint8_t id, char *pPara)
+{
+    int depth = 0, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (depth)
+    flag = at_get_next_int_dec(&pPara, &depth, &err);
+    if (err != 0) goto exit_err;
+    if ((depth < 1) || (depth > TCPSEND_DEPTH_MAX)) goto exit_err;
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    tcpsend_depth = depth;
+
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//AT+TCPSENDQ?
+//=========================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPSendQueue(uint8_t id)
+{
+    char buf[48] = {'\0'};
+    uint8_t tcp_n;
+
+    os_sprintf(buf, "+TCPSENDQ:%d,%d\r\n", tcpsend_depth, tcpsend_queued);
+    at_port_print(buf);
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->tx_ops)) {
+            os_sprintf(buf, "+TCPSENDQ:%d,%d,%d\r\n", tcp_n, tcpconns[tcp_n]->tx_ops, tcpconns[tcp_n]->tx_seq);
+            at_port_print(buf);
+        }
+    }
+
+    at_response_ok();
+    return;
+}
+
+//AT+SSLLOADCERT=<cert_no>[,<length>]
+// <length> = 0       -> delete the certificate
+// <length> > 100     -> load certificate of specified length
+// <length> not given -> load certificate with terminating character at the end
+//====================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPLoadCert(uint8_t id, char *pPara)
+{
+    int cert_n = 0, len = -1, err = 0, flag = 0;
+    char buf[24] = {0};
+    uint8_t res, term;
+    char ch;
+    uint8_t *end_ptr;
+    uint8_t *tcp_input_buf = NULL;
+    uint16_t send_len;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (certificate number, nut used at the moment)
+    flag = at_get_next_int_dec(&pPara, &cert_n, &err);
+    if (err != 0) goto exit_err;
+    if ((cert_n < 0) || (cert_n >= TCP_MAX_CERTS)) goto exit_err;
+
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the 2nd parameter (length)
+        flag = at_get_next_int_dec(&pPara, &len, &err);
+        if (err != 0) goto exit_err;
+        if ((len < 0) || (len > (SECTOR_SIZE-TCP_CERT_HEAD_SIZE-TCP_CERT_LEN_SIZE))) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    // Delete current certificate buffer if exists
+    if (espconn_in_ram_sector.buffer) os_free(espconn_in_ram_sector.buffer);
+    espconn_in_ram_sector.sector = 0;
+    espconn_in_ram_sector.size = 0;
+    espconn_in_ram_sector.buffer = NULL;
+    if (len == 0) {
+        at_response_ok();
+        return;
+    }
+    if (len < 0) len = 0; // load up to terminating character
+
+    // Create the certificate buffer
+    tcp_input_buf = (uint8_t *)os_zalloc(SECTOR_SIZE);
+    if (!tcp_input_buf) goto exit_err;
+
+    // Send the ready prompt to the client
+    // and accept input data into buffer at position after the certificate header (34 bytes)
+    send_len = _request_get_input(tcp_input_buf+TCP_CERT_HEAD_SIZE+TCP_CERT_LEN_SIZE, len, "+SSLLOADCERT");
+    if (send_len == 0) return;
+
+    // Create header and length in RAM sector
+    os_sprintf(tcp_input_buf, "TLS.ca_x509.cer");
+    uint16_t *clen = (uint16_t *)(tcp_input_buf + TCP_CERT_HEAD_SIZE);
+    *clen = send_len;
+
+    espconn_in_ram_sector.buffer = tcp_input_buf;
+    espconn_in_ram_sector.sector = SYSTEM_PARTITION_SSL_CLIENT_CA_ADDR / SECTOR_SIZE;
+    espconn_in_ram_sector.size = send_len+TCP_CERT_HEAD_SIZE+TCP_CERT_LEN_SIZE+1;
+
+    at_response_ok();
+
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//AT+TCPLOADCERT?
+//=======================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPLoadCert(uint8_t id)
+{
+    if ((espconn_in_ram_sector.sector > 0) && (espconn_in_ram_sector.buffer)) {
+        char buf[32] = {'\0'};
+        uint16_t *clen = (uint16_t *)(espconn_in_ram_sector.buffer + TCP_CERT_HEAD_SIZE);
+
+        os_sprintf(buf, "+SSLLOADCERT:0,%04X,%d\r\n", espconn_in_ram_sector.sector, *clen);
+        at_port_print(buf);
+        at_port_print(espconn_in_ram_sector.buffer+TCP_CERT_HEAD_SIZE+TCP_CERT_LEN_SIZE);
+    }
+    else {
+        at_port_print_irom_str("+SSLLOADCERT:0\r\n");
+    }
+    at_response_ok();
+}
+
+/*
+  bit0: if set to 1, certificate and private key will be enabled,
+        so SSL server can verify ESP8266; if 0, then will not.
+  bit1: if set to 1, CA will be enabled, so ESP8266 can verify SSL server,
+        if 0, then will not.
+*/
+//AT+TCPSSLCONFIG=<cfg>
+//=====================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPSSLconfig(uint8_t id, char *pPara)
+{
+    int cfg = 0, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (config)
+    flag = at_get_next_int_dec(&pPara, &cfg, &err);
+    if (err != 0) goto exit_err;
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+    if ((cfg < 0) || (cfg > 3)) goto exit_err;
+
+    tcp_sslconfig = cfg;
+
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//AT+SSLCCONF?
+//========================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPSSLconfig(uint8_t id)
+{
+    char buf[32] = {'\0'};
+
+    os_sprintf(buf, "+SSLCCONF:%d\r\n", tcp_sslconfig);
+    at_port_print(buf);
+
+    at_response_ok();
+    return;
+}
+
+//AT+TCPRECVMODE=<mode>[,<buf_size>]
+// <mode> = 0 -> active mode, received data are sent to the host
+// <mode> = 1 -> passive mode, data are kept in the link's receive buffer and read with AT+TCPRECV
+// The mode is applied to the links created after the command
+//=====================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPRecvMode(uint8_t id, char *pPara)
+{
+    int mode = 0, size = tcp_recvbuf_size, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (mode)
+    flag = at_get_next_int_dec(&pPara, &mode, &err);
+    if (err != 0) goto exit_err;
+    if ((mode != TCPRECV_MODE_ACTIVE) && (mode != TCPRECV_MODE_PASSIVE)) goto exit_err;
+
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 2nd parameter (receive buffer size)
+        flag = at_get_next_int_dec(&pPara, &size, &err);
+        if (err != 0) goto exit_err;
+        if ((size < TCP_MSS) || (size > TCPCONN_RXRING_MAX)) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    tcp_recvmode = mode;
+    tcp_recvbuf_size = size;
+
+    at_response_ok();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//AT+TCPRECVMODE?
+//=======================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPRecvMode(uint8_t id)
+{
+    char buf[32] = {'\0'};
+
+    os_sprintf(buf, "+TCPRECVMODE:%d,%d\r\n", tcp_recvmode, tcp_recvbuf_size);
+    at_port_print(buf);
+
+    at_response_ok();
+    return;
+}
+
+//AT+TCPRECV=<link ID>,<max_len>
+// Read up to <max_len> bytes from the link's receive buffer (passive mode)
+//================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPRecv(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, len = 0, err = 0, flag = 0;
+    uint8_t buf[TCPRECV_CHUNK_SIZE];
+    char info[32] = {'\0'};
+    tcpconn_t *tcpconn;
+    uint16_t n;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    if ((tcpconns[tcp_n] == NULL) || (tcpconns[tcp_n]->rx_mode != TCPRECV_MODE_PASSIVE)) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (max length)
+    flag = at_get_next_int_dec(&pPara, &len, &err);
+    if (err != 0) goto exit_err;
+    if ((len < 1) || (len > TCPCONN_RXRING_MAX)) goto exit_err;
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    tcpconn = tcpconns[tcp_n];
+    if (len > ringbuf_bytes_used(tcpconn->rx_ring)) len = ringbuf_bytes_used(tcpconn->rx_ring);
+
+    os_sprintf(info, "\r\n+TCPRECV,%d,%d:", tcp_n, len);
+    at_port_print(info);
+    tcpconn->rx_queued -= len;
+    // copy the data from the ring buffer to the UART in small chunks
+    // in framed mode each chunk is sent in the data frame
+    while (len > 0) {
+        n = (len > TCPRECV_CHUNK_SIZE) ? TCPRECV_CHUNK_SIZE : len;
+        ringbuf_memcpy_from(buf, tcpconn->rx_ring, n);
+        if (tcp_framed) frame_send(tcp_n, FRAME_TYPE_DATA, buf, n);
+        else uart0_tx_buffer(buf, n);
+        len -= n;
+    }
+    at_response_ok();
+
+    // make room for more data
+    tcpconn_rx_refill(tcp_n);
+    if ((tcpconn->rx_hold) && (tcpconn->rx_head == NULL) &&
+            (ringbuf_bytes_free(tcpconn->rx_ring) >= (ringbuf_capacity(tcpconn->rx_ring) / 2))) {
+        tcpconn_rx_unhold(tcpconn);
+    }
+    // notify the host again on next received data
+    tcpconn->rx_notify = 0;
+    if ((tcpconn->closing) && (tcpconn->rx_queued == 0)) tcpconn_closed(tcp_n);
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//AT+TCPRECV?
+// Report the number of bytes available in each passive mode link
+//===================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPRecv(uint8_t id)
+{
+    char buf[32] = {'\0'};
+    uint8_t tcp_n;
+
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->rx_mode == TCPRECV_MODE_PASSIVE)) {
+            os_sprintf(buf, "+TCPRECV:%d,%d\r\n", tcp_n, tcpconns[tcp_n]->rx_queued);
+            at_port_print(buf);
+        }
+    }
+
+    at_response_ok();
+    return;
+}
+
+//AT+TCPCREDIT=<link ID>,<credit>[,<unit>]
+// <credit> = 0 -> each received segment is delivered with the '+TCP' alert and 'r'/'y' handshake
+// <credit> > 0 -> segments are streamed to the host while they fit into <credit>, acknowledged with AT+TCPACK
+// <unit> = 0   -> <credit> is in bytes (default)
+// <unit> = 1   -> <credit> is in segments
+//=====================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPCredit(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, credit = 0, unit = TCPRX_CREDIT_BYTES, err = 0, flag = 0;
+    tcpconn_t *tcpconn;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    if ((tcpconns[tcp_n] == NULL) || (tcpconns[tcp_n]->rx_mode != TCPRECV_MODE_ACTIVE)) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (credit)
+    flag = at_get_next_int_dec(&pPara, &credit, &err);
+    if (err != 0) goto exit_err;
+
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 3rd parameter (unit)
+        flag = at_get_next_int_dec(&pPara, &unit, &err);
+        if (err != 0) goto exit_err;
+        if ((unit != TCPRX_CREDIT_BYTES) && (unit != TCPRX_CREDIT_SEGMENTS)) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+    if ((credit < 0) || (credit > ((unit == TCPRX_CREDIT_BYTES) ? TCPCONN_RXCREDIT_MAX : TCPCONN_RXCREDIT_SEGS))) goto exit_err;
+
+    tcpconn = tcpconns[tcp_n];
+    if ((tcpconn->rx_credit) && (credit) && (unit != tcpconn->rx_unit)) goto exit_err;
+
+    if ((tcprx_state != TCPRX_IDLE) && (tcprx_link == tcp_n)) {
+        // framed mode, the data frame waiting for the acknowledge is streamed again
+        os_timer_disarm(&tcprx_timer);
+        tcprx_state = TCPRX_IDLE;
+    }
+    if (credit == 0) {
+        // the unacknowledged segments are delivered again with the handshake
+        tcpconn->rx_next = NULL;
+        tcpconn->rx_delivered = 0;
+        tcpconn->rx_dlv_segs = 0;
+        tcpconn->rx_ackpend = 0;
+    }
+    else if (tcpconn->rx_credit == 0) tcpconn->rx_next = tcpconn->rx_head;
+    tcpconn->rx_credit = credit;
+    tcpconn->rx_unit = unit;
+
+    at_response_ok();
+    tcprx_start();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//AT+TCPCREDIT?
+// Report the credit mode links: '+TCPCREDIT:<link ID>,<credit>,<unit>,<unacknowledged>,<waiting>'
+//=====================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPCredit(uint8_t id)
+{
+    char buf[64] = {'\0'};
+    uint8_t tcp_n;
+
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->rx_credit)) {
+            os_sprintf(buf, "+TCPCREDIT:%d,%d,%d,%d,%d\r\n", tcp_n, tcpconns[tcp_n]->rx_credit, tcpconns[tcp_n]->rx_unit,
+                    tcpconns[tcp_n]->rx_delivered, tcpconns[tcp_n]->rx_queued - tcpconns[tcp_n]->rx_delivered);
+            at_port_print(buf);
+        }
+    }
+
+    at_response_ok();
+    return;
+}
+
+//AT+TCPACK=<link ID>,<count>[,<resend>]
+// <count>  -> number of bytes or segments (AT+TCPCREDIT unit) processed by the host
+// <resend> = 1 -> deliver the rest of the unacknowledged data again
+//===============================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPAck(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, count = 0, resend = 0, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    if ((tcpconns[tcp_n] == NULL) || (tcpconns[tcp_n]->rx_credit == 0)) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (count)
+    flag = at_get_next_int_dec(&pPara, &count, &err);
+    if (err != 0) goto exit_err;
+    if (count < 0) goto exit_err;
+
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 3rd parameter (resend)
+        flag = at_get_next_int_dec(&pPara, &resend, &err);
+        if (err != 0) goto exit_err;
+        if ((resend < 0) || (resend > 1)) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    at_response_ok();
+    tcpconn_rx_ack(tcp_n, count, resend);
+    tcprx_start();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//AT+TCPCOAL=<link ID>,<bytes>[,<window>]
+// <bytes>  -> coalesce the received segments up to this size, 0: disabled
+// <window> -> us, segments arriving within the window are merged
+//=================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPCoal(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, bytes = 0, window = TCPCOAL_WINDOW_DEFAULT, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    // datagrams are never merged
+    if ((tcpconns[tcp_n] == NULL) || (tcpconns[tcp_n]->udp)) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (bytes)
+    flag = at_get_next_int_dec(&pPara, &bytes, &err);
+    if (err != 0) goto exit_err;
+    if ((bytes < 0) || (bytes > TCPCOAL_BYTES_MAX)) goto exit_err;
+
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 3rd parameter (window)
+        flag = at_get_next_int_dec(&pPara, &window, &err);
+        if (err != 0) goto exit_err;
+        if ((window < 0) || (window > TCPCOAL_WINDOW_MAX)) goto exit_err;
+    }
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    tcpconns[tcp_n]->rx_coal_bytes = bytes;
+    tcpconns[tcp_n]->rx_coal_window = window;
+    tcpconns[tcp_n]->rx_coal_until = system_get_time();
+
+    at_response_ok();
+    // the waiting segment is delivered if the coalescing was disabled
+    tcprx_start();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
+}
+
+//AT+TCPCOAL?
+// Report the links: '+TCPCOAL:<link ID>,<bytes>,<window>,<segments>,<merged>'
+//===================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPCoal(uint8_t id)
+{
+    char buf[64] = {'\0'};
+    uint8_t tcp_n;
+
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if (tcpconns[tcp_n]) {
+            os_sprintf(buf, "+TCPCOAL:%d,%d,%d,%d,%d\r\n", tcp_n, tcpconns[tcp_n]->rx_coal_bytes, tcpconns[tcp_n]->rx_coal_window,
+                    tcpconns[tcp_n]->rx_segs, tcpconns[tcp_n]->rx_merged);
+            at_port_print(buf);
+        }
+    }
+
+    at_response_ok();
+    return;
+}
+
+//AT+TCPCORK=<link ID>,<mode>[,<bytes>[,<delay>]]
+// <mode> = 0 -> send each chunk at once, Nagle algorithm disabled (default)
+// <mode> = 1 -> Nagle algorithm enabled, the chunks waiting to be sent are merged
+// <mode> = 2 -> cork, the data are merged and sent when <bytes> are waiting or after <delay> ms
+// The data waiting are sent when the mode is set (uncork)
+//=================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPCork(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, mode = 0, bytes = TCPSEND_CHUNK_SIZE, delay = TCPCORK_DELAY_DEFAULT, err = 0, flag = 0;
+    tcpconn_t *tcpconn;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    // datagrams are never merged
+    if ((tcpconns[tcp_n] == NULL) || (tcpconns[tcp_n]->udp) || (!tcpconns[tcp_n]->connected)) goto exit_err;
+    tcpconn = tcpconns[tcp_n];
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (mode)
+    flag = at_get_next_int_dec(&pPara, &mode, &err);
+    if (err != 0) goto exit_err;
+    if ((mode < TCPTX_MODE_NODELAY) || (mode > TCPTX_MODE_CORK)) goto exit_err;
 
-    // check if the last parameter
-    if (*pPara == ',') {
-        pPara++; // skip ','
-        //get the optional 3rd parameter (port)
-        flag = at_get_next_int_dec(&pPara, &port, &err);
-        if (err != 0) port = 333;
-        if ((port < 0) || (port > 65535)) port = 333;
-    }
-    // check if the last parameter
-    if (*pPara == ',') {
-        pPara++; // skip ','
-        //get the optional 4th parameter (ssl)
-        flag = at_get_next_int_dec(&pPara, &ssl, &err);
-        if (err != 0) ssl = 0;
-        if ((ssl < 0) || (ssl > 1)) ssl = 0;
-    }
-    // check if the last parameter
     if (*pPara == ',') {
         pPara++; // skip ','
-        //get the optional 5th parameter (keepalive)
-        flag = at_get_next_int_dec(&pPara, &maxconn, &err);
-        if (err != 0) maxconn = TCPCONN_MAX_CONN;
-        if ((maxconn < 1) || (maxconn > TCPCONN_MAX_CONN)) goto exit_err;
+        //get the optional 3rd parameter (bytes)
+        flag = at_get_next_int_dec(&pPara, &bytes, &err);
+        if (err != 0) goto exit_err;
+        if ((bytes < 1) || (bytes > TCPSEND_CHUNK_SIZE)) goto exit_err;
+        if (*pPara == ',') {
+            pPara++; // skip ','
+            //get the optional 4th parameter (delay)
+            flag = at_get_next_int_dec(&pPara, &delay, &err);
+            if (err != 0) goto exit_err;
+            if ((delay < 1) || (delay > TCPCORK_DELAY_MAX)) goto exit_err;
+        }
     }
     // check if the last parameter
-    if (*pPara == ',') {
-        pPara++; // skip ','
-        //get the optional 6th parameter (timeout)
-        flag = at_get_next_int_dec(&pPara, &tmo, &err);
-        if (err != 0) tmo = TCPSERV_CONN_TIMEOUT;
-        if ((tmo < 0) || (maxconn > 7200)) goto exit_err;
-    }
     if (*pPara != '\r') goto exit_err;
 
-    if (enable == 1) {
-        // === Create the new TCP Server ===
-        if (tcpservers[srv_n] != NULL) goto exit_err;
+    if ((mode == TCPTX_MODE_NAGLE) && (tcpconn->tx_mode != TCPTX_MODE_NAGLE)) espconn_clear_opt(tcpconn->conn, ESPCONN_NODELAY);
+    else if ((mode != TCPTX_MODE_NAGLE) && (tcpconn->tx_mode == TCPTX_MODE_NAGLE)) espconn_set_opt(tcpconn->conn, ESPCONN_NODELAY);
+    tcpconn->tx_mode = mode;
+    tcpconn->tx_cork_bytes = bytes;
+    tcpconn->tx_cork_delay = delay;
+    tcpconn->tx_cork_until = system_get_time();
 
-        // create tcpconn structure
-        tcpserver_t *tcpsrv = (tcpserver_t *)os_zalloc(sizeof(tcpserver_t));
-        if (!tcpsrv) goto exit_err;
+    at_response_ok();
+    // the waiting data are sent
+    tcpconn_tx_push(tcp_n);
+    return;
 
-        // create connection
-        tcpsrv->conn = (struct espconn *)os_zalloc(sizeof(struct espconn));
-        if (!tcpsrv->conn) {
-            os_free(tcpsrv);
-            goto exit_err;
-        }
-        tcpsrv->conn->proto.tcp = (esp_tcp *)os_zalloc(sizeof(esp_tcp));
-        if (!tcpsrv->conn->proto.tcp) {
-            os_free(tcpsrv->conn);
-            os_free(tcpsrv);
-            goto exit_err;
-        }
+exit_err:
+    at_response_error();
+    return;
+}
 
-        // Configure tcpserver structure
-        tcpservers[srv_n] = tcpsrv;
-        tcpservers[srv_n]->port = port;
-        tcpservers[srv_n]->connected = 0;
-        tcpservers[srv_n]->ssl = ssl;
-        tcpservers[srv_n]->timeout = tmo;
-        tcpservers[srv_n]->maxconn = maxconn;
-        tcpservers[srv_n]->conn->parrent = TCPCONN_PARRENT_MASK | srv_n;
-        tcpservers[srv_n]->conn->type = ESPCONN_TCP;
-        tcpservers[srv_n]->conn->state = ESPCONN_NONE;
-        tcpservers[srv_n]->conn->proto.tcp->local_port = port;
-        // register client connection callback
-        espconn_regist_connectcb(tcpservers[srv_n]->conn, tcpserver_client_connect_cb);
+//AT+TCPCORK?
+// Report the links: '+TCPCORK:<link ID>,<mode>,<bytes>,<delay>,<merged>'
+//===================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPCork(uint8_t id)
+{
+    char buf[64] = {'\0'};
+    uint8_t tcp_n;
 
-        espconn_tcp_set_max_con_allow(tcpservers[srv_n]->conn, maxconn);
-        // Accept connections
-        if (ssl) espconn_secure_accept(tcpservers[srv_n]->conn);
-        else {
-            res = espconn_accept(tcpservers[srv_n]->conn);
-            if (res != ESPCONN_OK) {
-                at_port_print_irom_str("\r\nTCPServerAcceptERROR\r\n");
-                goto exit_err;
-            }
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if ((tcpconns[tcp_n]) && (!tcpconns[tcp_n]->udp)) {
+            os_sprintf(buf, "+TCPCORK:%d,%d,%d,%d,%d\r\n", tcp_n, tcpconns[tcp_n]->tx_mode, tcpconns[tcp_n]->tx_cork_bytes,
+                    tcpconns[tcp_n]->tx_cork_delay, tcpconns[tcp_n]->tx_merged);
+            at_port_print(buf);
         }
     }
-    else if (enable == 0) {
-        // === Delete the TCP Server ===
-        if (tcpservers[srv_n]) {
-            // Close all clients
-            for (tcp_n=0; tcp_n<TCPCONN_MAX_CONN; tcp_n++) {
-                if (tcpconns[tcp_n] != NULL) {
-                    if ((tcpconns[tcp_n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
-                        cli_srv_n = tcpconns[tcp_n]->parrent & 0x07;
-                        if (cli_srv_n == srv_n) {
-                            if (tcpconns[tcp_n]->connected) {
-                                if (tcpconns[tcp_n]->ssl > 0) espconn_secure_disconnect(tcpconns[tcp_n]->conn);
-                                else espconn_disconnect(tcpconns[tcp_n]->conn);
-                            }
-                        }
-                    }
-                }
-            }
 
-            espconn_delete(tcpservers[srv_n]->conn);
-            os_free(tcpservers[srv_n]->conn);
-            os_free(tcpservers[srv_n]);
-            tcpservers[srv_n] = NULL;
-        }
-        else goto exit_err;
+    at_response_ok();
+    return;
+}
+
+//AT+TCPSPOOL=<link ID>,<mode>
+// <mode> = 1 -> the data sent to the link while it is not connected are written to the flash spool
+//               and sent before any new data when the link is connected again
+// <mode> = 0 -> spool disabled, the link's spooled data are discarded
+//=================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPSpool(uint8_t id, char *pPara)
+{
+    int tcp_n = 0, mode = 0, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (conn number)
+    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    if (err != 0) goto exit_err;
+    if ((tcp_n < 0) || (tcp_n >= tcpconn_max)) goto exit_err;
+    // datagrams are not spooled
+    if ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->udp)) goto exit_err;
+
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (mode)
+    flag = at_get_next_int_dec(&pPara, &mode, &err);
+    if (err != 0) goto exit_err;
+    if ((mode < 0) || (mode > 1)) goto exit_err;
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    if (mode) {
+        // no spare flash for the spool with this flash map
+        if ((!tcpspool_ready) && (!spool_init())) goto exit_err;
+        tcpspool_ready = 1;
+        tcpspool_links |= (1 << tcp_n);
+    }
+    else {
+        tcpspool_links &= ~(1 << tcp_n);
+        // the records already queued by the replay are still sent
+        if (tcpspool_ready) spool_discard(tcp_n);
     }
-    else goto exit_err;
 
     at_response_ok();
     return;
@@ -806,148 +4438,343 @@ exit_err:
     return;
 }
 
-//AT+TCPSERVER?
-//-----------------------------------------------------
-void ICACHE_FLASH_ATTR at_queryCmdTCPServer(uint8_t id)
+//AT+TCPSPOOL?
+// '+TCPSPOOL:<size>,<used>,<records>,<delivered>,<discarded>,<full>,<erases>'
+// and for each link with the spool enabled: '+TCPSPOOL:<link ID>,<records>,<bytes>,<replaying>'
+//===================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPSpool(uint8_t id)
 {
-    char info[128] = {'\0'};
-    char ip_addr[16] = {'\0'};
-    uint8_t srv_n, cli_srv_n;
-    uint8_t tcp_n, n = 0;
+    char buf[96] = {'\0'};
+    uint8_t tcp_n;
 
-    for (srv_n=0; srv_n<TCPCONN_MAX_SERV; srv_n++) {
-        if (tcpservers[srv_n]) n++;
+    if (tcpspool_ready) {
+        os_sprintf(buf, "+TCPSPOOL:%u,%u,%u,%u,%u,%u,%u\r\n", spool_size(), spool_used(), spool_stats.records,
+                spool_stats.delivered, spool_stats.discarded, spool_stats.full, spool_stats.erases);
     }
-    os_sprintf(info, "+TCPSERVER:%d\r\n", n);
-    at_port_print(info);
-    if (n > 0) {
-        for (srv_n=0; srv_n<TCPCONN_MAX_SERV; srv_n++) {
-            if (tcpservers[srv_n]) {
-                n++;
-                os_sprintf(info, "+TCPSERVER:%d,%d,%d,%d,%d,%d\r\n", srv_n, tcpservers[srv_n]->connected,
-                        tcpservers[srv_n]->maxconn, tcpservers[srv_n]->port, tcpservers[srv_n]->ssl, tcpservers[srv_n]->timeout);
-                at_port_print(info);
-                for (tcp_n=0; tcp_n<TCPCONN_MAX_CONN; tcp_n++) {
-                    if (tcpconns[tcp_n] != NULL) {
-                        if ((tcpconns[tcp_n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
-                            cli_srv_n = tcpconns[tcp_n]->parrent & 0x07;
-                            if (cli_srv_n == srv_n) {
-                                os_sprintf(ip_addr, IPSTR, tcpconns[tcp_n]->conn->proto.tcp->remote_ip[0], tcpconns[tcp_n]->conn->proto.tcp->remote_ip[1],
-                                        tcpconns[tcp_n]->conn->proto.tcp->remote_ip[2], tcpconns[tcp_n]->conn->proto.tcp->remote_ip[3]);
-                                os_sprintf(info, "+TCPCLIENT:%d,\"%s\",%d\r\n", ip_addr, tcpconns[tcp_n]->conn->proto.tcp->remote_port);
-                                at_port_print(info);
-                            }
-                        }
-                    }
-                }
-            }
+    else os_sprintf(buf, "+TCPSPOOL:%u,0,0,0,0,0,0\r\n", SPOOL_FLASH_SIZE);
+    at_port_print(buf);
+
+    for (tcp_n=0; tcp_n<tcpconn_max; tcp_n++) {
+        if (tcpspool_links & (1 << tcp_n)) {
+            os_sprintf(buf, "+TCPSPOOL:%d,%d,%u,%d\r\n", tcp_n, spool_records(tcp_n), spool_pending(tcp_n),
+                    ((tcpconns[tcp_n]) && (tcpconns[tcp_n]->spool_op)) ? 1 : 0);
+            at_port_print(buf);
         }
     }
+
     at_response_ok();
+    return;
 }
 
-//AT+TCPSTATUS or AT+TCPSTATUS?
-//=====================================================
-void ICACHE_FLASH_ATTR at_queryCmdTCPStatus(uint8_t id)
+// AT command processor output in framed mode
+//-----------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpframe_at_tx(const uint8 *data, uint32 length)
 {
-    char info[80] = {'\0'};
-    char ip_addr[16] = {'\0'};
-    uint8_t is_server, n, status, found = 0;
-    uint8_t wifi_mode = wifi_get_opmode() & 1;
+    uint16_t n;
 
-    for (n=0; n<TCPCONN_MAX_CONN; n++) {
-        if (tcpconns[n] != NULL) {
-            if (tcpconns[n]->connected) {
-                found++;
-                break;
-            }
-        }
+    while (length > 0) {
+        n = (length > FRAME_MAX_PAYLOAD) ? FRAME_MAX_PAYLOAD : length;
+        frame_send(FRAME_LINK_SYSTEM, FRAME_TYPE_AT, data, n);
+        data += n;
+        length -= n;
     }
-    if (wifi_mode == 0) status = 5;
-    else {
-        status = 2;
-        if (found) status = 3;
+}
+
+// UDP datagram frame received from the host, sent to the address at the start of the payload
+//------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpframe_send_dgram(uint8_t tcp_n, uint8_t *data, uint16_t len)
+{
+    uint16_t seq = 0;
+
+    if ((tcp_n >= tcpconn_max) || (tcpconns[tcp_n] == NULL)) goto exit_nak;
+    seq = ++tcpconns[tcp_n]->tx_seq;
+    if ((!tcpconns[tcp_n]->udp) || (!tcpconns[tcp_n]->connected) || (len <= FRAME_DGRAM_ADDR_SIZE)) goto exit_nak;
+    if (udpconn_sendto(tcp_n, data + FRAME_DGRAM_ADDR_SIZE, len - FRAME_DGRAM_ADDR_SIZE, data, data[4] | (data[5] << 8)) != ESPCONN_OK) goto exit_nak;
+    tcpframe_send_result(tcp_n, FRAME_TYPE_ACK, seq);
+    return;
+
+exit_nak:
+    tcpframe_send_result(tcp_n, FRAME_TYPE_NAK, seq);
+}
+
+// Data received from the host in framed mode
+//-------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpframe_uart_rx_cb(uint8 *data, int32 len)
+{
+    frame_rx(data, len);
+}
+
+// Leave the framed mode
+// The data frame not yet acknowledged by the host is delivered again in text mode
+//------------------------------------------
+static void ICACHE_FLASH_ATTR tcpframe_exit(void)
+{
+    if (tcprx_state != TCPRX_IDLE) {
+        os_timer_disarm(&tcprx_timer);
+        tcprx_state = TCPRX_IDLE;
     }
+    tcp_framed = 0;
+    frame_deinit();
+    at_fake_uart_enable(false, NULL);
+    at_register_uart_rx_intr(NULL);
 
-    os_sprintf(info, "STATUS:%d\r\n", status);
-    at_port_print(info);
-    if (status == 3) {
-        for (n=0; n<TCPCONN_MAX_CONN; n++) {
-            if (tcpconns[n] != NULL) {
-                is_server = 0;
-                if ((tcpconns[n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
-                    is_server = ((tcpconns[n]->parrent & 0x07) < TCPCONN_MAX_SERV) ? 1 : 0;
-                }
-                os_sprintf(ip_addr, IPSTR, tcpconns[n]->conn->proto.tcp->remote_ip[0], tcpconns[n]->conn->proto.tcp->remote_ip[1],
-                        tcpconns[n]->conn->proto.tcp->remote_ip[2], tcpconns[n]->conn->proto.tcp->remote_ip[3]);
-                os_sprintf(info, "+TCPSTATUS:%d,\"TCP\",\"%s\",%d,%d,%d\r\n",
-                        n, ip_addr, tcpconns[n]->port, tcpconns[n]->conn->proto.tcp->remote_port, is_server);
-                at_port_print(info);
+    at_response_ok();
+    tcprx_start();
+}
+
+// Data frame received from the host, queue the data to the link
+// Each data frame is the send operation with its own sequence number
+//------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpframe_send_data(uint8_t tcp_n, uint8_t *data, uint16_t len)
+{
+    tcpconn_t *tcpconn;
+    tcp_txop_t *op = NULL;
+    tcp_txseg_t *seg = NULL;
+    uint16_t seq = 0, size;
+
+    if ((tcp_n >= tcpconn_max) || (tcpconns[tcp_n] == NULL)) goto exit_nak;
+    tcpconn = tcpconns[tcp_n];
+    seq = ++tcpconn->tx_seq;
+
+    if (tcpconn->udp) {
+        // the datagram is sent directly from the frame, to the link's remote
+        if ((!tcpconn->connected) || (udpconn_sendto(tcp_n, data, len, NULL, 0) != ESPCONN_OK)) goto exit_nak;
+        tcpframe_send_result(tcp_n, FRAME_TYPE_ACK, seq);
+        return;
+    }
+
+    if ((!tcpconn->connected) || (len == 0) || (tcpconn->tx_ops >= tcpsend_depth)) goto exit_nak;
+    // a small chunk gets room for the following data in Nagle and cork modes
+    size = ((tcpconn->tx_mode != TCPTX_MODE_NODELAY) && (len < TCPSEND_CHUNK_SIZE)) ? TCPSEND_CHUNK_SIZE : len;
+    if ((tcpsend_queued + size) > TCPSEND_QUEUE_MAX) goto exit_nak;
+
+    op = (tcp_txop_t *)os_zalloc(sizeof(tcp_txop_t));
+    seg = (tcp_txseg_t *)os_malloc(sizeof(tcp_txseg_t) + size);
+    if ((!op) || (!seg)) goto exit_nak;
+
+    op->seq = seq;
+    op->input_done = 1;
+    seg->next = NULL;
+    seg->op = op;
+    seg->len = len;
+    seg->size = size;
+    os_memcpy(seg->data, data, len);
+    tcpsend_queued += size;
+
+    if (tcpconn->txop_tail) tcpconn->txop_tail->next = op;
+    else tcpconn->txop_head = op;
+    tcpconn->txop_tail = op;
+    tcpconn->tx_ops++;
+
+    tcpconn_tx_queue(tcp_n, seg);
+    return;
+
+exit_nak:
+    if (op) os_free(op);
+    if (seg) os_free(seg);
+    tcpframe_send_result(tcp_n, FRAME_TYPE_NAK, seq);
+}
+
+// Credit mode acknowledge count from the ACK/NAK frame payload (LE, 2 or 4 bytes)
+//--------------------------------------------------------------------------
+static uint32_t ICACHE_FLASH_ATTR tcpframe_get_count(uint8_t *data, uint16_t len)
+{
+    uint32_t count = 0;
+
+    if (len >= 2) count = data[0] | (data[1] << 8);
+    if (len >= 4) count |= ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    return count;
+}
+
+// Frame received from the host
+//---------------------------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR tcpframe_handler(uint8_t link, uint8_t type, uint8_t *data, uint16_t len)
+{
+    switch (type) {
+        case FRAME_TYPE_AT:
+            if (link == FRAME_LINK_SYSTEM) at_fake_uart_rx(data, len);
+            break;
+        case FRAME_TYPE_DATA:
+            tcpframe_send_data(link, data, len);
+            break;
+        case FRAME_TYPE_DGRAM:
+            tcpframe_send_dgram(link, data, len);
+            break;
+        case FRAME_TYPE_ACK:
+            // the host processed the data
+            if ((link < tcpconn_max) && (tcpconns[link]) && (tcpconns[link]->rx_credit)) {
+                // credit mode, the payload is the acknowledged count (LE)
+                tcpconn_rx_ack(link, tcpframe_get_count(data, len), false);
+                tcprx_start();
             }
-        }
+            else if ((tcprx_state == TCPRX_WAIT_CONFIRM) && (tcprx_link == link)) {
+                tcprx_done();
+                tcprx_start();
+            }
+            break;
+        case FRAME_TYPE_NAK:
+            // send the data again
+            if ((link < tcpconn_max) && (tcpconns[link]) && (tcpconns[link]->rx_credit)) {
+                tcpconn_rx_ack(link, tcpframe_get_count(data, len), true);
+                tcprx_start();
+            }
+            else if ((tcprx_state == TCPRX_WAIT_CONFIRM) && (tcprx_link == link)) {
+                tcpconns[link]->stats.resends++;
+                tcprx_send_alert();
+            }
+            break;
+        case FRAME_TYPE_ABORT:
+            if ((tcprx_state != TCPRX_IDLE) && (tcprx_link == link)) {
+                tcprx_abort();
+                tcprx_start();
+            }
+            else if ((link < tcpconn_max) && (tcpconns[link]) && (tcpconns[link]->connected)) {
+                tcpconns[link]->stats.aborts++;
+                if (tcpconns[link]->rx_credit) tcpconn_rx_flush(link);
+                tcpconn_disconnect(link);
+            }
+            break;
+        case FRAME_TYPE_CTRL:
+            if ((len > 0) && (data[0] == FRAME_CTRL_EXIT)) tcpframe_exit();
+            break;
+        default:
+            break;
+    }
+}
+
+//AT+TCPFRAME=<mode>
+// <mode> = 1 -> enter the binary framed mode
+// <mode> = 0 -> leave the binary framed mode (sent in AT frame)
+//=================================================================
+void ICACHE_FLASH_ATTR at_setupCmdTCPFrame(uint8_t id, char *pPara)
+{
+    int mode = 0, err = 0, flag = 0;
+
+    pPara++; // skip '='
+
+    //get the 1st parameter (mode)
+    flag = at_get_next_int_dec(&pPara, &mode, &err);
+    if (err != 0) goto exit_err;
+    if ((mode < 0) || (mode > 1)) goto exit_err;
+    // check if the last parameter
+    if (*pPara != '\r') goto exit_err;
+
+    if (mode == tcp_framed) {
+        at_response_ok();
+        return;
+    }
+    if (mode == 0) {
+        tcpframe_exit();
+        return;
     }
 
+    if (tcpsend.state != TCPTX_IDLE) goto exit_err;
+    #if AT_SDIO_ENABLE || AT_HSPI_ENABLE
+    // the SDIO and HSPI transports use the fake UART and are already packet based
+    goto exit_err;
+    #endif
+    if (!frame_init(tcpframe_handler)) goto exit_err;
+
+    // OK is the last text response, all following communication is framed
     at_response_ok();
+    // the AT input of this command may have come through the fake UART
+    tcp_uart_fwd_stop();
+    if (!at_fake_uart_enable(true, tcpframe_at_tx)) {
+        frame_deinit();
+        return;
+    }
+    tcp_framed = 1;
+    at_register_uart_rx_intr(tcpframe_uart_rx_cb);
+    tcprx_start();
+    return;
+
+exit_err:
+    at_response_error();
+    return;
 }
 
-//AT+TCPSTATUS=<link_id>
-//==================================================================
-void ICACHE_FLASH_ATTR at_setupCmdTCPStatus(uint8_t id, char *pPara)
+//AT+TCPFRAME?
+//====================================================
+void ICACHE_FLASH_ATTR at_queryCmdTCPFrame(uint8_t id)
 {
-    int tcp_n = 0, err = 0, flag = 0;
-    char info[40] = {'\0'};
-    char ip_addr[16] = {'\0'};
-    uint8_t is_server = 0;
+    char buf[64] = {'\0'};
+
+    os_sprintf(buf, "+TCPFRAME:%d,%d,%d,%d\r\n", tcp_framed, frame_stats.rx_frames, frame_stats.tx_frames, frame_stats.rx_errors);
+    at_port_print(buf);
+
+    at_response_ok();
+    return;
+}
+
+//AT+UARTFLOW=<mode>[,<rx_thresh>]
+// <mode> = 0 -> no flow control, 1 -> RTS, 2 -> CTS, 3 -> RTS and CTS
+// <rx_thresh> -> RX FIFO level at which RTS is deasserted
+//==================================================================
+void ICACHE_FLASH_ATTR at_setupCmdUartFlow(uint8_t id, char *pPara)
+{
+    int mode = 0, thresh = uart_flow_rx_thresh, err = 0, flag = 0;
 
     pPara++; // skip '='
 
-    //get the 1st parameter (conn number)
-    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    //get the 1st parameter (mode)
+    flag = at_get_next_int_dec(&pPara, &mode, &err);
     if (err != 0) goto exit_err;
+    if ((mode < USART_HardwareFlowControl_None) || (mode > USART_HardwareFlowControl_CTS_RTS)) goto exit_err;
 
-    if ((tcp_n < 0) || (tcp_n >= TCPCONN_MAX_CONN)) goto exit_err;
-    if (tcpconns[tcp_n] == NULL) goto exit_err;
-
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 2nd parameter (RTS threshold)
+        flag = at_get_next_int_dec(&pPara, &thresh, &err);
+        if (err != 0) goto exit_err;
+        if ((thresh < 1) || (thresh > 127)) goto exit_err;
+    }
     // check if the last parameter
     if (*pPara != '\r') goto exit_err;
 
-    is_server = 0;
-    if ((tcpconns[tcp_n]->parrent & TCPCONN_PARRENT_MASK) == TCPCONN_PARRENT_MASK) {
-        is_server = ((tcpconns[tcp_n]->parrent & 0x07) < TCPCONN_MAX_SERV) ? 1 : 0;
-    }
-    os_sprintf(ip_addr, IPSTR, tcpconns[tcp_n]->conn->proto.tcp->remote_ip[0], tcpconns[tcp_n]->conn->proto.tcp->remote_ip[1],
-            tcpconns[tcp_n]->conn->proto.tcp->remote_ip[2], tcpconns[tcp_n]->conn->proto.tcp->remote_ip[3]);
-    os_sprintf(info, "+TCPSTATUS:\"%s\",%d,%d", ip_addr, tcpconns[tcp_n]->conn->proto.tcp->remote_port, is_server);
-    at_port_print(info);
-
     at_response_ok();
+    // wait until the response is sent, CTS may stop the output immediately
+    UART_CheckOutputFinished(UART0, 100000);
+    UART_SetFlowCtrl(UART0, mode, thresh);
+    uart_flowctrl = mode;
+    uart_flow_rx_thresh = thresh;
+    if ((uart_tx_held) && ((mode & USART_HardwareFlowControl_CTS) == 0)) uart_flow_timer_cb(NULL);
+    return;
 
 exit_err:
     at_response_error();
     return;
 }
 
-//AT+TCPCLOSE=<link ID>
-//=================================================================
-void ICACHE_FLASH_ATTR at_setupCmdTCPClose(uint8_t id, char *pPara)
+//AT+UARTFLOW?
+//====================================================
+void ICACHE_FLASH_ATTR at_queryCmdUartFlow(uint8_t id)
 {
-    int tcp_n = 0, err = 0, flag = 0;
+    char buf[64] = {'\0'};
+
+    os_sprintf(buf, "+UARTFLOW:%d,%d,%d,%d\r\n", uart_flowctrl, uart_flow_rx_thresh, uart_tx_held, uart_tx_holds);
+    at_port_print(buf);
+
+    at_response_ok();
+    return;
+}
+
+//AT+UARTTXBUF=<size>
+// <size> -> UART TX buffer size in bytes
+//===================================================================
+void ICACHE_FLASH_ATTR at_setupCmdUartTxBuf(uint8_t id, char *pPara)
+{
+    int size = 0, err = 0, flag = 0;
 
     pPara++; // skip '='
 
-    //get the 1st parameter (conn number)
-    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
+    //get the 1st parameter (size)
+    flag = at_get_next_int_dec(&pPara, &size, &err);
     if (err != 0) goto exit_err;
-    if ((tcp_n < 0) || (tcp_n >= TCPCONN_MAX_CONN)) goto exit_err;
-    if (tcpconns[tcp_n] == NULL) goto exit_err;
-
+    if ((size < UART_TXBUF_MIN) || (size > UART_TXBUF_MAX)) goto exit_err;
     // check if the last parameter
     if (*pPara != '\r') goto exit_err;
 
-    if (tcpconns[tcp_n]->connected) {
-        if (tcpconns[tcp_n]->ssl > 0) espconn_secure_disconnect(tcpconns[tcp_n]->conn);
-        else espconn_disconnect(tcpconns[tcp_n]->conn);
-    }
+    uart_tx_set_size(size);
 
     at_response_ok();
     return;
@@ -957,173 +4784,177 @@ exit_err:
     return;
 }
 
-//-----------------------------------------------------------------------------------------
-static uint16_t ICACHE_FLASH_ATTR _request_get_input(uint8_t *buf, uint16_t len, char *msg)
+//AT+UARTTXBUF?
+//=====================================================
+void ICACHE_FLASH_ATTR at_queryCmdUartTxBuf(uint8_t id)
 {
-    uint16_t idx = 0;
-    uint32_t tmo = 500000; // one second timeout
-    uint8_t term = 0, ch;
-    char info[32] = {0};
+    char buf[64] = {'\0'};
 
-    // ==== Send the data request prompt to the client ====
-    at_port_print_irom_str("\r\n>");
+    os_sprintf(buf, "+UARTTXBUF:%d,%d,%d,%d\r\n", uart_tx_get_size(), uart_tx_stats.writes, uart_tx_stats.bytes, uart_tx_stats.done);
+    at_port_print(buf);
 
-    // ==== Accept input data into buffer ====
-    system_soft_wdt_stop();
-    while (tmo) {
-        os_delay_us(2);
-        tmo--;
-        while (uart_rx_one_char(&ch) == 0) {
-            if ((len == 0) && (ch == TCPINPUT_TERMINATE_CHAR)) term = 1;
-            else {
-                // place the received character into the buffer
-                buf[idx++] = ch;
-                if (idx == len) term = 1;
-            }
-            if (term) break;
-        }
-        if (term) break;
-    }
-    system_soft_wdt_restart();
+    at_response_ok();
+    return;
+}
 
-    os_sprintf(info, "\r\n%s:%d\r\n", msg, idx);
-    at_port_print(info);
+// Current UART0 baudrate
+//--------------------------------------------
+static uint32_t ICACHE_FLASH_ATTR uart0_get_baud(void)
+{
+    uint32_t clkdiv = READ_PERI_REG(UART_CLKDIV(UART0)) & UART_CLKDIV_CNT;
 
-    if ((tmo == 0) || (idx == 0) || ((len > 0) && (idx != len))) {
-        os_free(buf);
-        at_port_print_irom_str("\r\nFAIL\r\n");
-        idx = 0;
-    }
-    return idx;
+    if (clkdiv == 0) return 0;
+    return UART_CLK_FREQ / clkdiv;
 }
 
-//AT+TCPSEND=<link ID>[,<length>]
-// <length> > 0       -> load send data of specified length
-// <length> not given -> load send data with terminating character at the end
-//================================================================
-void ICACHE_FLASH_ATTR at_setupCmdTCPSend(uint8_t id, char *pPara)
+// Finish the UART test and return the UART to the AT command processor
+//-----------------------------------------------
+static void ICACHE_FLASH_ATTR uarttest_end(bool ok)
 {
-    int tcp_n = 0, len = -1, err = 0, flag = 0;
-    char buf[16] = {0};
-    uint8_t res;
-    char ch;
-    uint8_t *tcp_input_buf;
-    uint16_t send_len;
+    os_timer_disarm(&uarttest_timer);
+    uarttest.state = UARTTEST_IDLE;
+    tcp_uart_rx_release();
 
-    pPara++; // skip '='
+    if (ok) at_response_ok();
+    else at_response_error();
+    at_leave_special_state();
+    // continue the data delivery
+    tcprx_start();
+}
 
-    //get the 1st parameter (conn number)
-    flag = at_get_next_int_dec(&pPara, &tcp_n, &err);
-    if (err != 0) goto exit_err;
-    if ((tcp_n < 0) || (tcp_n >= TCPCONN_MAX_CONN)) goto exit_err;
-    if (tcpconns[tcp_n] == NULL) goto exit_err;
+// The host did not confirm the new baudrate, restore the previous one
+//---------------------------------------------------------
+static void ICACHE_FLASH_ATTR uartfast_timeout_cb(void *arg)
+{
+    char info[32] = {'\0'};
 
-    if (*pPara == ',') {
-        pPara++; // skip ','
-        //get the 2nd parameter (length)
-        flag = at_get_next_int_dec(&pPara, &len, &err);
-        if (err != 0) goto exit_err;
-        if ((len < 1) || (len > 2048)) goto exit_err;
+    if (uarttest.state != UARTTEST_CONFIRM) return;
+
+    UART_CheckOutputFinished(UART0, 100000);
+    WRITE_PERI_REG(UART_CLKDIV(UART0), uarttest.old_clkdiv);
+    UART_ResetFifo(UART0);
+    os_sprintf(info, "\r\n+UARTFAST:%d\r\n", uart0_get_baud());
+    at_port_print(info);
+    uarttest_end(false);
+}
+
+// Data received from the host at the new baudrate
+// The host confirms the baudrate by sending back the '+UARTFAST:<baud>' line
+//-----------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR uartfast_uart_rx_cb(uint8 *data, int32 len)
+{
+    int32 i;
+
+    for (i=0; i<len; i++) {
+        if (uarttest.state != UARTTEST_CONFIRM) return;
+        if (data[i] != uarttest.confirm[uarttest.match]) uarttest.match = 0;
+        if (data[i] == uarttest.confirm[uarttest.match]) uarttest.match++;
+        if (uarttest.confirm[uarttest.match] == '\0') {
+            uarttest_end(true);
+            return;
+        }
     }
-    // check if the last parameter
-    if (*pPara != '\r') goto exit_err;
+}
 
-    if (len < 0) len = 0; // load up to terminating character
+// Report the benchmark result: '+UARTBENCH:<baud>,<rx_bytes>,<errors>,<rx_Bps>,<tx_Bps>'
+// Called when the echo of the received data is sent or on timeout
+//------------------------------------------------------
+static void ICACHE_FLASH_ATTR uartbench_report(void *arg)
+{
+    char info[80] = {'\0'};
+    uint32_t t_end = system_get_time();
+    uint32_t rx_bps = 0, tx_bps = 0;
 
-    // Create input buffer
-    tcp_input_buf = (uint8_t *)os_zalloc(len+16);
-    if (!tcp_input_buf) goto exit_err;
+    if ((uarttest.state != UARTTEST_BENCH) && (uarttest.state != UARTTEST_DRAIN)) return;
 
-    at_enter_special_state();
-    // Send the ready prompt to the client
-    // and accept input data into buffer
-    send_len = _request_get_input(tcp_input_buf, len, "+TCPSEND");
-    if (send_len == 0) {
-        at_leave_special_state();
-        return;
+    if (uarttest.rx_bytes) {
+        rx_bps = (uint32_t)(((uint64_t)uarttest.rx_bytes * 1000000) / (uarttest.t_last - uarttest.t_first + 1));
+        tx_bps = (uint32_t)(((uint64_t)uarttest.rx_bytes * 1000000) / (t_end - uarttest.t_first + 1));
     }
+    os_sprintf(info, "\r\n+UARTBENCH:%d,%d,%d,%d,%d\r\n", uart0_get_baud(), uarttest.rx_bytes, uarttest.errors, rx_bps, tx_bps);
+    at_port_print(info);
+    uarttest_end(uarttest.rx_bytes == uarttest.length);
+}
 
-    // All expected characters are received, send the buffer
-    if (tcpconns[tcp_n]->ssl > 0) res = espconn_secure_send(tcpconns[tcp_n]->conn, tcp_input_buf, send_len);
-    else res = espconn_send(tcpconns[tcp_n]->conn, tcp_input_buf, send_len);
+// Benchmark data received from the host
+// Called from the AT UART receive task (UART RX interrupt -> AT library RX buffer),
+// the data are checked and echoed back through the UART TX buffer
+//------------------------------------------------------------------------
+static void ICACHE_FLASH_ATTR uartbench_uart_rx_cb(uint8 *data, int32 len)
+{
+    int32 i;
+    uint32_t now = system_get_time();
 
-    os_free(tcp_input_buf);
-    if (res != 0) {
-        at_port_print_irom_str("\r\nFAIL\r\n");
-        if (tcpconns[tcp_n]->ssl > 0) espconn_secure_disconnect(tcpconns[tcp_n]->conn);
-        else espconn_disconnect(tcpconns[tcp_n]->conn);
-        at_leave_special_state();
-    }
+    if (uarttest.state != UARTTEST_BENCH) return;
 
-    return;
+    if (uarttest.rx_bytes == 0) uarttest.t_first = now;
+    uarttest.t_last = now;
+    if (len > (uarttest.length - uarttest.rx_bytes)) len = uarttest.length - uarttest.rx_bytes;
+    for (i=0; i<len; i++) {
+        if (data[i] != UART_BENCH_PATTERN(uarttest.rx_bytes + i)) uarttest.errors++;
+    }
+    uarttest.rx_bytes += len;
 
-exit_err:
-    at_response_error();
+    os_timer_disarm(&uarttest_timer);
+    if (uarttest.rx_bytes < uarttest.length) {
+        uart_tx_write(data, len);
+        os_timer_arm(&uarttest_timer, uarttest.timeout, 0);
+        return;
+    }
+    // all data received, report when the echo is sent
+    uarttest.state = UARTTEST_DRAIN;
+    if (!uart_tx_write_cb(data, len, uartbench_report, NULL)) uartbench_report(NULL);
 }
 
-//AT+SSLLOADCERT=<cert_no>[,<length>]
-// <length> = 0       -> delete the certificate
-// <length> > 100     -> load certificate of specified length
-// <length> not given -> load certificate with terminating character at the end
-//====================================================================
-void ICACHE_FLASH_ATTR at_setupCmdTCPLoadCert(uint8_t id, char *pPara)
+//AT+UARTFAST=<baud>,<timeout>
+// <baud> -> new UART0 baudrate
+// <timeout> -> ms, time in which the host must confirm the new baudrate
+// '+UARTFAST:<baud>' is sent at the new baudrate, the host confirms it by sending the same line back.
+// OK is sent at the new baudrate after the confirmation,
+// otherwise the previous baudrate is restored, '+UARTFAST:<old_baud>' and ERROR are sent.
+//==================================================================
+void ICACHE_FLASH_ATTR at_setupCmdUartFast(uint8_t id, char *pPara)
 {
-    int cert_n = 0, len = -1, err = 0, flag = 0;
-    char buf[24] = {0};
-    uint8_t res, term;
-    char ch;
-    uint8_t *end_ptr;
-    uint8_t *tcp_input_buf = NULL;
-    uint16_t send_len;
+    int baud = 0, timeout = 0, err = 0, flag = 0;
+    char info[32] = {'\0'};
 
     pPara++; // skip '='
 
-    //get the 1st parameter (certificate number, nut used at the moment)
-    flag = at_get_next_int_dec(&pPara, &cert_n, &err);
+    //get the 1st parameter (baudrate)
+    flag = at_get_next_int_dec(&pPara, &baud, &err);
     if (err != 0) goto exit_err;
-    if ((cert_n < 0) || (cert_n >= TCP_MAX_CERTS)) goto exit_err;
+    if ((baud < UART_FAST_BAUD_MIN) || (baud > UART_FAST_BAUD_MAX)) goto exit_err;
 
-    if (*pPara == ',') {
-        pPara++; // skip ','
-        //get the 2nd parameter (length)
-        flag = at_get_next_int_dec(&pPara, &len, &err);
-        if (err != 0) goto exit_err;
-        if ((len < 0) || (len > (SECTOR_SIZE-TCP_CERT_HEAD_SIZE-TCP_CERT_LEN_SIZE))) goto exit_err;
-    }
+    if (*pPara != ',') goto exit_err;
+    pPara++; // skip ','
+    //get the 2nd parameter (timeout)
+    flag = at_get_next_int_dec(&pPara, &timeout, &err);
+    if (err != 0) goto exit_err;
+    if ((timeout < UART_FAST_TIMEOUT_MIN) || (timeout > UART_FAST_TIMEOUT_MAX)) goto exit_err;
     // check if the last parameter
     if (*pPara != '\r') goto exit_err;
+    // the UART input must not be used by the data delivery
+    if ((tcp_framed) || (tcprx_state != TCPRX_IDLE) || (uarttest.state != UARTTEST_IDLE)) goto exit_err;
 
-    // Delete current certificate buffer if exists
-    if (espconn_in_ram_sector.buffer) os_free(espconn_in_ram_sector.buffer);
-    espconn_in_ram_sector.sector = 0;
-    espconn_in_ram_sector.size = 0;
-    espconn_in_ram_sector.buffer = NULL;
-    if (len == 0) {
-        at_response_ok();
-        return;
-    }
-    if (len < 0) len = 0; // load up to terminating character
-
-    // Create the certificate buffer
-    tcp_input_buf = (uint8_t *)os_zalloc(SECTOR_SIZE);
-    if (!tcp_input_buf) goto exit_err;
-
-    // Send the ready prompt to the client
-    // and accept input data into buffer at position after the certificate header (34 bytes)
-    send_len = _request_get_input(tcp_input_buf+TCP_CERT_HEAD_SIZE+TCP_CERT_LEN_SIZE, len, "+SSLLOADCERT");
-    if (send_len == 0) return;
-
-    // Create header and length in RAM sector
-    os_sprintf(tcp_input_buf, "TLS.ca_x509.cer");
-    uint16_t *clen = (uint16_t *)(tcp_input_buf + TCP_CERT_HEAD_SIZE);
-    *clen = send_len;
-
-    espconn_in_ram_sector.buffer = tcp_input_buf;
-    espconn_in_ram_sector.sector = SYSTEM_PARTITION_SSL_CLIENT_CA_ADDR / SECTOR_SIZE;
-    espconn_in_ram_sector.size = send_len+TCP_CERT_HEAD_SIZE+TCP_CERT_LEN_SIZE+1;
+    os_memset(&uarttest, 0, sizeof(uarttest_t));
+    uarttest.baud = baud;
+    uarttest.timeout = timeout;
+    uarttest.old_clkdiv = READ_PERI_REG(UART_CLKDIV(UART0)) & UART_CLKDIV_CNT;
+    os_sprintf(uarttest.confirm, "+UARTFAST:%d", baud);
+    uarttest.state = UARTTEST_CONFIRM;
 
-    at_response_ok();
+    at_enter_special_state();
+    at_register_uart_rx_intr(uartfast_uart_rx_cb);
+    // the command echo is sent at the current baudrate
+    UART_CheckOutputFinished(UART0, 100000);
+    UART_SetBaudrate(UART0, baud);
+    UART_ResetFifo(UART0);
 
+    os_sprintf(info, "\r\n%s\r\n", uarttest.confirm);
+    at_port_print(info);
+    os_timer_disarm(&uarttest_timer);
+    os_timer_setfn(&uarttest_timer, (os_timer_func_t *)uartfast_timeout_cb, NULL);
+    os_timer_arm(&uarttest_timer, uarttest.timeout, 0);
     return;
 
 exit_err:
@@ -1131,48 +4962,59 @@ exit_err:
     return;
 }
 
-//AT+TCPLOADCERT?
-//=======================================================
-void ICACHE_FLASH_ATTR at_queryCmdTCPLoadCert(uint8_t id)
+//AT+UARTFAST?
+//===================================================
+void ICACHE_FLASH_ATTR at_queryCmdUartFast(uint8_t id)
 {
-    if ((espconn_in_ram_sector.sector > 0) && (espconn_in_ram_sector.buffer)) {
-        char buf[32] = {'\0'};
-        uint16_t *clen = (uint16_t *)(espconn_in_ram_sector.buffer + TCP_CERT_HEAD_SIZE);
+    char buf[32] = {'\0'};
+
+    os_sprintf(buf, "+UARTFAST:%d\r\n", uart0_get_baud());
+    at_port_print(buf);
 
-        os_sprintf(buf, "+SSLLOADCERT:0,%04X,%d\r\n", espconn_in_ram_sector.sector, *clen);
-        at_port_print(buf);
-        at_port_print(espconn_in_ram_sector.buffer+TCP_CERT_HEAD_SIZE+TCP_CERT_LEN_SIZE);
-    }
-    else {
-        at_port_print_irom_str("+SSLLOADCERT:0\r\n");
-    }
     at_response_ok();
+    return;
 }
 
-/*
-  bit0: if set to 1, certificate and private key will be enabled,
-        so SSL server can verify ESP8266; if 0, then will not.
-  bit1: if set to 1, CA will be enabled, so ESP8266 can verify SSL server,
-        if 0, then will not.
-*/
-//AT+TCPSSLCONFIG=<cfg>
-//=====================================================================
-void ICACHE_FLASH_ATTR at_setupCmdTCPSSLconfig(uint8_t id, char *pPara)
+//AT+UARTBENCH=<length>[,<timeout>]
+// <length> -> number of bytes the host sends, byte n of the data is (n + (n >> 8)) & 0xFF
+// <timeout> -> ms, maximal pause in the host's data; default 1000
+// After the '>' prompt the host sends the data, all received data are echoed back.
+// '+UARTBENCH:<baud>,<rx_bytes>,<errors>,<rx_Bps>,<tx_Bps>' is reported when all data are echoed
+//==================================================================
+void ICACHE_FLASH_ATTR at_setupCmdUartBench(uint8_t id, char *pPara)
 {
-    int cfg = 0, err = 0, flag = 0;
+    int length = 0, timeout = UART_BENCH_TIMEOUT_MS, err = 0, flag = 0;
 
     pPara++; // skip '='
 
-    //get the 1st parameter (config)
-    flag = at_get_next_int_dec(&pPara, &cfg, &err);
+    //get the 1st parameter (length)
+    flag = at_get_next_int_dec(&pPara, &length, &err);
     if (err != 0) goto exit_err;
+    if ((length < 1) || (length > UART_BENCH_MAX_LEN)) goto exit_err;
+
+    if (*pPara == ',') {
+        pPara++; // skip ','
+        //get the optional 2nd parameter (timeout)
+        flag = at_get_next_int_dec(&pPara, &timeout, &err);
+        if (err != 0) goto exit_err;
+        if ((timeout < UART_FAST_TIMEOUT_MIN) || (timeout > UART_FAST_TIMEOUT_MAX)) goto exit_err;
+    }
     // check if the last parameter
     if (*pPara != '\r') goto exit_err;
-    if ((cfg < 0) || (cfg > 3)) goto exit_err;
+    // the UART input must not be used by the data delivery
+    if ((tcp_framed) || (tcprx_state != TCPRX_IDLE) || (uarttest.state != UARTTEST_IDLE)) goto exit_err;
 
-    tcp_sslconfig = cfg;
+    os_memset(&uarttest, 0, sizeof(uarttest_t));
+    uarttest.length = length;
+    uarttest.timeout = timeout;
+    uarttest.state = UARTTEST_BENCH;
 
-    at_response_ok();
+    at_enter_special_state();
+    at_register_uart_rx_intr(uartbench_uart_rx_cb);
+    os_timer_disarm(&uarttest_timer);
+    os_timer_setfn(&uarttest_timer, (os_timer_func_t *)uartbench_report, NULL);
+    os_timer_arm(&uarttest_timer, uarttest.timeout, 0);
+    at_port_print_irom_str("\r\n>");
     return;
 
 exit_err:
@@ -1180,18 +5022,56 @@ exit_err:
     return;
 }
 
-//AT+SSLCCONF?
-//========================================================
-void ICACHE_FLASH_ATTR at_queryCmdTCPSSLconfig(uint8_t id)
+#if AT_SDIO_ENABLE
+//AT+SDIOSTAT?
+//===================================================
+void ICACHE_FLASH_ATTR at_queryCmdSdioStat(uint8_t id)
 {
-    char buf[32] = {'\0'};
+    char buf[96] = {'\0'};
 
-    os_sprintf(buf, "+SSLCCONF:%d\r\n", tcp_sslconfig);
+    os_sprintf(buf, "+SDIOSTAT:%d,%d,%d,%d,%d,%d,%d\r\n", sdio_stats.to_host_bytes, sdio_stats.to_host_reads, sdio_stats.to_host_dropped,
+            sdio_stats.from_host_bytes, sdio_stats.from_host_writes, sdio_stats.from_host_full, sdio_stats.errors);
+    at_port_print(buf);
+
+    at_response_ok();
+    return;
+}
+#endif
+
+#if AT_HSPI_ENABLE
+// Per-link status reported in the HSPI status word
+// RX bits 0~7: received data waiting for the host, TX bits 8~15: the link can accept AT+TCPSEND
+//------------------------------------------
+uint16 ICACHE_FLASH_ATTR at_hspi_link_status(void)
+{
+    tcpconn_t *tcpconn;
+    uint16 status = 0;
+    uint8_t tcp_n;
+
+    // the status word has room for links 0~7
+    for (tcp_n=0; (tcp_n<tcpconn_max) && (tcp_n<8); tcp_n++) {
+        tcpconn = tcpconns[tcp_n];
+        if (tcpconn == NULL) continue;
+        if (tcpconn->rx_queued > tcpconn->rx_delivered) status |= 1 << tcp_n;
+        if ((tcpconn->connected) && (!tcpconn->closing) && (tcpconn->tx_ops < tcpsend_depth)) status |= 0x100 << tcp_n;
+    }
+    return status;
+}
+
+//AT+HSPISTAT?
+//===================================================
+void ICACHE_FLASH_ATTR at_queryCmdHspiStat(uint8_t id)
+{
+    char buf[128] = {'\0'};
+
+    os_sprintf(buf, "+HSPISTAT:%d,%d,%d,%d,%d,%d,%d,%d\r\n", hspi_stats.to_host_bytes, hspi_stats.to_host_reads, hspi_stats.to_host_dropped,
+            hspi_stats.from_host_bytes, hspi_stats.from_host_writes, hspi_stats.from_host_full, hspi_stats.from_host_lost, hspi_stats.status_reads);
     at_port_print(buf);
 
     at_response_ok();
     return;
 }
+#endif
 
 // AT+TCPSTART? or AT+TCPSEND? or AT+TCPCLOSE?
 // Used to confirm the TCP commands are implemented
@@ -0,0 +1,176 @@
+/*
+ * Binary framing of the host communication for ESP8266 AT firmware
+ * Copyright LoBo 2019
+*/
+
+#include "c_types.h"
+#include "osapi.h"
+#include "mem.h"
+#include "at_frame.h"
+#include "at_extra_cmd.h"
+
+#define FRAME_BUF_SIZE          (FRAME_HEAD_SIZE + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE)
+#define FRAME_OUT_SIZE          64
+
+frame_stats_t frame_stats = { 0 };
+
+static frame_handler_t frame_handler = NULL;
+static uint8_t *frame_buf = NULL;
+static uint16_t frame_len = 0;
+static uint8_t frame_esc = 0;
+static uint8_t frame_overrun = 0;
+
+static uint8_t frame_out[FRAME_OUT_SIZE];
+static uint8_t frame_out_len = 0;
+
+
+// CRC-16/CCITT-FALSE, use 0xFFFF as initial crc value
+//----------------------------------------------------------------------------------
+uint16_t ICACHE_FLASH_ATTR frame_crc16(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+    uint8_t i;
+
+    while (len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (i=0; i<8; i++) {
+            if (crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+            else crc <<= 1;
+        }
+    }
+    return crc;
+}
+
+//-------------------------------------------------------------
+bool ICACHE_FLASH_ATTR frame_init(frame_handler_t handler)
+{
+    if (frame_buf == NULL) {
+        frame_buf = (uint8_t *)os_malloc(FRAME_BUF_SIZE);
+        if (frame_buf == NULL) return false;
+    }
+    frame_handler = handler;
+    frame_len = 0;
+    frame_esc = 0;
+    frame_overrun = 0;
+    os_memset(&frame_stats, 0, sizeof(frame_stats_t));
+    return true;
+}
+
+// Can be called from the frame handler, the rest of the received data is discarded
+//------------------------------------
+void ICACHE_FLASH_ATTR frame_deinit(void)
+{
+    if (frame_buf) os_free(frame_buf);
+    frame_buf = NULL;
+    frame_handler = NULL;
+}
+
+//--------------------------------------------
+static void ICACHE_FLASH_ATTR frame_out_flush(void)
+{
+    if (frame_out_len) uart0_tx_buffer(frame_out, frame_out_len);
+    frame_out_len = 0;
+}
+
+//----------------------------------------------------
+static void ICACHE_FLASH_ATTR frame_out_byte(uint8_t ch)
+{
+    if (frame_out_len > (FRAME_OUT_SIZE-2)) frame_out_flush();
+    if (ch == FRAME_END) {
+        frame_out[frame_out_len++] = FRAME_ESC;
+        frame_out[frame_out_len++] = FRAME_ESC_END;
+    }
+    else if (ch == FRAME_ESC) {
+        frame_out[frame_out_len++] = FRAME_ESC;
+        frame_out[frame_out_len++] = FRAME_ESC_ESC;
+    }
+    else frame_out[frame_out_len++] = ch;
+}
+
+// Encode and send the frame to the host, the payload is 'hdr' followed by 'data'
+// The payload parts are encoded directly from the caller's buffers
+//--------------------------------------------------------------------------------------------------------------------------
+void ICACHE_FLASH_ATTR frame_send_hdr(uint8_t link, uint8_t type, const uint8_t *hdr, uint16_t hlen, const uint8_t *data, uint16_t len)
+{
+    uint8_t head[FRAME_HEAD_SIZE];
+    uint16_t i, crc;
+
+    head[0] = link;
+    head[1] = type;
+    head[2] = (hlen + len) & 0xFF;
+    head[3] = (hlen + len) >> 8;
+    crc = frame_crc16(0xFFFF, head, FRAME_HEAD_SIZE);
+    crc = frame_crc16(crc, hdr, hlen);
+    crc = frame_crc16(crc, data, len);
+
+    frame_out[frame_out_len++] = FRAME_END;
+    for (i=0; i<FRAME_HEAD_SIZE; i++) frame_out_byte(head[i]);
+    for (i=0; i<hlen; i++) frame_out_byte(hdr[i]);
+    for (i=0; i<len; i++) frame_out_byte(data[i]);
+    frame_out_byte(crc & 0xFF);
+    frame_out_byte(crc >> 8);
+    if (frame_out_len > (FRAME_OUT_SIZE-1)) frame_out_flush();
+    frame_out[frame_out_len++] = FRAME_END;
+    frame_out_flush();
+
+    frame_stats.tx_frames++;
+}
+
+// Encode and send the frame to the host
+//-------------------------------------------------------------------------------------------
+void ICACHE_FLASH_ATTR frame_send(uint8_t link, uint8_t type, const uint8_t *data, uint16_t len)
+{
+    frame_send_hdr(link, type, NULL, 0, data, len);
+}
+
+// Check the received frame and pass it to the handler
+//------------------------------------------------
+static void ICACHE_FLASH_ATTR frame_process(void)
+{
+    uint16_t len, crc;
+
+    if (frame_len < (FRAME_HEAD_SIZE + FRAME_CRC_SIZE)) goto exit_err;
+    len = frame_buf[2] | (frame_buf[3] << 8);
+    if ((len + FRAME_HEAD_SIZE + FRAME_CRC_SIZE) != frame_len) goto exit_err;
+    crc = frame_crc16(0xFFFF, frame_buf, frame_len - FRAME_CRC_SIZE);
+    if ((frame_buf[frame_len-2] != (crc & 0xFF)) || (frame_buf[frame_len-1] != (crc >> 8))) goto exit_err;
+
+    frame_stats.rx_frames++;
+    if (frame_handler) frame_handler(frame_buf[0], frame_buf[1], frame_buf + FRAME_HEAD_SIZE, len);
+    return;
+
+exit_err:
+    frame_stats.rx_errors++;
+}
+
+// Decode the data received from the host
+//--------------------------------------------------------------
+void ICACHE_FLASH_ATTR frame_rx(const uint8_t *data, int32 len)
+{
+    int32 i;
+    uint8_t ch;
+
+    for (i=0; i<len; i++) {
+        if (frame_buf == NULL) return;
+        ch = data[i];
+        if (ch == FRAME_END) {
+            if ((frame_len > 0) && (!frame_overrun)) frame_process();
+            else if (frame_overrun) frame_stats.rx_errors++;
+            frame_len = 0;
+            frame_esc = 0;
+            frame_overrun = 0;
+            continue;
+        }
+        if (frame_esc) {
+            frame_esc = 0;
+            if (ch == FRAME_ESC_END) ch = FRAME_END;
+            else if (ch == FRAME_ESC_ESC) ch = FRAME_ESC;
+            else frame_overrun = 1;
+        }
+        else if (ch == FRAME_ESC) {
+            frame_esc = 1;
+            continue;
+        }
+        if (frame_len < FRAME_BUF_SIZE) frame_buf[frame_len++] = ch;
+        else frame_overrun = 1;
+    }
+}
@@ -0,0 +1,416 @@
+/*
+ * Flash spool of the link data for ESP8266 AT firmware
+ * Copyright LoBo 2019
+*/
+
+#include "c_types.h"
+#include "osapi.h"
+#include "os_type.h"
+#include "spi_flash.h"
+#include "user_config.h"
+#include "at_spool.h"
+
+#define SPOOL_NONE              0xFFFFFFFF
+#define SPOOL_SECTORS           (SPOOL_FLASH_SIZE / SECTOR_SIZE)
+#define SPOOL_COPY_SIZE         64      // the flash is read and written through an aligned buffer
+#define SPOOL_ERASE_DELAY_MS    10      // the next sector is erased in advance, outside of the data input
+#define SPOOL_ALIGN(len)        (((len) + 3) & ~3)
+
+typedef struct {
+    uint8_t     magic;
+    uint8_t     link;
+    uint16_t    len;
+    uint32_t    state;          // 0xFFFFFFFF: not delivered, 0: delivered or discarded
+} spool_hdr_t;
+
+typedef struct {
+    uint32_t    first;          // scan start for the oldest record not delivered
+    uint32_t    cursor;         // scan start for the next record to read
+    uint16_t    records;        // records not delivered
+    uint16_t    unread;         // records not yet read
+    uint32_t    bytes;          // data bytes not delivered
+} spool_link_t;
+
+spool_stats_t spool_stats = { 0 };
+
+static spool_link_t spool_links[SPOOL_LINKS];
+static uint32_t spool_head = 0;         // write position
+static uint32_t spool_tail = 0;         // oldest record not delivered
+static uint32_t spool_count = 0;        // records not delivered, all links
+static uint8_t spool_head_open = 0;     // the head's sector is erased, the records are appended to it
+static int16_t spool_erased = -1;       // sector erased in advance, -1: none
+static os_timer_t spool_erase_timer;
+
+
+//----------------------------------------------------------
+static uint16_t ICACHE_FLASH_ATTR spool_sector(uint32_t pos)
+{
+    return pos / SECTOR_SIZE;
+}
+
+// Start of the next sector, the ring wraps at the end of the spool
+//---------------------------------------------------------------
+static uint32_t ICACHE_FLASH_ATTR spool_next_sector(uint32_t pos)
+{
+    pos = (pos / SECTOR_SIZE + 1) * SECTOR_SIZE;
+    return (pos >= SPOOL_FLASH_SIZE) ? 0 : pos;
+}
+
+// Position following the record
+//-------------------------------------------------------------------
+static uint32_t ICACHE_FLASH_ATTR spool_after(uint32_t pos, uint16_t len)
+{
+    pos += SPOOL_HDR_SIZE + SPOOL_ALIGN(len);
+    return (pos >= SPOOL_FLASH_SIZE) ? 0 : pos;
+}
+
+// Read the record header
+// Returns false if there is no record at the position, the rest of the sector is not used
+//------------------------------------------------------------------------
+static bool ICACHE_FLASH_ATTR spool_read_hdr(uint32_t pos, spool_hdr_t *hdr)
+{
+    if ((pos % SECTOR_SIZE) > (SECTOR_SIZE - SPOOL_HDR_SIZE)) return false;
+    if (spi_flash_read(SPOOL_FLASH_ADDR + pos, (uint32_t *)hdr, SPOOL_HDR_SIZE) != SPI_FLASH_RESULT_OK) return false;
+    return (hdr->magic == SPOOL_MAGIC);
+}
+
+// Clear the record's state, the flash bits can be cleared without erasing
+//---------------------------------------------------
+static void ICACHE_FLASH_ATTR spool_mark(uint32_t pos)
+{
+    uint32_t state = 0;
+
+    spi_flash_write(SPOOL_FLASH_ADDR + pos + 4, &state, 4);
+}
+
+//-------------------------------------------------------
+static bool ICACHE_FLASH_ATTR spool_erase(uint16_t sector)
+{
+    if (spi_flash_erase_sector((SPOOL_FLASH_ADDR / SECTOR_SIZE) + sector) != SPI_FLASH_RESULT_OK) return false;
+    spool_stats.erases++;
+    return true;
+}
+
+// Sector the head will write to next
+//-------------------------------------------------
+static uint16_t ICACHE_FLASH_ATTR spool_next_head_sector(void)
+{
+    if (spool_head_open) return spool_sector(spool_next_sector(spool_head));
+    return spool_sector(spool_head);
+}
+
+// Erase the next sector in advance, the erase blocks for tens of ms
+//----------------------------------------------------------
+static void ICACHE_FLASH_ATTR spool_erase_timer_cb(void *arg)
+{
+    uint16_t sector = spool_next_head_sector();
+
+    if (sector == spool_erased) return;
+    // the sector still holds records not delivered
+    if ((spool_count > 0) && (spool_sector(spool_tail) == sector)) return;
+    if (spool_erase(sector)) spool_erased = sector;
+}
+
+// Find the link's next record which is not delivered, starting at 'pos'
+//-----------------------------------------------------------------------
+static uint32_t ICACHE_FLASH_ATTR spool_find(uint8_t link, uint32_t pos)
+{
+    spool_hdr_t hdr;
+
+    while ((pos != SPOOL_NONE) && (pos != spool_head)) {
+        if (!spool_read_hdr(pos, &hdr)) {
+            pos = spool_next_sector(pos);
+            continue;
+        }
+        if ((hdr.link == link) && (hdr.state != 0)) return pos;
+        pos = spool_after(pos, hdr.len);
+    }
+    return SPOOL_NONE;
+}
+
+// Move the tail over the delivered records, the sectors behind it can be erased
+//----------------------------------------------------
+static void ICACHE_FLASH_ATTR spool_advance_tail(void)
+{
+    spool_hdr_t hdr;
+
+    if (spool_count == 0) {
+        spool_tail = spool_head;
+        return;
+    }
+    while (spool_tail != spool_head) {
+        if (!spool_read_hdr(spool_tail, &hdr)) spool_tail = spool_next_sector(spool_tail);
+        else if (hdr.state == 0) spool_tail = spool_after(spool_tail, hdr.len);
+        else break;
+    }
+}
+
+// Initialize the empty spool
+// Returns false if there is no spare flash for the spool
+//------------------------------
+bool ICACHE_FLASH_ATTR spool_init(void)
+{
+    uint8_t i;
+
+    if (SPOOL_SECTORS == 0) return false;
+
+    os_memset(&spool_stats, 0, sizeof(spool_stats_t));
+    for (i=0; i<SPOOL_LINKS; i++) {
+        os_memset(&spool_links[i], 0, sizeof(spool_link_t));
+        spool_links[i].first = SPOOL_NONE;
+        spool_links[i].cursor = SPOOL_NONE;
+    }
+    spool_head = 0;
+    spool_tail = 0;
+    spool_count = 0;
+    spool_head_open = 0;
+    spool_erased = -1;
+    os_timer_disarm(&spool_erase_timer);
+    os_timer_setfn(&spool_erase_timer, (os_timer_func_t *)spool_erase_timer_cb, NULL);
+    return true;
+}
+
+//------------------------------
+uint32_t ICACHE_FLASH_ATTR spool_size(void)
+{
+    return SPOOL_FLASH_SIZE;
+}
+
+// Bytes used by the records not delivered, including the delivered records between them
+//------------------------------
+uint32_t ICACHE_FLASH_ATTR spool_used(void)
+{
+    if (spool_count == 0) return 0;
+    if (spool_head >= spool_tail) return spool_head - spool_tail;
+    return SPOOL_FLASH_SIZE - spool_tail + spool_head;
+}
+
+// Bytes which can still be written, the tail's sector is never shared with the head
+//------------------------------
+uint32_t ICACHE_FLASH_ATTR spool_free(void)
+{
+    uint32_t used = spool_used() + SECTOR_SIZE;
+
+    return (used < SPOOL_FLASH_SIZE) ? (SPOOL_FLASH_SIZE - used) : 0;
+}
+
+// Append the link's data as a new record
+// Returns false if the spool is full
+//-------------------------------------------------------------------------------
+bool ICACHE_FLASH_ATTR spool_write(uint8_t link, const uint8_t *data, uint16_t len)
+{
+    uint32_t buf[SPOOL_COPY_SIZE / 4];
+    spool_hdr_t hdr;
+    spool_link_t *lk;
+    uint32_t pos, need = SPOOL_HDR_SIZE + SPOOL_ALIGN(len);
+    uint16_t sector, n, done;
+    bool ok;
+
+    if ((SPOOL_SECTORS == 0) || (link >= SPOOL_LINKS) || (len == 0) || (len > SPOOL_RECORD_MAX)) return false;
+
+    if ((spool_head_open) && (((spool_head % SECTOR_SIZE) + need) > SECTOR_SIZE)) {
+        // no room left in the sector
+        spool_head = spool_next_sector(spool_head);
+        spool_head_open = 0;
+    }
+    if (!spool_head_open) {
+        sector = spool_sector(spool_head);
+        // the ring is full when the next sector holds records not delivered
+        if ((spool_count > 0) && (spool_sector(spool_tail) == sector)) goto full;
+        if ((sector != spool_erased) && (!spool_erase(sector))) goto full;
+        spool_erased = -1;
+        spool_head_open = 1;
+        if (spool_count == 0) spool_tail = spool_head;
+    }
+
+    pos = spool_head;
+    hdr.magic = SPOOL_MAGIC;
+    hdr.link = link;
+    hdr.len = len;
+    hdr.state = 0xFFFFFFFF;
+    ok = (spi_flash_write(SPOOL_FLASH_ADDR + pos, (uint32_t *)&hdr, SPOOL_HDR_SIZE) == SPI_FLASH_RESULT_OK);
+    for (done=0; (ok) && (done<len); done+=n) {
+        n = len - done;
+        if (n > SPOOL_COPY_SIZE) n = SPOOL_COPY_SIZE;
+        os_memcpy(buf, data + done, n);
+        ok = (spi_flash_write(SPOOL_FLASH_ADDR + pos + SPOOL_HDR_SIZE + done, buf, SPOOL_ALIGN(n)) == SPI_FLASH_RESULT_OK);
+    }
+
+    spool_head = spool_after(pos, len);
+    if ((spool_head % SECTOR_SIZE) == 0) spool_head_open = 0;
+    if (!ok) {
+        // the incomplete record is skipped
+        spool_mark(pos);
+        spool_advance_tail();
+        goto full;
+    }
+
+    lk = &spool_links[link];
+    if (lk->records == 0) lk->first = pos;
+    if (lk->unread == 0) lk->cursor = pos;
+    lk->records++;
+    lk->unread++;
+    lk->bytes += len;
+    spool_count++;
+    spool_stats.records++;
+    spool_stats.bytes += len;
+
+    if (spool_next_head_sector() != spool_erased) {
+        os_timer_disarm(&spool_erase_timer);
+        os_timer_arm(&spool_erase_timer, SPOOL_ERASE_DELAY_MS, 0);
+    }
+    return true;
+
+full:
+    spool_stats.full++;
+    return false;
+}
+
+// Length of the link's next record to read, 0: no record
+//------------------------------------------
+uint16_t ICACHE_FLASH_ATTR spool_next(uint8_t link)
+{
+    spool_hdr_t hdr;
+    uint32_t pos;
+
+    if ((link >= SPOOL_LINKS) || (spool_links[link].unread == 0)) return 0;
+    pos = spool_find(link, spool_links[link].cursor);
+    spool_links[link].cursor = pos;
+    if ((pos == SPOOL_NONE) || (!spool_read_hdr(pos, &hdr))) return 0;
+    return hdr.len;
+}
+
+// Read the link's next record into 'buf'
+// The record stays in the spool until it is committed, it is read again after rewind
+// Returns the data length, 0 if there is no record or it does not fit into the buffer
+//-----------------------------------------------------------------------------
+uint16_t ICACHE_FLASH_ATTR spool_read(uint8_t link, uint8_t *buf, uint16_t size)
+{
+    uint32_t tmp[SPOOL_COPY_SIZE / 4];
+    spool_link_t *lk;
+    uint32_t pos;
+    uint16_t len, n, done;
+
+    len = spool_next(link);
+    if ((len == 0) || (len > size)) return 0;
+    lk = &spool_links[link];
+    pos = lk->cursor;
+
+    for (done=0; done<len; done+=n) {
+        n = len - done;
+        if (n > SPOOL_COPY_SIZE) n = SPOOL_COPY_SIZE;
+        if (spi_flash_read(SPOOL_FLASH_ADDR + pos + SPOOL_HDR_SIZE + done, tmp, SPOOL_ALIGN(n)) != SPI_FLASH_RESULT_OK) return 0;
+        os_memcpy(buf + done, tmp, n);
+    }
+    lk->unread--;
+    lk->cursor = (lk->unread) ? spool_after(pos, len) : SPOOL_NONE;
+    return len;
+}
+
+// The link's oldest record is delivered, remove it from the spool
+// The records are delivered in the order they were read
+// Returns the data length of the record
+//------------------------------------------
+uint16_t ICACHE_FLASH_ATTR spool_commit(uint8_t link)
+{
+    spool_hdr_t hdr;
+    spool_link_t *lk;
+    uint32_t pos;
+
+    if ((link >= SPOOL_LINKS) || (spool_links[link].records == 0)) return 0;
+    lk = &spool_links[link];
+    pos = spool_find(link, lk->first);
+    if ((pos == SPOOL_NONE) || (!spool_read_hdr(pos, &hdr))) return 0;
+
+    spool_mark(pos);
+    lk->records--;
+    lk->bytes -= hdr.len;
+    if (lk->unread > lk->records) lk->unread = lk->records;
+    lk->first = (lk->records) ? spool_after(pos, hdr.len) : SPOOL_NONE;
+    spool_count--;
+    spool_stats.delivered++;
+    spool_advance_tail();
+    return hdr.len;
+}
+
+// Read the link's records again, starting with the oldest one not delivered
+//------------------------------------------
+void ICACHE_FLASH_ATTR spool_rewind(uint8_t link)
+{
+    if (link >= SPOOL_LINKS) return;
+    spool_links[link].cursor = spool_links[link].first;
+    spool_links[link].unread = spool_links[link].records;
+}
+
+// Remove all records of the link
+//------------------------------------------
+void ICACHE_FLASH_ATTR spool_discard(uint8_t link)
+{
+    spool_hdr_t hdr;
+    spool_link_t *lk;
+    uint32_t pos;
+
+    if (link >= SPOOL_LINKS) return;
+    lk = &spool_links[link];
+    pos = lk->first;
+    while ((lk->records) && ((pos = spool_find(link, pos)) != SPOOL_NONE) && (spool_read_hdr(pos, &hdr))) {
+        spool_mark(pos);
+        lk->records--;
+        spool_count--;
+        spool_stats.discarded++;
+        pos = spool_after(pos, hdr.len);
+    }
+    spool_count -= lk->records;
+    os_memset(lk, 0, sizeof(spool_link_t));
+    lk->first = SPOOL_NONE;
+    lk->cursor = SPOOL_NONE;
+    spool_advance_tail();
+}
+
+// Remove the link's newest 'count' records, written by the input which failed
+//------------------------------------------
+void ICACHE_FLASH_ATTR spool_drop(uint8_t link, uint16_t count)
+{
+    spool_hdr_t hdr;
+    spool_link_t *lk;
+    uint32_t pos;
+    uint16_t skip;
+
+    if ((link >= SPOOL_LINKS) || (count == 0)) return;
+    lk = &spool_links[link];
+    if (count >= lk->records) {
+        spool_discard(link);
+        return;
+    }
+    skip = lk->records - count;
+    pos = lk->first;
+    while (((pos = spool_find(link, pos)) != SPOOL_NONE) && (spool_read_hdr(pos, &hdr))) {
+        if (skip) skip--;
+        else {
+            spool_mark(pos);
+            lk->records--;
+            lk->bytes -= hdr.len;
+            if (lk->unread) lk->unread--;
+            spool_count--;
+            spool_stats.discarded++;
+        }
+        pos = spool_after(pos, hdr.len);
+    }
+    if (lk->unread == 0) lk->cursor = SPOOL_NONE;
+    spool_advance_tail();
+}
+
+//------------------------------------------
+uint16_t ICACHE_FLASH_ATTR spool_records(uint8_t link)
+{
+    if (link >= SPOOL_LINKS) return 0;
+    return spool_links[link].records;
+}
+
+// Data bytes of the link not yet delivered
+//------------------------------------------
+uint32_t ICACHE_FLASH_ATTR spool_pending(uint8_t link)
+{
+    if (link >= SPOOL_LINKS) return 0;
+    return spool_links[link].bytes;
+}
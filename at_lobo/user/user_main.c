@@ -65,10 +65,18 @@
 #include "at_upgrade.h"
 #endif
 #include "at_extra_cmd.h"
+#include "driver/uart_tx.h"
 
 #if AT_SDIO_ENABLE
 #include "driver/sdio_slv.h"
 #endif
+#if AT_HSPI_ENABLE
+#include "driver/hspi_slv.h"
+#endif
+
+#if AT_SDIO_ENABLE && AT_HSPI_ENABLE
+#error "Only one of AT_SDIO_ENABLE and AT_HSPI_ENABLE can be set"
+#endif
 
 
 #ifdef CONFIG_ENABLE_IRAM_MEMORY
@@ -192,13 +200,7 @@ void user_spi_flash_dio_to_qio_pre_init(void)
 }
 
 
-#if AT_SDIO_ENABLE
-
-#ifdef SDIO_DEBUG
-static os_timer_t at_spi_check;
-uint32 sum_len = 0;
-extern void ICACHE_FLASH_ATTR at_spi_check_cb(void *arg);
-#endif
+#if AT_SDIO_ENABLE || AT_HSPI_ENABLE
 
 uint32 at_fake_uart_rx(uint8* data,uint32 length);
 typedef void (*at_fake_uart_tx_func_type)(const uint8*data,uint32 length);
@@ -207,6 +209,10 @@ bool at_fake_uart_enable(bool enable,at_fake_uart_tx_func_type at_fake_uart_tx_f
 typedef void (*at_custom_uart_rx_buffer_fetch_cb_type)(void);
 void at_register_uart_rx_buffer_fetch_cb(at_custom_uart_rx_buffer_fetch_cb_type rx_buffer_fetch_cb);
 
+#endif
+
+#if AT_SDIO_ENABLE
+
 extern void at_custom_uart_rx_buffer_fetch_cb(void);
 
 sint8 ICACHE_FLASH_ATTR espconn_tcp_set_wnd(uint8 num);
@@ -229,6 +235,26 @@ uint32 sdio_recv_data_callback(uint8* data,uint32 len)
 
 #endif
 
+#if AT_HSPI_ENABLE
+
+//---------------------------------------------------------------------
+void ICACHE_FLASH_ATTR at_hspi_response(const uint8*data,uint32 length)
+{
+    if((data == NULL) || (length == 0)) {
+        return;
+    }
+
+    hspi_load_data(data,length);
+}
+
+//----------------------------------------------------
+uint32 hspi_recv_data_callback(uint8* data,uint32 len)
+{
+    return at_fake_uart_rx(data,len);
+}
+
+#endif
+
 
 
 //===== Main code =======================================================================
@@ -238,11 +264,39 @@ uint32 sdio_recv_data_callback(uint8* data,uint32 len)
 at_funcationType at_custom_cmd[] = {
     {"+SYSFLASHMAP",      12, NULL,               at_queryCmdFlashMap,     NULL,                      NULL},
     {"+SYSCPUFREQ",       11, NULL,               at_queryCmdSysCPUfreq,   at_setupCmdCPUfreq,        NULL},
+    {"+UARTFLOW",          9, NULL,               at_queryCmdUartFlow,     at_setupCmdUartFlow,       NULL},
+    {"+UARTTXBUF",        10, NULL,               at_queryCmdUartTxBuf,    at_setupCmdUartTxBuf,      NULL},
+    {"+UARTFAST",          9, NULL,               at_queryCmdUartFast,     at_setupCmdUartFast,       NULL},
+    {"+UARTBENCH",        10, NULL,               NULL,                    at_setupCmdUartBench,      NULL},
+    #if AT_SDIO_ENABLE
+    {"+SDIOSTAT",          9, NULL,               at_queryCmdSdioStat,     NULL,                      NULL},
+    #endif
+    #if AT_HSPI_ENABLE
+    {"+HSPISTAT",          9, NULL,               at_queryCmdHspiStat,     NULL,                      NULL},
+    #endif
     {"+TCPSERVER",        10, NULL,               at_queryCmdTCPServer,    at_setupCmdTCPServer,      NULL},
     {"+TCPSTART",          9, NULL,               at_queryCmdTCP,          at_setupCmdTCPConnConnect, NULL},
     {"+TCPSEND",           8, NULL,               at_queryCmdTCP,          at_setupCmdTCPSend,        NULL},
+    {"+TCPSENDQ",          9, NULL,               at_queryCmdTCPSendQueue, at_setupCmdTCPSendQueue,   NULL},
     {"+TCPCLOSE",          9, NULL,               at_queryCmdTCP,          at_setupCmdTCPClose,       NULL},
+    {"+TCPRECVMODE",      12, NULL,               at_queryCmdTCPRecvMode,  at_setupCmdTCPRecvMode,    NULL},
+    {"+TCPRECV",           8, NULL,               at_queryCmdTCPRecv,      at_setupCmdTCPRecv,        NULL},
+    {"+TCPCREDIT",        10, NULL,               at_queryCmdTCPCredit,    at_setupCmdTCPCredit,      NULL},
+    {"+TCPACK",            7, NULL,               NULL,                    at_setupCmdTCPAck,         NULL},
+    {"+TCPCOAL",           8, NULL,               at_queryCmdTCPCoal,      at_setupCmdTCPCoal,        NULL},
+    {"+TCPCORK",           8, NULL,               at_queryCmdTCPCork,      at_setupCmdTCPCork,        NULL},
+    {"+TCPSPOOL",          9, NULL,               at_queryCmdTCPSpool,     at_setupCmdTCPSpool,       NULL},
+    {"+TCPASYNC",          9, NULL,               at_queryCmdTCPAsync,     at_setupCmdTCPAsync,       NULL},
+    {"+TCPLIMITS",        10, NULL,               at_queryCmdTCPLimits,    at_setupCmdTCPLimits,      NULL},
+    {"+TCPPOOL",           8, NULL,               at_queryCmdTCPPool,      at_setupCmdTCPPool,        NULL},
+    {"+DNSCACHE",          9, NULL,               at_queryCmdDNSCache,     at_setupCmdDNSCache,       NULL},
+    {"+LWIPMEM",           8, NULL,               at_queryCmdLwipMem,      NULL,                      at_exeCmdLwipMem},
+    {"+NETSTATS",          9, NULL,               at_queryCmdNetStats,     NULL,                      at_exeCmdNetStats},
+    {"+UDPSTART",          9, NULL,               at_queryCmdUDPStart,     at_setupCmdUDPStart,       NULL},
+    {"+UDPSEND",           8, NULL,               NULL,                    at_setupCmdUDPSend,        NULL},
+    {"+TCPFRAME",          9, NULL,               at_queryCmdTCPFrame,     at_setupCmdTCPFrame,       NULL},
     {"+TCPSTATUS",        10, NULL,               at_queryCmdTCPStatus,    at_setupCmdTCPStatus,      at_queryCmdTCPStatus},
+    {"+TCPSTATS",          9, NULL,               at_queryCmdTCPStats,     at_setupCmdTCPStats,       at_exeCmdTCPStats},
     {"+SSLCCONF",          9, NULL,               at_queryCmdTCPSSLconfig, at_setupCmdTCPSSLconfig,   NULL},
     {"+SSLLOADCERT",      12, NULL,               at_queryCmdTCPLoadCert,  at_setupCmdTCPLoadCert,    NULL},
     {"+SNTPTIME",          9, at_testCmdSNTPTime, at_queryCmdSNTPTime,     NULL,                      NULL},
@@ -279,6 +333,10 @@ static const partition_item_t at_partition_table[] = {
     { SYSTEM_PARTITION_PHY_DATA,                        SYSTEM_PARTITION_PHY_DATA_ADDR,                     SECTOR_SIZE},
     { SYSTEM_PARTITION_SYSTEM_PARAMETER,                SYSTEM_PARTITION_SYSTEM_PARAMETER_ADDR,             SECTOR_SIZE*3},
 
+    #if (SPOOL_FLASH_SIZE > 0)
+    { SYSTEM_PARTITION_SPOOL,                           SPOOL_FLASH_ADDR,                                   SPOOL_FLASH_SIZE},
+    #endif
+
 #ifdef CONFIG_AT_WPA2_ENTERPRISE_COMMAND_ENABLE
     { SYSTEM_PARTITION_WPA2_ENTERPRISE_CA,              SYSTEM_PARTITION_WPA2_ENTERPRISE_CA_ADDR,           SECTOR_SIZE},
     { SYSTEM_PARTITION_WPA2_ENTERPRISE_CERT_PRIVKEY,    SYSTEM_PARTITION_WPA2_ENTERPRISE_CERT_PRIVKEY_ADDR, SECTOR_SIZE},
@@ -310,18 +368,31 @@ void ICACHE_FLASH_ATTR user_init(void)
     #endif
 
     at_init();
+    uart_tx_init();
     #if AT_SDIO_ENABLE
     at_register_uart_rx_buffer_fetch_cb(at_custom_uart_rx_buffer_fetch_cb);
     #endif
+    #if AT_HSPI_ENABLE
+    at_register_uart_rx_buffer_fetch_cb(hspi_rx_buffer_fetch_cb);
+    #endif
 
     os_sprintf(buf,"Compile time: "__DATE__" "__TIME__"\r\n"ESP_AT_LOBO_VERSION);
     at_set_custom_info(buf);
     #if AT_SDIO_ENABLE
     at_fake_uart_enable(TRUE,at_sdio_response);
     #endif
+    #if AT_HSPI_ENABLE
+    at_fake_uart_enable(TRUE,at_hspi_response);
+    #endif
 
     os_delay_us(100000);
     system_uart_de_swap(); // swapped in `user_pre_init`
+    #if AT_HSPI_ENABLE
+    // HSPI uses GPIO13 and GPIO15, initialize it when UART0 is back on its default pins
+    hspi_slave_init();
+    hspi_register_recv_cb(hspi_recv_data_callback);
+    hspi_register_link_status_cb(at_hspi_link_status);
+    #endif
     #if AT_SDIO_ENABLE
     espconn_tcp_set_wnd(4);
     #endif
@@ -336,14 +407,5 @@ void ICACHE_FLASH_ATTR user_init(void)
     #ifdef CONFIG_AT_WPA2_ENTERPRISE_COMMAND_ENABLE
     at_cmd_enable_wpa2_enterprise();
     #endif
-
-    #if AT_SDIO_ENABLE
-    #ifdef SDIO_DEBUG
-    os_timer_disarm(&at_spi_check);
-    os_timer_setfn(&at_spi_check, (os_timer_func_t *)at_spi_check_cb, NULL);
-    os_timer_arm(&at_spi_check, 1000, 1);
-    os_printf("\r\ntimer start\r\n");
-    #endif
-    #endif
 }
 
@@ -96,6 +96,11 @@ typedef struct _remot_info{
 
 /** A callback prototype to inform about events for a espconn */
 typedef void (* espconn_recv_callback)(void *arg, char *pdata, unsigned short len);
+/** Receive callback taking the pbuf chain, it is released with espconn_recv_pbuf_free
+ *  A result other than ESPCONN_OK refuses the chain, lwIP keeps the TCP data and delivers
+ *  them again, the UDP datagram is dropped */
+struct pbuf;
+typedef sint8 (* espconn_recv_pbuf_callback)(void *arg, struct pbuf *p, unsigned short len);
 typedef void (* espconn_sent_callback)(void *arg);
 
 /** A espconn descriptor */
@@ -193,6 +198,7 @@ typedef struct _espconn_msg{
 	uint16 recv_holded_buf_Len;
 //*******************************************************
 	ringbuf *readbuf;
+	espconn_recv_pbuf_callback recv_pbuf_callback;	// plain TCP and UDP only, the SSL nodes are allocated without it
 }espconn_msg;
 
 #ifndef _MDNS_INFO
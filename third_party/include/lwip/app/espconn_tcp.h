@@ -90,5 +90,49 @@ extern sint8 espconn_tcp_client(struct espconn* espconn);
 
 extern sint8 espconn_tcp_server(struct espconn *espconn);
 
+/******************************************************************************
+ * FunctionName : espconn_tcp_get_stats
+ * Description  : get the state of the TCP connection from its pcb
+ * Parameters   : pespconn -- the espconn of the TCP connection
+ * Returns      : ESPCONN_OK, ESPCONN_ARG if the connection is not found
+*******************************************************************************/
+
+extern sint8 espconn_tcp_get_stats(struct espconn *pespconn, uint16 *srtt, uint16 *rto, uint16 *rexmits, uint16 *snd_wnd, uint16 *cwnd);
+
+/******************************************************************************
+ * FunctionName : espconn_regist_recv_pbufcb
+ * Description  : used to receive the data of the TCP connection or the UDP datagrams
+ *                as the pbuf chain, without copying them to the linear buffer
+ * Parameters   : pespconn -- the espconn of the plain TCP connection or of the UDP connection
+ *                recv_cb -- callback taking the chain, NULL: data callback is used;
+ *                           returning ESPCONN_MEM refuses the chain, the TCP data are
+ *                           delivered again, the UDP datagram is dropped
+ * Returns      : ESPCONN_OK, ESPCONN_ARG if the connection is not found or is secure
+*******************************************************************************/
+
+extern sint8 espconn_regist_recv_pbufcb(struct espconn *pespconn, espconn_recv_pbuf_callback recv_cb);
+
+/******************************************************************************
+ * FunctionName : espconn_recv_pbuf_free
+ * Description  : release the received chain when its data are delivered
+ *                and advertise the TCP window
+ * Parameters   : pespconn -- the espconn which received the chain
+ *                p -- the chain passed to the pbuf receive callback
+ * Returns      : ESPCONN_OK, ESPCONN_ARG if the chain is NULL
+*******************************************************************************/
+
+extern sint8 espconn_recv_pbuf_free(struct espconn *pespconn, struct pbuf *p);
+
+/******************************************************************************
+ * FunctionName : espconn_pbuf_payload
+ * Description  : walk the received chain segment by segment
+ * Parameters   : p -- the segment of the chain
+ *                payload -- the segment's data
+ *                next -- the next segment, NULL at the end of the chain
+ * Returns      : length of the segment's data
+*******************************************************************************/
+
+extern uint16 espconn_pbuf_payload(struct pbuf *p, void **payload, struct pbuf **next);
+
 #endif /* __CLIENT_TCP_H__ */
 
@@ -110,6 +110,13 @@ ip_addr_t      dns_getserver(u8_t numdns);
 err_t          dns_gethostbyname(const char *hostname, ip_addr_t *addr,
                                  dns_found_callback found, void *callback_arg);
 
+#if DNS_CACHE_MAX
+u8_t           dns_cache_setup(u8_t size, u16_t neg_ttl);
+u8_t           dns_cache_get_setup(u16_t *neg_ttl);
+void           dns_cache_get_stats(u32_t *hits, u32_t *neg_hits, u32_t *misses, u32_t *prefetches);
+const char    *dns_cache_get_entry(u8_t i, ip_addr_t *addr, u32_t *ttl, u16_t *hits);
+#endif /* DNS_CACHE_MAX */
+
 #if DNS_LOCAL_HOSTLIST && DNS_LOCAL_HOSTLIST_IS_DYNAMIC
 int            dns_local_removehost(const char *hostname, const ip_addr_t *addr);
 err_t          dns_local_addhost(const char *hostname, const ip_addr_t *addr);
@@ -84,8 +84,8 @@ extern const u32_t memp_sizes[MEMP_MAX];
 #include "mem.h"
 
 #define memp_init()
-#define memp_malloc(type)     mem_malloc(memp_sizes[type])
-#define memp_free(type, mem)  mem_free(mem)
+void *memp_malloc(memp_t type)ICACHE_FLASH_ATTR;
+void  memp_free(memp_t type, void *mem)ICACHE_FLASH_ATTR;
 
 #else /* MEMP_MEM_MALLOC */
 
@@ -109,6 +109,12 @@ void  memp_free(memp_t type, void *mem)ICACHE_FLASH_ATTR;
 
 #endif /* MEMP_MEM_MALLOC */
 
+/* Per pool counters, kept with both allocators. num is 0 for the pools allocated from the heap */
+u8_t  memp_get_stats(u8_t type, const char **desc, u16_t *size, u16_t *num,
+                     u16_t *used, u16_t *high, u16_t *fail)ICACHE_FLASH_ATTR;
+void  memp_clear_stats(void)ICACHE_FLASH_ATTR;
+u32_t memp_get_fails(void)ICACHE_FLASH_ATTR;
+
 #ifdef __cplusplus
 }
 #endif
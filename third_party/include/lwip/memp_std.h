@@ -39,7 +39,7 @@ LWIP_MEMPOOL(UDP_PCB,        MEMP_NUM_UDP_PCB,         sizeof(struct udp_pcb),
 #endif /* LWIP_UDP */
 
 #if LWIP_TCP
-LWIP_MEMPOOL(TCP_PCB,        MEMP_NUM_TCP_PCB,         sizeof(struct tcp_pcb),        "TCP_PCB", DMEM_ATTR)
+LWIP_MEMPOOL(TCP_PCB,        MEMP_NUM_TCP_PCB_POOL,    sizeof(struct tcp_pcb),        "TCP_PCB", DMEM_ATTR)
 LWIP_MEMPOOL(TCP_PCB_LISTEN, MEMP_NUM_TCP_PCB_LISTEN,  sizeof(struct tcp_pcb_listen), "TCP_PCB_LISTEN", DMEM_ATTR)
 LWIP_MEMPOOL(TCP_SEG,        MEMP_NUM_TCP_SEG,         sizeof(struct tcp_seg),        "TCP_SEG", DMEM_ATTR)
 #endif /* LWIP_TCP */
@@ -104,7 +104,7 @@ LWIP_PBUF_MEMPOOL(PBUF,      MEMP_NUM_PBUF,            0,
 /* XXX:  need to align to 4 byte as memp strcut is 4-byte long.  otherwise will crash */
 #define LWIP_MEM_ALIGN4_SIZE(size) (((size) + 4 - 1) & ~(4-1))
 
-LWIP_PBUF_MEMPOOL(PBUF_POOL, PBUF_POOL_SIZE, LWIP_MEM_ALIGN4_SIZE(PBUF_POOL_BUFSIZE), "PBUF_POOL", DMEM_ATTR)
+LWIP_PBUF_MEMPOOL(PBUF_POOL, MEMP_NUM_PBUF_POOL, LWIP_MEM_ALIGN4_SIZE(PBUF_POOL_BUFSIZE), "PBUF_POOL", DMEM_ATTR)
 
 
 /*
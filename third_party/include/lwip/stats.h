@@ -87,6 +87,20 @@ struct stats_igmp {
   STAT_COUNTER tx_report;        /* Sent reports. */
 };
 
+struct stats_tcp_ext {
+  STAT_COUNTER rto;              /* Retransmission timeouts. */
+  STAT_COUNTER rexmit;           /* Fast retransmits. */
+  STAT_COUNTER ooseq;            /* Out of sequence segments received. */
+  STAT_COUNTER ooseq_drop;       /* Out of sequence segments dropped or reclaimed. */
+};
+
+struct stats_pbuf {
+  STAT_COUNTER ram_err;          /* PBUF_RAM allocation failed (heap). */
+  STAT_COUNTER pool_err;         /* PBUF_POOL allocation failed. */
+  STAT_COUNTER ref_err;          /* PBUF_REF/ROM allocation failed. */
+  STAT_COUNTER rx_err;           /* PBUF_ESF_RX allocation failed, WLAN frame dropped. */
+};
+
 struct stats_mem {
 #ifdef LWIP_DEBUG
   const char *name;
@@ -134,6 +148,10 @@ struct stats_ {
 #endif
 #if TCP_STATS
   struct stats_proto tcp;
+  struct stats_tcp_ext tcp_ext;
+#endif
+#if PBUF_STATS
+  struct stats_pbuf pbuf;
 #endif
 #if MEM_STATS
   struct stats_mem mem;
@@ -149,6 +167,8 @@ struct stats_ {
 extern struct stats_ lwip_stats;
 
 void stats_init(void)ICACHE_FLASH_ATTR;
+void stats_reset(void)ICACHE_FLASH_ATTR;
+u8_t stats_get_counters(u8_t group, const char **name, u32_t *cnt, u8_t max)ICACHE_FLASH_ATTR;
 
 #define STATS_INC(x) ++lwip_stats.x
 #define STATS_DEC(x) --lwip_stats.x
@@ -159,6 +179,7 @@ void stats_init(void)ICACHE_FLASH_ATTR;
                              } while(0)
 #else /* LWIP_STATS */
 #define stats_init()
+#define stats_reset()
 #define STATS_INC(x)
 #define STATS_DEC(x)
 #define STATS_INC_USED(x)
@@ -172,6 +193,12 @@ void stats_init(void)ICACHE_FLASH_ATTR;
 #define TCP_STATS_DISPLAY()
 #endif
 
+#if PBUF_STATS
+#define PBUF_STATS_INC(x) STATS_INC(x)
+#else
+#define PBUF_STATS_INC(x)
+#endif
+
 #if UDP_STATS
 #define UDP_STATS_INC(x) STATS_INC(x)
 #define UDP_STATS_DISPLAY() stats_display_proto(&lwip_stats.udp, "UDP")
@@ -277,6 +277,9 @@ struct tcp_pcb {
 
   /* KEEPALIVE counter */
   u8_t keep_cnt_sent;
+
+  /* number of retransmissions (timeout or fast retransmit) since the connection was created */
+  u16_t rexmits;
 };
 
 struct tcp_pcb_listen {  
@@ -91,6 +91,26 @@
    ---------- Memory options ----------
    ------------------------------------
 */
+/**
+ * LWIP_MEMP_FIXED_POOLS==1: back the memp_std.h pools with fixed-size free lists
+ * instead of MEMP_MEM_MALLOC. The numbers of elements are set in memp_profile.h.
+ */
+#ifndef LWIP_MEMP_FIXED_POOLS
+#define LWIP_MEMP_FIXED_POOLS           0
+#endif
+
+#if LWIP_MEMP_FIXED_POOLS
+#include "memp_profile.h"
+#endif
+
+/**
+ * MEMP_TRACE==1: print every memp_malloc() and memp_free() as "memp:a|f <pool> <address>"
+ * with os_printf. The log can be replayed by the memp_sim host benchmark.
+ */
+#ifndef MEMP_TRACE
+#define MEMP_TRACE                      0
+#endif
+
 /**
  * MEM_LIBC_MALLOC==1: Use malloc/free/realloc provided by your C-library
  * instead of the lwip internal allocator. Can save code size if you
@@ -245,6 +265,14 @@
 #define MEMP_NUM_TCP_PCB                (*(volatile uint32*)0x600011FC)
 #endif
 
+/**
+ * MEMP_NUM_TCP_PCB_POOL: the number of elements in the TCP_PCB pool.
+ * MEMP_NUM_TCP_PCB is the run time connection limit and can't size a fixed pool.
+ */
+#ifndef MEMP_NUM_TCP_PCB_POOL
+#define MEMP_NUM_TCP_PCB_POOL           MEMP_NUM_TCP_PCB
+#endif
+
 /**
  * MEMP_NUM_TCP_PCB_LISTEN: the number of listening TCP connections.
  * (requires the LWIP_TCP option)
@@ -406,6 +434,14 @@
 #define PBUF_POOL_SIZE                  10
 #endif
 
+/**
+ * MEMP_NUM_PBUF_POOL: the number of elements in the PBUF_POOL pool.
+ * With fixed pools 0 leaves the pbuf pool on the heap.
+ */
+#ifndef MEMP_NUM_PBUF_POOL
+#define MEMP_NUM_PBUF_POOL              PBUF_POOL_SIZE
+#endif
+
 /*
    ---------------------------------
    ---------- ARP options ----------
@@ -803,14 +839,15 @@
 #define LWIP_DNS                        1
 #endif
 
-/** DNS maximum number of entries to maintain locally. */
+/** DNS maximum number of entries to maintain locally.
+ *  Each lookup in progress takes one entry, the links started together resolve in parallel. */
 #ifndef DNS_TABLE_SIZE
-#define DNS_TABLE_SIZE                  4
+#define DNS_TABLE_SIZE                  8
 #endif
 
 /** DNS maximum host name length supported in the name table. */
 #ifndef DNS_MAX_NAME_LENGTH
-#define DNS_MAX_NAME_LENGTH             256
+#define DNS_MAX_NAME_LENGTH             128
 #endif
 
 /** The maximum of DNS servers */
@@ -828,6 +865,36 @@
 #define DNS_MSG_SIZE                    512
 #endif
 
+/** DNS_CACHE_SIZE: default number of entries of the DNS cache, 0: disabled.
+ *  The cache keeps the resolved names for their TTL and the failed lookups
+ *  for DNS_CACHE_NEG_TTL seconds. The size can be changed at runtime
+ *  (dns_cache_setup), the entries are allocated with the first lookup. */
+#ifndef DNS_CACHE_SIZE
+#define DNS_CACHE_SIZE                  8
+#endif
+
+/** Maximal number of entries of the DNS cache. */
+#ifndef DNS_CACHE_MAX
+#define DNS_CACHE_MAX                   32
+#endif
+
+/** DNS maximum host name length supported in the cache, longer names are not cached. */
+#ifndef DNS_CACHE_NAME_LENGTH
+#define DNS_CACHE_NAME_LENGTH           64
+#endif
+
+/** Default time in seconds a failed lookup (NXDOMAIN, no address or timeout) is cached. */
+#ifndef DNS_CACHE_NEG_TTL
+#define DNS_CACHE_NEG_TTL               10
+#endif
+
+/** An entry used since it was resolved is refreshed in the background
+ *  when its remaining TTL drops below DNS_CACHE_PREFETCH seconds
+ *  (or a quarter of its TTL, if that is shorter). */
+#ifndef DNS_CACHE_PREFETCH
+#define DNS_CACHE_PREFETCH              10
+#endif
+
 /** DNS_LOCAL_HOSTLIST: Implements a local host-to-address list. If enabled,
  *  you have to define
  *    #define DNS_LOCAL_HOSTLIST_INIT {{"host1", 0x123}, {"host2", 0x234}}
@@ -1475,13 +1542,21 @@
 */
 /**
  * LWIP_STATS==1: Enable statistics collection in lwip_stats.
+ * The counters are reported by AT+NETSTATS.
  */
 #ifndef LWIP_STATS
-#define LWIP_STATS                      0
+#define LWIP_STATS                      1
 #endif
 
 #if LWIP_STATS
 
+/**
+ * LWIP_STATS_LARGE==1: Use 32 bit counters, 16 bit counters wrap in minutes on a busy link.
+ */
+#ifndef LWIP_STATS_LARGE
+#define LWIP_STATS_LARGE                1
+#endif
+
 /**
  * LWIP_STATS_DISPLAY==1: Compile in the statistics output functions.
  */
@@ -1515,21 +1590,21 @@
  * on if using either frag or reass.
  */
 #ifndef IPFRAG_STATS
-#define IPFRAG_STATS                    (IP_REASSEMBLY || IP_FRAG)
+#define IPFRAG_STATS                    0
 #endif
 
 /**
  * ICMP_STATS==1: Enable ICMP stats.
  */
 #ifndef ICMP_STATS
-#define ICMP_STATS                      1
+#define ICMP_STATS                      0
 #endif
 
 /**
  * IGMP_STATS==1: Enable IGMP stats.
  */
 #ifndef IGMP_STATS
-#define IGMP_STATS                      (LWIP_IGMP)
+#define IGMP_STATS                      0
 #endif
 
 /**
@@ -1548,6 +1623,13 @@
 #define TCP_STATS                       (LWIP_TCP)
 #endif
 
+/**
+ * PBUF_STATS==1: Enable pbuf_alloc() failure stats.
+ */
+#ifndef PBUF_STATS
+#define PBUF_STATS                      1
+#endif
+
 /**
  * MEM_STATS==1: Enable mem.c stats.
  */
@@ -1557,9 +1639,10 @@
 
 /**
  * MEMP_STATS==1: Enable memp.c pool stats.
+ * memp.c keeps its own counters with both allocators (memp_get_stats).
  */
 #ifndef MEMP_STATS
-#define MEMP_STATS                      (MEMP_MEM_MALLOC == 0)
+#define MEMP_STATS                      0
 #endif
 
 /**
@@ -1578,6 +1661,7 @@
 #define IGMP_STATS                      0
 #define UDP_STATS                       0
 #define TCP_STATS                       0
+#define PBUF_STATS                      0
 #define MEM_STATS                       0
 #define MEMP_STATS                      0
 #define SYS_STATS                       0
@@ -1799,9 +1883,27 @@
 /**
  * LWIP_CHECKSUM_ON_COPY==1: Calculate checksum when copying data from
  * application buffers to pbufs.
+ * tcp_write() of espconn copies the data, the payload is not read again by
+ * tcp_output() or on retransmission.
  */
 #ifndef LWIP_CHECKSUM_ON_COPY
-#define LWIP_CHECKSUM_ON_COPY           0
+#define LWIP_CHECKSUM_ON_COPY           1
+#endif
+
+/**
+ * LWIP_CHKSUM_ALGORITHM: checksum routine of inet_chksum.c,
+ * 4: 32 bits at a time, aligned loads for the LX106 (2: 16 bits at a time).
+ */
+#ifndef LWIP_CHKSUM_ALGORITHM
+#define LWIP_CHKSUM_ALGORITHM           4
+#endif
+
+/**
+ * LWIP_CHKSUM_COPY_ALGORITHM: copy routine of LWIP_CHECKSUM_ON_COPY,
+ * 2: copy and checksum in one pass (1: MEMCPY, then LWIP_CHKSUM).
+ */
+#if LWIP_CHECKSUM_ON_COPY && !defined(LWIP_CHKSUM_COPY_ALGORITHM)
+#define LWIP_CHKSUM_COPY_ALGORITHM      2
 #endif
 
 /*
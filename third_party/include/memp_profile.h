@@ -0,0 +1,25 @@
+/*
+ * Fixed memp pool profile for the AT firmware, used with LWIP_MEMP_FIXED_POOLS=1
+ *
+ * The pools are placed in .bss and allocated from O(1) free lists.
+ * The numbers follow the AT firmware limits (15 TCP links, 7 TCP servers,
+ * AT UDP links, DNS, SNTP and DHCP), check them with the AT+LWIPMEM high-water
+ * marks or with the sim/memp_sim host benchmark, which prints this file from a trace.
+ * A pool with 0 elements is still allocated from the heap.
+ * The pools not listed here keep the lwipopts.h numbers.
+ */
+
+#ifndef __MEMP_PROFILE_H__
+#define __MEMP_PROFILE_H__
+
+#define MEMP_MEM_MALLOC                 0
+#define MEMP_SANITY_CHECK               0       // walks all free lists on every memp_free()
+
+#define MEMP_NUM_TCP_PCB_POOL           16      // linkMax connections + one closing
+#define MEMP_NUM_TCP_PCB_LISTEN         8       // TCPCONN_MAX_SERV servers + one
+#define MEMP_NUM_TCP_SEG                64      // unsent, unacked and out of sequence segments of all links
+#define MEMP_NUM_PBUF                   32      // PBUF_REF/ROM and the WLAN receive pbufs (PBUF_ESF_RX)
+#define MEMP_NUM_UDP_PCB                8
+#define MEMP_NUM_PBUF_POOL              0       // PBUF_POOL stays on the heap, a fixed pool would take PBUF_POOL_SIZE * 1.5 KB
+
+#endif
@@ -603,6 +603,11 @@ sint8 ICACHE_FLASH_ATTR espconn_tcp_set_max_con(uint8 num)
 {
 	if (num == 0 || num > linkMax)
 		return ESPCONN_ARG;
+#if !MEMP_MEM_MALLOC
+	/* the fixed TCP_PCB pool can't hold more connections */
+	if (num > MEMP_NUM_TCP_PCB_POOL)
+		return ESPCONN_ARG;
+#endif
 
 	MEMP_NUM_TCP_PCB = num;
 	return ESPCONN_OK;
@@ -700,6 +700,126 @@ espconn_recv_unhold(struct espconn *pespconn)
 	return ESPCONN_OK;
 }
 
+/******************************************************************************
+ * FunctionName : espconn_tcp_get_stats
+ * Description  : get the state of the TCP connection from its pcb
+ * Parameters   : pespconn -- the espconn of the TCP connection
+ *                srtt -- smoothed round trip time in ms
+ *                rto -- retransmission timeout in ms
+ *                rexmits -- number of retransmissions
+ *                snd_wnd -- window advertised by the remote side
+ *                cwnd -- congestion window
+ * Returns      : ESPCONN_OK, ESPCONN_ARG if the connection is not found
+*******************************************************************************/
+sint8 ICACHE_FLASH_ATTR
+espconn_tcp_get_stats(struct espconn *pespconn, uint16 *srtt, uint16 *rto, uint16 *rexmits, uint16 *snd_wnd, uint16 *cwnd)
+{
+	espconn_msg *pnode = NULL;
+	struct tcp_pcb *pcb = NULL;
+
+	if ((pespconn == NULL) || (pespconn->type != ESPCONN_TCP))
+		return ESPCONN_ARG;
+	if (!espconn_find_connection(pespconn, &pnode))
+		return ESPCONN_ARG;
+	pcb = pnode->pcommon.pcb;
+	if ((pcb == NULL) || (pcb->state != ESTABLISHED))
+		return ESPCONN_ARG;
+
+	/* sa is the RTT estimate scaled by 8, both in TCP_SLOW_INTERVAL ticks */
+	*srtt = (pcb->sa >> 3) * TCP_SLOW_INTERVAL;
+	*rto = pcb->rto * TCP_SLOW_INTERVAL;
+	*rexmits = pcb->rexmits;
+	*snd_wnd = pcb->snd_wnd;
+	*cwnd = pcb->cwnd;
+	return ESPCONN_OK;
+}
+
+/******************************************************************************
+ * FunctionName : espconn_regist_recv_pbufcb
+ * Description  : used to receive the data of the TCP connection or the UDP datagrams
+ *                as the pbuf chain, the copy to the linear buffer of the data callback is avoided
+ * Parameters   : pespconn -- the espconn of the plain TCP connection or of the UDP connection
+ *                recv_cb -- callback taking the chain, NULL: data callback is used;
+ *                           returning ESPCONN_MEM refuses the chain, the TCP data are
+ *                           delivered again, the UDP datagram is dropped
+ * Returns      : ESPCONN_OK, ESPCONN_ARG if the connection is not found or is secure
+*******************************************************************************/
+sint8 ICACHE_FLASH_ATTR
+espconn_regist_recv_pbufcb(struct espconn *pespconn, espconn_recv_pbuf_callback recv_cb)
+{
+	espconn_msg *pnode = NULL;
+
+	if ((pespconn == NULL) || ((pespconn->type != ESPCONN_TCP) && (pespconn->type != ESPCONN_UDP)))
+		return ESPCONN_ARG;
+	if (!espconn_find_connection(pespconn, &pnode))
+		return ESPCONN_ARG;
+	/* the secure connections receive the decrypted data */
+	if (pnode->pssl != NULL)
+		return ESPCONN_ARG;
+
+	pnode->recv_pbuf_callback = recv_cb;
+	return ESPCONN_OK;
+}
+
+/******************************************************************************
+ * FunctionName : espconn_recv_pbuf_free
+ * Description  : release the received chain when its data are delivered
+ *                and advertise the window, unless the receive is held
+ * Parameters   : pespconn -- the espconn which received the chain
+ *                p -- the chain passed to the pbuf receive callback
+ * Returns      : ESPCONN_OK, ESPCONN_ARG if the chain is NULL
+*******************************************************************************/
+sint8 ICACHE_FLASH_ATTR
+espconn_recv_pbuf_free(struct espconn *pespconn, struct pbuf *p)
+{
+	espconn_msg *pnode = NULL;
+	struct tcp_pcb *pcb = NULL;
+	u16_t len;
+
+	if (p == NULL)
+		return ESPCONN_ARG;
+	len = p->tot_len;
+	/* the WLAN receive buffers are returned to the driver */
+	pbuf_free(p);
+
+	/* the connection may be closed while the data were delivered */
+	if ((pespconn == NULL) || (!espconn_find_connection(pespconn, &pnode)))
+		return ESPCONN_OK;
+	/* UDP has no receive window */
+	if (pnode->pespconn->type != ESPCONN_TCP)
+		return ESPCONN_OK;
+	pcb = pnode->pcommon.pcb;
+	if ((pcb == NULL) || (pcb->state != ESTABLISHED))
+		return ESPCONN_OK;
+
+	if (pnode->recv_hold_flag == 0)
+		tcp_recved(pcb, len);
+	else
+		pnode->recv_holded_buf_Len += len;
+	return ESPCONN_OK;
+}
+
+/******************************************************************************
+ * FunctionName : espconn_pbuf_payload
+ * Description  : walk the received chain segment by segment
+ * Parameters   : p -- the segment of the chain
+ *                payload -- the segment's data
+ *                next -- the next segment, NULL at the end of the chain
+ * Returns      : length of the segment's data
+*******************************************************************************/
+uint16 ICACHE_FLASH_ATTR
+espconn_pbuf_payload(struct pbuf *p, void **payload, struct pbuf **next)
+{
+	if (p == NULL) {
+		*payload = NULL;
+		*next = NULL;
+		return 0;
+	}
+	*payload = p->payload;
+	*next = p->next;
+	return p->len;
+}
+
 //***********Code for WIFI_BLOCK from upper**************
 sint8 ICACHE_FLASH_ATTR
 espconn_lock_recv(espconn_msg *plockmsg)
@@ -750,7 +870,8 @@ espconn_client_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
 	/*lock the window because of application layer don't need the data*/
 	espconn_lock_recv(precv_cb);
 
-    if (p != NULL) {
+    /*the pbuf receiver advertises the window when it frees the chain*/
+    if (p != NULL && precv_cb->recv_pbuf_callback == NULL) {
     	/*To update and advertise a larger window*/
 		if(precv_cb->recv_hold_flag == 0)
         	tcp_recved(pcb, p->tot_len);
@@ -758,7 +879,24 @@ espconn_client_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
 			precv_cb->recv_holded_buf_Len += p->tot_len;
     }
 
-    if (precv_cb->pespconn->recv_callback != NULL){
+    if (precv_cb->recv_pbuf_callback != NULL){
+		if (err == ERR_OK && p != NULL) {
+			/*pass the chain without copying, the receiver frees it with espconn_recv_pbuf_free*/
+			precv_cb->pespconn ->state = ESPCONN_READ;
+			precv_cb->pcommon.pcb = pcb;
+			if (precv_cb->recv_pbuf_callback(precv_cb->pespconn, p, p->tot_len) != ESPCONN_OK) {
+				/*refused, lwIP keeps the chain as refused data and passes it again,
+				 *the window is not advertised until the chain is freed*/
+				if (pcb->state == ESTABLISHED)
+					precv_cb->pespconn ->state = ESPCONN_CONNECT;
+				return ERR_MEM;
+			}
+
+			/*switch the state of espconn for next packet copy*/
+			if (pcb->state == ESTABLISHED)
+				precv_cb->pespconn ->state = ESPCONN_CONNECT;
+		}
+    } else if (precv_cb->pespconn->recv_callback != NULL){
 		if (err == ERR_OK && p != NULL) {
 			char *pdata = NULL;
 			u16_t length = 0;
@@ -1150,7 +1288,8 @@ espconn_server_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
     /*lock the window because of application layer don't need the data*/
     espconn_lock_recv(precv_cb);
 
-    if (p != NULL) {
+    /*the pbuf receiver advertises the window when it frees the chain*/
+    if (p != NULL && precv_cb->recv_pbuf_callback == NULL) {
     	/*To update and advertise a larger window*/
 		if(precv_cb->recv_hold_flag == 0)
         	tcp_recved(pcb, p->tot_len);
@@ -1159,7 +1298,26 @@ espconn_server_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
     }
 
     /*register receive function*/
-	if (precv_cb->pespconn->recv_callback != NULL) {
+	if (precv_cb->recv_pbuf_callback != NULL) {
+		if (err == ERR_OK && p != NULL) {
+			/*clear the count for connection timeout*/
+			precv_cb->pcommon.recv_check = 0;
+			/*pass the chain without copying, the receiver frees it with espconn_recv_pbuf_free*/
+			precv_cb->pespconn->state = ESPCONN_READ;
+			precv_cb->pcommon.pcb = pcb;
+			if (precv_cb->recv_pbuf_callback(precv_cb->pespconn, p, p->tot_len) != ESPCONN_OK) {
+				/*refused, lwIP keeps the chain as refused data and passes it again,
+				 *the window is not advertised until the chain is freed*/
+				if (pcb->state == ESTABLISHED)
+					precv_cb->pespconn->state = ESPCONN_CONNECT;
+				return ERR_MEM;
+			}
+
+			/*switch the state of espconn for next packet copy*/
+			if (pcb->state == ESTABLISHED)
+				precv_cb->pespconn->state = ESPCONN_CONNECT;
+		}
+	} else if (precv_cb->pespconn->recv_callback != NULL) {
 		if (err == ERR_OK && p != NULL) {
 			u8_t *data_ptr = NULL;
 			u32_t data_cntr = 0;
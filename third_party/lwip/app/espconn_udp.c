@@ -322,9 +322,22 @@ espconn_udp_recv(void *arg, struct udp_pcb *upcb, struct pbuf *p,
 	precv->pespconn->proto.udp->local_ip[3] = ip4_addr4_16(&ipconfig.ip);
 
     if (p != NULL) {
+    	precv->pcommon.pcb = upcb;
+    	if (precv->recv_pbuf_callback != NULL) {
+    		/* pass the datagram without copying, the receiver frees it with espconn_recv_pbuf_free,
+    		 * a refused datagram is dropped */
+    		if ((p->tot_len == 0) || (precv->recv_pbuf_callback(precv->pespconn, p, p->tot_len) != ESPCONN_OK)) {
+    			pbuf_free(p);
+    		}
+    		return;
+    	}
+    	/* the data callback gets the NUL terminated copy */
     	pdata = (u8_t *)os_zalloc(p ->tot_len + 1);
+    	if (pdata == NULL) {
+    		pbuf_free(p);
+    		return;
+    	}
     	length = pbuf_copy_partial(p, pdata, p ->tot_len, 0);
-    	precv->pcommon.pcb = upcb;
         pbuf_free(p);
 		if (length != 0) {
 			if (precv->pespconn->recv_callback != NULL) {
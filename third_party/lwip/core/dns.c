@@ -126,6 +126,11 @@ static const char mem_debug_file[] ICACHE_RODATA_ATTR = __FILE__;
 #define DNS_STATE_ASKING          2
 #define DNS_STATE_DONE            3
 
+/* DNS cache entry states */
+#define DNS_CACHE_UNUSED          0
+#define DNS_CACHE_VALID           1
+#define DNS_CACHE_FAILED          2
+
 #ifdef PACK_STRUCT_USE_INCLUDES
 #  include "arch/bpstruct.h"
 #endif
@@ -184,6 +189,19 @@ struct dns_table_entry {
   void *arg;
 };
 
+#if DNS_CACHE_MAX
+/** DNS cache entry */
+struct dns_cache_entry {
+  u8_t  state;
+  u8_t  refresh;    /* background lookup in progress */
+  u16_t hits;       /* number of lookups answered since the name was resolved */
+  u32_t ttl;        /* seconds left */
+  u32_t prefetch;   /* the used entry is refreshed when its ttl drops to this */
+  ip_addr_t ipaddr;
+  char name[DNS_CACHE_NAME_LENGTH];
+};
+#endif /* DNS_CACHE_MAX */
+
 #if DNS_LOCAL_HOSTLIST
 
 #if DNS_LOCAL_HOSTLIST_IS_DYNAMIC
@@ -214,6 +232,10 @@ static void dns_init_local();
 /* forward declarations */
 static void dns_recv(void *s, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t port);
 static void dns_check_entries(void);
+#if DNS_CACHE_MAX
+static void dns_cache_tmr(void);
+static err_t dns_enqueue(const char *name, dns_found_callback found, void *callback_arg);
+#endif /* DNS_CACHE_MAX */
 
 /*-----------------------------------------------------------------------------
  * Globales
@@ -228,6 +250,15 @@ static ip_addr_t              dns_servers[DNS_MAX_SERVERS];
 //static u8_t                   dns_payload_buffer[LWIP_MEM_ALIGN_BUFFER(DNS_MSG_SIZE)];
 static u8_t*                  dns_payload;
 static u16_t					  dns_random;
+#if DNS_CACHE_MAX
+static struct dns_cache_entry *dns_cache;
+static u8_t                   dns_cache_size = DNS_CACHE_SIZE;
+static u16_t                  dns_cache_neg_ttl = DNS_CACHE_NEG_TTL;
+static u32_t                  dns_cache_hits;
+static u32_t                  dns_cache_neg_hits;
+static u32_t                  dns_cache_misses;
+static u32_t                  dns_cache_prefetches;
+#endif /* DNS_CACHE_MAX */
 /**
  * Initialize the resolver: set up the UDP pcb and configure the default server
  * (DNS_SERVER_ADDRESS).
@@ -309,6 +340,9 @@ dns_tmr(void)
   if (dns_pcb != NULL) {
     LWIP_DEBUGF(DNS_DEBUG, ("dns_tmr: dns_check_entries\n"));
     dns_check_entries();
+#if DNS_CACHE_MAX
+    dns_cache_tmr();
+#endif /* DNS_CACHE_MAX */
   }
 }
 
@@ -482,6 +516,207 @@ dns_lookup(const char *name)
   return IPADDR_NONE;
 }
 
+#if DNS_CACHE_MAX
+/**
+ * Look up a hostname in the DNS cache.
+ *
+ * @param name the hostname to look up
+ * @return the cache entry of the hostname or NULL if it is not cached
+ */
+static struct dns_cache_entry * ICACHE_FLASH_ATTR
+dns_cache_find(const char *name)
+{
+  u8_t i;
+
+  if (dns_cache == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < dns_cache_size; ++i) {
+    if ((dns_cache[i].state != DNS_CACHE_UNUSED) &&
+        (strcmp(name, dns_cache[i].name) == 0)) {
+      return &dns_cache[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Store the result of a lookup in the DNS cache.
+ * A failed refresh does not replace the cached address, it is used until it expires.
+ * When the cache is full, a failed lookup or the entry expiring first is replaced.
+ *
+ * @param name the hostname that was looked up
+ * @param addr the resolved address or NULL if the lookup failed
+ * @param ttl time to live of the address in seconds, 0: must not be cached
+ */
+static void ICACHE_FLASH_ATTR
+dns_cache_put(const char *name, ip_addr_t *addr, u32_t ttl)
+{
+  struct dns_cache_entry *pEntry;
+  u8_t i;
+
+  if ((dns_cache_size == 0) || (os_strlen(name) >= DNS_CACHE_NAME_LENGTH)) {
+    return;
+  }
+  if (addr == NULL) {
+    ttl = dns_cache_neg_ttl;
+  }
+
+  pEntry = dns_cache_find(name);
+  if (pEntry == NULL) {
+    if (ttl == 0) {
+      return;
+    }
+    if (dns_cache == NULL) {
+      dns_cache = (struct dns_cache_entry *)os_zalloc(dns_cache_size * sizeof(struct dns_cache_entry));
+      if (dns_cache == NULL) {
+        return;
+      }
+    }
+    pEntry = &dns_cache[0];
+    for (i = 0; i < dns_cache_size; ++i) {
+      if (dns_cache[i].state == DNS_CACHE_UNUSED) {
+        pEntry = &dns_cache[i];
+        break;
+      }
+      if ((dns_cache[i].state > pEntry->state) ||
+          ((dns_cache[i].state == pEntry->state) && (dns_cache[i].ttl < pEntry->ttl))) {
+        pEntry = &dns_cache[i];
+      }
+    }
+    MEMCPY(pEntry->name, name, os_strlen(name) + 1);
+  } else if ((addr == NULL) && (pEntry->state == DNS_CACHE_VALID)) {
+    /* refresh failed, do not retry it before the entry is used again */
+    pEntry->refresh = 0;
+    pEntry->hits = 0;
+    return;
+  }
+
+  pEntry->refresh = 0;
+  pEntry->hits = 0;
+  if (ttl == 0) {
+    pEntry->state = DNS_CACHE_UNUSED;
+    return;
+  }
+  if (addr == NULL) {
+    pEntry->state = DNS_CACHE_FAILED;
+    ip_addr_set_any(&pEntry->ipaddr);
+  } else {
+    pEntry->state = DNS_CACHE_VALID;
+    ip_addr_copy(pEntry->ipaddr, *addr);
+  }
+  pEntry->ttl = ttl;
+  pEntry->prefetch = LWIP_MIN(DNS_CACHE_PREFETCH, ttl / 4);
+}
+
+/**
+ * Age the DNS cache entries, called every second from dns_tmr.
+ * The entries used since they were resolved are looked up again before they expire,
+ * so the frequently used names are always answered from the cache.
+ */
+static void ICACHE_FLASH_ATTR
+dns_cache_tmr(void)
+{
+  struct dns_cache_entry *pEntry;
+  u8_t i;
+
+  if (dns_cache == NULL) {
+    return;
+  }
+  for (i = 0; i < dns_cache_size; ++i) {
+    pEntry = &dns_cache[i];
+    if (pEntry->state == DNS_CACHE_UNUSED) {
+      continue;
+    }
+    if (--pEntry->ttl == 0) {
+      LWIP_DEBUGF(DNS_DEBUG, ("dns_cache_tmr: \"%s\": expired\n", pEntry->name));
+      pEntry->state = DNS_CACHE_UNUSED;
+      continue;
+    }
+    if ((pEntry->state == DNS_CACHE_VALID) && (pEntry->hits) && (!pEntry->refresh) &&
+        (pEntry->ttl <= pEntry->prefetch)) {
+      /* no callback, the answer is stored in the cache by dns_recv */
+      if (dns_enqueue(pEntry->name, NULL, NULL) == ERR_INPROGRESS) {
+        pEntry->refresh = 1;
+        dns_cache_prefetches++;
+      }
+    }
+  }
+}
+
+/**
+ * Set the number of DNS cache entries and the time failed lookups are cached.
+ * The cache is flushed, the entries are allocated again with the next lookup.
+ *
+ * @param size number of entries, 0 disables the cache
+ * @param neg_ttl time in seconds a failed lookup is cached, 0: not cached
+ * @return the number of entries set
+ */
+u8_t ICACHE_FLASH_ATTR
+dns_cache_setup(u8_t size, u16_t neg_ttl)
+{
+  if (size > DNS_CACHE_MAX) {
+    size = DNS_CACHE_MAX;
+  }
+  if (dns_cache != NULL) {
+    os_free(dns_cache);
+    dns_cache = NULL;
+  }
+  dns_cache_size = size;
+  dns_cache_neg_ttl = neg_ttl;
+  return size;
+}
+
+/**
+ * Get the DNS cache setup.
+ *
+ * @param neg_ttl pointer to store the time a failed lookup is cached
+ * @return the number of entries
+ */
+u8_t ICACHE_FLASH_ATTR
+dns_cache_get_setup(u16_t *neg_ttl)
+{
+  if (neg_ttl != NULL) {
+    *neg_ttl = dns_cache_neg_ttl;
+  }
+  return dns_cache_size;
+}
+
+/**
+ * Get the DNS cache counters.
+ * A lookup of a name which is not cached counts as a miss only while the cache is enabled.
+ */
+void ICACHE_FLASH_ATTR
+dns_cache_get_stats(u32_t *hits, u32_t *neg_hits, u32_t *misses, u32_t *prefetches)
+{
+  *hits = dns_cache_hits;
+  *neg_hits = dns_cache_neg_hits;
+  *misses = dns_cache_misses;
+  *prefetches = dns_cache_prefetches;
+}
+
+/**
+ * Get a DNS cache entry.
+ *
+ * @param i index of the entry
+ * @param addr pointer to store the address, IPADDR_ANY for a failed lookup
+ * @param ttl pointer to store the seconds left
+ * @param hits pointer to store the number of lookups answered since the name was resolved
+ * @return the hostname or NULL if the entry is not used
+ */
+const char * ICACHE_FLASH_ATTR
+dns_cache_get_entry(u8_t i, ip_addr_t *addr, u32_t *ttl, u16_t *hits)
+{
+  if ((dns_cache == NULL) || (i >= dns_cache_size) || (dns_cache[i].state == DNS_CACHE_UNUSED)) {
+    return NULL;
+  }
+  ip_addr_copy(*addr, dns_cache[i].ipaddr);
+  *ttl = dns_cache[i].ttl;
+  *hits = dns_cache[i].hits;
+  return dns_cache[i].name;
+}
+#endif /* DNS_CACHE_MAX */
+
 #if DNS_DOES_NAME_CHECK
 /**
  * Compare the "dotted" name "query" with the encoded name "response"
@@ -673,6 +908,9 @@ dns_check_entry(u8_t i)
             break;
           } else {
             LWIP_DEBUGF(DNS_DEBUG, ("dns_check_entry: \"%s\": timeout\n", pEntry->name));
+#if DNS_CACHE_MAX
+            dns_cache_put(pEntry->name, NULL, 0);
+#endif /* DNS_CACHE_MAX */
             /* call specified callback function if provided */
             if (pEntry->found)
               (*pEntry->found)(pEntry->name, NULL, pEntry->arg);
@@ -784,6 +1022,13 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t
         /* Check for error. If so, call callback to inform. */
         if (((hdr->flags1 & DNS_FLAG1_RESPONSE) == 0) || (pEntry->err != 0) || (nquestions != 1)) {
           LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": error in flags\n", pEntry->name));
+#if DNS_CACHE_MAX
+          if (((hdr->flags1 & DNS_FLAG1_RESPONSE) != 0) && (pEntry->err == DNS_FLAG2_ERR_NAME)) {
+            /* the name does not exist, no need to wait for the timeout */
+            dns_cache_put(pEntry->name, NULL, 0);
+            goto responseerr;
+          }
+#endif /* DNS_CACHE_MAX */
           /* call callback to indicate error, clean up memory and return */
           //goto responseerr;
           goto memerr;
@@ -821,6 +1066,9 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t
             LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": response = ", pEntry->name));
             ip_addr_debug_print(DNS_DEBUG, (&(pEntry->ipaddr)));
             LWIP_DEBUGF(DNS_DEBUG, ("\n"));
+#if DNS_CACHE_MAX
+            dns_cache_put(pEntry->name, &pEntry->ipaddr, pEntry->ttl);
+#endif /* DNS_CACHE_MAX */
             /* call specified callback function if provided */
             if (pEntry->found) {
               (*pEntry->found)(pEntry->name, &pEntry->ipaddr, pEntry->arg);
@@ -840,6 +1088,9 @@ dns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, ip_addr_t *addr, u16_t
           --nanswers;
         }
         LWIP_DEBUGF(DNS_DEBUG, ("dns_recv: \"%s\": error in response\n", pEntry->name));
+#if DNS_CACHE_MAX
+        dns_cache_put(pEntry->name, NULL, 0);
+#endif /* DNS_CACHE_MAX */
         /* call callback to indicate error, clean up memory and return */
         goto responseerr;
       }
@@ -956,6 +1207,9 @@ dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback foun
                   void *callback_arg)
 {
   u32_t ipaddr;
+#if DNS_CACHE_MAX
+  struct dns_cache_entry *pEntry;
+#endif /* DNS_CACHE_MAX */
   /* not initialized or no valid server yet, or invalid addr pointer
    * or invalid hostname or invalid hostname length */
   if ((dns_pcb == NULL) || (addr == NULL) ||
@@ -976,6 +1230,22 @@ dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback foun
   if (ipaddr == IPADDR_NONE) {
     /* already have this address cached? */
 //    ipaddr = dns_lookup(hostname);
+#if DNS_CACHE_MAX
+    pEntry = dns_cache_find(hostname);
+    if (pEntry == NULL) {
+      if (dns_cache_size) {
+        dns_cache_misses++;
+      }
+    } else if (pEntry->state == DNS_CACHE_FAILED) {
+      /* looked up recently and failed */
+      dns_cache_neg_hits++;
+      return ERR_VAL;
+    } else {
+      dns_cache_hits++;
+      pEntry->hits++;
+      ipaddr = ip4_addr_get_u32(&pEntry->ipaddr);
+    }
+#endif /* DNS_CACHE_MAX */
   }
   if (ipaddr != IPADDR_NONE) {
     ip4_addr_set_u32(addr, ipaddr);
@@ -52,7 +52,7 @@
  * #define LWIP_CHKSUM <your_checksum_routine> 
  *
  * Or you can select from the implementations below by defining
- * LWIP_CHKSUM_ALGORITHM to 1, 2 or 3.
+ * LWIP_CHKSUM_ALGORITHM to 1, 2, 3 or 4.
  */
 
 #ifndef LWIP_CHKSUM
@@ -256,6 +256,91 @@ lwip_standard_chksum(void *dataptr, int len)
 }
 #endif
 
+/** Add both 16-bit halves of a 32-bit word to the accumulator. The LX106 has no
+ * carry flag, the halves need no carry check (a 64k buffer sums to < 2^32). */
+#define CHKSUM_ADD_U32(sum, w)  (sum) += ((w) & 0x0000ffffUL) + ((w) >> 16)
+
+#if (LWIP_CHKSUM_ALGORITHM == 4) /* Alternative version #4 */
+/**
+ * Version #4, version #3 reworked for the ESP8266 (LX106): it faults on
+ * unaligned 32-bit loads and has no add with carry. The buffer is aligned
+ * to 4 bytes, the words are added as two halves, 16 bytes per loop.
+ *
+ * @param dataptr points to start of data to be summed at any boundary
+ * @param len length of data to be summed, up to 0xffff
+ * @return host order (!) lwip checksum (non-inverted Internet sum)
+ */
+
+static u16_t ICACHE_FLASH_ATTR
+lwip_standard_chksum(void *dataptr, int len)
+{
+  u8_t *pb = (u8_t *)dataptr;
+  u16_t *ps, t = 0;
+  u32_t *pl;
+  u32_t sum = 0, w0, w1, w2, w3;
+  /* starts at odd byte address? */
+  int odd = ((mem_ptr_t)pb & 1);
+
+  if (odd && len > 0) {
+    ((u8_t *)&t)[1] = *pb++;
+    len--;
+  }
+
+  ps = (u16_t *)(void *)pb;
+
+  if (((mem_ptr_t)ps & 2) && len > 1) {
+    sum += *ps++;
+    len -= 2;
+  }
+
+  pl = (u32_t *)(void *)ps;
+
+  while (len > 15) {
+    /* all loads first, hides the load-use stall of the LX106 */
+    w0 = pl[0];
+    w1 = pl[1];
+    w2 = pl[2];
+    w3 = pl[3];
+    CHKSUM_ADD_U32(sum, w0);
+    CHKSUM_ADD_U32(sum, w1);
+    CHKSUM_ADD_U32(sum, w2);
+    CHKSUM_ADD_U32(sum, w3);
+    pl += 4;
+    len -= 16;
+  }
+
+  while (len > 3) {
+    w0 = *pl++;
+    CHKSUM_ADD_U32(sum, w0);
+    len -= 4;
+  }
+
+  ps = (u16_t *)(void *)pl;
+
+  /* 16-bit aligned word remaining? */
+  if (len > 1) {
+    sum += *ps++;
+    len -= 2;
+  }
+
+  /* dangling tail byte remaining? */
+  if (len > 0) {
+    ((u8_t *)&t)[0] = *(u8_t *)ps;
+  }
+
+  sum += t;
+
+  sum = FOLD_U32T(sum);
+  sum = FOLD_U32T(sum);
+
+  if (odd) {
+    sum = SWAP_BYTES_IN_WORD(sum);
+  }
+
+  return (u16_t)sum;
+}
+#endif
+
 /* inet_chksum_pseudo:
  *
  * Calculates the pseudo Internet checksum used by TCP and UDP for a pbuf chain.
@@ -441,10 +526,141 @@ inet_chksum_pbuf(struct pbuf *p)
  * For architectures with big caches, data might still be in cache when
  * generating the checksum after copying.
  */
-u16_t
+u16_t ICACHE_FLASH_ATTR
 lwip_chksum_copy(void *dst, const void *src, u16_t len)
 {
   MEMCPY(dst, src, len);
   return LWIP_CHKSUM(dst, len);
 }
 #endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 1) */
+
+#if (LWIP_CHKSUM_COPY_ALGORITHM == 2) /* Version #2 */
+/** Source word from two aligned words, shift: source offset in bits */
+#if BYTE_ORDER == LITTLE_ENDIAN
+#define CHKSUM_MERGE_U32(lo, hi, shift) (((lo) >> (shift)) | ((hi) << (32 - (shift))))
+#else
+#define CHKSUM_MERGE_U32(lo, hi, shift) (((lo) << (shift)) | ((hi) >> (32 - (shift))))
+#endif
+
+/** Copy and checksum in one pass, 32 bits at a time (see LWIP_CHKSUM_ALGORITHM 4).
+ * The destination is aligned to 4 bytes, a source with another alignment is read
+ * in aligned words and shifted into place: the LX106 faults on unaligned loads.
+ * Both paths move 16 bytes per loop.
+ */
+u16_t ICACHE_FLASH_ATTR
+lwip_chksum_copy(void *dst, const void *src, u16_t len)
+{
+  u8_t *pd = (u8_t *)dst;
+  const u8_t *ps = (const u8_t *)src;
+  u32_t *pdl;
+  const u32_t *psl;
+  u32_t sum = 0, w0, w1, w2, w3, w4;
+  u16_t t = 0, words;
+  u8_t shift;
+  /* dst starts at odd byte address? */
+  int odd = ((mem_ptr_t)pd & 1);
+
+  if (odd && len > 0) {
+    ((u8_t *)&t)[1] = *pd++ = *ps++;
+    len--;
+  }
+
+  if (((mem_ptr_t)pd & 2) && len > 1) {
+    pd[0] = ps[0];
+    pd[1] = ps[1];
+    sum += *(u16_t *)(void *)pd;
+    pd += 2;
+    ps += 2;
+    len -= 2;
+  }
+
+  pdl = (u32_t *)(void *)pd;
+  words = len >> 2;
+  shift = ((mem_ptr_t)ps & 3) * 8;
+
+  if (shift == 0) {
+    psl = (const u32_t *)(const void *)ps;
+    for (; words > 3; words -= 4) {
+      w0 = psl[0];
+      w1 = psl[1];
+      w2 = psl[2];
+      w3 = psl[3];
+      pdl[0] = w0;
+      pdl[1] = w1;
+      pdl[2] = w2;
+      pdl[3] = w3;
+      CHKSUM_ADD_U32(sum, w0);
+      CHKSUM_ADD_U32(sum, w1);
+      CHKSUM_ADD_U32(sum, w2);
+      CHKSUM_ADD_U32(sum, w3);
+      psl += 4;
+      pdl += 4;
+    }
+    for (; words > 0; words--) {
+      w0 = *psl++;
+      *pdl++ = w0;
+      CHKSUM_ADD_U32(sum, w0);
+    }
+  } else if (words > 0) {
+    /* the last word read still holds source bytes, nothing is read past the end */
+    psl = (const u32_t *)(const void *)(ps - (shift >> 3));
+    w4 = *psl++;
+    for (; words > 3; words -= 4) {
+      w0 = w4;
+      w1 = psl[0];
+      w2 = psl[1];
+      w3 = psl[2];
+      w4 = psl[3];
+      w0 = CHKSUM_MERGE_U32(w0, w1, shift);
+      w1 = CHKSUM_MERGE_U32(w1, w2, shift);
+      w2 = CHKSUM_MERGE_U32(w2, w3, shift);
+      w3 = CHKSUM_MERGE_U32(w3, w4, shift);
+      pdl[0] = w0;
+      pdl[1] = w1;
+      pdl[2] = w2;
+      pdl[3] = w3;
+      CHKSUM_ADD_U32(sum, w0);
+      CHKSUM_ADD_U32(sum, w1);
+      CHKSUM_ADD_U32(sum, w2);
+      CHKSUM_ADD_U32(sum, w3);
+      psl += 4;
+      pdl += 4;
+    }
+    for (; words > 0; words--) {
+      w0 = w4;
+      w4 = *psl++;
+      w0 = CHKSUM_MERGE_U32(w0, w4, shift);
+      *pdl++ = w0;
+      CHKSUM_ADD_U32(sum, w0);
+    }
+  }
+
+  ps += (u8_t *)pdl - pd;
+  pd = (u8_t *)pdl;
+  len &= 3;
+
+  if (len > 1) {
+    pd[0] = ps[0];
+    pd[1] = ps[1];
+    sum += *(u16_t *)(void *)pd;
+    pd += 2;
+    ps += 2;
+    len -= 2;
+  }
+
+  if (len > 0) {
+    ((u8_t *)&t)[0] = *pd = *ps;
+  }
+
+  sum += t;
+
+  sum = FOLD_U32T(sum);
+  sum = FOLD_U32T(sum);
+
+  if (odd) {
+    sum = SWAP_BYTES_IN_WORD(sum);
+  }
+
+  return (u16_t)sum;
+}
+#endif /* (LWIP_CHKSUM_COPY_ALGORITHM == 2) */
@@ -133,14 +133,6 @@ const u32_t memp_sizes[MEMP_MAX] ICACHE_RODATA_ATTR = { //LWIP_MEM_ALIGN_SIZE
 
 u16_t memp_sizes_test[1] = {PBUF_POOL_BUFSIZE,};
 
-#if !MEMP_MEM_MALLOC /* don't build if not configured for use in lwipopts.h */
-
-/** This array holds the number of elements in each pool. */
-static const u16_t memp_num[MEMP_MAX] = {
-#define LWIP_MEMPOOL(name,num,size,desc,attr)  (num),
-#include "lwip/memp_std.h"
-};
-
 /** This array holds a textual description of each pool. */
 //#ifdef LWIP_DEBUG
 //static const char *memp_desc[MEMP_MAX] = {
@@ -150,6 +142,44 @@ const char *memp_desc[MEMP_MAX] = {
 };
 //#endif /* LWIP_DEBUG */
 
+/** Allocation counters of each pool, reported by memp_get_stats() */
+struct memp_counters {
+  u16_t used;
+  u16_t high;
+  u16_t fail;
+};
+static struct memp_counters memp_counters[MEMP_MAX];
+/** Failed allocations of all pools, not cleared by memp_clear_stats() */
+static u32_t memp_fails;
+
+#define MEMP_COUNT_ALLOC(type) do { \
+    if (++memp_counters[type].used > memp_counters[type].high) { \
+      memp_counters[type].high = memp_counters[type].used; \
+    } \
+  } while (0)
+#define MEMP_COUNT_FAIL(type) do { \
+    if (memp_counters[type].fail < 0xFFFF) { \
+      memp_counters[type].fail++; \
+    } \
+    memp_fails++; \
+  } while (0)
+#define MEMP_COUNT_FREE(type)  memp_counters[type].used--
+
+#if MEMP_TRACE
+#define MEMP_TRACE_OP(op, type, mem) os_printf("memp:%c %s %x\n", (op), memp_desc[type], (u32_t)(mem))
+#else
+#define MEMP_TRACE_OP(op, type, mem)
+#endif
+
+#if !MEMP_MEM_MALLOC /* don't build if not configured for use in lwipopts.h */
+
+/** This array holds the number of elements in each pool.
+ *  The pools with 0 elements are allocated from the heap. */
+static const u16_t memp_num[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name,num,size,desc,attr)  (num),
+#include "lwip/memp_std.h"
+};
+
 #if MEMP_SEPARATE_POOLS
 
 /** This creates each memory pool. These are named memp_memory_XXX_base (where
@@ -400,6 +430,17 @@ memp_malloc_fn(memp_t type, const char* file, const int line)
  
   LWIP_ERROR("memp_malloc: type < MEMP_MAX", (type < MEMP_MAX), return NULL;);
 
+  if (memp_num[type] == 0) {
+    memp = (struct memp *)mem_malloc(memp_sizes[type]);
+    if (memp != NULL) {
+      MEMP_COUNT_ALLOC(type);
+    } else {
+      MEMP_COUNT_FAIL(type);
+    }
+    MEMP_TRACE_OP('a', type, memp);
+    return memp;
+  }
+
   SYS_ARCH_PROTECT(old_level);
 #if MEMP_OVERFLOW_CHECK >= 2
   memp_overflow_check_all();
@@ -415,16 +456,19 @@ memp_malloc_fn(memp_t type, const char* file, const int line)
     memp->line = line;
 #endif /* MEMP_OVERFLOW_CHECK */
     MEMP_STATS_INC_USED(used, type);
+    MEMP_COUNT_ALLOC(type);
     LWIP_ASSERT("memp_malloc: memp properly aligned",
                 ((mem_ptr_t)memp % MEM_ALIGNMENT) == 0);
     memp = (struct memp*)(void *)((u8_t*)memp + MEMP_SIZE);
   } else {
     LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in pool %s\n", memp_desc[type]));
     MEMP_STATS_INC(err, type);
+    MEMP_COUNT_FAIL(type);
   }
 
   SYS_ARCH_UNPROTECT(old_level);
 
+  MEMP_TRACE_OP('a', type, memp);
   return memp;
 }
 
@@ -443,6 +487,12 @@ memp_free(memp_t type, void *mem)
   if (mem == NULL) {
     return;
   }
+  MEMP_TRACE_OP('f', type, mem);
+  if (memp_num[type] == 0) {
+    MEMP_COUNT_FREE(type);
+    mem_free(mem);
+    return;
+  }
   LWIP_ASSERT("memp_free: mem properly aligned",
                 ((mem_ptr_t)mem % MEM_ALIGNMENT) == 0);
 
@@ -459,6 +509,7 @@ memp_free(memp_t type, void *mem)
 #endif /* MEMP_OVERFLOW_CHECK */
 
   MEMP_STATS_DEC(used, type); 
+  MEMP_COUNT_FREE(type);
   
   memp->next = memp_tab[type]; 
   memp_tab[type] = memp;
@@ -470,7 +521,103 @@ memp_free(memp_t type, void *mem)
   SYS_ARCH_UNPROTECT(old_level);
 }
 
+#else /* MEMP_MEM_MALLOC */
+
+/**
+ * Get an element of a pool from the heap.
+ *
+ * @param type the pool to get an element from
+ *
+ * @return a pointer to the allocated memory or a NULL pointer on error
+ */
+void * ICACHE_FLASH_ATTR
+memp_malloc(memp_t type)
+{
+  void *mem = mem_malloc(memp_sizes[type]);
+
+  if (mem != NULL) {
+    MEMP_COUNT_ALLOC(type);
+  } else {
+    MEMP_COUNT_FAIL(type);
+  }
+  MEMP_TRACE_OP('a', type, mem);
+  return mem;
+}
+
+/**
+ * Return an element of a pool to the heap.
+ *
+ * @param type the pool mem was allocated for
+ * @param mem the memp element to free
+ */
+void ICACHE_FLASH_ATTR
+memp_free(memp_t type, void *mem)
+{
+  if (mem == NULL) {
+    return;
+  }
+  MEMP_TRACE_OP('f', type, mem);
+  MEMP_COUNT_FREE(type);
+  mem_free(mem);
+}
+
 #endif /* MEMP_MEM_MALLOC */
+
+/**
+ * Get the allocation counters of one pool.
+ *
+ * @param type the pool index, 0 .. MEMP_MAX-1
+ * @param desc pool name
+ * @param size element size in bytes
+ * @param num number of elements, 0 for the pools allocated from the heap
+ * @param used elements in use
+ * @param high maximal number of elements in use
+ * @param fail failed allocations, stops at 65535
+ * @return 0 if type is not a valid pool
+ */
+u8_t ICACHE_FLASH_ATTR
+memp_get_stats(u8_t type, const char **desc, u16_t *size, u16_t *num,
+               u16_t *used, u16_t *high, u16_t *fail)
+{
+  if (type >= MEMP_MAX) {
+    return 0;
+  }
+  *desc = memp_desc[type];
+  *size = (u16_t)memp_sizes[type];
+#if MEMP_MEM_MALLOC
+  *num = 0;
+#else
+  *num = memp_num[type];
+#endif
+  *used = memp_counters[type].used;
+  *high = memp_counters[type].high;
+  *fail = memp_counters[type].fail;
+  return 1;
+}
+
+/**
+ * Get the failed allocations of all pools since the start, they are not cleared by memp_clear_stats().
+ */
+u32_t ICACHE_FLASH_ATTR
+memp_get_fails(void)
+{
+  return memp_fails;
+}
+
+/**
+ * Restart the high-water marks from the elements in use and clear the failure counters.
+ */
+void ICACHE_FLASH_ATTR
+memp_clear_stats(void)
+{
+  u8_t i;
+
+  for (i = 0; i < MEMP_MAX; i++) {
+    memp_counters[i].high = memp_counters[i].used;
+    memp_counters[i].fail = 0;
+  }
+}
+
 #if 0
 void memp_dump(void)
 {
@@ -114,6 +114,7 @@ pbuf_free_ooseq_new(void* arg)
 		  if (seg1->next == NULL){
 			  head = head->next;
 			  tcp_seg_free(seg1);
+			  TCP_STATS_INC(tcp_ext.ooseq_drop);
 			  pcb->ooseq = head;
 		  } else {
 			  while (seg1 != NULL){
@@ -122,6 +123,7 @@ pbuf_free_ooseq_new(void* arg)
 				  if (seg2 ->next == NULL){
 					  seg1->next = seg2->next;
 					  tcp_seg_free(seg2);
+					  TCP_STATS_INC(tcp_ext.ooseq_drop);
 					  break;
 				  }
 				  seg1 = seg1->next;
@@ -298,6 +300,7 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
     LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_TRACE, ("pbuf_alloc: allocated pbuf %p\n", (void *)p));
     if (p == NULL) {
       PBUF_POOL_IS_EMPTY();
+      PBUF_STATS_INC(pbuf.pool_err);
       return NULL;
     }
     p->type = type;
@@ -330,6 +333,7 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
       q = (struct pbuf *)memp_malloc(MEMP_PBUF_POOL);
       if (q == NULL) {
         PBUF_POOL_IS_EMPTY();
+        PBUF_STATS_INC(pbuf.pool_err);
         /* free chain so far allocated */
         pbuf_free(p);
         /* bail out unsuccesfully */
@@ -365,6 +369,7 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
     /* If pbuf is to be allocated in RAM, allocate memory for it. */
     p = (struct pbuf*)mem_malloc(LWIP_MEM_ALIGN_SIZE(SIZEOF_STRUCT_PBUF + offset) + LWIP_MEM_ALIGN_SIZE(length));
     if (p == NULL) {
+      PBUF_STATS_INC(pbuf.ram_err);
       return NULL;
     }
     /* Set up internal structure of the pbuf. */
@@ -390,6 +395,14 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
       LWIP_DEBUGF(PBUF_DEBUG | LWIP_DBG_LEVEL_SERIOUS,
                   ("pbuf_alloc: Could not allocate MEMP_PBUF for PBUF_%s.\n",
                   (type == PBUF_ROM) ? "ROM" : "REF"));
+#ifdef EBUF_LWIP
+      if (type == PBUF_ESF_RX) {
+        PBUF_STATS_INC(pbuf.rx_err);
+      } else
+#endif /* EBUF_LWIP */
+      {
+        PBUF_STATS_INC(pbuf.ref_err);
+      }
       return NULL;
     }
     /* caller must set this field properly, afterwards */
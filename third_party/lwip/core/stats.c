@@ -67,6 +67,101 @@ void stats_init(void)
 #endif /* LWIP_DEBUG */
 }
 
+/**
+ * Clear all counters.
+ */
+void ICACHE_FLASH_ATTR
+stats_reset(void)
+{
+  os_memset(&lwip_stats, 0, sizeof(lwip_stats));
+  stats_init();
+}
+
+/* Copy the counters of one protocol */
+static u8_t ICACHE_FLASH_ATTR
+stats_copy_proto(struct stats_proto *proto, u32_t *cnt, u8_t max)
+{
+  STAT_COUNTER c[] = {proto->recv, proto->xmit, proto->drop, proto->chkerr, proto->lenerr,
+                      proto->memerr, proto->rterr, proto->proterr, proto->err};
+  u8_t i;
+
+  for (i = 0; (i < max) && (i < sizeof(c) / sizeof(c[0])); i++) {
+    cnt[i] = c[i];
+  }
+  return i;
+}
+
+/**
+ * Get the counters of one group, used by the AT firmware which has no access to struct stats_.
+ * The protocol groups report recv, xmit, drop, chkerr, lenerr, memerr, rterr, proterr, err,
+ * TCP adds rto, rexmit, ooseq, ooseq_drop.
+ * The PBUF group reports the pbuf_alloc() failures: ram, pool, ref, rx (WLAN receive).
+ *
+ * @param group group index, 0 .. the first index returning 0
+ * @param name group name
+ * @param cnt counters
+ * @param max size of cnt
+ * @return number of counters, 0 if there is no such group
+ */
+u8_t ICACHE_FLASH_ATTR
+stats_get_counters(u8_t group, const char **name, u32_t *cnt, u8_t max)
+{
+  u8_t n = 0;
+
+#if LINK_STATS
+  if (group == n++) {
+    *name = "LINK";
+    return stats_copy_proto(&lwip_stats.link, cnt, max);
+  }
+#endif
+#if ETHARP_STATS
+  if (group == n++) {
+    *name = "ETHARP";
+    return stats_copy_proto(&lwip_stats.etharp, cnt, max);
+  }
+#endif
+#if IP_STATS
+  if (group == n++) {
+    *name = "IP";
+    return stats_copy_proto(&lwip_stats.ip, cnt, max);
+  }
+#endif
+#if UDP_STATS
+  if (group == n++) {
+    *name = "UDP";
+    return stats_copy_proto(&lwip_stats.udp, cnt, max);
+  }
+#endif
+#if TCP_STATS
+  if (group == n++) {
+    u8_t i = stats_copy_proto(&lwip_stats.tcp, cnt, max);
+    STAT_COUNTER c[] = {lwip_stats.tcp_ext.rto, lwip_stats.tcp_ext.rexmit,
+                        lwip_stats.tcp_ext.ooseq, lwip_stats.tcp_ext.ooseq_drop};
+    u8_t j;
+
+    for (j = 0; (i < max) && (j < sizeof(c) / sizeof(c[0])); j++) {
+      cnt[i++] = c[j];
+    }
+    *name = "TCP";
+    return i;
+  }
+#endif
+#if PBUF_STATS
+  if (group == n++) {
+    STAT_COUNTER c[] = {lwip_stats.pbuf.ram_err, lwip_stats.pbuf.pool_err,
+                        lwip_stats.pbuf.ref_err, lwip_stats.pbuf.rx_err};
+    u8_t i;
+
+    for (i = 0; (i < max) && (i < sizeof(c) / sizeof(c[0])); i++) {
+      cnt[i] = c[i];
+    }
+    *name = "PBUF";
+    return i;
+  }
+#endif
+  return 0;
+}
+
 #if LWIP_STATS_DISPLAY
 void
 stats_display_proto(struct stats_proto *proto, char *name)
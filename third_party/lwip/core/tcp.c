@@ -1111,6 +1111,9 @@ tcp_seg_copy(struct tcp_seg *seg)
 
   cseg = (struct tcp_seg *)memp_malloc(MEMP_TCP_SEG);
   if (cseg == NULL) {
+    /* only used to queue out of sequence segments */
+    TCP_STATS_INC(tcp.memerr);
+    TCP_STATS_INC(tcp_ext.ooseq_drop);
     return NULL;
   }
   SMEMCPY((u8_t *)cseg, (const u8_t *)seg, sizeof(struct tcp_seg)); 
@@ -367,7 +367,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #endif /* TCP_OVERSIZE */
 #if TCP_CHECKSUM_ON_COPY
   u16_t concat_chksum = 0;
+#if !LWIP_NETIF_TX_SINGLE_PBUF
   u8_t concat_chksum_swapped = 0;
+#endif /* !LWIP_NETIF_TX_SINGLE_PBUF */
   u16_t concat_chksummed = 0;
 #endif /* TCP_CHECKSUM_ON_COPY */
   err_t err;
@@ -1301,6 +1303,8 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 
   /* increment number of retransmissions */
   ++pcb->nrtx;
+  ++pcb->rexmits;
+  TCP_STATS_INC(tcp_ext.rto);
 
   /* Don't take any RTT measurements after retransmitting. */
   pcb->rttest = 0;
@@ -1346,6 +1350,8 @@ tcp_rexmit(struct tcp_pcb *pcb)
 #endif /* TCP_OVERSIZE */
 
   ++pcb->nrtx;
+  ++pcb->rexmits;
+  TCP_STATS_INC(tcp_ext.rexmit);
 
   /* Don't take any rtt measurements after retransmitting. */
   pcb->rttest = 0;
@@ -409,6 +409,27 @@ find_entry(ip_addr_t *ipaddr, u8_t flags)
   return (err_t)i;
 }
 
+/**
+ * Send a frame with netif->linkoutput and count it in the link stats.
+ * A frame the WLAN driver refused is counted as dropped.
+ *
+ * @params netif the lwIP network interface on which to send the frame
+ * @params p the frame to send, with the ethernet header
+ * @return the result of netif->linkoutput
+ */
+static err_t ICACHE_FLASH_ATTR
+etharp_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  err_t err;
+
+  LINK_STATS_INC(link.xmit);
+  err = netif->linkoutput(netif, p);
+  if (err != ERR_OK) {
+    LINK_STATS_INC(link.drop);
+  }
+  return err;
+}
+
 /**
  * Send an IP packet on the network using netif->linkoutput
  * The ethernet header is filled in before sending.
@@ -431,7 +452,7 @@ etharp_send_ip(struct netif *netif, struct pbuf *p, struct eth_addr *src, struct
   ethhdr->type = PP_HTONS(ETHTYPE_IP);
   LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_send_ip: sending packet %p\n", (void *)p));
   /* send the packet */
-  return netif->linkoutput(netif, p);
+  return etharp_linkoutput(netif, p);
 }
 
 /**
@@ -826,16 +847,16 @@ etharp_arp_input(struct netif *netif, struct eth_addr *ethaddr, struct pbuf *p)
       if (q != NULL) {
           pbuf_copy(q, p);
           //pbuf_free(p);
+          etharp_linkoutput(netif, q);
+          pbuf_free(q);
       } else {
           LWIP_ASSERT("q != NULL", q != NULL);
+          ETHARP_STATS_INC(etharp.memerr);
       }
-
-      netif->linkoutput(netif, q);
-      pbuf_free(q);
 #else
 
       /* return ARP reply */
-      netif->linkoutput(netif, p);
+      etharp_linkoutput(netif, p);
 #endif /* ESF_LWIP */
     /* we are not configured? */
     } else if (ip_addr_isany(&netif->ip_addr)) {
@@ -1160,7 +1181,7 @@ etharp_query(struct netif *netif, ip_addr_t *ipaddr, struct pbuf *q)
         	old = arp_table[i].q;
         	arp_table[i].q = arp_table[i].q->next;
         	pbuf_free(old->p);
-        	memp_free(MEM_ARP_QUEUE, old);
+        	memp_free(MEMP_ARP_QUEUE, old);
         }
         LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_query: queued packet %p on ARP entry %"S16_F"\n", (void *)q, (s16_t)i));
         result = ERR_OK;
@@ -1270,7 +1291,7 @@ etharp_raw(struct netif *netif, const struct eth_addr *ethsrc_addr,
 
   ethhdr->type = PP_HTONS(ETHTYPE_ARP);
   /* send ARP query */
-  result = netif->linkoutput(netif, p);
+  result = etharp_linkoutput(netif, p);
   ETHARP_STATS_INC(etharp.xmit);
   /* free ARP query packet */
   pbuf_free(p);
@@ -1314,6 +1335,7 @@ ethernet_input(struct pbuf *p, struct netif *netif)
   u16_t type;
   s16_t ip_hdr_offset = SIZEOF_ETH_HDR;
 
+  LINK_STATS_INC(link.recv);
   if (p->len <= SIZEOF_ETH_HDR) {
     /* a packet with only an ethernet header (or less) is not valid for us modify by ives at 2014.4.24*/
     ETHARP_STATS_INC(etharp.proterr);